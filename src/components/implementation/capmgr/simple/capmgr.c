@@ -9,6 +9,7 @@
 #include <consts.h>
 #include <static_slab.h>
 #include <crt.h>
+#include <crt_timeline.h>
 
 #include <cos_component.h>
 #include <cos_kernel_api.h>
@@ -50,18 +51,21 @@ struct cm_asnd {
 
 struct mm_mapping {
 	SS_STATE_T(struct cm_comp *) comp;
-	vaddr_t     addr;
+	vaddr_t      addr;
+	unsigned int hash_next;	/* next mapping in the same mm_mappings bucket */
 };
 
 typedef unsigned int cbuf_t;
 struct mm_page {
 	void *page;
 	struct mm_mapping mappings[MM_MAPPINGS_MAX];
+	unsigned int next;	/* next page of the allocation */
+	cbuf_t       span;	/* span the page is shared through, or 0 */
 };
 
 /* Span of pages, indexed by cbuf_t */
 struct mm_span {
-	unsigned int page_off;
+	unsigned int page_off;	/* the first page, the rest are linked through `next` */
 	unsigned int n_pages;
 };
 
@@ -77,8 +81,66 @@ SS_STATIC_SLAB(asnd, struct cm_asnd, MAX_NUM_THREADS);
 SS_STATIC_SLAB(page, struct mm_page, MM_NPAGES);
 SS_STATIC_SLAB(span, struct mm_span, MM_NPAGES);
 
+/*
+ * Index of the mappings by component and virtual address, to find
+ * the page to unmap. Buckets chain the mappings (through `hash_next`)
+ * by their reference, `MM_MAPPING_REF(page id, mapping offset)`. Page
+ * ids start at 1, thus the `0` reference terminates the chains.
+ */
+#define MM_MAPPING_HASH_SZ    (1 << 16)
+#define MM_MAPPING_REF(id, i) ((id) * MM_MAPPINGS_MAX + (i))
+static unsigned int mm_mappings[MM_MAPPING_HASH_SZ];
+
+/*
+ * Pages that are mapped nowhere are retired, but their translations
+ * might still be cached in the TLBs of the cores that accessed them
+ * (page-table switches don't flush the entries of other PCIDs), so a
+ * page is reused only once the kernel reports that every core flushed
+ * its TLB since the page's retirement. Quiescence is monotonic in
+ * time: the latest quiescent retirement time is cached, to save the
+ * system calls.
+ */
+static cycles_t mm_quiesced;
+/* Protects the mappings index, and the contiguous and heap memory allocators */
+static struct ps_lock mm_lock;
+
+/*
+ * Page ids identify the physical pages: the pages of the contiguous
+ * memory come first, followed by those of the heap. Thus the page
+ * structures are allocated at the id of the memory they track.
+ */
 #define CONTIG_PHY_PAGES 70000
-static void * contig_phy_pages = 0;
+static void * contig_phy_base  = 0;
+static void * contig_phy_pages = 0; /* the allocation frontier */
+/* When each contiguous page below the frontier was retired, or 0 if it is in use */
+static cycles_t contig_phy_retired[CONTIG_PHY_PAGES];
+
+/*
+ * The heap memory is allocated by a buddy allocator, over chunks of
+ * `MM_CHUNK_PAGES` pages, adjacent in our address space, that are
+ * added as needed. Heap pages are identified by their offset in the
+ * heap, `h`, and the lists below reference them by `h + 1`, thus `0`
+ * terminates them.
+ */
+#define MM_CHUNK_ORDER   9
+#define MM_CHUNK_PAGES   (1 << MM_CHUNK_ORDER)
+#define MM_NCHUNKS       ((MM_NPAGES - CONTIG_PHY_PAGES) / MM_CHUNK_PAGES)
+#define MM_HEAP_ID_BASE  (CONTIG_PHY_PAGES + 1)
+
+struct mm_frame {
+	unsigned int next, prev; /* on the buddy free list, or the retired list (next only) */
+	u8_t         order;	 /* order of the free block this page starts */
+	u8_t         free;	 /* starts a free block? */
+	u8_t         dirty;	 /* must be zeroed before it is reused */
+	cycles_t     retired;
+};
+
+static struct mm_frame mm_frames[MM_NCHUNKS * MM_CHUNK_PAGES];
+static void           *mm_chunks[MM_NCHUNKS];
+static unsigned int    mm_nchunks;
+static unsigned int    mm_buddy[MM_CHUNK_ORDER + 1];
+/* Retired heap pages, in retirement order */
+static unsigned int    mm_retired_head, mm_retired_tail;
 
 static struct cm_comp *
 cm_self(void)
@@ -195,59 +257,419 @@ cm_thd_alloc_in(struct cm_comp *c, struct cm_comp *sched, thdclosure_index_t clo
 	return t;
 }
 
+/* Called with the `mm_lock` taken */
+static inline int
+mm_quiescent(cycles_t retired)
+{
+	if (retired <= mm_quiesced) return 1;
+	if (!cos_hw_tlb_quiescent(BOOT_CAPTBL_SELF_INITHW_BASE, retired)) return 0;
+	mm_quiesced = retired;
+
+	return 1;
+}
+
+/* The retirement time of a page just unmapped, after its unmapping */
+static inline cycles_t
+mm_retire_time(void)
+{
+	/* The kernel's page-table update must precede the time */
+	ps_mem_fence();
+
+	return ps_tsc();
+}
+
+static inline int
+mm_page_contig(struct mm_page *p)
+{
+	return ss_page_id(p) < MM_HEAP_ID_BASE;
+}
+
+static inline void *
+mm_heap_page(unsigned int h)
+{
+	return mm_chunks[h / MM_CHUNK_PAGES] + (h % MM_CHUNK_PAGES) * PAGE_SIZE;
+}
+
+static inline unsigned int
+mm_mapping_hash(struct cm_comp *c, vaddr_t addr)
+{
+	return ((addr / PAGE_SIZE) ^ (ss_comp_id(c) << 12)) % MM_MAPPING_HASH_SZ;
+}
+
+/*
+ * Activate the (constructing) mapping `i` of page `p` into `c`, and
+ * add it to the mappings index.
+ */
+static void
+mm_mapping_activate(struct mm_page *p, int i, struct cm_comp *c)
+{
+	struct mm_mapping *m      = &p->mappings[i];
+	unsigned int      *bucket = &mm_mappings[mm_mapping_hash(c, m->addr)];
+
+	ss_state_activate_with(&m->comp, (word_t)c);
+	ps_lock_take(&mm_lock);
+	m->hash_next = *bucket;
+	*bucket      = MM_MAPPING_REF(ss_page_id(p), i);
+	ps_lock_release(&mm_lock);
+}
+
+/*
+ * The buddy allocator. All of these are called with the `mm_lock`
+ * taken.
+ */
+static void
+mm_buddy_push(unsigned int h, unsigned int order)
+{
+	struct mm_frame *f = &mm_frames[h];
+
+	f->order = order;
+	f->free  = 1;
+	f->prev  = 0;
+	f->next  = mm_buddy[order];
+	if (f->next) mm_frames[f->next - 1].prev = h + 1;
+	mm_buddy[order] = h + 1;
+}
+
+static void
+mm_buddy_remove(unsigned int h)
+{
+	struct mm_frame *f = &mm_frames[h];
+
+	if (f->prev) mm_frames[f->prev - 1].next = f->next;
+	else         mm_buddy[f->order]          = f->next;
+	if (f->next) mm_frames[f->next - 1].prev = f->prev;
+	f->free = 0;
+}
+
+/* Free the block of `2^order` pages at `h`, merging it with its free buddies */
+static void
+mm_buddy_free(unsigned int h, unsigned int order)
+{
+	unsigned int b;
+
+	for (; order < MM_CHUNK_ORDER; order++) {
+		b = h ^ (1 << order);
+		if (!mm_frames[b].free || mm_frames[b].order != order) break;
+		mm_buddy_remove(b);
+		h &= ~(1 << order);
+	}
+	mm_buddy_push(h, order);
+}
+
+/* Free the `npages` pages at `h`, as the largest aligned blocks */
+static void
+mm_buddy_free_range(unsigned int h, unsigned long npages)
+{
+	unsigned int order;
+
+	while (npages > 0) {
+		for (order = 0; order < MM_CHUNK_ORDER && !(h & (1 << order)) && (2UL << order) <= npages; order++) ;
+		mm_buddy_free(h, order);
+		h      += 1 << order;
+		npages -= 1 << order;
+	}
+}
+
+/* Allocate a block of `2^order` pages, splitting a larger block if required */
+static int
+mm_buddy_alloc(unsigned int order, unsigned int *h)
+{
+	unsigned int o;
+
+	for (o = order; o <= MM_CHUNK_ORDER && !mm_buddy[o]; o++) ;
+	if (o > MM_CHUNK_ORDER) return -ENOMEM;
+
+	*h = mm_buddy[o] - 1;
+	mm_buddy_remove(*h);
+	/* Free the upper halves we don't need */
+	while (o > order) {
+		o--;
+		mm_buddy_push(*h + (1 << o), o);
+	}
+
+	return 0;
+}
+
+/*
+ * Take from the buddy allocator a run of `nchunks` free chunks,
+ * adjacent in our address space, and return the first one's heap
+ * offset in `h`. The pages of a freed run are merged back into whole
+ * free chunks by the buddy allocator, thus are found here.
+ */
+static int
+mm_chunks_find(unsigned long nchunks, unsigned int *h)
+{
+	unsigned long c, run = 0, i;
+	struct mm_frame *f;
+
+	if (!mm_buddy[MM_CHUNK_ORDER]) return -ENOMEM;
+	for (c = 0; c < mm_nchunks; c++) {
+		f = &mm_frames[c * MM_CHUNK_PAGES];
+		if (!f->free || f->order != MM_CHUNK_ORDER) {
+			run = 0;
+			continue;
+		}
+		if (run > 0 && mm_chunks[c] != mm_chunks[c - 1] + MM_CHUNK_PAGES * PAGE_SIZE) run = 0;
+		if (++run < nchunks) continue;
+
+		c -= nchunks - 1;
+		for (i = 0; i < nchunks; i++) mm_buddy_remove((c + i) * MM_CHUNK_PAGES);
+		*h = c * MM_CHUNK_PAGES;
+
+		return 0;
+	}
+
+	return -ENOMEM;
+}
+
+/* Free the quiescent, retired heap pages into the buddy allocator */
+static void
+mm_retired_release(void)
+{
+	unsigned int h;
+
+	while (mm_retired_head && mm_quiescent(mm_frames[mm_retired_head - 1].retired)) {
+		h               = mm_retired_head - 1;
+		mm_retired_head = mm_frames[h].next;
+		if (!mm_retired_head) mm_retired_tail = 0;
+		mm_buddy_free(h, 0);
+	}
+}
+
+/*
+ * Allocate a run of `npages` heap pages, adjacent in our address
+ * space. Runs up to a chunk come from the buddy allocator, which gets
+ * back the excess of the block, and larger runs from free chunks.
+ * Failing that, new chunks are added to the heap: they are reserved
+ * with the `mm_lock` taken, but their memory is allocated without it.
+ * A reserved chunk whose allocation fails is left empty, and never
+ * reaches the buddy allocator.
+ */
+static int
+mm_heap_alloc(unsigned long npages, unsigned int *h)
+{
+	unsigned long nchunks = 1, excess, i;
+	unsigned int order = 0, c;
+	void *mem;
+
+	if (npages > MM_CHUNK_PAGES) nchunks = (npages + MM_CHUNK_PAGES - 1) / MM_CHUNK_PAGES;
+	else while ((1UL << order) < npages) order++;
+
+	ps_lock_take(&mm_lock);
+	mm_retired_release();
+	if (nchunks > 1 && !mm_chunks_find(nchunks, h)) {
+		excess = nchunks * MM_CHUNK_PAGES - npages;
+		goto done;
+	}
+	if (nchunks == 1 && !mm_buddy_alloc(order, h)) {
+		excess = (1UL << order) - npages;
+		goto done;
+	}
+	if (mm_nchunks + nchunks > MM_NCHUNKS) {
+		ps_lock_release(&mm_lock);
+		return -ENOMEM;
+	}
+	c           = mm_nchunks;
+	mm_nchunks += nchunks;
+	ps_lock_release(&mm_lock);
+
+	mem = crt_page_allocn(&cm_self()->comp, nchunks * MM_CHUNK_PAGES);
+	if (!mem) return -ENOMEM;
+
+	ps_lock_take(&mm_lock);
+	for (i = 0; i < nchunks; i++) {
+		mm_chunks[c + i] = mem + i * MM_CHUNK_PAGES * PAGE_SIZE;
+	}
+	*h     = c * MM_CHUNK_PAGES;
+	excess = nchunks * MM_CHUNK_PAGES - npages;
+done:
+	mm_buddy_free_range(*h + npages, excess);
+	ps_lock_release(&mm_lock);
+
+	return 0;
+}
+
+/*
+ * Retire a page that is mapped nowhere. The span it was shared
+ * through can't be mapped anymore, as it is missing a page.
+ * Contiguous pages return to the contiguous memory, and heap pages
+ * are queued to be released to the buddy allocator once they are
+ * quiescent. Called with the `mm_lock` taken.
+ */
+static void
+mm_page_retire(struct mm_page *p)
+{
+	struct mm_span  *s = ss_span_get(p->span);
+	struct mm_page  *sp;
+	struct mm_frame *f;
+	unsigned int i, h;
+
+	if (s) {
+		sp = ss_page_get(s->page_off);
+		for (i = 0; i < s->n_pages && sp; i++) {
+			sp->span = 0;
+			sp       = ss_page_get(sp->next);
+		}
+		ss_span_free(s);
+	}
+
+	if (mm_page_contig(p)) {
+		contig_phy_retired[ss_page_id(p) - 1] = mm_retire_time();
+	} else {
+		h = ss_page_id(p) - MM_HEAP_ID_BASE;
+		f = &mm_frames[h];
+
+		f->retired = mm_retire_time();
+		f->dirty   = 1;
+		f->next    = 0;
+		if (mm_retired_tail) mm_frames[mm_retired_tail - 1].next = h + 1;
+		else                 mm_retired_head = h + 1;
+		mm_retired_tail = h + 1;
+	}
+	ss_page_free(p);
+}
+
+/*
+ * Map the `npages` pages at `mem` (adjacent in our address space)
+ * into `c` with a single alias, and create their page structures,
+ * starting with page id `id`. Returns the first page, with the rest
+ * linked from it.
+ */
+static struct mm_page *
+mm_page_run_map(struct cm_comp *c, unsigned int id, void *mem, unsigned long npages, unsigned long align)
+{
+	struct mm_page *p;
+	vaddr_t addr;
+	unsigned long i;
+
+	if (crt_page_aliasn_aligned_in(mem, align, npages, &cm_self()->comp, &c->comp, &addr)) BUG();
+
+	for (i = 0; i < npages; i++) {
+		p = ss_page_alloc_at_id(id + i);
+		assert(p);
+		if (ss_state_alloc(&p->mappings[0].comp)) BUG();
+
+		p->page             = mem + i * PAGE_SIZE;
+		p->next             = (i + 1 < npages) ? id + i + 1 : 0;
+		p->mappings[0].addr = addr + i * PAGE_SIZE;
+		mm_mapping_activate(p, 0, c);
+		ss_page_activate(p);
+	}
+
+	return ss_page_get(id);
+}
+
 /**
- * Allocate a page from the pool of physical memory into a component.
+ * Allocate `num_pages` pages from the heap into a component, with a
+ * single (thus contiguous) mapping.
  *
  * - @c - The component to allocate into.
- * - @return - the allocated and initialized page, or `NULL` if no
- *   page is available.
+ * - @num_pages - the number of pages
+ * - @align - the alignment of the mapping in `c`
+ * - @return - the first allocated page, with the rest linked from
+ *   it, or `NULL` if not enough memory is available.
  */
 static struct mm_page *
-mm_page_alloc(struct cm_comp *c, unsigned long align)
+mm_page_allocn(struct cm_comp *c, unsigned long num_pages, unsigned long align)
+{
+	struct mm_frame *f;
+	unsigned int h;
+	unsigned long i;
+
+	if (num_pages == 0) return NULL;
+	if (mm_heap_alloc(num_pages, &h)) return NULL;
+
+	/* Don't leak the previous contents of reused pages */
+	for (i = 0; i < num_pages; i++) {
+		f = &mm_frames[h + i];
+		if (!f->dirty) continue;
+		memset(mm_heap_page(h + i), 0, PAGE_SIZE);
+		f->dirty = 0;
+	}
+
+	return mm_page_run_map(c, MM_HEAP_ID_BASE + h, mm_heap_page(h), num_pages, align);
+}
+
+/**
+ * Unmap the page mapped at `addr` in `c`, and retire it if that was
+ * its last mapping.
+ *
+ * - @c - the component to unmap from
+ * - @addr - the virtual address of the page in `c`
+ * - @return - `0` = success, `-EINVAL` if no page is mapped there
+ */
+static int
+mm_page_unmap(struct cm_comp *c, vaddr_t addr)
 {
+	struct mm_page    *p;
 	struct mm_mapping *m;
-	struct mm_page    *ret = NULL, *p;
-	int    i;
+	unsigned int      *ref, r;
+	int i;
 
-	p = ss_page_alloc();
-	if (!p) return NULL;
+	ps_lock_take(&mm_lock);
+	for (ref = &mm_mappings[mm_mapping_hash(c, addr)]; (r = *ref) != 0; ref = &m->hash_next) {
+		p = ss_page_get(r / MM_MAPPINGS_MAX);
+		assert(p);
+		m = &p->mappings[r % MM_MAPPINGS_MAX];
+		if (m->addr == addr && ss_state_val_get(m->comp) == (word_t)c) break;
+	}
+	if (r == 0) {
+		ps_lock_release(&mm_lock);
+		return -EINVAL;
+	}
 
-	m = &p->mappings[0];
-	if (ss_state_alloc(&m->comp)) BUG();
+	*ref = m->hash_next;
+	if (cos_mem_remove(c->comp.comp_res->ci.pgtbl_cap, addr)) BUG();
+	m->addr = 0;
+	ss_state_free(&m->comp);
 
-	/* Allocate page, map page */
-	p->page = crt_page_allocn(&cm_self()->comp, 1);
-	if (!p->page) ERR_THROW(NULL, free_p);
-	if (crt_page_aliasn_aligned_in(p->page, align, 1, &cm_self()->comp, &c->comp, &m->addr)) BUG();
+	for (i = 0; i < MM_MAPPINGS_MAX; i++) {
+		if (!ss_state_is_free(p->mappings[i].comp)) break;
+	}
+	if (i == MM_MAPPINGS_MAX) mm_page_retire(p);
+	ps_lock_release(&mm_lock);
+
+	return 0;
+}
+
+/*
+ * Unmap the `npages` pages at `addr` in `c`. All of the pages that
+ * are mapped are unmapped, even if some aren't.
+ */
+static int
+mm_page_unmapn(struct cm_comp *c, vaddr_t addr, unsigned long npages)
+{
+	unsigned long i;
+	int ret = 0;
+
+	if (addr % PAGE_SIZE) return -EINVAL;
+	for (i = 0; i < npages; i++) {
+		if (mm_page_unmap(c, addr + i * PAGE_SIZE)) ret = -EINVAL;
+	}
 
-	ss_state_activate_with(&m->comp, (word_t)c);
-	ss_page_activate(p);
-	ret = p;
-done:
 	return ret;
-free_p:
-	ss_page_free(p);
-	goto done;
 }
 
-static struct mm_page *
-mm_page_allocn(struct cm_comp *c, unsigned long num_pages, unsigned long align)
+/*
+ * Make the `n_pages` pages linked from `p` shared memory through the
+ * span `s`, and return its id.
+ */
+static cbuf_t
+mm_span_activate(struct mm_span *s, struct mm_page *p, unsigned long n_pages)
 {
-	struct mm_page *p, *prev, *initial;
+	cbuf_t id = ss_span_id(s);
 	unsigned long i;
 
-	initial = prev = p = mm_page_alloc(c, align);
-	if (!p) return 0;
-	for (i = 1; i < num_pages; i++) {
-		p = mm_page_alloc(c, PAGE_SIZE);
-		if (!p) return NULL;
-		if ((prev->page + 4096) != p->page) {
-			BUG(); /* FIXME: handle concurrency */
-		}
-		prev = p;
+	s->page_off = ss_page_id(p);
+	s->n_pages  = n_pages;
+	for (i = 0; i < n_pages; i++) {
+		assert(p);
+		p->span = id;
+		p       = ss_page_get(p->next);
 	}
+	ss_span_activate(s);
 
-	return initial;
+	return id;
 }
 
 static vaddr_t
@@ -282,101 +704,117 @@ contigmem_check(compid_t id, vaddr_t vaddr, int npages)
 	}
 }
 
+/*
+ * Allocate `npages` physically contiguous pages from the frontier of
+ * the contiguous memory or, once it is exhausted, from the first run
+ * of quiescent, retired pages below it.
+ */
+static void *
+contig_phy_alloc(unsigned long npages)
+{
+	unsigned long frontier, run = 0, i;
+	/* The earliest retirement found not quiescent: later ones aren't either */
+	cycles_t busy = ~(cycles_t)0;
+	void *ret = NULL;
+
+	ps_lock_take(&mm_lock);
+	frontier = (contig_phy_pages - contig_phy_base) / PAGE_SIZE;
+	if (frontier + npages <= CONTIG_PHY_PAGES) {
+		ret               = contig_phy_pages;
+		contig_phy_pages += npages * PAGE_SIZE;
+		ps_lock_release(&mm_lock);
+
+		return ret;
+	}
+	for (i = 0; i < frontier; i++) {
+		if (!contig_phy_retired[i] || contig_phy_retired[i] >= busy) {
+			run = 0;
+			continue;
+		}
+		if (!mm_quiescent(contig_phy_retired[i])) {
+			busy = contig_phy_retired[i];
+			run  = 0;
+			continue;
+		}
+		if (++run < npages) continue;
+
+		i  -= npages - 1;
+		ret = contig_phy_base + i * PAGE_SIZE;
+		memset(&contig_phy_retired[i], 0, npages * sizeof(cycles_t));
+		break;
+	}
+	ps_lock_release(&mm_lock);
+	/* Don't leak the previous contents */
+	if (ret) memset(ret, 0, npages * PAGE_SIZE);
+
+	return ret;
+}
+
+/*
+ * Map `npages` physically contiguous pages into `c`. Returns the
+ * first page, with the rest linked from it, or `NULL` if there isn't
+ * enough contiguous memory.
+ */
+static struct mm_page *
+contig_page_allocn(struct cm_comp *c, unsigned long npages, unsigned long align)
+{
+	struct mm_page *p;
+	void *page;
+
+	if (npages == 0) return NULL;
+	page = contig_phy_alloc(npages);
+	if (!page) return NULL;
+
+	p = mm_page_run_map(c, (page - contig_phy_base) / PAGE_SIZE + 1, page, npages, align);
+	contigmem_check(ss_comp_id(c), p->mappings[0].addr, npages);
+
+	return p;
+}
+
 vaddr_t
 contigmem_alloc(unsigned long npages)
 {
 	struct cm_comp *c;
 	struct mm_page *p;
 
-	struct mm_mapping *m;
-
-	vaddr_t vaddr;
-	unsigned long i;
-
 	c = ss_comp_get(cos_inv_token());
 	if (!c) return 0;
+	p = contig_page_allocn(c, npages, PAGE_SIZE);
+	if (!p) return 0;
 
-	void *page = contig_phy_pages;
-
-	if (crt_page_aliasn_aligned_in(page, PAGE_SIZE, npages, &cm_self()->comp, &c->comp, &vaddr)) BUG();
-
-	for (i = 0; i < npages; i++) {
-		p = ss_page_alloc();
-		assert(p);
-
-		m = &p->mappings[0];
-		if (ss_state_alloc(&m->comp)) BUG();
+	return p->mappings[0].addr;
+}
 
-		p->page = page + i * PAGE_SIZE;
-		m->addr = vaddr + i * PAGE_SIZE;
+int
+contigmem_free(vaddr_t addr, unsigned long npages)
+{
+	struct cm_comp *c;
 
-		ss_state_activate_with(&m->comp, (word_t)c);
-		ss_page_activate(p);
-	}
+	c = ss_comp_get(cos_inv_token());
+	if (!c) return -EINVAL;
 
-	contigmem_check(cos_inv_token(), (vaddr_t)vaddr, npages);
-	contig_phy_pages += npages * PAGE_SIZE;
-	assert((word_t)contig_phy_pages < CONTIG_PHY_PAGES * PAGE_SIZE);
-	return vaddr;
+	return mm_page_unmapn(c, addr, npages);
 }
 
 cbuf_t
 contigmem_shared_alloc_aligned(unsigned long npages, unsigned long align, vaddr_t *pgaddr)
 {
 	struct cm_comp *c;
-	struct mm_page *p, *initial = NULL;
+	struct mm_page *p;
 	struct mm_span *s;
 
-	struct mm_mapping *m;
-
-	vaddr_t vaddr;
-
-	unsigned long i;
-	int ret;
-
 	c = ss_comp_get(cos_inv_token());
 	if (!c) return 0;
-
-	void * page = contig_phy_pages;
-
-	if (crt_page_aliasn_aligned_in(page, align, npages, &cm_self()->comp, &c->comp, &vaddr)) BUG();
-
 	s = ss_span_alloc();
 	if (!s) return 0;
-	for (i = 0; i < npages; i++) {
-		p = ss_page_alloc();
-		assert(p);
-
-		if (unlikely(i == 0)) {
-			initial = p;
-		}
-
-		m = &p->mappings[0];
-		if (ss_state_alloc(&m->comp)) BUG();
-
-		p->page = page + i * PAGE_SIZE;
-		m->addr = vaddr + i * PAGE_SIZE;
-
-		ss_state_activate_with(&m->comp, (word_t)c);
-		ss_page_activate(p);
+	p = contig_page_allocn(c, npages, align);
+	if (!p) {
+		ss_span_free(s);
+		return 0;
 	}
+	*pgaddr = p->mappings[0].addr;
 
-	/**
-	 * FIXME: Need to reslove concurrent issue here,
-	 * this is not multi-thread safe
-	 */
-	s->page_off = ss_page_id(initial);
-	s->n_pages  = npages;
-	ss_span_activate(s);
-
-	ret = ss_span_id(s);
-
-	*pgaddr = initial->mappings[0].addr;
-
-	contigmem_check(cos_inv_token(), (vaddr_t)vaddr, npages);
-	contig_phy_pages += npages * PAGE_SIZE;
-	assert((word_t)contig_phy_pages < CONTIG_PHY_PAGES * PAGE_SIZE);
-	return ret;
+	return mm_span_activate(s, p, npages);
 }
 
 vaddr_t
@@ -393,6 +831,17 @@ memmgr_heap_page_allocn_aligned(unsigned long num_pages, unsigned long align)
 	return (vaddr_t)p->mappings[0].addr;
 }
 
+int
+memmgr_heap_page_freen(vaddr_t addr, unsigned long num_pages)
+{
+	struct cm_comp *c;
+
+	c = ss_comp_get(cos_inv_token());
+	if (!c) return -EINVAL;
+
+	return mm_page_unmapn(c, addr, num_pages);
+}
+
 vaddr_t
 memmgr_map_phys_to_virt(paddr_t paddr, size_t size)
 {
@@ -425,11 +874,7 @@ memmgr_shared_page_allocn_aligned(unsigned long num_pages, unsigned long align,
 	p = mm_page_allocn(c, num_pages, align);
 	if (!p) ERR_THROW(0, cleanup);
 
-	s->page_off = ss_page_id(p);
-	s->n_pages  = num_pages;
-	ss_span_activate(s);
-
-	ret = ss_span_id(s);
+	ret = mm_span_activate(s, p, num_pages);
 
 	*pgaddr = p->mappings[0].addr;
 done:
@@ -469,7 +914,7 @@ mm_page_alias(struct mm_page *p, struct cm_comp *c, vaddr_t *addr, unsigned long
 		if (crt_page_aliasn_aligned_in(p->page, align, 1, &cm_self()->comp, &c->comp, &m->addr)) BUG();
 		assert(m->addr);
 		*addr = m->addr;
-		ss_state_activate_with(&m->comp, (word_t)c);
+		mm_mapping_activate(p, i, c);
 
 		return 0;
 	}
@@ -497,15 +942,14 @@ memmgr_shared_page_map_aligned_in_vm(cbuf_t id, unsigned long align, vaddr_t *pg
 	/* Only the vmm of this VM is allowed to call this interface */
 	assert(vmm == c->comp.vm_comp_info.vmm_comp_id);
 
+	p = ss_page_get(s->page_off);
 	for (i = 0; i < s->n_pages; i++) {
-		struct mm_page *p;
-
-		p = ss_page_get(s->page_off + i);
 		if (!p) return 0;
 
 		if (mm_page_alias(p, c, &addr, align)) BUG();
 		if (*pgaddr == 0) *pgaddr = addr;
 		align = PAGE_SIZE_4K;
+		p     = ss_page_get(p->next);
 	}
 
 	return s->n_pages;
@@ -526,15 +970,14 @@ memmgr_shared_page_map_aligned(cbuf_t id, unsigned long align, vaddr_t *pgaddr)
 	c = ss_comp_get(cos_inv_token());
 	if (!c) return 0;
 
+	p = ss_page_get(s->page_off);
 	for (i = 0; i < s->n_pages; i++) {
-		struct mm_page *p;
-
-		p = ss_page_get(s->page_off + i);
 		if (!p) return 0;
 
 		if (mm_page_alias(p, c, &addr, align)) BUG();
 		if (*pgaddr == 0) *pgaddr = addr;
 		align = PAGE_SIZE; // only the first page can have special alignment
+		p     = ss_page_get(p->next);
 	}
 
 	return s->n_pages;
@@ -977,6 +1420,10 @@ cos_init(void)
 	struct initargs_iter i;
 	int cont, found_shared = 0;
 	int ret;
+	vaddr_t timeline = addr_get(cos_compid(), ADDR_BOOT_TIMELINE);
+	cycles_t start;
+
+	if (timeline) crt_timeline_set(timeline);
 
 	/* 
 	 * FIXME: This is a hack since the booter's __thdid_alloc is
@@ -1017,10 +1464,12 @@ cos_init(void)
 	cos_comp_capfrontier_update(ci, addr_get(cos_compid(), ADDR_CAPTBL_FRONTIER), 0);
 	if (!cm_comp_self_alloc("capmgr")) BUG();
 	/* Initialize the other component's for which we're responsible */
+	start = ps_tsc();
 	capmgr_comp_init();
+	crt_timeline_mark(start, "capmgr: component init");
 
 	/* Reserve some continuous pages */
-	contig_phy_pages = crt_page_allocn(&cm_self()->comp, CONTIG_PHY_PAGES);
+	contig_phy_base = contig_phy_pages = crt_page_allocn(&cm_self()->comp, CONTIG_PHY_PAGES);
 	contigmem_check(cos_compid(), (vaddr_t)contig_phy_pages, CONTIG_PHY_PAGES);
 
 	return;
@@ -1029,8 +1478,12 @@ cos_init(void)
 void
 cos_parallel_init(coreid_t cid, int init_core, int ncores)
 {
+	cycles_t start;
+
 	cos_defcompinfo_sched_init();
+	start = ps_tsc();
 	capmgr_execution_init(init_core);
+	crt_timeline_mark(start, "capmgr: execution init");
 }
 
 void
@@ -17,6 +17,71 @@
 static struct ip4_addr ip, mask, gw, client;
 struct netif net_interface;
 
+void netmgr_conn_init(void);
+
+/*
+ * While a thread sends a batch, the packets lwip outputs are given to
+ * the nicmgr in bursts, through a shmem object of their descriptors.
+ */
+struct netmgr_tx_burst {
+	int                  on;
+	u16_t                n;
+	shm_bm_objid_t       descid;
+	struct nic_pkt_desc *descs;
+};
+
+static struct netmgr_tx_burst tx_bursts[MAX_NUM_THREADS];
+
+/* Queue the packets this thread outputs, until netmgr_tx_burst_end */
+void
+netmgr_tx_burst_begin(void)
+{
+	struct netmgr_tx_burst  *b = &tx_bursts[cos_thdid()];
+	struct netshmem_pkt_buf *desc_buf;
+
+	if (unlikely(!b->descs)) {
+		desc_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &b->descid);
+		assert(desc_buf);
+		b->descs = (struct nic_pkt_desc *)desc_buf->data;
+	}
+	b->on = 1;
+}
+
+static void
+netmgr_tx_burst_flush(struct netmgr_tx_burst *b)
+{
+	/* The packets the nicmgr cannot queue are dropped, and their objects freed by it */
+	if (b->n) nic_send_packets(b->descid, b->n);
+	b->n = 0;
+}
+
+/* Send the packets queued since netmgr_tx_burst_begin */
+void
+netmgr_tx_burst_end(void)
+{
+	struct netmgr_tx_burst *b = &tx_bursts[cos_thdid()];
+
+	netmgr_tx_burst_flush(b);
+	b->on = 0;
+}
+
+/* The nicmgr frees the object once the packet is transmitted */
+static void
+cos_interface_send(shm_bm_objid_t objid, u16_t pkt_offset, u16_t pkt_len)
+{
+	struct netmgr_tx_burst *b = &tx_bursts[cos_thdid()];
+
+	if (!b->on) {
+		nic_send_packet(objid, pkt_offset, pkt_len);
+		return;
+	}
+
+	b->descs[b->n].objid      = objid;
+	b->descs[b->n].pkt_offset = pkt_offset;
+	b->descs[b->n].pkt_len    = pkt_len;
+	if (++b->n == NIC_PKT_BURST_MAX) netmgr_tx_burst_flush(b);
+}
+
 struct ether_addr {
 	uint8_t addr_bytes[6];
 } __attribute__((__packed__));
@@ -27,49 +92,63 @@ struct ether_hdr {
 	uint16_t          ether_type;
 } __attribute__((__packed__));
 
+/*
+ * The shmem object whose data `p` is, from its start, NULL if it is
+ * anything else: lwip's memory, or data further in an object (e.g. a
+ * TCP write split at the MSS).
+ */
+static struct netshmem_pkt_buf *
+cos_interface_shmem_data(struct pbuf *p)
+{
+	struct netshmem_pkt_buf *obj;
+
+	/* Only the data written from shmem is referred to, by PBUF_REF or PBUF_ROM pbufs */
+	if (!(p->type_internal & PBUF_ROM) || (p->type_internal & PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS)) return NULL;
+
+	obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), shm_bm_get_objid_net_pkt_buf(p->payload));
+	if (!obj || (char *)p->payload != (char *)netshmem_get_data_buf(obj)) return NULL;
+
+	return obj;
+}
+
 static err_t
 cos_interface_output(struct netif *ni, struct pbuf *p)
 {
-	char *data = p->payload;	
-	struct netshmem_pkt_buf *obj = NULL;
-
+	struct netshmem_pkt_buf *obj;
 	shm_bm_objid_t objid;
-
 	u16_t pkt_offset, pkt_len;
 
-	/* 
-	 * We assume that lwip always produces either a contiguous packet, 
-	 * or a packet of headers followed by a single packet with payload.
+	/*
+	 * A packet of lwip's headers followed by the data of a shmem object
+	 * is sent in place: the headers are copied in the object's headroom.
 	 */
-	assert(p->next == NULL || p->next->next == NULL);
-	if (p->type_internal & PBUF_RAM) {
-		if (p->next != NULL && p->next->type_internal & PBUF_ROM) {
-			/* shemem case, pbuf is chained with a header pbuf and a data pbuf that points to shemem */
-			obj   = (struct netshmem_pkt_buf*)(p->next->payload - netshmem_get_data_offset());
-			objid = shm_bm_get_objid_net_pkt_buf(obj);
-			data  = netshmem_get_data_buf(obj) ;
-
-			memcpy(data - p->len, p->payload, p->len);
-
-			pkt_offset = netshmem_get_data_offset() - p->len;
-
-			pkt_len  = p->len;
-			pkt_len += p->next->len;
-
-			nic_send_packet(objid, pkt_offset, pkt_len);
-		} else {
-			/* other cases that don't use shmem */
-			obj = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &objid);
-			assert(obj);
-
-			memcpy(obj->data, data, p->len);
-			pkt_offset = 0;
-			pkt_len = p->len;
-
-			nic_send_packet(objid, pkt_offset, pkt_len);
-			shm_bm_free_net_pkt_buf(obj);
-		}
+	if (p->next && !p->next->next && p->len <= netshmem_get_data_offset()
+	    && (obj = cos_interface_shmem_data(p->next))) {
+		memcpy((char *)netshmem_get_data_buf(obj) - p->len, p->payload, p->len);
+
+		objid      = shm_bm_get_objid_net_pkt_buf(obj);
+		pkt_offset = netshmem_get_data_offset() - p->len;
+		pkt_len    = p->tot_len;
+
+		/* The nicmgr frees the object once the packet is transmitted: that reference is its */
+		shm_bm_take_net_pkt_buf(netshmem_get_shm(), objid);
+		cos_interface_send(objid, pkt_offset, pkt_len);
+
+		return ERR_OK;
 	}
+
+	/*
+	 * Any other packet is copied in an object of its own: lwip's own
+	 * packets, and the segments that hold part of a write, or several.
+	 */
+	if (unlikely(p->tot_len > PKT_BUF_SIZE)) return ERR_BUF;
+	obj = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &objid);
+	if (unlikely(!obj)) return ERR_MEM;
+
+	pbuf_copy_partial(p, obj->data, p->tot_len, 0);
+	/* The nicmgr frees the object once the packet is transmitted */
+	cos_interface_send(objid, 0, p->tot_len);
+
 	return ERR_OK;
 }
 
@@ -129,6 +208,7 @@ cos_init(void)
 	IP4_ADDR(&gw, 10,10,1,10);
 
 	lwip_init();
+	netmgr_conn_init();
 	netif_add(&net_interface, &ip, &mask, &gw, NULL, cos_interface_init, ethernet_input);
 	netif_set_default(&net_interface);
 	netif_set_up(&net_interface);
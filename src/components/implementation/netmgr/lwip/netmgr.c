@@ -3,88 +3,497 @@
 #include <netshmem.h>
 #include <shm_bm.h>
 #include <string.h>
+#include <errno.h>
 #include <nic.h>
 #include <contigmem.h>
+#include <sync_lock.h>
+#include <cos_time.h>
 
 #include <lwip/init.h>
 #include <lwip/netif.h>
 #include <lwip/tcp.h>
 #include <lwip/udp.h>
 #include <lwip/stats.h>
+#include <lwip/timeouts.h>
 #include <lwip/prot/tcp.h>
 #include <netif/ethernet.h>
 #include <lwip/etharp.h>
 
 #include <netmgr.h>
 
-/* This is used to indicate whether the packet is a data packet to application or a state packet to lwip */
-static int back_to_app = 0;
+/* The connection descriptors, 0 is not one */
+#define NETMGR_MAX_CONNS   4096
+/* The most datagrams queued on a UDP connection, the next are dropped */
+#define NETMGR_UDP_RXQ_MAX 64
+/* The most writes not yet acknowledged on a TCP connection */
+#define NETMGR_TXQ_SZ      16
+/* The received packets lwip can hold at once: queued to be read, or out of order */
+#define NETMGR_RX_PBUFS    8192
 
-static shm_bm_objid_t g_objid;
+extern struct netif net_interface;
+extern u32_t lwip_sys_now;
 
-static u16_t g_data_offset, g_data_len;
+void netmgr_tx_burst_begin(void);
+void netmgr_tx_burst_end(void);
 
-static ip_addr_t g_remote_addr;
-static u16_t g_remote_port;
+enum netmgr_conn_type {
+	NETMGR_CONN_FREE = 0,
+	NETMGR_CONN_TCP_LISTEN,
+	NETMGR_CONN_TCP,
+	NETMGR_CONN_UDP,
+};
 
-static struct pbuf *g_pbuf = NULL;
+/*
+ * A received packet, that lwip holds in place in its shmem object.
+ * Its pbuf is lwip's: the object is freed with it, unless it has been
+ * read, and is then the application's.
+ */
+struct netmgr_rx_pbuf {
+	struct pbuf_custom       pc;
+	struct netshmem_pkt_buf *obj;
+	/* In the free list, or in a connection's receive queue */
+	struct netmgr_rx_pbuf   *next;
+	/* The source of a datagram */
+	u32_t                    remote_addr;
+	u16_t                    remote_port;
+};
 
-#define LWIP_MAX_CONNS (16)
+/* The object of a TCP write, held until it is acknowledged */
+struct netmgr_tx_seg {
+	struct netshmem_pkt_buf *obj;
+	u16_t                    len;
+};
 
-extern struct netif net_interface;
+struct netmgr_conn {
+	enum netmgr_conn_type  type;
+	thdid_t                thd;
+	union {
+		struct tcp_pcb *tp;
+		struct udp_pcb *up;
+	};
+	/* The peer closed the connection, or it failed (and its pcb is freed) */
+	int                    eof, err;
+	/* Closed by the application, and freed once its writes are acknowledged */
+	int                    closing;
+	struct conn_addr       remote;
+
+	/* The data (TCP), or the datagrams (UDP) received */
+	struct netmgr_rx_pbuf *rxq_head, *rxq_tail;
+	u16_t                  rxq_len;
+
+	struct netmgr_tx_seg   txq[NETMGR_TXQ_SZ];
+	u16_t                  txq_head, txq_tail;
+	u32_t                  tx_acked;
+
+	/* The accepted connections not yet returned by netmgr_tcp_accept */
+	int                    acceptq_head, acceptq_tail;
+	u16_t                  acceptq_len, backlog;
+
+	/* In the free list, or in an accept queue */
+	int                    next;
+	/* In the thread's list of ready connections */
+	int                    ready, ready_prev, ready_next;
+};
 
-struct lwip_pcb
-{
-	struct tcp_pcb *tp;
-	struct udp_pcb *up;
+/*
+ * The pbuf of the datagrams a thread sends, that refers to their
+ * objects. It is reused for each of them, unless lwip still holds it.
+ */
+struct netmgr_tx_pbuf {
+	struct pbuf_custom pc;
+	int                busy;
+};
+
+/*
+ * Packets are received from the nicmgr in bursts, into a shmem
+ * object holding their descriptors. A thread's ready connections are
+ * those netmgr_conn_wait returns.
+ */
+struct netmgr_thd {
+	shm_bm_objid_t        descid;
+	struct nic_pkt_desc  *descs;
+	int                   ready_head, ready_tail;
+	struct netmgr_tx_pbuf tx_pbuf;
 };
 
-static struct lwip_pcb lwip_connections[LWIP_MAX_CONNS];
+/*
+ * lwip is not thread-safe: the lock is held while any of this is used.
+ * A netmgr per core has it taken by the threads of its core only.
+ */
+static struct sync_lock      lwip_lock;
+static struct netmgr_conn    conns[NETMGR_MAX_CONNS];
+static int                   conn_free;
+static struct netmgr_thd     netmgr_thds[MAX_NUM_THREADS];
+static struct netmgr_rx_pbuf rx_pbufs[NETMGR_RX_PBUFS];
+static struct netmgr_rx_pbuf *rx_pbuf_free;
+
+static inline int
+netmgr_conn_fd(struct netmgr_conn *c)
+{
+	return c - conns;
+}
+
+/* The connection `fd` of this thread, of one of `types`, NULL if there is none */
+static struct netmgr_conn *
+netmgr_conn_get(int fd, unsigned int types)
+{
+	struct netmgr_conn *c;
+
+	if (fd <= 0 || fd >= NETMGR_MAX_CONNS) return NULL;
+	c = &conns[fd];
+	if (!(types & (1 << c->type)) || c->thd != cos_thdid() || c->closing) return NULL;
+
+	return c;
+}
+
+#define NETMGR_TCP      (1 << NETMGR_CONN_TCP)
+#define NETMGR_TCP_LSTN (1 << NETMGR_CONN_TCP_LISTEN)
+#define NETMGR_UDP      (1 << NETMGR_CONN_UDP)
+
+static struct netmgr_conn *
+netmgr_conn_alloc(enum netmgr_conn_type type, thdid_t thd)
+{
+	struct netmgr_conn *c;
+
+	/* The connections of a netmgr per core are processed by its core's threads */
+	if (NETMGR_CORE >= 0 && cos_cpuid() != NETMGR_CORE) return NULL;
+	if (!conn_free) return NULL;
+	c         = &conns[conn_free];
+	conn_free = c->next;
+
+	memset(c, 0, sizeof(struct netmgr_conn));
+	c->type = type;
+	c->thd  = thd;
+
+	return c;
+}
+
+static int
+netmgr_conn_pending(struct netmgr_conn *c)
+{
+	if (c->rxq_head || c->acceptq_head) return 1;
+
+	return c->type == NETMGR_CONN_TCP && (c->eof || c->err);
+}
+
+/* Make `c` one its thread's netmgr_conn_wait returns */
+static void
+netmgr_conn_ready(struct netmgr_conn *c)
+{
+	struct netmgr_thd *t = &netmgr_thds[c->thd];
+	int fd = netmgr_conn_fd(c);
+
+	if (c->ready || c->closing) return;
+
+	c->ready      = 1;
+	c->ready_prev = t->ready_tail;
+	c->ready_next = 0;
+	if (t->ready_tail) conns[t->ready_tail].ready_next = fd;
+	else               t->ready_head = fd;
+	t->ready_tail = fd;
+}
+
+static void
+netmgr_conn_unready(struct netmgr_conn *c)
+{
+	struct netmgr_thd *t = &netmgr_thds[c->thd];
+
+	if (!c->ready) return;
+
+	if (c->ready_prev) conns[c->ready_prev].ready_next = c->ready_next;
+	else               t->ready_head = c->ready_next;
+	if (c->ready_next) conns[c->ready_next].ready_prev = c->ready_prev;
+	else               t->ready_tail = c->ready_prev;
+	c->ready = 0;
+}
+
+static void
+netmgr_conn_rxq_push(struct netmgr_conn *c, struct pbuf *p)
+{
+	struct netmgr_rx_pbuf *rp = (struct netmgr_rx_pbuf *)p;
+
+	/* All of the received pbufs are netmgr_rx_pbufs, lwip queues and passes them as they are */
+	assert(p->flags & PBUF_FLAG_IS_CUSTOM);
+
+	rp->next = NULL;
+	if (c->rxq_tail) c->rxq_tail->next = rp;
+	else             c->rxq_head = rp;
+	c->rxq_tail = rp;
+	c->rxq_len++;
+}
+
+/*
+ * Dequeue the first pbuf of the receive queue: that of the next
+ * datagram, or the first of the chain of TCP data received together.
+ */
+static struct netmgr_rx_pbuf *
+netmgr_conn_rxq_pop(struct netmgr_conn *c)
+{
+	struct netmgr_rx_pbuf *rp = c->rxq_head;
+	struct pbuf           *rest;
+
+	if (!rp) return NULL;
+
+	rest = rp->pc.pbuf.next;
+	if (rest && c->type == NETMGR_CONN_TCP) {
+		/* The rest of the chain takes its place, it is no longer referenced by the first pbuf */
+		pbuf_ref(rest);
+		pbuf_dechain(&rp->pc.pbuf);
+		assert(rest->flags & PBUF_FLAG_IS_CUSTOM);
+		((struct netmgr_rx_pbuf *)rest)->next = rp->next;
+		c->rxq_head = (struct netmgr_rx_pbuf *)rest;
+		if (c->rxq_tail == rp) c->rxq_tail = c->rxq_head;
+
+		return rp;
+	}
+
+	c->rxq_head = rp->next;
+	if (!c->rxq_head) c->rxq_tail = NULL;
+	c->rxq_len--;
+
+	return rp;
+}
+
+/* Give the object of `rp` to the application, and free the pbuf */
+static shm_bm_objid_t
+netmgr_rx_pbuf_read(struct netmgr_rx_pbuf *rp, u16_t *data_offset, u16_t *data_len)
+{
+	struct netshmem_pkt_buf *obj = rp->obj;
+
+	*data_offset = (char *)rp->pc.pbuf.payload - obj->data;
+	*data_len    = rp->pc.pbuf.len;
+	rp->obj      = NULL;
+	pbuf_free(&rp->pc.pbuf);
+
+	return shm_bm_get_objid_net_pkt_buf(obj);
+}
+
+static void
+netmgr_tx_acked(struct netmgr_conn *c, u32_t len)
+{
+	struct netmgr_tx_seg *s;
+
+	c->tx_acked += len;
+	while (c->txq_head != c->txq_tail) {
+		s = &c->txq[c->txq_head % NETMGR_TXQ_SZ];
+		if (c->tx_acked < s->len) break;
+
+		c->tx_acked -= s->len;
+		shm_bm_free_net_pkt_buf(s->obj);
+		c->txq_head++;
+	}
+	/* The SYN and FIN are acknowledged as well */
+	if (c->txq_head == c->txq_tail) c->tx_acked = 0;
+}
+
+static void
+netmgr_conn_free(struct netmgr_conn *c)
+{
+	struct netmgr_rx_pbuf *rp;
+
+	netmgr_conn_unready(c);
+	while ((rp = netmgr_conn_rxq_pop(c))) pbuf_free(&rp->pc.pbuf);
+	while (c->txq_head != c->txq_tail) shm_bm_free_net_pkt_buf(c->txq[c->txq_head++ % NETMGR_TXQ_SZ].obj);
+
+	c->type   = NETMGR_CONN_FREE;
+	c->next   = conn_free;
+	conn_free = netmgr_conn_fd(c);
+}
+
+static void
+netmgr_rx_pbuf_free(struct pbuf *p)
+{
+	struct netmgr_rx_pbuf *rp = (struct netmgr_rx_pbuf *)p;
+
+	if (rp->obj) shm_bm_free_net_pkt_buf(rp->obj);
+	rp->next     = rx_pbuf_free;
+	rx_pbuf_free = rp;
+}
+
+static void
+netmgr_tx_pbuf_free(struct pbuf *p)
+{
+	((struct netmgr_tx_pbuf *)p)->busy = 0;
+}
+
+/* A pbuf of the `len` bytes of data at `payload`, in a shmem object */
+static struct pbuf *
+netmgr_tx_pbuf_get(void *payload, u16_t len)
+{
+	struct netmgr_tx_pbuf *tp = &netmgr_thds[cos_thdid()].tx_pbuf;
+	struct pbuf           *p;
+
+	if (unlikely(tp->busy)) {
+		p = pbuf_alloc(PBUF_LINK, len, PBUF_ROM);
+		if (p) p->payload = payload;
+
+		return p;
+	}
+
+	tp->busy                    = 1;
+	tp->pc.custom_free_function = netmgr_tx_pbuf_free;
+
+	return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &tp->pc, payload, len);
+}
+
+static void
+net_interface_input(struct netshmem_pkt_buf *obj, u16_t pkt_offset, u16_t pkt_len)
+{
+	struct netmgr_rx_pbuf *rp = rx_pbuf_free;
+	struct pbuf           *p;
+
+	if (unlikely(!rp)) {
+		/* lwip holds too many packets, this one is dropped */
+		shm_bm_free_net_pkt_buf(obj);
+		return;
+	}
+	rx_pbuf_free = rp->next;
+
+	rp->obj                     = obj;
+	rp->next                    = NULL;
+	rp->pc.custom_free_function = netmgr_rx_pbuf_free;
+	p = pbuf_alloced_custom(PBUF_RAW, pkt_len, PBUF_REF, &rp->pc, obj->data + pkt_offset, pkt_len);
+	assert(p);
+
+	if (net_interface.input(p, &net_interface) != ERR_OK) pbuf_free(p);
+}
+
+/*
+ * Feed a burst of this thread's received packets to lwip, blocking
+ * until there is one, and run lwip's timers. The lwip lock is held by
+ * the caller, and released while it blocks. The wait stops at lwip's
+ * next timeout, so that its timers (retransmissions, delayed ACKs,
+ * TIME_WAIT) run without traffic, and the callers waiting on them
+ * (e.g. for a write's ACKs) see their outcome: this returns then with
+ * no packets.
+ */
+static void
+netmgr_rx_burst(void)
+{
+	struct netshmem_pkt_buf *desc_buf, *obj;
+	struct netmgr_thd       *t = &netmgr_thds[cos_thdid()];
+	struct nic_pkt_desc     *d;
+	cycles_t timeout = 0;
+	u32_t    sleep_ms;
+	int i, n;
+
+	if (unlikely(!t->descs)) {
+		desc_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &t->descid);
+		assert(desc_buf);
+		t->descs = (struct nic_pkt_desc *)desc_buf->data;
+	}
+
+	lwip_sys_now = (u32_t)(time_now_usec() / 1000);
+	sleep_ms     = sys_timeouts_sleeptime();
+	if (sleep_ms != SYS_TIMEOUTS_SLEEPTIME_INFINITE) timeout = time_now() + time_usec2cyc((microsec_t)sleep_ms * 1000);
+
+	sync_lock_release(&lwip_lock);
+	/* Packets can be dropped when out of shmem objects */
+	do {
+		if (timeout) n = nic_get_packets_timeout(t->descid, NIC_PKT_BURST_MAX, timeout);
+		else         n = nic_get_packets(t->descid, NIC_PKT_BURST_MAX);
+	} while (n == 0 && (!timeout || cycles_greater_than(timeout, time_now())));
+	assert(n >= 0);
+	sync_lock_take(&lwip_lock);
+
+	for (i = 0; i < n; i++) {
+		d   = &t->descs[i];
+		obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), d->objid);
+		assert(obj);
+		net_interface_input(obj, d->pkt_offset, d->pkt_len);
+	}
+
+	lwip_sys_now = (u32_t)(time_now_usec() / 1000);
+	sys_check_timeouts();
+}
 
 static err_t
 cos_lwip_tcp_sent(void *arg, struct tcp_pcb *tp, u16_t len)
 {
-	/* TODO: process sent state */
+	struct netmgr_conn *c = arg;
+
+	netmgr_tx_acked(c, len);
+	if (c->closing && c->txq_head == c->txq_tail) {
+		tcp_arg(tp, NULL);
+		tcp_sent(tp, NULL);
+		tcp_err(tp, NULL);
+		netmgr_conn_free(c);
+	}
+
 	return ERR_OK;
 }
 
-
 static err_t
 cos_lwip_tcp_recv(void *arg, struct tcp_pcb *tp, struct pbuf *p, err_t err)
 {
-	if (p != NULL) {
-		back_to_app = 1;
-		g_pbuf = p;
-		tcp_recved(tp, p->tot_len);
-	}
+	struct netmgr_conn *c = arg;
+
+	if (p == NULL) c->eof = 1;
+	else           netmgr_conn_rxq_push(c, p);
+	netmgr_conn_ready(c);
 
 	return ERR_OK;
 }
 
+/* The connection is reset or aborted, and lwip has freed its pcb */
 static void
-cos_lwip_tcp_err(void *arg,  err_t err)
+cos_lwip_tcp_err(void *arg, err_t err)
 {
-	assert(0);
-	return;
+	struct netmgr_conn *c = arg;
+
+	if (!c) return;
+
+	c->tp  = NULL;
+	c->err = err;
+	if (c->closing) netmgr_conn_free(c);
+	else            netmgr_conn_ready(c);
 }
 
 static err_t
 cos_lwip_tcp_accept(void *arg, struct tcp_pcb *tp, err_t err)
 {
-	err_t ret_err;
-	thdid_t thd = cos_thdid();
+	struct netmgr_conn *l = arg, *c;
+
+	if (err != ERR_OK || tp == NULL) return ERR_VAL;
+	/* lwip aborts the connections the application has no room for */
+	if (l->acceptq_len >= l->backlog) return ERR_MEM;
+	c = netmgr_conn_alloc(NETMGR_CONN_TCP, l->thd);
+	if (!c) return ERR_MEM;
 
-	tcp_arg(tp, 0);
+	c->tp          = tp;
+	c->remote.ip   = ip4_addr_get_u32(&tp->remote_ip);
+	c->remote.port = tp->remote_port;
+
+	tcp_arg(tp, c);
 	tcp_err(tp, cos_lwip_tcp_err);
 	tcp_recv(tp, cos_lwip_tcp_recv);
 	tcp_sent(tp, cos_lwip_tcp_sent);
+	tcp_nagle_disable(tp);
 
-	lwip_connections[thd].tp = tp;
+	if (l->acceptq_tail) conns[l->acceptq_tail].next = netmgr_conn_fd(c);
+	else                 l->acceptq_head = netmgr_conn_fd(c);
+	l->acceptq_tail = netmgr_conn_fd(c);
+	l->acceptq_len++;
+	netmgr_conn_ready(l);
 
-	tcp_nagle_disable(tp);
+	return ERR_OK;
+}
+
+void
+netmgr_conn_init(void)
+{
+	int i;
+
+	sync_lock_init(&lwip_lock);
 
-	ret_err = ERR_OK;
-	return ret_err;
+	for (i = NETMGR_MAX_CONNS - 1; i > 0; i--) {
+		conns[i].next = conn_free;
+		conn_free     = i;
+	}
+	for (i = 0; i < NETMGR_RX_PBUFS; i++) {
+		rx_pbufs[i].next = rx_pbuf_free;
+		rx_pbuf_free     = &rx_pbufs[i];
+	}
 }
 
 void netmgr_shmem_map(cbuf_t shm_id)
@@ -96,238 +505,445 @@ void netmgr_shmem_map(cbuf_t shm_id)
 int
 netmgr_tcp_bind(u32_t ip_addr, u16_t port)
 {
-	unsigned long npages;
-	shm_bm_t      shm;
-	err_t         ret;
-
-	void                    *mem;
-	struct netshmem_pkt_buf *obj;
-
-	struct tcp_pcb *tp;
-	struct ip4_addr ipa = *(struct ip4_addr*)&ip_addr;
-
-	thdid_t thd = cos_thdid();
+	struct netmgr_conn *c;
+	struct tcp_pcb     *tp;
+	struct ip4_addr     ipa = *(struct ip4_addr*)&ip_addr;
+	int fd = -ENOMEM;
 
 	nic_bind_port(ip_addr, htons(port));
 
+	sync_lock_take(&lwip_lock);
+	c  = netmgr_conn_alloc(NETMGR_CONN_TCP, cos_thdid());
 	tp = tcp_new();
-	assert(tp != NULL);
-
-	lwip_connections[thd].tp = tp;
+	if (!c || !tp) goto err;
 
-	ret = tcp_bind(tp, &ipa, port);
-
-	return ret;
+	if (tcp_bind(tp, &ipa, port) != ERR_OK) {
+		fd = -EADDRINUSE;
+		goto err;
+	}
+	c->tp = tp;
+	tcp_arg(tp, c);
+	fd = netmgr_conn_fd(c);
+	sync_lock_release(&lwip_lock);
+
+	return fd;
+err:
+	if (tp) tcp_close(tp);
+	if (c)  netmgr_conn_free(c);
+	sync_lock_release(&lwip_lock);
+
+	return fd;
 }
 
 int
-netmgr_tcp_listen(u8_t backlog)
+netmgr_tcp_listen(int fd, u8_t backlog)
 {
-	struct tcp_pcb *new_tp = NULL;
-	thdid_t         thd    = cos_thdid();
-
-	new_tp = tcp_listen_with_backlog(lwip_connections[thd].tp, backlog);
-	assert(new_tp);
+	struct netmgr_conn *c;
+	struct tcp_pcb     *new_tp;
+	int ret = NETMGR_OK;
+
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_TCP);
+	if (!c || !c->tp) {
+		ret = -EINVAL;
+		goto done;
+	}
 
-	lwip_connections[thd].tp = new_tp;
+	new_tp = tcp_listen_with_backlog(c->tp, backlog);
+	if (!new_tp) {
+		ret = -ENOMEM;
+		goto done;
+	}
+	c->type    = NETMGR_CONN_TCP_LISTEN;
+	c->tp      = new_tp;
+	c->backlog = backlog;
+	tcp_arg(new_tp, c);
+	tcp_accept(new_tp, cos_lwip_tcp_accept);
+done:
+	sync_lock_release(&lwip_lock);
 
-	return ERR_OK;
+	return ret;
 }
 
-static void
-net_interface_input(void *pkt, int len)
+int
+netmgr_tcp_accept(int fd, struct conn_addr *client_addr)
 {
-	void        *pl;
-	struct pbuf *p;
-	
-	pl = pkt;
+	struct netmgr_conn *l, *c;
 
-	p = pbuf_alloc(PBUF_LINK, len, PBUF_ROM);
-	assert(p);
-
-	p->payload = pl;
-	if (net_interface.input(p, &net_interface) != ERR_OK) {
-		assert(0);
+	sync_lock_take(&lwip_lock);
+	l = netmgr_conn_get(fd, NETMGR_TCP_LSTN);
+	if (!l) {
+		sync_lock_release(&lwip_lock);
+		return -EINVAL;
 	}
 
-	if (p->ref != 0) {
-		pbuf_free(p);
-	}
+	while (!l->acceptq_head) netmgr_rx_burst();
 
-	return;
-}
+	c = &conns[l->acceptq_head];
+	l->acceptq_head = c->next;
+	if (!l->acceptq_head) l->acceptq_tail = 0;
+	l->acceptq_len--;
+	if (netmgr_conn_pending(l)) netmgr_conn_ready(l);
+	else                        netmgr_conn_unready(l);
 
-int
-net_receive_packet(char *pkt, size_t pkt_len)
-{
-	net_interface_input(pkt, pkt_len);
-	return 0;
+	*client_addr = c->remote;
+	sync_lock_release(&lwip_lock);
+
+	return netmgr_conn_fd(c);
 }
 
-int
-netmgr_tcp_accept(struct conn_addr *client_addr)
+shm_bm_objid_t
+netmgr_tcp_shmem_read(int fd, u16_t *data_offset, u16_t *data_len)
 {
-	shm_bm_objid_t           objid = 0;
-	struct netshmem_pkt_buf *obj;
-	size_t shmsz;
-	cbuf_t rx_shm_id;
-	void  *mem;
-	u16_t  pkt_len;
+	struct netmgr_conn    *c;
+	struct netmgr_rx_pbuf *rp;
+	shm_bm_objid_t         objid = 0;
 
-	thdid_t thd = cos_thdid();
+	*data_offset = *data_len = 0;
 
-	netif_set_link_up(&net_interface);
-	tcp_accept(lwip_connections[thd].tp, cos_lwip_tcp_accept);
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_TCP);
+	if (!c) goto done;
 
-	while (!back_to_app) {
-		objid = nic_get_a_packet(&pkt_len);
-		obj   = shm_bm_take_net_pkt_buf(netshmem_get_shm(), objid);
-		net_receive_packet(obj->data, pkt_len);
+	while (1) {
+		while (!c->rxq_head && !c->eof && !c->err) netmgr_rx_burst();
+
+		rp = netmgr_conn_rxq_pop(c);
+		/* lwip can leave empty pbufs in the chains it reassembles */
+		if (!rp || rp->pc.pbuf.len > 0) break;
+		pbuf_free(&rp->pc.pbuf);
 	}
-	g_objid = objid;
+	if (rp) {
+		objid = netmgr_rx_pbuf_read(rp, data_offset, data_len);
+		if (c->tp) tcp_recved(c->tp, *data_len);
+	}
+	if (netmgr_conn_pending(c)) netmgr_conn_ready(c);
+	else                        netmgr_conn_unready(c);
+done:
+	sync_lock_release(&lwip_lock);
 
-	return 0;
+	return objid;
 }
 
-shm_bm_objid_t
-netmgr_tcp_shmem_read(u16_t *data_offset, u16_t *data_len)
+int
+netmgr_tcp_shmem_write(int fd, shm_bm_objid_t objid, u16_t data_offset, u16_t data_len)
 {
-	shm_bm_objid_t           objid;
+	struct netmgr_conn      *c;
 	struct netshmem_pkt_buf *obj;
-	u16_t pkt_len;
-
-	obj = shm_bm_take_net_pkt_buf(netshmem_get_shm(), g_objid);
+	struct netmgr_tx_seg    *s;
+	err_t wr_err;
+	int ret = NETMGR_OK;
+
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_TCP);
+	if (!c) {
+		ret = -EINVAL;
+		goto done;
+	}
 
-	while (!back_to_app) {
-		objid = nic_get_a_packet(&pkt_len);
-		obj = shm_bm_take_net_pkt_buf(netshmem_get_shm(), objid);
-		assert(obj);
+	if (data_len > TCP_SND_BUF) {
+		ret = -EMSGSIZE;
+		goto done;
+	}
 
-		net_receive_packet(obj->data, pkt_len);
-		g_objid = objid;
+	/* lwip sends the data in place: the object is held until it is acknowledged */
+	while (1) {
+		if (!c->tp) {
+			ret = -EPIPE;
+			goto done;
+		}
+		if ((u16_t)(c->txq_tail - c->txq_head) < NETMGR_TXQ_SZ && tcp_sndbuf(c->tp) >= data_len
+		    && tcp_sndqueuelen(c->tp) < TCP_SND_QUEUELEN) break;
+		/* Wait for the acknowledgments that make room for the data */
+		tcp_output(c->tp);
+		netmgr_rx_burst();
 	}
 
-	*data_offset = (char *)g_pbuf->payload - obj->data;
-	*data_len = g_pbuf->len;
+	obj = shm_bm_take_net_pkt_buf(netshmem_get_shm(), objid);
+	assert(obj);
+
+	wr_err = tcp_write(c->tp, obj->data + data_offset, data_len, 0);
+	if (wr_err != ERR_OK) {
+		shm_bm_free_net_pkt_buf(obj);
+		ret = -ENOMEM;
+		goto done;
+	}
+	s      = &c->txq[c->txq_tail++ % NETMGR_TXQ_SZ];
+	s->obj = obj;
+	s->len = data_len;
 
-	back_to_app = 0;
+	tcp_output(c->tp);
+done:
+	sync_lock_release(&lwip_lock);
 
-	return g_objid;
+	return ret;
 }
 
 int
-netmgr_tcp_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len)
+netmgr_tcp_close(int fd)
 {
-	struct netshmem_pkt_buf *obj;
-
-	thdid_t thd = cos_thdid();
-	char *data;
-
-	obj = shm_bm_take_net_pkt_buf(netshmem_get_shm(), objid);
-	data = obj->data + data_offset;
+	struct netmgr_conn *c, *a;
+	struct tcp_pcb     *tp;
+
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_TCP | NETMGR_TCP_LSTN);
+	if (!c) {
+		sync_lock_release(&lwip_lock);
+		return -EINVAL;
+	}
 
-	err_t wr_err = tcp_write(lwip_connections[thd].tp, data, data_len, 0);
-	assert(wr_err == ERR_OK);
+	/* The connections not yet accepted are closed with their listening one */
+	while (c->acceptq_head) {
+		a = &conns[c->acceptq_head];
+		c->acceptq_head = a->next;
+		if (a->tp) {
+			tcp_arg(a->tp, NULL);
+			tcp_abort(a->tp);
+		}
+		netmgr_conn_free(a);
+	}
 
-	/* tcp_output() might be needed in the future */
-	// wr_err = tcp_output(lwip_connections[thd].tp);
-	// assert(wr_err == ERR_OK);
+	tp = c->tp;
+	if (tp && c->type == NETMGR_CONN_TCP_LISTEN) {
+		tcp_close(tp);
+	} else if (tp) {
+		tcp_recv(tp, NULL);
+		if (c->txq_head != c->txq_tail) {
+			/* The writes are still sent from their objects, that are freed once they are acknowledged */
+			netmgr_conn_unready(c);
+			c->closing = 1;
+		} else {
+			tcp_arg(tp, NULL);
+			tcp_sent(tp, NULL);
+			tcp_err(tp, NULL);
+		}
+		if (tcp_close(tp) != ERR_OK) {
+			tcp_arg(tp, NULL);
+			tcp_abort(tp);
+			c->closing = 0;
+		}
+	}
+	if (!c->closing) netmgr_conn_free(c);
+	sync_lock_release(&lwip_lock);
 
-	return 0;
+	return NETMGR_OK;
 }
 
 static void
 cos_lwip_udp_recv(void *arg, struct udp_pcb *up, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
-	if (p != NULL) {
-		back_to_app = 1;
-		g_pbuf = p;
-		g_remote_addr = *addr;
-		g_remote_port = port;
+	struct netmgr_conn    *c  = arg;
+	struct netmgr_rx_pbuf *rp = (struct netmgr_rx_pbuf *)p;
+
+	if (c->rxq_len >= NETMGR_UDP_RXQ_MAX) {
+		pbuf_free(p);
+		return;
 	}
+
+	/* The address is in the packet's headers */
+	rp->remote_addr = ip4_addr_get_u32(addr);
+	rp->remote_port = port;
+	netmgr_conn_rxq_push(c, p);
+	netmgr_conn_ready(c);
 }
 
 int
 netmgr_udp_bind(u32_t ip_addr, u16_t port)
 {
-	unsigned long npages;
-	void         *mem;
-	shm_bm_t      shm;
+	struct netmgr_conn *c;
+	struct udp_pcb     *up;
+	struct ip4_addr     ipa = *(struct ip4_addr *)&ip_addr;
+	int fd = -ENOMEM;
 
-	struct netshmem_pkt_buf *obj;
+	nic_bind_port(ip_addr, htons(port));
 
-	struct ip4_addr ipa = *(struct ip4_addr *)&ip_addr;
-	err_t ret;
+	sync_lock_take(&lwip_lock);
+	c  = netmgr_conn_alloc(NETMGR_CONN_UDP, cos_thdid());
+	up = udp_new();
+	if (!c || !up) goto err;
 
-	thdid_t thd = cos_thdid();
-	assert(thd < LWIP_MAX_CONNS);
+	if (udp_bind(up, &ipa, port) != ERR_OK) {
+		fd = -EADDRINUSE;
+		goto err;
+	}
+	c->up = up;
+	udp_recv(up, cos_lwip_udp_recv, c);
+	fd = netmgr_conn_fd(c);
+	sync_lock_release(&lwip_lock);
+
+	return fd;
+err:
+	if (up) udp_remove(up);
+	if (c)  netmgr_conn_free(c);
+	sync_lock_release(&lwip_lock);
+
+	return fd;
+}
 
-	nic_bind_port(ip_addr, htons(port));
+shm_bm_objid_t
+netmgr_udp_shmem_read(int fd, u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port)
+{
+	struct netmgr_conn    *c;
+	struct netmgr_rx_pbuf *rp;
+	shm_bm_objid_t         objid = 0;
 
-	lwip_connections[thd].up = udp_new();
-	assert(lwip_connections[thd].up != NULL);
+	*data_offset = *data_len = *remote_port = 0;
+	*remote_addr = 0;
 
-	ret = udp_bind(lwip_connections[thd].up, &ipa, port);
-	assert(ret == ERR_OK);
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_UDP);
+	if (!c) goto done;
 
-	udp_recv(lwip_connections[thd].up, cos_lwip_udp_recv, 0);
+	while (!c->rxq_head) netmgr_rx_burst();
 
-	return ret;
+	rp           = netmgr_conn_rxq_pop(c);
+	*remote_addr = rp->remote_addr;
+	*remote_port = rp->remote_port;
+	objid        = netmgr_rx_pbuf_read(rp, data_offset, data_len);
+
+	if (netmgr_conn_pending(c)) netmgr_conn_ready(c);
+	else                        netmgr_conn_unready(c);
+done:
+	sync_lock_release(&lwip_lock);
+
+	return objid;
 }
 
-shm_bm_objid_t
-netmgr_udp_shmem_read(u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port)
+int
+netmgr_udp_shmem_write(int fd, shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port)
 {
-	shm_bm_objid_t           objid;
+	struct netmgr_conn      *c;
 	struct netshmem_pkt_buf *obj;
-	u16_t pkt_len;
+	struct pbuf             *p;
+	ip_addr_t dst_ip;
+	int ret = NETMGR_OK;
 
-	while (1) {
-		objid = nic_get_a_packet(&pkt_len);
-		obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
-		assert(obj);
+	obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
+	assert(obj);
 
-		net_receive_packet(obj->data, pkt_len);
-		g_objid = objid;
-		if (!back_to_app) {
-			/* if this packet doesn't need to transfer to application, lwip needs to free it. */
-			shm_bm_free_net_pkt_buf(obj);
-		} else {
-			break;
-		}
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_UDP);
+	if (!c) {
+		ret = -EINVAL;
+		goto done;
 	}
 
-	*data_offset = (char *)g_pbuf->payload - obj->data;
-	*data_len    = g_pbuf->len;
-	*remote_addr = g_remote_addr.addr;
-	*remote_port = g_remote_port;
+	p = netmgr_tx_pbuf_get(obj->data + data_offset, data_len);
+	if (!p) {
+		ret = -ENOMEM;
+		goto done;
+	}
+	dst_ip.addr = remote_ip;
 
-	back_to_app = 0;
-	return g_objid;
+	udp_sendto_if(c->up, p, &dst_ip, remote_port, &net_interface);
+	pbuf_free(p);
+done:
+	sync_lock_release(&lwip_lock);
+
+	return ret;
 }
 
 int
-netmgr_udp_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port)
+netmgr_udp_shmem_read_batch(int fd, shm_bm_objid_t msgsid, u16_t max)
 {
-	struct netshmem_pkt_buf *obj;
-	struct pbuf             *p;
+	struct netmgr_conn      *c;
+	struct netmgr_rx_pbuf   *rp;
+	struct netshmem_pkt_buf *msgs_buf;
+	struct netmgr_udp_msg   *m;
+	int n = 0;
+
+	msgs_buf = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), msgsid);
+	if (!msgs_buf) return -EINVAL;
+	if (max > NETMGR_UDP_BATCH_MAX) max = NETMGR_UDP_BATCH_MAX;
+
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_UDP);
+	if (!c) {
+		n = -EINVAL;
+		goto done;
+	}
+
+	while (!c->rxq_head) netmgr_rx_burst();
+
+	/* All of the datagrams queued, up to max: a burst from the nicmgr often has several for a connection */
+	for (n = 0; n < max && c->rxq_head; n++) {
+		m              = &((struct netmgr_udp_msg *)msgs_buf->data)[n];
+		rp             = netmgr_conn_rxq_pop(c);
+		m->remote_addr = rp->remote_addr;
+		m->remote_port = rp->remote_port;
+		m->objid       = netmgr_rx_pbuf_read(rp, &m->data_offset, &m->data_len);
+	}
+
+	if (netmgr_conn_pending(c)) netmgr_conn_ready(c);
+	else                        netmgr_conn_unready(c);
+done:
+	sync_lock_release(&lwip_lock);
+
+	return n;
+}
 
+int
+netmgr_udp_shmem_write_batch(int fd, shm_bm_objid_t msgsid, u16_t n)
+{
+	struct netmgr_conn      *c;
+	struct netshmem_pkt_buf *msgs_buf, *obj;
+	struct netmgr_udp_msg   *m;
+	struct pbuf             *p;
 	ip_addr_t dst_ip;
-	
-	thdid_t thd = cos_thdid();
-	char *data;
+	int i = 0;
 
-	obj  = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
-	data = obj->data + data_offset;
+	msgs_buf = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), msgsid);
+	if (!msgs_buf) return -EINVAL;
+	if (n > NETMGR_UDP_BATCH_MAX) n = NETMGR_UDP_BATCH_MAX;
 
-	p = pbuf_alloc(PBUF_LINK, data_len, PBUF_ROM);
-	assert(p);
+	sync_lock_take(&lwip_lock);
+	c = netmgr_conn_get(fd, NETMGR_UDP);
+	if (!c) {
+		i = -EINVAL;
+		goto done;
+	}
 
-	p->payload  = data;
-	dst_ip.addr = remote_ip;
+	/* The lock is taken, and the nicmgr invoked, once for the batch rather than for each datagram */
+	netmgr_tx_burst_begin();
+	for (i = 0; i < n; i++) {
+		m   = &((struct netmgr_udp_msg *)msgs_buf->data)[i];
+		obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), m->objid);
+		if (!obj) break;
+		p = netmgr_tx_pbuf_get(obj->data + m->data_offset, m->data_len);
+		if (!p) break;
+
+		dst_ip.addr = m->remote_addr;
+		udp_sendto_if(c->up, p, &dst_ip, m->remote_port, &net_interface);
+		pbuf_free(p);
+	}
+	netmgr_tx_burst_end();
+done:
+	sync_lock_release(&lwip_lock);
 
-	udp_sendto_if(lwip_connections[thd].up, p , &dst_ip, remote_port, &net_interface);
-	pbuf_free(p);
+	return i;
+}
+
+int
+netmgr_conn_wait(void)
+{
+	struct netmgr_thd  *t = &netmgr_thds[cos_thdid()];
+	struct netmgr_conn *c;
+	int fd;
+
+	sync_lock_take(&lwip_lock);
+	while (1) {
+		while ((fd = t->ready_head)) {
+			c = &conns[fd];
+			if (netmgr_conn_pending(c)) goto done;
+			netmgr_conn_unready(c);
+		}
+		netmgr_rx_burst();
+	}
+done:
+	/* The connection stays ready until what is pending is read: move it last, so that the others get a turn */
+	netmgr_conn_unready(c);
+	netmgr_conn_ready(c);
+	sync_lock_release(&lwip_lock);
 
-	return 0;
+	return fd;
 }
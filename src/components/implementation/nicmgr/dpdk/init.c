@@ -7,12 +7,12 @@
 #include <arpa/inet.h>
 #include <net_stack_types.h>
 #include <rte_atomic.h>
-#include <rte_hash.h>
-#include <rte_jhash.h>
-#include <rte_hash_crc.h>
 #include <sync_blkpt.h>
 #include <sync_lock.h>
+#include <stdio.h>
+#include <ps.h>
 #include "nicmgr.h"
+#include "nic_flow.h"
 
 #define ENABLE_DEBUG_INFO 0
 
@@ -35,59 +35,27 @@ char tx_per_core_mpool_name[NIC_TX_QUEUE_NUM][32];
 
 static u16_t nic_ports = 0;
 
-struct rte_hash *tenant_hash_tbl;
-struct sync_lock tx_lock[NIC_TX_QUEUE_NUM];
-
-static struct rte_hash_parameters rte_hash_params = {
-	.entries = NIC_MAX_SESSION,
-	.key_len = sizeof(uint16_t),
-	.hash_func = rte_jhash,
-	.hash_func_init_val = 0,
-	.socket_id = 0,
-	.extra_flag = RTE_HASH_EXTRA_FLAGS_MULTI_WRITER_ADD,
+/* The shared rx queues, one per polling core */
+static unsigned long rx_queue_num = 1;
+
+/*
+ * The zero-copy rx queues (after the rx_queue_num shared ones). Queue
+ * q is polled by core q % rx_queue_num, and is given to a session of
+ * that core. Without a session, it receives as a shared queue.
+ */
+struct nic_rx_zc_queue {
+	char                  *mp;
+	unsigned long          claimed;
+	struct client_session *session;
 };
 
-static void
-cos_hash_init()
-{
-	int pos, ret;
-
-	rte_hash_params.name = "tenant_id_tbl";
-
-	tenant_hash_tbl = rte_hash_create(&rte_hash_params);
-
-	assert(tenant_hash_tbl);
+static struct nic_rx_zc_queue rx_zc_queues[NIC_RX_ZC_QUEUE_NUM];
+static unsigned long rx_zc_queue_num = 0;
+/* Zero-copy needs RSS to only spread packets to the shared queues */
+static int rx_zc_enabled = 1;
 
-	printc("tenant hash table init done\n");
-}
-
-void 
-cos_hash_add(uint16_t tenant_id, struct client_session *session)
-{
-	int ret;
-	ret = rte_hash_add_key_data(tenant_hash_tbl, &tenant_id, session);
-	assert(ret >= 0);
-}
-
-struct client_session *
-cos_hash_lookup(uint16_t tenant_id)
-{
-	int ret;
-	struct client_session *session = NULL;
-
-	/* If DPDK receives this port, it goes to process debug information */
-	if (unlikely(tenant_id == htons(NIC_DEBUG_PORT))) {
-		// asm volatile("mfence");
-		printc("debug flag is open\n");
-		debug_flag = 1;
-		return NULL;
-	}
-
-	ret = rte_hash_lookup_data(tenant_hash_tbl, &tenant_id, (void *)&session);
-	if (ret < 0) return NULL;
-
-	return session;
-}
+struct sync_lock tx_lock[NIC_TX_QUEUE_NUM];
+static struct sync_lock rx_bind_lock;
 
 static void
 debug_print_stats(void)
@@ -99,8 +67,8 @@ debug_print_stats(void)
 	printc("tx enqueued miss:%lu\n", tx_enqueued_miss.cnt);
 	printc("enqueue:%lu, txqneueue:%lu\n", enqueued_rx, dequeued_tx);
 	struct client_session	*session1, *session2;
-	session1 = cos_hash_lookup(ntohs(6));
-	session2 = cos_hash_lookup(ntohs(7));
+	session1 = nic_flow_port_lookup(htons(6));
+	session2 = nic_flow_port_lookup(htons(7));
 	int ret1 = sched_debug_thd_state(session1->thd);
 	int ret2 = sched_debug_thd_state(session2->thd);
 	printc("com 6:%u\n", ret1);
@@ -130,106 +98,180 @@ ext_buf_free_callback_fn(void *addr, void *opaque)
 }
 
 static void
-process_tx_packets(void)
-{
-	struct pkt_buf buf;
-	char *mbuf;
-	void *ext_shinfo;
-	char *tx_packets[MAX_PKT_BURST];
-	struct pkt_ring_buf *per_thd_tx_ring;
-	int i = 0, j = 0;
-	// cycles_t    before, after;
-	for (j = 0; j < NIC_MAX_SESSION; j++) {
-		if (client_sessions[j].tx_init_done == 0) continue;
-
-		per_thd_tx_ring = &client_sessions[j].pkt_tx_ring;
-		while (!pkt_ring_buf_empty(per_thd_tx_ring)) {
-			i = 0;
-
-			pkt_ring_buf_dequeue(per_thd_tx_ring, &buf);
-
-			dequeued_tx++;
-			mbuf = cos_allocate_mbuf(g_tx_mp[0]);
-			assert(mbuf);
-			ext_shinfo = netshmem_get_tailroom((struct netshmem_pkt_buf *)buf.obj);
-
-			cos_attach_external_mbuf(mbuf, buf.obj, buf.paddr, PKT_BUF_SIZE, ext_buf_free_callback_fn, ext_shinfo);
-			cos_set_external_packet(mbuf, (buf.pkt - buf.obj), buf.pkt_len, ENABLE_OFFLOAD);
-			tx_packets[i++] = mbuf;
-			// rdtscll(before);
-			cos_dev_port_tx_burst(0, 0, tx_packets, i);
-			// rdtscll(after);
-		}
-
-	}
-}
-
-static void
-process_rx_packets(cos_portid_t port_id, char** rx_pkts, uint16_t nb_pkts)
+process_rx_packets(coreid_t cid, char** rx_pkts, uint16_t nb_pkts)
 {
-	int i, ret;
+	int i, j, n, nkeys;
 	int len = 0;
 
-	struct eth_hdr		*eth;
-	struct ip_hdr		*iph;
-	struct arp_hdr		*arp_hdr;
-	struct tcp_udp_port	*port;
-	struct client_session	*session;
+	struct nic_flow_key	 keys[NIC_FLOW_BURST];
+	struct client_session	*sessions[NIC_FLOW_BURST];
+	char			*pkts[NIC_FLOW_BURST];
 	char                    *pkt;
 	struct pkt_buf           buf;
 
-	for (i = 0; i < nb_pkts; i++) {
-		pkt = cos_get_packet(rx_pkts[i], &len);
-		eth = (struct eth_hdr *)pkt;
+	for (i = 0; i < nb_pkts; i += n) {
+		n = nb_pkts - i < NIC_FLOW_BURST ? nb_pkts - i : NIC_FLOW_BURST;
 
-		if (htons(eth->ether_type) == 0x0800) {
-			iph	= (struct ip_hdr *)((char *)eth + sizeof(struct eth_hdr));
-			if (unlikely(iph->proto != UDP_PROTO)) {
-				// assert(0);
-				cos_free_packet(rx_pkts[i]);
-				rx_enqueued_miss++;
+		for (j = 0, nkeys = 0; j < n; j++) {
+			pkt = cos_get_packet(rx_pkts[i + j], &len);
+			/* ARP, and any packet other than IPv4 UDP and TCP, is for no session */
+			if (unlikely(nic_flow_key_get(pkt, len, &keys[nkeys]))) {
+				cos_free_packet(rx_pkts[i + j]);
 				continue;
 			}
-			port	= (struct tcp_udp_port *)((char *)eth + sizeof(struct eth_hdr) + iph->ihl * 4);
-
-			// printc("port id:0x%x\n", port->dst_port);
-			session = cos_hash_lookup(port->dst_port);
-			// assert(session->port == port->dst_port);
-			if (unlikely(debug_flag)) {
-				debug_print_stats();
-				debug_flag = 0;
-			}
-			if (unlikely(session == NULL)) {
-				cos_free_packet(rx_pkts[i]);
+			pkts[nkeys++] = rx_pkts[i + j];
+		}
+		nic_flow_lookup_burst(cid, keys, nkeys, sessions);
+
+		for (j = 0; j < nkeys; j++) {
+			if (unlikely(sessions[j] == NULL)) {
+				/* If DPDK receives this port, it goes to process debug information */
+				if (unlikely(keys[j].local_port == htons(NIC_DEBUG_PORT))) debug_print_stats();
+				cos_free_packet(pkts[j]);
 				continue;
 			}
-			// memset(&buf, 0, sizeof(buf));
-			buf.pkt = rx_pkts[i];
-			// if (ntohs(port->dst_port) == 6) {
-			// 	buf.tent_id = 6;
-			// 	buf.srcid = ntohs(port->src_port);
-			// } else if(ntohs(port->dst_port) == 7) {
-			// 	buf.tent_id = 7;
-			// 	buf.srcid = ntohs(port->src_port);
-			// } else {
-			// 	assert(0);
-			// }
-			if (unlikely(!pkt_ring_buf_enqueue(&(session->pkt_ring_buf), &buf))){
+			buf.pkt = pkts[j];
+			buf.obj = NULL;
+			if (unlikely(!pkt_ring_buf_enqueue_mp(&(sessions[j]->pkt_ring_buf), &buf))){
 				cos_free_packet(buf.pkt);
 				rx_enqueued_miss++;
 				continue;
 			}
 			enqueued_rx++;
-			// if (unlikely(debug_flag)) {
-			// 	session->sem.debug = 1;
-			// }
 
-			sync_sem_give(&session->sem);
-		} else if (htons(eth->ether_type) == 0x0806) {
+			nic_session_give(sessions[j]);
+		}
+	}
+}
+
+/*
+ * The packets of a session's zero-copy rx queue are in the session's
+ * shmem objects, unless they were received before the queue was given
+ * to the session.
+ */
+static void
+process_rx_zc_packets(struct client_session *session, char **rx_pkts, uint16_t nb_pkts)
+{
+	int   i, len;
+	char *pkt;
+	struct pkt_buf buf;
+
+	for (i = 0; i < nb_pkts; i++) {
+		pkt = cos_get_packet(rx_pkts[i], &len);
+
+		buf.pkt = rx_pkts[i];
+		buf.obj = NULL;
+		/* shmem regions are SHM_BM_ALIGN aligned */
+		if (((word_t)pkt & ~(SHM_BM_ALIGN - 1)) == (word_t)session->shemem_info.shm) {
+			buf.obj = shm_bm_borrow_net_pkt_buf(session->shemem_info.shm, shm_bm_get_objid_net_pkt_buf(pkt));
+		}
+
+		if (unlikely(!pkt_ring_buf_enqueue_mp(&session->pkt_ring_buf, &buf))) {
 			cos_free_packet(buf.pkt);
+			if (buf.obj) shm_bm_free_net_pkt_buf(buf.obj);
+			rx_enqueued_miss++;
 			continue;
 		}
+		enqueued_rx++;
+
+		nic_session_give(session);
+	}
+}
+
+/* Attach the shmem objects of the queue's session to refill the queue */
+static int
+rx_zc_attach(void *opaque, char **mbufs, unsigned int n)
+{
+	struct client_session   *session = opaque;
+	struct netshmem_pkt_buf *objs[NIC_RX_ZC_DESC];
+	shm_bm_objid_t           objids[NIC_RX_ZC_DESC];
+	unsigned int i;
+	int got;
+
+	if (unlikely(n > NIC_RX_ZC_DESC)) return -1;
+
+	got = shm_bm_alloc_n_net_pkt_buf(session->shemem_info.shm, (void **)objs, objids, n);
+	if (unlikely(got < (int)n)) {
+		shm_bm_free_n_net_pkt_buf((void **)objs, got);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		/* The tailroom holds DPDK's data, and is not received into */
+		cos_attach_external_mbuf(mbufs[i], objs[i],
+			session->shemem_info.paddr + ((char *)objs[i] - (char *)session->shemem_info.shm),
+			PKT_BUF_SIZE - NETSHMEM_TAILROOM, ext_buf_free_callback_fn, netshmem_get_tailroom(objs[i]));
+	}
+
+	return 0;
+}
+
+/*
+ * Give a zero-copy rx queue of the session's core, if any is left, to
+ * the session, and steer its packets to it. The queue is not polled
+ * from its claim until the session is set.
+ */
+static int
+nic_rx_zc_bind(struct client_session *session)
+{
+	unsigned long q;
+	int i;
+
+	if (!rx_zc_enabled) return -1;
+	for (q = session->rx_queue; q < rx_zc_queue_num; q += rx_queue_num) {
+		if (ps_cas(&rx_zc_queues[q].claimed, 0, 1)) break;
+	}
+	if (q >= rx_zc_queue_num) return -1;
+
+	cos_mbuf_pool_extbuf_user(rx_zc_queues[q].mp, session);
+	for (i = 0; i < nic_ports; i++) {
+		if (cos_dev_port_flow_udp_to_queue(i, session->port, rx_queue_num + q)) {
+			cos_mbuf_pool_extbuf_user(rx_zc_queues[q].mp, NULL);
+			ps_store(&rx_zc_queues[q].claimed, 0);
+			return -1;
+		}
+	}
+	session->rx_zc_queue = q;
+	ps_store(&rx_zc_queues[q].session, session);
+
+	return 0;
+}
+
+/*
+ * Steer the session's packets to a rx queue polled by the core of the
+ * session's thread: its zero-copy queue if it can get one, otherwise
+ * the core's shared queue, with the packets copied. If the ports
+ * cannot steer the packets, RSS spreads them.
+ *
+ * A port bound on several cores is not steered: RSS spreads its flows
+ * over the cores, each of which gives them to its session.
+ */
+void
+nic_rx_bind(struct client_session *session)
+{
+	struct client_session *first;
+	int i;
+
+	sync_lock_take(&rx_bind_lock);
+	session->rx_queue    = cos_cpuid() % rx_queue_num;
+	session->rx_zc_queue = -1;
+
+	first = nic_flow_port_lookup(session->port);
+	if (first && first->rx_queue != session->rx_queue) {
+		for (i = 0; i < nic_ports; i++) cos_dev_port_flow_udp_unsteer(i, session->port);
+		printc("nicmgr: port %u is bound on several cores, using RSS\n", ntohs(session->port));
+		goto done;
+	}
+	if (!nic_rx_zc_bind(session)) goto done;
+
+	if (rx_queue_num == 1) goto done;
+	for (i = 0; i < nic_ports; i++) {
+		if (cos_dev_port_flow_udp_to_queue(i, session->port, session->rx_queue)) {
+			printc("nicmgr: cannot steer port %u to rx queue %d, using RSS\n", ntohs(session->port), session->rx_queue);
+			goto done;
+		}
 	}
+done:
+	sync_lock_release(&rx_bind_lock);
 }
 
 static void
@@ -278,13 +320,16 @@ transmit_back(cos_portid_t port_id, char** rx_pkts, uint16_t nb_pkts)
 	assert(ret == nb_pkts);
 }
 
+/* Poll the shared rx queue of this core, and the zero-copy queues of its sessions */
 static void
-cos_nic_start(){
+cos_nic_start(coreid_t cid)
+{
 	int i, j, recv_round;
 	uint16_t nb_pkts = 0;
 
 	char *rx_packets[MAX_PKT_BURST];
 
+	nic_flow_reader_online(cid);
 	while (1) {
 #if USE_CK_RING_FREE_MBUF
 		cos_free_rx_buf();
@@ -292,16 +337,29 @@ cos_nic_start(){
 #if ENABLE_DEBUG_INFO
 		debug_dump_info();
 #endif
-		// process_tx_packets();
+		/* The cores share the tx queues if there are fewer of them */
+		nic_tx_process(cid, cid % NIC_TX_QUEUE_NUM, rx_queue_num > NIC_TX_QUEUE_NUM);
 
-		// only port 0, queue 0 receive packets
-		nb_pkts = cos_dev_port_rx_burst(0, 0, rx_packets, MAX_PKT_BURST);
+		// only port 0 receives packets
+		nb_pkts = cos_dev_port_rx_burst(0, cid, rx_packets, MAX_PKT_BURST);
 		/* These are the two test options */
 		// if (nb_pkts!= 0) transmit_back(0, rx_packets, nb_pkts);
 		// if (nb_pkts!= 0) cos_dev_port_tx_burst(0, 0, rx_packets, nb_pkts);
 
 		/* This is the real processing logic for applications */
-		if (nb_pkts != 0) process_rx_packets(0, rx_packets, nb_pkts);
+		if (nb_pkts != 0) process_rx_packets(cid, rx_packets, nb_pkts);
+
+		for (i = cid; i < rx_zc_queue_num; i += rx_queue_num) {
+			struct client_session *session = ps_load(&rx_zc_queues[i].session);
+
+			if (!session && ps_load(&rx_zc_queues[i].claimed)) continue;
+			nb_pkts = cos_dev_port_rx_burst(0, rx_queue_num + i, rx_packets, MAX_PKT_BURST);
+			if (nb_pkts == 0) continue;
+
+			if (session) process_rx_zc_packets(session, rx_packets, nb_pkts);
+			else         process_rx_packets(cid, rx_packets, nb_pkts);
+		}
+		nic_flow_quiesce(cid);
 	}
 }
 
@@ -321,7 +379,7 @@ cos_nic_init(void)
 	 * set max_mbufs 2 times than nb_rx_desc, so that there is enough room
 	 * to store packets, or this will fail if nb_rx_desc <= max_mbufs.
 	 */
-	const size_t max_rx_mbufs = 8 * nb_rx_desc;
+	size_t max_rx_mbufs = 8 * nb_rx_desc;
 	const size_t max_tx_mbufs = 2 * nb_tx_desc;
 	memset(rx_per_core_mpool_name, 0, sizeof(rx_per_core_mpool_name));
 	memset(tx_per_core_mpool_name, 0, sizeof(tx_per_core_mpool_name));
@@ -348,11 +406,30 @@ cos_nic_init(void)
 
 	/* 2. init all Ether ports */
 	nic_ports = cos_eth_ports_init();
+	if (nic_ports == 0) {
+		/* No NIC the drivers support: what is sent is received, to test in-system */
+		printc("nicmgr: no NIC found, using a loopback virtual NIC\n");
+		ret = cos_eth_vnic_loopback_create("cos_vnic0", NIC_RX_QUEUE_NUM, NIC_TX_QUEUE_NUM);
+		assert(ret == 0);
+		nic_ports = cos_eth_ports_init();
+	}
 
 	assert(nic_ports > 0);
 
+	/* A shared rx queue per core, as many as all ports support */
+	rx_queue_num = NIC_RX_QUEUE_NUM;
+	for (i = 0; i < nic_ports; i++) {
+		u16_t max = cos_dev_port_max_rx_queues(i);
+
+		if (max < rx_queue_num) rx_queue_num = max;
+	}
+	assert(rx_queue_num > 0);
+	/* DPDK is given a fixed amount of memory for all of the pools */
+	if (max_rx_mbufs / rx_queue_num > 2 * nb_rx_desc) max_rx_mbufs /= rx_queue_num;
+	else max_rx_mbufs = 2 * nb_rx_desc;
+
 	/* 3. create mbuf pool where packets will be stored, user can create multiple pools */
-	for (i = 0; i < NIC_RX_QUEUE_NUM; i++) {
+	for (i = 0; i < rx_queue_num; i++) {
 		rx_per_core_mpool_name[i][0] = 'r';
 		rx_per_core_mpool_name[i][1] = i;
 		g_rx_mp[i] = cos_create_pkt_mbuf_pool_by_ops(rx_per_core_mpool_name[i], max_rx_mbufs, COS_MEMPOOL_MT_RTS_OPS);
@@ -367,13 +444,35 @@ cos_nic_init(void)
 	}
 
 
+	/*
+	 * The zero-copy rx queues, as many as all ports support. Their
+	 * pools attach the shmem objects of the sessions given the queues.
+	 */
+	rx_zc_queue_num = NIC_RX_ZC_QUEUE_NUM;
+	for (i = 0; i < nic_ports; i++) {
+		u16_t max = cos_dev_port_max_rx_queues(i);
+
+		max = max > rx_queue_num ? max - rx_queue_num : 0;
+		if (max < rx_zc_queue_num) rx_zc_queue_num = max;
+	}
+	for (i = 0; i < rx_zc_queue_num; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "rx_zc_%u", i);
+		rx_zc_queues[i].mp = cos_create_pkt_mbuf_pool_extbuf(name, 2 * NIC_RX_ZC_DESC * nic_ports, rx_zc_attach);
+		assert(rx_zc_queues[i].mp);
+	}
+
 	/* 4. config each port */
 	for (i = 0; i < nic_ports; i++) {
-		cos_config_dev_port_queue(i, NIC_RX_QUEUE_NUM, NIC_TX_QUEUE_NUM);
+		cos_config_dev_port_queue(i, rx_queue_num + rx_zc_queue_num, NIC_TX_QUEUE_NUM);
 		cos_dev_port_adjust_rx_tx_desc(i, &nb_rx_desc, &nb_tx_desc);
-		for (int j = 0; j < NIC_RX_QUEUE_NUM; j++) {
+		for (int j = 0; j < rx_queue_num; j++) {
 			cos_dev_port_rx_queue_setup(i, j, nb_rx_desc, g_rx_mp[j]);
 		}
+		for (int j = 0; j < rx_zc_queue_num; j++) {
+			cos_dev_port_rx_queue_setup(i, rx_queue_num + j, NIC_RX_ZC_DESC, rx_zc_queues[j].mp);
+		}
 		for (int j = 0; j < NIC_TX_QUEUE_NUM; j++) {
 			cos_dev_port_tx_queue_setup(i, j, nb_tx_desc);
 		}
@@ -383,6 +482,11 @@ cos_nic_init(void)
 	for (i = 0; i < nic_ports; i++) {
 		cos_dev_port_start(i);
 		cos_dev_port_set_promiscuous_mode(i, COS_DPDK_SWITCH_ON);
+		/* RSS must not spread packets to the zero-copy queues */
+		if (rx_zc_queue_num > 0 && cos_dev_port_rss_queues(i, rx_queue_num)) {
+			printc("nicmgr: cannot limit RSS to the shared rx queues of port %u, no zero-copy rx\n", i);
+			rx_zc_enabled = 0;
+		}
 	}
 }
 
@@ -392,7 +496,8 @@ cos_init(void)
 {
 	printc("nicmgr init...\n");
 	cos_nic_init();
-	cos_hash_init();
+	nic_flow_init();
+	sync_lock_init(&rx_bind_lock);
 #ifdef USE_CK_RING_FREE_MBUF
 	pkt_ring_buf_init(&g_free_ring, FREE_PKT_RBUF_NUM, FREE_PKT_RING_SZ);
 #endif
@@ -406,9 +511,9 @@ cos_init(void)
 int
 parallel_main(coreid_t cid)
 {
-	/* DPDK rx and tx will only run on core 0 */
-	if(cid == 0) {
-		cos_nic_start();
+	/* DPDK rx runs on each core with a rx queue */
+	if (cid < rx_queue_num) {
+		cos_nic_start(cid);
 	} else {
 #if 0
 #if E810_NIC == 0
@@ -0,0 +1,345 @@
+#include <string.h>
+#include <errno.h>
+#include <llprint.h>
+#include <sched.h>
+#include <sync_lock.h>
+#include <rte_hash_crc.h>
+#include "nicmgr.h"
+#include "nic_flow.h"
+
+/*
+ * A flow is in one of two buckets: the one its hash indexes, and the
+ * alternate one its signature gives from there, so that an entry can
+ * be moved to its other bucket without its key being hashed again.
+ */
+struct nic_flow_bucket {
+	u16_t                  sigs[NIC_FLOW_BUCKET_SZ]; /* 0 for a free slot */
+	struct nic_flow_key    keys[NIC_FLOW_BUCKET_SZ];
+	struct client_session *sessions[NIC_FLOW_BUCKET_SZ];
+} CACHE_ALIGNED;
+
+struct nic_flow_tbl {
+	unsigned long          nflows;
+	struct nic_flow_bucket buckets[NIC_FLOW_BUCKETS];
+};
+
+/* The most entries moved to insert one, before the table is deemed full */
+#define NIC_FLOW_MAX_KICKS 64
+/* How long an update waits for the pollers, before it checks again */
+#define NIC_FLOW_SYNC_CYCS 10000
+
+/* The 5-tuple table the pollers use, and the one the next update is made to */
+static struct nic_flow_tbl  flow_tbls[2];
+static struct nic_flow_tbl *flow_tbl       = &flow_tbls[0];
+static struct nic_flow_tbl *flow_tbl_spare = &flow_tbls[1];
+static struct sync_lock     flow_tbl_lock;
+
+/* The sessions of a port: that of each rx queue's core, and the first bound */
+struct nic_flow_port {
+	struct client_session *first;
+	struct client_session *queues[NUM_CPU];
+};
+
+/* The ports' sessions by their port, in network byte order */
+static struct nic_flow_port *port_tbl[1 << 16];
+static struct nic_flow_port  flow_ports[NIC_MAX_SESSION];
+static unsigned long         nflow_ports;
+
+struct nic_flow_reader nic_flow_readers[NUM_CPU];
+
+/* The session of the packets of `port` received on rx queue `q` */
+static inline struct client_session *
+nic_flow_port_session(u16_t port, coreid_t q)
+{
+	struct nic_flow_port  *p = ps_load(&port_tbl[port]);
+	struct client_session *s;
+
+	if (!p) return NULL;
+	s = ps_load(&p->queues[q]);
+
+	return s ? s : ps_load(&p->first);
+}
+
+static inline u32_t
+nic_flow_hash(const struct nic_flow_key *key)
+{
+	return rte_hash_crc(key, sizeof(struct nic_flow_key), 0);
+}
+
+static inline u16_t
+nic_flow_sig(u32_t hash)
+{
+	u16_t sig = hash >> 16;
+
+	return sig ? sig : 1;
+}
+
+static inline u32_t
+nic_flow_bucket(u32_t hash)
+{
+	return hash & (NIC_FLOW_BUCKETS - 1);
+}
+
+/* Each of the two buckets of a flow is the alternate of the other */
+static inline u32_t
+nic_flow_alt_bucket(u32_t b, u16_t sig)
+{
+	return (b ^ ((u32_t)sig * 0x5bd1e995)) & (NIC_FLOW_BUCKETS - 1);
+}
+
+static inline int
+nic_flow_slot_find(struct nic_flow_bucket *bkt, u16_t sig, const struct nic_flow_key *key)
+{
+	int i;
+
+	for (i = 0; i < NIC_FLOW_BUCKET_SZ; i++) {
+		if (bkt->sigs[i] == sig && !memcmp(&bkt->keys[i], key, sizeof(struct nic_flow_key))) return i;
+	}
+
+	return -1;
+}
+
+static inline struct client_session *
+nic_flow_tbl_lookup(struct nic_flow_tbl *tbl, const struct nic_flow_key *key, u32_t hash)
+{
+	u16_t sig = nic_flow_sig(hash);
+	u32_t b   = nic_flow_bucket(hash);
+	int   i;
+
+	i = nic_flow_slot_find(&tbl->buckets[b], sig, key);
+	if (i >= 0) return tbl->buckets[b].sessions[i];
+
+	b = nic_flow_alt_bucket(b, sig);
+	i = nic_flow_slot_find(&tbl->buckets[b], sig, key);
+	if (i >= 0) return tbl->buckets[b].sessions[i];
+
+	return NULL;
+}
+
+/*
+ * Insert a flow that is not in the table, moving the entries in its
+ * way to their alternate buckets. Returns 0 on success, or -ENOSPC if
+ * the table is too full, in which case it has lost an entry.
+ */
+static int
+nic_flow_tbl_insert(struct nic_flow_tbl *tbl, const struct nic_flow_key *key, u32_t hash, struct client_session *session)
+{
+	struct nic_flow_bucket *bkt;
+	struct nic_flow_key     k   = *key, tk;
+	struct client_session  *s   = session, *ts;
+	u16_t                   sig = nic_flow_sig(hash), tsig;
+	u32_t                   bs[2];
+	int                     kick, i, j;
+
+	bs[0] = nic_flow_bucket(hash);
+	for (kick = 0; kick < NIC_FLOW_MAX_KICKS; kick++) {
+		bs[1] = nic_flow_alt_bucket(bs[0], sig);
+
+		for (j = 0; j < 2; j++) {
+			bkt = &tbl->buckets[bs[j]];
+			for (i = 0; i < NIC_FLOW_BUCKET_SZ; i++) {
+				if (bkt->sigs[i] != 0) continue;
+
+				bkt->sigs[i]     = sig;
+				bkt->keys[i]     = k;
+				bkt->sessions[i] = s;
+				tbl->nflows++;
+
+				return 0;
+			}
+		}
+
+		/* Both are full: take the place of an entry of the alternate bucket, and move it */
+		bkt = &tbl->buckets[bs[1]];
+		i   = kick % NIC_FLOW_BUCKET_SZ;
+		tsig = bkt->sigs[i];
+		tk   = bkt->keys[i];
+		ts   = bkt->sessions[i];
+		bkt->sigs[i]     = sig;
+		bkt->keys[i]     = k;
+		bkt->sessions[i] = s;
+		sig   = tsig;
+		k     = tk;
+		s     = ts;
+		bs[0] = bs[1];
+	}
+
+	return -ENOSPC;
+}
+
+static int
+nic_flow_tbl_del(struct nic_flow_tbl *tbl, const struct nic_flow_key *key, u32_t hash)
+{
+	u16_t sig = nic_flow_sig(hash);
+	u32_t b   = nic_flow_bucket(hash);
+	int   i, j;
+
+	for (j = 0; j < 2; j++, b = nic_flow_alt_bucket(b, sig)) {
+		i = nic_flow_slot_find(&tbl->buckets[b], sig, key);
+		if (i < 0) continue;
+
+		tbl->buckets[b].sigs[i]     = 0;
+		tbl->buckets[b].sessions[i] = NULL;
+		tbl->nflows--;
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+/* Wait until the pollers have passed a quiescent point */
+static void
+nic_flow_synchronize(void)
+{
+	unsigned long snap[NUM_CPU];
+	int i;
+
+	for (i = 0; i < NUM_CPU; i++) {
+		/* A poller that comes online later sees the new table */
+		snap[i] = ps_load(&nic_flow_readers[i].online) ? ps_load(&nic_flow_readers[i].quiesced) : 0;
+	}
+	for (i = 0; i < NUM_CPU; i++) {
+		if (!ps_load(&nic_flow_readers[i].online)) continue;
+		/* Updates are made by clients' threads, that can share the core of the poller */
+		while (ps_load(&nic_flow_readers[i].quiesced) == snap[i]) {
+			sched_thd_block_timeout(0, ps_tsc() + NIC_FLOW_SYNC_CYCS);
+		}
+	}
+}
+
+/* Make the updated spare table the pollers', once they no longer use the current one */
+static void
+nic_flow_publish(void)
+{
+	struct nic_flow_tbl *old = flow_tbl;
+
+	ps_store(&flow_tbl, flow_tbl_spare);
+	ps_mem_fence();
+	nic_flow_synchronize();
+	flow_tbl_spare = old;
+}
+
+void
+nic_flow_init(void)
+{
+	sync_lock_init(&flow_tbl_lock);
+}
+
+/* Bind `port` to `session` on the core of its rx queue */
+void
+nic_flow_port_add(u16_t port, struct client_session *session)
+{
+	struct nic_flow_port *p;
+
+	sync_lock_take(&flow_tbl_lock);
+	p = port_tbl[port];
+	if (!p) {
+		assert(nflow_ports < NIC_MAX_SESSION);
+		p        = &flow_ports[nflow_ports++];
+		p->first = session;
+	}
+	ps_store(&p->queues[session->rx_queue], session);
+	ps_store(&port_tbl[port], p);
+	sync_lock_release(&flow_tbl_lock);
+}
+
+/* The first session bound to `port`, NULL if there is none */
+struct client_session *
+nic_flow_port_lookup(u16_t port)
+{
+	struct nic_flow_port *p = ps_load(&port_tbl[port]);
+
+	return p ? ps_load(&p->first) : NULL;
+}
+
+/*
+ * Steer the flow `key` to `session`, ahead of the port table. Returns
+ * 0 on success, or -ENOSPC if the table is full.
+ */
+int
+nic_flow_add(struct nic_flow_key *key, struct client_session *session)
+{
+	u32_t hash = nic_flow_hash(key);
+	u16_t sig  = nic_flow_sig(hash);
+	u32_t b;
+	int   i, ret = 0;
+
+	sync_lock_take(&flow_tbl_lock);
+	memcpy(flow_tbl_spare, flow_tbl, sizeof(struct nic_flow_tbl));
+
+	b = nic_flow_bucket(hash);
+	i = nic_flow_slot_find(&flow_tbl_spare->buckets[b], sig, key);
+	if (i < 0) {
+		b = nic_flow_alt_bucket(b, sig);
+		i = nic_flow_slot_find(&flow_tbl_spare->buckets[b], sig, key);
+	}
+	if (i >= 0) flow_tbl_spare->buckets[b].sessions[i] = session;
+	else        ret = nic_flow_tbl_insert(flow_tbl_spare, key, hash, session);
+
+	if (!ret) nic_flow_publish();
+	sync_lock_release(&flow_tbl_lock);
+
+	return ret;
+}
+
+int
+nic_flow_del(struct nic_flow_key *key)
+{
+	int ret;
+
+	sync_lock_take(&flow_tbl_lock);
+	memcpy(flow_tbl_spare, flow_tbl, sizeof(struct nic_flow_tbl));
+
+	ret = nic_flow_tbl_del(flow_tbl_spare, key, nic_flow_hash(key));
+	if (!ret) nic_flow_publish();
+	sync_lock_release(&flow_tbl_lock);
+
+	return ret;
+}
+
+/* The poller of core `cid` is about to look up packets */
+void
+nic_flow_reader_online(coreid_t cid)
+{
+	ps_store(&nic_flow_readers[cid].online, 1);
+	ps_mem_fence();
+}
+
+/*
+ * Find the sessions of the `n` (up to NIC_FLOW_BURST) flows `keys`,
+ * received by the poller of core `cid`, or NULL for the flows of no
+ * session. The buckets of the whole burst are prefetched before any of
+ * them is searched.
+ */
+void
+nic_flow_lookup_burst(coreid_t cid, struct nic_flow_key *keys, int n, struct client_session **sessions)
+{
+	struct nic_flow_tbl *tbl = ps_load(&flow_tbl);
+	u32_t hashes[NIC_FLOW_BURST];
+	int   i;
+
+	assert(n <= NIC_FLOW_BURST);
+
+	/* Only the port table is used without flows */
+	if (tbl->nflows == 0) {
+		for (i = 0; i < n; i++) __builtin_prefetch(&port_tbl[keys[i].local_port]);
+		for (i = 0; i < n; i++) sessions[i] = nic_flow_port_session(keys[i].local_port, cid);
+
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct nic_flow_bucket *bkt;
+
+		hashes[i] = nic_flow_hash(&keys[i]);
+		bkt       = &tbl->buckets[nic_flow_bucket(hashes[i])];
+		__builtin_prefetch(bkt);
+		__builtin_prefetch((char *)bkt + CACHE_LINE);
+		__builtin_prefetch(&port_tbl[keys[i].local_port]);
+	}
+	for (i = 0; i < n; i++) {
+		sessions[i] = nic_flow_tbl_lookup(tbl, &keys[i], hashes[i]);
+		if (!sessions[i]) sessions[i] = nic_flow_port_session(keys[i].local_port, cid);
+	}
+}
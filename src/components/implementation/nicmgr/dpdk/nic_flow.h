@@ -0,0 +1,93 @@
+#ifndef NIC_FLOW_H
+#define NIC_FLOW_H
+
+#include <cos_types.h>
+#include <cos_component.h>
+#include <arpa/inet.h>
+#include <net_stack_types.h>
+#include <ps.h>
+
+/***
+ * The flow classifier, that finds the client session of each received
+ * packet. The flows sessions bind (e.g. TCP connections) are found by
+ * their 5-tuple in a cuckoo hash table, and the other packets by their
+ * destination port in a table indexed by it: the fast path for UDP.
+ *
+ * A port can be bound by a session on each core: RSS spreads the flows
+ * over the cores' rx queues, and the poller of a queue gives the
+ * packets of a port to the session bound on its core, or else to the
+ * first one bound.
+ *
+ * The pollers look up bursts of packets without locks. A 5-tuple table
+ * update is made to a copy of the table that then replaces it, and the
+ * old table is reused only once all of the pollers have passed a
+ * quiescent point (nic_flow_quiesce) since. The port table is updated
+ * in place, a pointer at a time.
+ */
+
+struct client_session;
+
+/* In network byte order, and two words long, without padding */
+struct nic_flow_key {
+	u32_t remote_ip;
+	u32_t local_ip;
+	u16_t remote_port;
+	u16_t local_port;
+	u32_t proto;
+};
+
+#define NIC_FLOW_BUCKET_SZ 4
+/* The 5-tuple table holds up to NIC_FLOW_BUCKETS * NIC_FLOW_BUCKET_SZ flows */
+#ifndef NIC_FLOW_BUCKETS
+#define NIC_FLOW_BUCKETS   1024 /* a power of 2 */
+#endif
+/* The most packets looked up at once */
+#define NIC_FLOW_BURST     32
+
+struct nic_flow_reader {
+	unsigned long online;
+	unsigned long quiesced;
+} CACHE_ALIGNED;
+
+extern struct nic_flow_reader nic_flow_readers[NUM_CPU];
+
+void nic_flow_init(void);
+void nic_flow_port_add(u16_t port, struct client_session *session);
+struct client_session *nic_flow_port_lookup(u16_t port);
+int  nic_flow_add(struct nic_flow_key *key, struct client_session *session);
+int  nic_flow_del(struct nic_flow_key *key);
+
+void nic_flow_reader_online(coreid_t cid);
+void nic_flow_lookup_burst(coreid_t cid, struct nic_flow_key *keys, int n, struct client_session **sessions);
+
+/* The poller of core `cid` no longer uses the tables it looked up in */
+static inline void
+nic_flow_quiesce(coreid_t cid)
+{
+	ps_store(&nic_flow_readers[cid].quiesced, nic_flow_readers[cid].quiesced + 1);
+}
+
+/* The key of an IPv4 UDP or TCP packet. Returns 0 on success, !0 for the other packets */
+static inline int
+nic_flow_key_get(char *pkt, int len, struct nic_flow_key *key)
+{
+	struct eth_hdr      *eth = (struct eth_hdr *)pkt;
+	struct ip_hdr       *iph = (struct ip_hdr *)(pkt + ETH_STD_LEN);
+	struct tcp_udp_port *port;
+
+	if (unlikely(len < (int)(ETH_STD_LEN + IP_STD_LEN + sizeof(struct tcp_udp_port)))) return -1;
+	if (unlikely(eth->ether_type != htons(0x0800))) return -1;
+	if (unlikely(iph->proto != UDP_PROTO && iph->proto != TCP_PROTO)) return -1;
+
+	port = (struct tcp_udp_port *)((char *)iph + iph->ihl * 4);
+
+	key->remote_ip   = iph->src_addr;
+	key->local_ip    = iph->dst_addr;
+	key->remote_port = port->src_port;
+	key->local_port  = port->dst_port;
+	key->proto       = iph->proto;
+
+	return 0;
+}
+
+#endif /* NIC_FLOW_H */
@@ -12,6 +12,7 @@
 #include <sync_lock.h>
 #include <arpa/inet.h>
 #include "nicmgr.h"
+#include "nic_flow.h"
 
 extern volatile int debug_flag;
 
@@ -32,14 +33,23 @@ struct pkt_ring_buf g_free_ring;
 rte_atomic64_t tx_enqueued_miss = {0};
 
 static char ring_buffers[NIC_MAX_SESSION][RX_PKT_RING_SZ];
-void
-pkt_ring_buf_init(struct pkt_ring_buf *pkt_ring_buf, size_t ringbuf_num, size_t ringbuf_sz)
-{
-	struct ck_ring *buf_addr;
+static char tx_ring_buffers[NIC_MAX_SESSION][TX_PKT_RING_SZ];
 
-	/* prevent multiple thread from contending memory */
-	assert(cos_thdid() < NIC_MAX_SESSION);
-	buf_addr = (struct ck_ring *)&ring_buffers[cos_thdid()];
+/*
+ * The sessions whose packets each core transmits, in nic_tx_process.
+ * Entries are only added, and can be NULL until they are set.
+ */
+struct nic_tx_core {
+	unsigned long          nsessions;
+	struct client_session *sessions[NIC_MAX_SESSION];
+} CACHE_ALIGNED;
+
+static struct nic_tx_core tx_cores[NUM_CPU];
+
+static void
+__pkt_ring_buf_init(struct pkt_ring_buf *pkt_ring_buf, size_t ringbuf_num, void *mem)
+{
+	struct ck_ring *buf_addr = mem;
 
 	ck_ring_init(buf_addr, ringbuf_num);
 
@@ -47,6 +57,14 @@ pkt_ring_buf_init(struct pkt_ring_buf *pkt_ring_buf, size_t ringbuf_num, size_t
 	pkt_ring_buf->ringbuf = (struct pkt_buf *)((char *)buf_addr + sizeof(struct ck_ring));
 }
 
+void
+pkt_ring_buf_init(struct pkt_ring_buf *pkt_ring_buf, size_t ringbuf_num, size_t ringbuf_sz)
+{
+	/* prevent multiple thread from contending memory */
+	assert(cos_thdid() < NIC_MAX_SESSION);
+	__pkt_ring_buf_init(pkt_ring_buf, ringbuf_num, &ring_buffers[cos_thdid()]);
+}
+
 inline int
 pkt_ring_buf_enqueue(struct pkt_ring_buf *pkt_ring_buf, struct pkt_buf *buf)
 {
@@ -55,6 +73,14 @@ pkt_ring_buf_enqueue(struct pkt_ring_buf *pkt_ring_buf, struct pkt_buf *buf)
 	return CK_RING_ENQUEUE_SPSC(pkt_ring_buf, pkt_ring_buf->ring, pkt_ring_buf->ringbuf, buf);
 }
 
+inline int
+pkt_ring_buf_enqueue_mp(struct pkt_ring_buf *pkt_ring_buf, struct pkt_buf *buf)
+{
+	assert(pkt_ring_buf->ring && pkt_ring_buf->ringbuf);
+
+	return CK_RING_ENQUEUE_MPSC(pkt_ring_buf, pkt_ring_buf->ring, pkt_ring_buf->ringbuf, buf);
+}
+
 inline int
 pkt_ring_buf_dequeue(struct pkt_ring_buf *pkt_ring_buf, struct pkt_buf *buf)
 {
@@ -71,15 +97,57 @@ pkt_ring_buf_empty(struct pkt_ring_buf *pkt_ring_buf)
 	return (!ck_ring_size(pkt_ring_buf->ring));
 }
 
+/*
+ * Get the next packet in the session's ring into a shmem object: the
+ * object the packet was received into for zero-copy rx, or a new one
+ * it is copied into. The caller has taken the semaphore count for it.
+ * Returns NULL, dropping the packet, if there are no free objects.
+ */
+static inline struct netshmem_pkt_buf *
+nic_rx_packet(struct client_session *session, shm_bm_objid_t *objid, u16_t *pkt_offset, u16_t *pkt_len)
+{
+	struct pkt_buf           buf;
+	struct netshmem_pkt_buf *obj;
+	char *pkt;
+	int   len;
+
+	assert(!pkt_ring_buf_empty(&session->pkt_ring_buf));
+
+	while (!pkt_ring_buf_dequeue(&session->pkt_ring_buf, &buf)) ;
+	assert(buf.pkt);
+
+	pkt = cos_get_packet(buf.pkt, &len);
+	assert(len < PKT_BUF_SIZE);
+
+	if (buf.obj) {
+		obj         = (struct netshmem_pkt_buf *)buf.obj;
+		*objid      = shm_bm_get_objid_net_pkt_buf(obj);
+		*pkt_offset = pkt - obj->data;
+	} else {
+		obj = shm_bm_alloc_net_pkt_buf(session->shemem_info.shm, objid);
+		if (likely(obj)) memcpy(obj->data, pkt, len);
+		*pkt_offset = 0;
+	}
+
+#if USE_CK_RING_FREE_MBUF
+	while (!pkt_ring_buf_enqueue(&g_free_ring, &buf));
+#else
+	/* The mbuf's external buffer, if any, is now the client's object */
+	cos_free_packet(buf.pkt);
+#endif
+	*pkt_len = len;
+
+	return obj;
+}
+
 shm_bm_objid_t
 nic_get_a_packet(u16_t *pkt_len)
 {
 	thdid_t                    thd;	
-	struct pkt_buf             buf;
 	shm_bm_objid_t             objid;
 	struct client_session     *session;
 	struct netshmem_pkt_buf   *obj;
-	int len;
+	u16_t pkt_offset;
 
 	thd = cos_thdid();
 	assert(thd < NIC_MAX_SESSION);
@@ -94,28 +162,105 @@ nic_get_a_packet(u16_t *pkt_len)
 	sync_sem_take(&session->sem);
 	session->blocked_loops_end++;
 
-	assert(!pkt_ring_buf_empty(&session->pkt_ring_buf));
+	obj = nic_rx_packet(session, &objid, &pkt_offset, pkt_len);
+	assert(obj);
 
-	while (!pkt_ring_buf_dequeue(&session->pkt_ring_buf, &buf))
-	assert(buf.pkt);
+	/* This interface has the packet at the start of the object */
+	if (pkt_offset != 0) memmove(obj->data, obj->data + pkt_offset, *pkt_len);
 
-	char *pkt = cos_get_packet(buf.pkt, &len);
-	assert(len < PKT_BUF_SIZE);
+	return objid;
+}
 
-	obj = shm_bm_alloc_net_pkt_buf(session->shemem_info.shm, &objid);
-	assert(obj);
+/*
+ * A thread waiting with a timeout does not block on the semaphore,
+ * which has no timed wait, but in the scheduler: it is woken
+ * explicitly, once.
+ */
+void
+nic_session_give(struct client_session *session)
+{
+	sync_sem_give(&session->sem);
+	if (unlikely(ps_load(&session->timed_wait)) && ps_cas(&session->timed_wait, 1, 0)) sched_thd_wakeup(session->thd);
+}
 
-	memcpy(obj->data, pkt, len);
+/*
+ * Take a count of the session's semaphore, blocking until there is
+ * one, or until abs_timeout if it isn't 0. Returns 0 once taken, and 1
+ * on timeout.
+ */
+static int
+nic_session_take(struct client_session *session, cycles_t abs_timeout)
+{
+	if (!abs_timeout) {
+		sync_sem_take(&session->sem);
+		return 0;
+	}
 
-#if USE_CK_RING_FREE_MBUF
-	while (!pkt_ring_buf_enqueue(&g_free_ring, &buf));
-#else
-	cos_free_packet(buf.pkt);
-#endif
+	while (1) {
+		/* Set before checking the semaphore, so that a packet queued after the check wakes us */
+		ps_store(&session->timed_wait, 1);
+		if (!sync_sem_try_take(&session->sem)) break;
+		/* An early, or stale, wakeup only makes us check again */
+		if (sched_thd_block_timeout(0, abs_timeout)) {
+			ps_store(&session->timed_wait, 0);
+			return 1;
+		}
+	}
+	ps_store(&session->timed_wait, 0);
 
-	*pkt_len = len;
+	return 0;
+}
 
-	return objid;
+static int
+nic_get_packets_burst(shm_bm_objid_t descid, u16_t max, cycles_t abs_timeout)
+{
+	thdid_t                  thd;
+	struct client_session   *session;
+	struct netshmem_pkt_buf *desc_buf;
+	struct nic_pkt_desc     *descs;
+	int n = 0;
+
+	thd = cos_thdid();
+	assert(thd < NIC_MAX_SESSION);
+
+	session = &client_sessions[thd];
+	if (max > NIC_PKT_BURST_MAX) max = NIC_PKT_BURST_MAX;
+	if (unlikely(max == 0)) return 0;
+
+	desc_buf = shm_bm_borrow_net_pkt_buf(session->shemem_info.shm, descid);
+	if (unlikely(!desc_buf)) return -EINVAL;
+	descs = (struct nic_pkt_desc *)desc_buf->data;
+
+	/* Only block if there are no packets at all */
+	session->blocked_loops_begin++;
+	if (nic_session_take(session, abs_timeout)) {
+		session->blocked_loops_end++;
+		return 0;
+	}
+	session->blocked_loops_end++;
+
+	do {
+		struct nic_pkt_desc *d = &descs[n];
+
+		if (likely(nic_rx_packet(session, &d->objid, &d->pkt_offset, &d->pkt_len) != NULL)) n++;
+	} while (n < max && !sync_sem_try_take(&session->sem));
+
+	return n;
+}
+
+int
+nic_get_packets(shm_bm_objid_t descid, u16_t max)
+{
+	return nic_get_packets_burst(descid, max, 0);
+}
+
+int
+nic_get_packets_timeout(shm_bm_objid_t descid, u16_t max, cycles_t abs_timeout)
+{
+	/* 0 is no timeout for nic_session_take */
+	if (unlikely(!abs_timeout)) abs_timeout = 1;
+
+	return nic_get_packets_burst(descid, max, abs_timeout);
 }
 
 static void
@@ -130,57 +275,139 @@ ext_buf_free_callback_fn(void *addr, void *opaque)
 	}
 }
 
-extern struct sync_lock tx_lock[NUM_CPU];
+extern struct sync_lock tx_lock[NIC_TX_QUEUE_NUM];
 
-int
-nic_send_packet(shm_bm_objid_t pktid, u16_t pkt_offset, u16_t pkt_len)
+/*
+ * Queue the packet in the client's shmem object on the session's tx
+ * ring. Only the session's thread enqueues, and only the core
+ * polling the session's rx queue dequeues (see nic_tx_process), thus
+ * the ring is lock-free.
+ */
+static inline int
+nic_tx_enqueue(struct client_session *session, shm_bm_objid_t objid, u16_t pkt_offset, u16_t pkt_len)
 {
-	thdid_t                  thd;
-	shm_bm_objid_t           objid;
 	struct pkt_buf           buf;
 	struct netshmem_pkt_buf *obj;
 
-	thd   = cos_thdid();
-	objid = pktid;
-
-	obj = (struct netshmem_pkt_buf *)shm_bm_borrow_net_pkt_buf(client_sessions[thd].shemem_info.shm, objid);
-
-	buf.obj = (char *)obj;
-	buf.pkt = pkt_offset + obj->data;
+	obj = (struct netshmem_pkt_buf *)shm_bm_borrow_net_pkt_buf(session->shemem_info.shm, objid);
+	if (unlikely(!obj)) return -EINVAL;
 
-	u64_t data_paddr = client_sessions[thd].shemem_info.paddr 
-		+ (u64_t)buf.obj - (u64_t)client_sessions[thd].shemem_info.shm;
-	
-	buf.paddr   = data_paddr;
+	buf.obj     = (char *)obj;
+	buf.pkt     = pkt_offset + obj->data;
+	buf.paddr   = session->shemem_info.paddr + (u64_t)buf.obj - (u64_t)session->shemem_info.shm;
 	buf.pkt_len = pkt_len;
-#if 0
-	if (!pkt_ring_buf_enqueue(&client_sessions[thd].pkt_tx_ring, &buf)) {
+
+	if (unlikely(!pkt_ring_buf_enqueue(&session->pkt_tx_ring, &buf))) {
 		/* tx queue is full, drop the packet */
 		rte_atomic64_add(&tx_enqueued_miss, 1);
 		shm_bm_free_net_pkt_buf(obj);
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+int
+nic_send_packet(shm_bm_objid_t pktid, u16_t pkt_offset, u16_t pkt_len)
+{
+	thdid_t thd = cos_thdid();
+
+	assert(thd < NIC_MAX_SESSION && client_sessions[thd].tx_init_done);
+
+	return nic_tx_enqueue(&client_sessions[thd], pktid, pkt_offset, pkt_len);
+}
+
+int
+nic_send_packets(shm_bm_objid_t descid, u16_t n)
+{
+	thdid_t                  thd = cos_thdid();
+	struct client_session   *session;
+	struct netshmem_pkt_buf *desc_buf;
+	struct nic_pkt_desc     *descs;
+	int i, sent = 0;
+
+	assert(thd < NIC_MAX_SESSION && client_sessions[thd].tx_init_done);
+	session = &client_sessions[thd];
+	if (n > NIC_PKT_BURST_MAX) n = NIC_PKT_BURST_MAX;
+
+	desc_buf = shm_bm_borrow_net_pkt_buf(session->shemem_info.shm, descid);
+	if (unlikely(!desc_buf)) return -EINVAL;
+	descs = (struct nic_pkt_desc *)desc_buf->data;
+
+	for (i = 0; i < n; i++) {
+		if (likely(!nic_tx_enqueue(session, descs[i].objid, descs[i].pkt_offset, descs[i].pkt_len))) sent++;
+	}
+
+	return sent;
+}
+
+static void
+nic_tx_burst(u16_t txq, int shared, char **tx_packets, u16_t n)
+{
+	u16_t sent, i;
+
+	if (shared) sync_lock_take(&tx_lock[txq]);
+	sent = cos_dev_port_tx_burst(0, txq, tx_packets, n);
+	if (shared) sync_lock_release(&tx_lock[txq]);
+
+	/* The tx queue is full: drop the rest, their objects are freed with the mbufs */
+	for (i = sent; i < n; i++) {
+		cos_free_packet(tx_packets[i]);
+		rte_atomic64_add(&tx_enqueued_miss, 1);
 	}
-#else 
+}
+
+/*
+ * Transmit, in bursts on tx queue `txq`, the packets queued by the
+ * sessions whose rx queue is polled by core `cid`. The tx queue is
+ * only locked if it is `shared` with other cores.
+ */
+void
+nic_tx_process(coreid_t cid, u16_t txq, int shared)
+{
+	struct nic_tx_core    *core = &tx_cores[cid];
+	struct client_session *session;
+	struct pkt_buf         buf;
+	char *tx_packets[NIC_TX_BURST];
 	char *mbuf;
-	void *ext_shinfo;
-	char *tx_packets[256];
+	unsigned long i, nsessions;
+	u16_t n = 0;
+
+	nsessions = ps_load(&core->nsessions);
+	for (i = 0; i < nsessions; i++) {
+		session = ps_load(&core->sessions[i]);
+		if (!session) continue;
+
+		while (pkt_ring_buf_dequeue(&session->pkt_tx_ring, &buf)) {
+			mbuf = cos_allocate_mbuf(g_tx_mp[txq]);
+			if (unlikely(!mbuf)) {
+				rte_atomic64_add(&tx_enqueued_miss, 1);
+				shm_bm_free_net_pkt_buf(buf.obj);
+				continue;
+			}
+			cos_attach_external_mbuf(mbuf, buf.obj, buf.paddr, PKT_BUF_SIZE, ext_buf_free_callback_fn,
+						 netshmem_get_tailroom((struct netshmem_pkt_buf *)buf.obj));
+			cos_set_external_packet(mbuf, (buf.pkt - buf.obj), buf.pkt_len, 1);
+			tx_packets[n++] = mbuf;
+
+			if (n == NIC_TX_BURST) {
+				nic_tx_burst(txq, shared, tx_packets, n);
+				n = 0;
+			}
+		}
+	}
+	if (n > 0) nic_tx_burst(txq, shared, tx_packets, n);
+}
 
-	coreid_t core_id = cos_cpuid();
-#if E810_NIC == 0
-	core_id = 1;
-#endif
-	mbuf = cos_allocate_mbuf(g_tx_mp[core_id - 1]);
-	assert(mbuf);
-	ext_shinfo = netshmem_get_tailroom((struct netshmem_pkt_buf *)buf.obj);
-	cos_attach_external_mbuf(mbuf, buf.obj, buf.paddr, PKT_BUF_SIZE, ext_buf_free_callback_fn, ext_shinfo);
-	cos_set_external_packet(mbuf, (buf.pkt - buf.obj), buf.pkt_len, 1);
-	tx_packets[0] = mbuf;
-
-	sync_lock_take(&tx_lock[core_id - 1]);
-	cos_dev_port_tx_burst(0, core_id - 1, tx_packets, 1);
-	sync_lock_release(&tx_lock[core_id - 1]);
-#endif
+/* The session's packets are transmitted by the core polling its rx queue */
+static void
+nic_tx_bind(struct client_session *session)
+{
+	struct nic_tx_core *core = &tx_cores[session->rx_queue];
+	unsigned long idx = ps_faa(&core->nsessions, 1);
 
-	return 0;
+	assert(idx < NIC_MAX_SESSION);
+	ps_store(&core->sessions[idx], session);
 }
 
 void
@@ -216,20 +443,58 @@ nic_bind_port(u32_t ip_addr, u16_t port)
 	client_sessions[thd].shemem_info.shmid = shmid;
 	client_sessions[thd].shemem_info.shm   = shm;
 	client_sessions[thd].shemem_info.paddr = paddr;
-	cos_hash_add(client_sessions[thd].port, &client_sessions[thd]);
 
 	sync_sem_init(&client_sessions[thd].sem, 0);
 
 	pkt_ring_buf_init(&client_sessions[thd].pkt_ring_buf, RX_PKT_RBUF_NUM, RX_PKT_RING_SZ);
-	// pkt_ring_buf_init(&client_sessions[thd].pkt_tx_ring, TX_PKT_RBUF_NUM, TX_PKT_RING_SZ);
+	__pkt_ring_buf_init(&client_sessions[thd].pkt_tx_ring, TX_PKT_RBUF_NUM, &tx_ring_buffers[thd]);
 
 	client_sessions[thd].blocked_loops_begin = 0;
 	client_sessions[thd].blocked_loops_end = 0;
 	client_sessions[thd].tx_init_done = 1;
 
+	/* The pollers can find the session once its rings are initialized, and its core is known */
+	nic_rx_bind(&client_sessions[thd]);
+	nic_flow_port_add(client_sessions[thd].port, &client_sessions[thd]);
+	nic_tx_bind(&client_sessions[thd]);
+
 	return 0;
 }
 
+static void
+nic_flow_key_set(struct nic_flow_key *key, struct client_session *session, u32_t remote_ip, u16_t remote_port, u16_t proto)
+{
+	key->remote_ip   = remote_ip;
+	key->local_ip    = session->ip_addr;
+	key->remote_port = remote_port;
+	key->local_port  = session->port;
+	key->proto       = proto;
+}
+
+int
+nic_bind_flow(u32_t remote_ip, u16_t remote_port, u16_t proto)
+{
+	struct nic_flow_key key;
+	thdid_t thd = cos_thdid();
+
+	assert(thd < NIC_MAX_SESSION && client_sessions[thd].tx_init_done);
+	nic_flow_key_set(&key, &client_sessions[thd], remote_ip, remote_port, proto);
+
+	return nic_flow_add(&key, &client_sessions[thd]);
+}
+
+int
+nic_unbind_flow(u32_t remote_ip, u16_t remote_port, u16_t proto)
+{
+	struct nic_flow_key key;
+	thdid_t thd = cos_thdid();
+
+	assert(thd < NIC_MAX_SESSION && client_sessions[thd].tx_init_done);
+	nic_flow_key_set(&key, &client_sessions[thd], remote_ip, remote_port, proto);
+
+	return nic_flow_del(&key);
+}
+
 u64_t
 nic_get_port_mac_address(u16_t port)
 {
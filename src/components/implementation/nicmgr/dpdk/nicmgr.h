@@ -49,6 +49,13 @@ struct client_session {
 
 	int tx_init_done;
 	struct sync_sem sem;
+	/* set while the session's thread waits for packets with a timeout, see nic_session_give */
+	unsigned long timed_wait;
+
+	/* the shared rx queue of the session's core, and the core polling it */
+	int rx_queue;
+	/* the zero-copy rx queue the session's packets are steered to, or -1 */
+	int rx_zc_queue;
 
 	/* number of blocked loops of the tenant, this is counted each time when the thread is blocked */
 	int blocked_loops_begin;
@@ -66,7 +73,7 @@ extern struct client_session client_sessions[NIC_MAX_SESSION];
 #define RX_PKT_RING_SZ   (sizeof(struct ck_ring) + RX_PKT_RBUF_SZ)
 #define RX_PKT_RING_PAGES (round_up_to_page(RX_PKT_RING_SZ)/PAGE_SIZE)
 
-#define TX_PKT_RBUF_NUM 4096
+#define TX_PKT_RBUF_NUM 512
 #define TX_PKT_RBUF_SZ (TX_PKT_RBUF_NUM * sizeof(struct pkt_buf))
 #define TX_PKT_RING_SZ   (sizeof(struct ck_ring) + TX_PKT_RBUF_SZ)
 #define TX_PKT_RING_PAGES (round_up_to_page(TX_PKT_RING_SZ)/PAGE_SIZE)
@@ -79,11 +86,36 @@ extern struct client_session client_sessions[NIC_MAX_SESSION];
 void pkt_ring_buf_init(struct pkt_ring_buf *pkt_ring_buf, size_t ringbuf_num, size_t ringbuf_sz);
 
 int pkt_ring_buf_enqueue(struct pkt_ring_buf *pkt_ring_buf, struct pkt_buf *buf);
+int pkt_ring_buf_enqueue_mp(struct pkt_ring_buf *pkt_ring_buf, struct pkt_buf *buf);
 int pkt_ring_buf_dequeue(struct pkt_ring_buf *pkt_ring_buf, struct pkt_buf *buf);
 int pkt_ring_buf_empty(struct pkt_ring_buf *pkt_ring_buf);
 
-void cos_hash_add(uint16_t tenant_id, struct client_session *session);
-struct client_session *cos_hash_lookup(uint16_t tenant_id);
+/*
+ * Zero-copy rx: a session can be given its own rx queue, that the
+ * session's packets are steered to, and that receives directly into
+ * the session's shmem objects. The packets received into shmem
+ * objects have `pkt_buf.obj` set.
+ */
+#ifndef NIC_RX_ZC_QUEUE_NUM
+#define NIC_RX_ZC_QUEUE_NUM 4
+#endif
+#define NIC_RX_ZC_DESC 64
+
+/*
+ * Each core (up to the number of queues the ports support) polls a
+ * rx queue, and RSS spreads the packets over them. A session's packets
+ * are steered to the queue of its thread's core, or its zero-copy
+ * queue, polled by the same core. As RSS can still spread them if the
+ * port cannot steer them, sessions' rings have multiple producers.
+ */
+void nic_rx_bind(struct client_session *session);
+
+/* A packet was queued for the session: wake its thread */
+void nic_session_give(struct client_session *session);
+
+#define NIC_TX_BURST 32
+
+void nic_tx_process(coreid_t cid, u16_t txq, int shared);
 
 #define USE_CK_RING_FREE_MBUF 0
 #endif /* NICMGR_H */
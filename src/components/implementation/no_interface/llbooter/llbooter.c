@@ -13,6 +13,7 @@
 #include <cos_kernel_api.h>
 #include <cos_defkernel_api.h>
 #include <crt.h>
+#include <crt_timeline.h>
 #include <static_slab.h>
 #include <protdom.h>
 
@@ -51,6 +52,8 @@
  */
 
 static struct crt_comp boot_comps[MAX_NUM_COMPS];
+/* Where the boot timeline is aliased in each capmgr */
+static vaddr_t         boot_timeline_addrs[MAX_NUM_COMPS];
 static const  compid_t sched_root_id  = 2;
 static        long     boot_id_offset = -1;
 
@@ -94,6 +97,143 @@ boot_comp_set_idoffset(int off)
 	boot_id_offset = off;
 }
 
+/*
+ * The components are created in parallel by all cores, from a queue
+ * of work planned by the init core (see `comps_init`). Each work item
+ * creates either a single component in its own address space, or a
+ * shared VAS and all of its components (which must be created in
+ * order). An item can depend on a previous one, in which case it
+ * awaits its completion.
+ */
+typedef enum {
+	BOOT_WORK_VAS,
+	BOOT_WORK_COMP,
+} boot_work_t;
+
+struct boot_work {
+	boot_work_t     type;
+	int             dep;  /* index of the work to await, or -1 */
+	struct initargs args; /* BOOT_WORK_VAS: the VAS's arguments */
+	compid_t        id;   /* BOOT_WORK_COMP: the component, and its protection domain */
+	prot_domain_t   pd;
+	unsigned long   done;
+};
+
+static struct boot_work        boot_work[MAX_NUM_COMPS + BOOTER_MAX_NS_VAS];
+static unsigned long           boot_work_n, boot_work_next;
+static struct protdom_ns_asid *boot_ns_asid;
+static coreid_t                boot_init_core;
+static struct simple_barrier   boot_created_barrier, boot_resources_barrier;
+
+/* Where the boot time goes, reported once all components are created */
+typedef enum {
+	BOOT_PHASE_PLAN,
+	BOOT_PHASE_CREATE,
+	BOOT_PHASE_DELEGATE,
+	BOOT_PHASE_SINV,
+	BOOT_PHASE_CAPMGR_MEM,
+	BOOT_PHASE_EXEC,
+	BOOT_PHASE_MAX
+} boot_phase_t;
+
+static const char *boot_phase_names[BOOT_PHASE_MAX] = {
+	[BOOT_PHASE_PLAN]       = "namespaces & planning",
+	[BOOT_PHASE_CREATE]     = "component creation",
+	[BOOT_PHASE_DELEGATE]   = "captbl delegations",
+	[BOOT_PHASE_SINV]       = "synchronous invocations",
+	[BOOT_PHASE_CAPMGR_MEM] = "capmgr memory",
+	[BOOT_PHASE_EXEC]       = "execution (init core)",
+};
+static cycles_t boot_phase_cycles[BOOT_PHASE_MAX];
+static int      boot_cycs_per_usec;
+
+struct boot_core_stats {
+	cycles_t      busy;
+	unsigned long nwork;
+} CACHE_ALIGNED;
+static struct boot_core_stats boot_core_stats[NUM_CPU];
+
+/* Account the phase that began at `start`, and return the current time */
+static cycles_t
+boot_phase_end(boot_phase_t phase, cycles_t start)
+{
+	cycles_t now = ps_tsc();
+
+	boot_phase_cycles[phase] += now - start;
+	crt_timeline_mark(start, "booter: %s", boot_phase_names[phase]);
+
+	return now;
+}
+
+static void
+boot_report(int ncores)
+{
+	int i;
+
+	printc("Boot time breakdown (usec):\n");
+	for (i = 0 ; i < BOOT_PHASE_MAX ; i++) {
+		printc("\t%s: %llu\n", boot_phase_names[i], (unsigned long long)(boot_phase_cycles[i] / boot_cycs_per_usec));
+	}
+	for (i = 0 ; i < ncores ; i++) {
+		printc("\tcore %d: %lu creation work items, %llu busy\n", i, boot_core_stats[i].nwork,
+		       (unsigned long long)(boot_core_stats[i].busy / boot_cycs_per_usec));
+	}
+}
+
+static struct boot_work *
+boot_work_add(boot_work_t type, int dep)
+{
+	struct boot_work *w;
+
+	assert(boot_work_n < sizeof(boot_work) / sizeof(boot_work[0]));
+	w  = &boot_work[boot_work_n++];
+	*w = (struct boot_work) {
+		.type = type,
+		.dep  = dep,
+	};
+
+	return w;
+}
+
+/*
+ * Return the name of component `id`, and if non-NULL, set the
+ * `elf_hdr` of its object, and the address of its `info`.
+ */
+static char *
+boot_comp_args(compid_t id, void **elf_hdr, vaddr_t *info)
+{
+	struct initargs comp_data;
+	char  comppath[INITARGS_MAX_PATHNAME + 1];
+	char  imgpath[INITARGS_MAX_PATHNAME + 1];
+	char *name;
+
+	comppath[0] = '\0';
+	snprintf(comppath, INITARGS_MAX_PATHNAME, "components/%lu", id);
+	args_get_entry(comppath, &comp_data);
+
+	name = args_get_from("img", &comp_data);
+	assert(id < MAX_NUM_COMPS && id > 0 && name);
+
+	if (info) *info = atol(args_get_from("info", &comp_data));
+	if (elf_hdr) {
+		imgpath[0] = '\0';
+		snprintf(imgpath, INITARGS_MAX_PATHNAME, "binaries/%s", name);
+		*elf_hdr = (void *)args_get(imgpath);
+	}
+
+	return name;
+}
+
+static void
+boot_comp_created(struct crt_comp *comp)
+{
+	/*
+	 * The components are initialized by the init core, regardless
+	 * of the core that created them.
+	 */
+	comp->init_core = boot_init_core;
+}
+
 /*
  * Create the threads in each of the components, including rcv/tcaps
  * for schedulers. This is called on each core as part of
@@ -149,14 +289,22 @@ execution_init(int is_init_core)
 	}
 }
 
+/*
+ * Plan the creation of the components, and create the booter's own
+ * component. The address space namespaces, the component ids, and
+ * the protection domains of the components in exclusive address
+ * spaces are all allocated here, in the order of the composition, so
+ * they are deterministic. The components themselves are created by
+ * all cores in `comps_create`.
+ */
 static void
 comps_init(void)
 {
 	struct initargs ases, curr, comps, curr_comp;
 	struct initargs_iter i;
-	int cont, ret, j;
-	int comp_idx = 0;
-	struct protdom_ns_asid *ns_asid;
+	int cont, ret;
+	int prev_vas = -1;
+	cycles_t start = ps_tsc();
 
 	/*
 	 * Assume: our component id is the lowest of the ids for all
@@ -170,141 +318,202 @@ comps_init(void)
 		cos_compid_set(booter_id);
 	}
 	boot_comp_set_idoffset(cos_compid());
+	boot_init_core = cos_cpuid();
 
 	/*
 	 * FIXME: the asid namespace is shared between all components,
 	 * so we can only create a # of components up to the number of
 	 * ASIDs (e.g. 1024 for x86-64).
 	 */
-	ns_asid = ss_ns_asid_alloc();
-	assert(ns_asid);
-	if (protdom_ns_asids_init(ns_asid) != 0) BUG();
-	ss_ns_asid_activate(ns_asid);
+	boot_ns_asid = ss_ns_asid_alloc();
+	assert(boot_ns_asid);
+	if (protdom_ns_asids_init(boot_ns_asid) != 0) BUG();
+	ss_ns_asid_activate(boot_ns_asid);
 
+	/*
+	 * A split VAS aliases the components of its parent, so it must
+	 * be created after them. Each VAS depends on the previous one,
+	 * which also keeps their ASID allocations in order.
+	 */
 	ret = args_get_entry("addrspc_shared", &ases);
 	assert(!ret);
-	printc("Creating address spaces & components:\n");
 	for (cont = args_iter(&ases, &i, &curr) ; cont ; cont = args_iter_next(&i, &curr)) {
-		/* Component-centric inner iteration */
-		struct initargs comps, curr_comp;
-		int comp_cont;
-		struct initargs_iter j;
-		int keylen;
-		int as_id = atoi(args_key(&curr, &keylen));
-		char *parent = args_get_from("parent", &curr);
-
-		/* allocate, initialize initial namespaces */
-		struct protdom_ns_vas *ns_vas = ss_ns_vas_alloc_at_id(as_id);
-		assert(ns_vas);
-		if (!parent) {
-			printc("Creating virtual address space %s (%d):\n", args_get_from("name", &curr), as_id);
-			if (protdom_ns_vas_init(ns_vas, ns_asid) != 0) BUG();
-		} else {
-			int parent_id = atoi(parent);
-			struct protdom_ns_vas *parent_vas = ss_ns_vas_get(parent_id);
-			/*
-			 * This must be true as the order of VASes
-			 * places parents before children
-			 */
-			assert(parent_vas);
-
-			printc("Creating virtual address space %s (%d) split from VAS %d:\n", args_get_from("name", &curr), as_id, parent_id);
-			if (protdom_ns_vas_split(ns_vas, parent_vas, ns_asid) != 0) BUG();
-		}
-		ss_ns_vas_activate(ns_vas);
+		struct boot_work *w = boot_work_add(BOOT_WORK_VAS, prev_vas);
 
-		/* Sequence of component ids within an address space... */
-		ret = args_get_entry_from("components", &curr, &comps);
-		assert(!ret);
-		for (comp_cont = args_iter(&comps, &j, &curr_comp) ; comp_cont ; comp_cont = args_iter_next(&j, &curr_comp)) {
-			struct crt_comp *comp;
-			void *elf_hdr;
-			compid_t id  = atoi(args_value(&curr_comp));
-			struct initargs comp_data;
-			char  comppath[INITARGS_MAX_PATHNAME + 1];
+		w->args  = curr;
+		prev_vas = w - boot_work;
+	}
 
-			comppath[0] = '\0';
-			snprintf(comppath, INITARGS_MAX_PATHNAME, "components/%lu", id);
-			args_get_entry(comppath, &comp_data);
+	ret = args_get_entry("addrspc_exclusive", &comps);
+	assert(!ret);
+	for (cont = args_iter(&comps, &i, &curr_comp) ; cont ; cont = args_iter_next(&i, &curr_comp)) {
+		compid_t id = atoi(args_value(&curr_comp));
+		prot_domain_t pd = protdom_ns_asid_alloc(boot_ns_asid);
+		struct boot_work *w;
 
-			char *name   = args_get_from("img", &comp_data);
-			vaddr_t info = atol(args_get_from("info", &comp_data));
-			char  imgpath[INITARGS_MAX_PATHNAME + 1];
+		assert(id < MAX_NUM_COMPS && id > 0);
+		/*
+		 * We assume, for now, that the composer is
+		 * *not* part of a shared VAS.
+		 */
+		if (id == cos_compid()) {
+			struct crt_comp *comp = boot_comp_get(id);
+			void *elf_hdr;
+			vaddr_t info;
+			char *name = boot_comp_args(id, &elf_hdr, &info);
 
-			printc("\tComponent %s: %lu\n", name, id);
+			assert(comp);
+			/* booter should not have an elf object */
+			assert(!elf_hdr);
+			ret = crt_booter_create(comp, name, id, info);
+			assert(ret == 0);
+			if (crt_timeline_create(comp)) printc("Error: cannot allocate the boot timeline.\n");
 
-			assert(id < MAX_NUM_COMPS && id > 0 && name);
+			continue;
+		}
+		w     = boot_work_add(BOOT_WORK_COMP, -1);
+		w->id = id;
+		w->pd = pd;
+	}
+	printc("Creating address spaces & components (%lu work items on %d cores):\n", boot_work_n, init_parallelism());
 
-			imgpath[0] = '\0';
-			snprintf(imgpath, INITARGS_MAX_PATHNAME, "binaries/%s", name);
+	boot_phase_end(BOOT_PHASE_PLAN, start);
+}
 
-			comp = boot_comp_get(id);
-			assert(comp);
-			elf_hdr = (void *)args_get(imgpath);
-
-			/*
-			 * We assume, for now, that the
-			 * constructor/booter is *not* part of a
-			 * shared VAS.
-			 */
-			if (id == cos_compid()) BUG();
-			assert(elf_hdr);
-			if (crt_comp_create_in_vas(comp, name, id, elf_hdr, info, ns_vas)) BUG();
-			assert(comp->refcnt != 0);
-		}
+/* Create a shared VAS, and each of the components within it, in order. */
+static void
+boot_work_vas(struct boot_work *w)
+{
+	struct initargs comps, curr_comp;
+	struct initargs_iter j;
+	int comp_cont, ret, keylen;
+	int as_id = atoi(args_key(&w->args, &keylen));
+	cycles_t start;
+	char *parent = args_get_from("parent", &w->args);
+
+	/* allocate, initialize initial namespaces */
+	struct protdom_ns_vas *ns_vas = ss_ns_vas_alloc_at_id(as_id);
+	assert(ns_vas);
+	if (!parent) {
+		printc("Creating virtual address space %s (%d):\n", args_get_from("name", &w->args), as_id);
+		if (protdom_ns_vas_init(ns_vas, boot_ns_asid) != 0) BUG();
+	} else {
+		int parent_id = atoi(parent);
+		struct protdom_ns_vas *parent_vas = ss_ns_vas_get(parent_id);
+		/*
+		 * This must be true as the order of VASes
+		 * places parents before children
+		 */
+		assert(parent_vas);
+
+		printc("Creating virtual address space %s (%d) split from VAS %d:\n", args_get_from("name", &w->args), as_id, parent_id);
+		if (protdom_ns_vas_split(ns_vas, parent_vas, boot_ns_asid) != 0) BUG();
 	}
+	ss_ns_vas_activate(ns_vas);
 
-	/* Create all of the components in their own address spaces */
-	ret = args_get_entry("addrspc_exclusive", &comps);
+	/* Sequence of component ids within an address space... */
+	ret = args_get_entry_from("components", &w->args, &comps);
 	assert(!ret);
-	for (cont = args_iter(&comps, &i, &curr_comp) ; cont ; cont = args_iter_next(&i, &curr_comp)) {
+	for (comp_cont = args_iter(&comps, &j, &curr_comp) ; comp_cont ; comp_cont = args_iter_next(&j, &curr_comp)) {
 		struct crt_comp *comp;
 		void *elf_hdr;
+		vaddr_t info;
 		compid_t id = atoi(args_value(&curr_comp));
-		struct initargs comp_data;
-		char  comppath[INITARGS_MAX_PATHNAME + 1];
+		char *name  = boot_comp_args(id, &elf_hdr, &info);
 
-		comppath[0] = '\0';
-		snprintf(comppath, INITARGS_MAX_PATHNAME, "components/%lu", id);
-		args_get_entry(comppath, &comp_data);
+		printc("\tComponent %s: %lu\n", name, id);
 
-		char *name   = args_get_from("img", &comp_data);
-		vaddr_t info = atol(args_get_from("info", &comp_data));
-		char  imgpath[INITARGS_MAX_PATHNAME + 1];
+		comp = boot_comp_get(id);
+		assert(comp);
 
-		printc("Component %s: %lu (in an exclusive address space)\n", name, id);
+		/*
+		 * We assume, for now, that the
+		 * constructor/booter is *not* part of a
+		 * shared VAS.
+		 */
+		if (id == cos_compid()) BUG();
+		assert(elf_hdr);
+		start = ps_tsc();
+		if (crt_comp_create_in_vas(comp, name, id, elf_hdr, info, ns_vas)) BUG();
+		assert(comp->refcnt != 0);
+		boot_comp_created(comp);
+		crt_timeline_mark(start, "create %s", name);
+	}
+}
 
-		assert(id < MAX_NUM_COMPS && id > 0 && name);
+/* Create a component in its own address space */
+static void
+boot_work_comp(struct boot_work *w)
+{
+	struct crt_comp *comp;
+	void *elf_hdr;
+	vaddr_t info;
+	char *name = boot_comp_args(w->id, &elf_hdr, &info);
+	cycles_t start = ps_tsc();
 
-		imgpath[0] = '\0';
-		snprintf(imgpath, INITARGS_MAX_PATHNAME, "binaries/%s", name);
+	printc("Component %s: %lu (in an exclusive address space, core %ld)\n", name, w->id, cos_cpuid());
 
-		comp = boot_comp_get(id);
-		assert(comp);
-		elf_hdr = (void *)args_get(imgpath);
+	comp = boot_comp_get(w->id);
+	assert(comp && elf_hdr);
+	if (crt_comp_create(comp, name, w->id, elf_hdr, info, w->pd)) {
+		printc("Error constructing the resource tables and image of component %s.\n", comp->name);
+		BUG();
+	}
+	boot_comp_created(comp);
+	crt_timeline_mark(start, "create %s", name);
+}
 
-		prot_domain_t pd = protdom_ns_asid_alloc(ns_asid);
+/*
+ * Executed by all cores: take the planned work in order, awaiting
+ * the completion of the work it depends on. The dependency always
+ * precedes the work in the queue, so it has already been taken by a
+ * core that will complete it.
+ */
+static void
+comps_create(void)
+{
+	struct boot_core_stats *s = &boot_core_stats[cos_cpuid()];
+	unsigned long idx;
 
-		/*
-		 * We assume, for now, that the composer is
-		 * *not* part of a shared VAS.
-		 */
-		if (id == cos_compid()) {
-			int ret;
+	while ((idx = ps_faa(&boot_work_next, 1)) < boot_work_n) {
+		struct boot_work *w = &boot_work[idx];
+		cycles_t start;
 
-			/* booter should not have an elf object */
-			assert(!elf_hdr);
-			ret = crt_booter_create(comp, name, id, info);
-			assert(ret == 0);
-		} else {
-			assert(elf_hdr);
-			if (crt_comp_create(comp, name, id, elf_hdr, info, pd)) {
-				printc("Error constructing the resource tables and image of component %s.\n", comp->name);
-				BUG();
-			}	
+		if (w->dep >= 0) {
+			while (!ps_load(&boot_work[w->dep].done)) ;
+		}
+
+		start = ps_tsc();
+		switch (w->type) {
+		case BOOT_WORK_VAS:
+			boot_work_vas(w);
+			break;
+		case BOOT_WORK_COMP:
+			boot_work_comp(w);
+			break;
 		}
+		s->busy += ps_tsc() - start;
+		s->nwork++;
+
+		ps_mem_fence();
+		ps_store(&w->done, 1);
 	}
+}
 
+/*
+ * Create the capability manager delegations, the synchronous
+ * invocations, and delegate memory to the capability managers. These
+ * allocate capabilities in the capability tables of the components,
+ * so are done serially, after all components are created, to keep
+ * the capability ids deterministic.
+ */
+static void
+comps_resources_init(void)
+{
+	struct initargs curr, comps;
+	struct initargs_iter i;
+	int cont, ret;
+	cycles_t start = ps_tsc();
 	/* perform any necessary captbl delegations */
 	ret = args_get_entry("captbl_delegations", &comps);
 	assert(!ret);
@@ -360,6 +569,7 @@ comps_init(void)
 		}
 		if (crt_comp_alias_in(target, c, &comp_res, alias_flags)) BUG();
 	}
+	start = boot_phase_end(BOOT_PHASE_DELEGATE, start);
 
 	/*
 	 * *No static capability slot allocations after this point.*
@@ -412,6 +622,7 @@ comps_init(void)
 		cli->n_sinvs++;
 	#endif /* ENABLE_CHKPT */
 	}
+	start = boot_phase_end(BOOT_PHASE_SINV, start);
 
 	/*
 	 * Delegate the untyped memory to the capmgr. This should go
@@ -436,8 +647,12 @@ comps_init(void)
 		c = boot_comp_get(atoi(args_key(&curr, &keylen)));
 		assert(c);
 
+		if (crt_timeline_alias_in(boot_comp_self(), c, &boot_timeline_addrs[c - boot_comps])) {
+			printc("\tThe boot timeline is not shared with capmgr %lu.\n", c->id);
+		}
 		if (crt_comp_exec(c, crt_comp_exec_capmgr_init(&ctxt, mem))) BUG();
 	}
+	boot_phase_end(BOOT_PHASE_CAPMGR_MEM, start);
 
 	printc("Kernel resources created, booting components!\n");
 
@@ -498,16 +713,38 @@ chkpt_comp_init(struct crt_comp *comp, struct crt_chkpt *chkpt, char *name)
 
 		sinv = ss_sinv_alloc();
 		assert(sinv);
+		/* The instance doesn't share its server's vas, thus doesn't use fast callgates */
 		crt_sinv_create(sinv, comp->sinvs[i].name, comp->sinvs[i].server, comp->sinvs[i].client,
-			comp->sinvs[i].c_fn_addr, comp->sinvs[i].c_ucap_addr, comp->sinvs[i].s_fn_addr);
+			comp->sinvs[i].c_fn_addr, 0, comp->sinvs[i].c_ucap_addr, comp->sinvs[i].s_fn_addr, 0);
 		ss_sinv_activate(sinv);
 		printc("\t(chkpt) sinv: %s (%lu->%lu):\tclient_fn @ 0x%lx, client_ucap @ 0x%lx, server_fn @ 0x%lx\n",
 			sinv->name, sinv->client->id, sinv->server->id, sinv->c_fn_addr, sinv->c_ucap_addr, sinv->s_fn_addr);
 	}
+	/* Restores reset the component to this point */
+	crt_chkpt_restore_point(comp);
 #endif /* ENABLE_CHKPT */
 
 }
 
+/*
+ * Reset a component created from a checkpoint to the point at which
+ * it was created. Its threads must not return into it.
+ */
+static void
+chkpt_comp_restore(struct crt_comp *comp)
+{
+#ifdef ENABLE_CHKPT
+	int ret;
+
+	ret = crt_chkpt_restore(comp->chkpt, comp);
+	if (ret < 0) {
+		printc("Error restoring component %s to its checkpoint: %d.\n", comp->name, ret);
+		BUG();
+	}
+	printc("\t(chkpt) component %s restored to its checkpoint: %d modified pages reset.\n", comp->name, ret);
+#endif /* ENABLE_CHKPT */
+}
+
 unsigned long
 addr_get(compid_t id, addr_t type)
 {
@@ -531,6 +768,9 @@ addr_get(compid_t id, addr_t type)
 		return ci->cap_frontier;
 	case ADDR_HEAP_FRONTIER:
 		return ci->vas_frontier;
+	case ADDR_BOOT_TIMELINE:
+		if (target != c) return 0;
+		return boot_timeline_addrs[c - boot_comps];
 	default:
 		return 0;
 	}
@@ -544,7 +784,8 @@ booter_init(void)
 	cos_meminfo_init(&(boot_info->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
 	cos_defcompinfo_init();
 
-	cos_hw_cycles_per_usec(BOOT_CAPTBL_SELF_INITHW_BASE);
+	boot_cycs_per_usec = cos_hw_cycles_per_usec(BOOT_CAPTBL_SELF_INITHW_BASE);
+	if (boot_cycs_per_usec <= 0) boot_cycs_per_usec = 1;
 }
 
 void
@@ -621,19 +862,43 @@ init_exit(int retval)
 	c = boot_comp_get(client);
 	assert(c);
 
+	/*
+	 * The thread won't return into the component, so it can be
+	 * restored. It then terminates like those of other components,
+	 * and the restored component isn't executed again.
+	 */
+	if (c->chkpt) chkpt_comp_restore(c);
 	crt_compinit_exit(c, retval);
 
-	/* TODO: recycle back to a chkpt via chkpt_restore() */
-
 	while (1) ;
 }
 
 void
 cos_parallel_init(coreid_t cid, int is_init_core, int ncores)
 {
+	cycles_t start;
+
 	if (!is_init_core) cos_defcompinfo_sched_init();
 
+	start = ps_tsc();
+	comps_create();
+	simple_barrier(&boot_created_barrier);
+	if (is_init_core) {
+		boot_phase_end(BOOT_PHASE_CREATE, start);
+		comps_resources_init();
+	}
+	/*
+	 * All component resources except for those required for
+	 * execution should be setup now.
+	 */
+	simple_barrier(&boot_resources_barrier);
+
+	start = ps_tsc();
 	execution_init(is_init_core);
+	if (is_init_core) {
+		boot_phase_end(BOOT_PHASE_EXEC, start);
+		boot_report(ncores);
+	}
 }
 
 void
@@ -641,11 +906,9 @@ cos_init(void)
 {
 	booter_init();
 	cos_defcompinfo_sched_init();
+	simple_barrier_init(&boot_created_barrier, init_parallelism());
+	simple_barrier_init(&boot_resources_barrier, init_parallelism());
 	comps_init();
-	/*
-	 * All component resources except for those required for
-	 * execution should be setup now.
-	 */
 }
 
 void
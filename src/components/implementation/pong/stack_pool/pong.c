@@ -0,0 +1,97 @@
+/**
+ * A pong that executes invocations on pooled stacks (see
+ * custom_acquire_stack), for tests/unit_stack_pool. pong_ret returns
+ * the number of free stacks in this core's pool, pong_arg sets if
+ * stacks are released on return, and pong_subset returns the top of
+ * the invocation's stack, and if it is pooled. The others are as in
+ * pong.pingpong, to check their return values with the releases.
+ */
+
+#include <cos_component.h>
+#include <llprint.h>
+#include <memmgr.h>
+#include <pong.h>
+
+#define POOL_NSTACKS 4
+
+extern char cos_static_stack[], cos_static_stack_end[];
+
+void
+cos_init(void)
+{
+	coreid_t c;
+
+	for (c = 0; c < NUM_CPU; c++) {
+		if (memmgr_stack_pool_grow(c, POOL_NSTACKS) != POOL_NSTACKS) BUG();
+	}
+	printc("Pong component %ld: %d pooled stacks per core\n", cos_compid(), POOL_NSTACKS);
+}
+
+void
+pong_call(void)
+{
+	return;
+}
+
+int
+pong_ret(void)
+{
+	return cos_stack_pool_nfree(cos_cpuid());
+}
+
+int
+pong_arg(int p1)
+{
+	cos_stack_release_set(p1);
+
+	return p1;
+}
+
+int
+pong_args(int p1, int p2, int p3, int p4)
+{
+	return p1 + p2 + p3 + p4;
+}
+
+int
+pong_wideargs(long long p0, long long p1)
+{
+	if (p0 <= ((long long)1 << 31) && p1 <= ((long long)1 << 31)) return p0 + p1;
+
+	return p0 < p1 ? -1 : (p0 == p1 ? 0 : 1);
+}
+
+int
+pong_argsrets(int p0, int p1, int p2, int p3, word_t *r0, word_t *r1)
+{
+	*r0 = p0;
+	*r1 = p1;
+
+	return p2 + p3;
+}
+
+long long
+pong_widerets(long long p0, long long p1)
+{
+	return p0 + p1;
+}
+
+int
+pong_subset(unsigned long p0, unsigned long p1, unsigned long *r0)
+{
+	char          here;
+	unsigned long top = round_to_pow2((unsigned long)&here, COS_STACK_SZ) + COS_STACK_SZ;
+
+	*r0 = top;
+
+	return !(top > (unsigned long)cos_static_stack && top <= (unsigned long)cos_static_stack_end);
+}
+
+thdid_t
+pong_ids(compid_t *client, compid_t *serv)
+{
+	*client = (compid_t)cos_inv_token();
+	*serv   = cos_compid();
+
+	return cos_thdid();
+}
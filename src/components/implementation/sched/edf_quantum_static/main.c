@@ -0,0 +1,7 @@
+/***
+ * The `pfprr_quantum_static` scheduler, with the earliest deadline
+ * first policy of slm (`edf.c`) in place of fixed priorities.
+ */
+
+#define SCHED_POLICY_EDF
+#include "../pfprr_quantum_static/main.c"
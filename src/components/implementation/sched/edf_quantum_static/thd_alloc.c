@@ -0,0 +1 @@
+#include "../pfprr_quantum_static/thd_alloc.c"
@@ -11,13 +11,23 @@
  * preemptive, fixed priority, round-robin scheduling, and uses the
  * capability manager to allocate threads, with local thread memory
  * tracked in static (allocate-only, finite) memory.
+ *
+ * Variants of this scheduler with another slm scheduling policy
+ * (e.g. `edf_quantum_static`) are built from these sources, and
+ * select their policy by defining `SCHED_POLICY_EDF`.
  */
 
 #include <slm.h>
 #include <quantum.h>
+#ifdef SCHED_POLICY_EDF
+#include <edf.h>
+#define SCHED_POLICY edf
+#else
 #include <fprr.h>
+#define SCHED_POLICY fprr
+#endif
 #include <slm_blkpt.c>
-#include <slm_modules.h>
+#include "slm_modules.h"
 
 #include <syncipc.h>
 
@@ -25,12 +35,17 @@ struct slm_resources_thd {
 	thdcap_t cap;
 	thdid_t  tid;
 	compid_t comp;
+	/* Exited threads are cached for reuse, see `sched_thd_recycle` */
+	struct ps_list     recycle_list;
+	thdclosure_index_t recycle_idx;
 };
 
 struct slm_thd *slm_thd_static_cm_lookup(thdid_t id);
 
 SLM_MODULES_COMPOSE_DATA();
-SLM_MODULES_COMPOSE_FNS(quantum, fprr, static_cm);
+/* Expand the policy before it is pasted into the function names */
+#define SCHED_MODULES_COMPOSE_FNS(timepol, schedpol, respol) SLM_MODULES_COMPOSE_FNS(timepol, schedpol, respol)
+SCHED_MODULES_COMPOSE_FNS(quantum, SCHED_POLICY, static_cm);
 
 struct crt_comp self;
 
@@ -83,15 +98,109 @@ slm_thd_mem_alloc(thdcap_t _cap, thdid_t _tid, thdcap_t *thd, thdid_t *tid)
 }
 
 void slm_thd_mem_activate(struct slm_thd_container *t) { ss_thd_activate(t); }
-/* TODO */
-void slm_thd_mem_free(struct slm_thd_container *t) { return; }
+void slm_thd_mem_free(struct slm_thd_container *t) { ss_thd_free(t); }
+
+/*
+ * Per-core caches, for each component, of threads that have exited
+ * there. A cached thread is parked in `sched_thd_recycle`, and a
+ * thread creation in the same component and core reuses it (its
+ * kernel thread, id, and `slm_thd_container`) by handing it the new
+ * closure, thus avoiding the capmgr and kernel thread activation.
+ */
+struct thd_recycle_cache {
+	struct ps_list_head thds[MAX_NUM_COMPS];
+	int                 initialized;
+} CACHE_ALIGNED;
+
+static struct thd_recycle_cache thd_recycle_caches[NUM_CPU];
+
+/* Must be called within the critical section */
+static struct ps_list_head *
+thd_recycle_cache(compid_t comp)
+{
+	struct thd_recycle_cache *c = &thd_recycle_caches[cos_cpuid()];
+
+	if (comp == 0 || comp > MAX_NUM_COMPS) return NULL;
+	if (unlikely(!c->initialized)) {
+		int i;
+
+		for (i = 0; i < MAX_NUM_COMPS; i++) ps_list_head_init(&c->thds[i]);
+		c->initialized = 1;
+	}
+
+	return &c->thds[comp - 1];
+}
+
+/*
+ * Reuse a cached thread in `comp` to execute the closure `idx`. The
+ * thread's scheduling state is reinitialized as if it were new, thus
+ * it won't execute until its parameters are set.
+ */
+static struct slm_thd *
+thd_recycle(compid_t comp, thdclosure_index_t idx)
+{
+	struct slm_thd *current = slm_thd_current();
+	struct slm_thd_container *t;
+	struct ps_list_head *cache;
+
+	slm_cs_enter(current, SLM_CS_NONE);
+	cache = thd_recycle_cache(comp);
+	if (!cache || ps_list_head_empty(cache)) {
+		slm_cs_exit(NULL, SLM_CS_NONE);
+		return NULL;
+	}
+	t = ps_list_head_first(cache, struct slm_thd_container, resources.recycle_list);
+	ps_list_rem(t, resources.recycle_list);
+
+	slm_thd_deinit(&t->thd);
+	if (slm_thd_init(&t->thd, t->resources.cap, t->resources.tid)) BUG();
+	t->resources.recycle_idx = idx;
+	slm_cs_exit(NULL, SLM_CS_NONE);
+
+	return &t->thd;
+}
+
+thdclosure_index_t
+sched_thd_recycle(void)
+{
+	struct slm_thd *current = slm_thd_current();
+	struct slm_thd_container *t = ps_container(current, struct slm_thd_container, thd);
+	struct ps_list_head *cache;
+	thdclosure_index_t idx;
+
+	slm_cs_enter(current, SLM_CS_NONE);
+	cache = thd_recycle_cache((compid_t)cos_inv_token());
+	if (!cache) {
+		slm_cs_exit(NULL, SLM_CS_NONE);
+		return 0;
+	}
+	t->resources.recycle_idx = 0;
+	ps_list_init(t, resources.recycle_list);
+	ps_list_head_append(cache, t, resources.recycle_list);
+
+	/* Block until a thread creation reuses us */
+	while (1) {
+		idx = t->resources.recycle_idx;
+		if (idx) break;
+		/* Consumed a stale wakeup? Block again. */
+		if (slm_thd_block(current)) continue;
+
+		slm_cs_exit_reschedule(current, SLM_CS_NONE);
+		slm_cs_enter(current, SLM_CS_NONE);
+	}
+	slm_cs_exit(NULL, SLM_CS_NONE);
+
+	return idx;
+}
 
 thdid_t
 sched_thd_create_closure(thdclosure_index_t idx)
 {
 	sched_param_t p = 0;
-	struct slm_thd *t = thd_alloc_in(cos_inv_token(), idx, &p, 0);
+	struct slm_thd *t;
 
+	t = thd_recycle(cos_inv_token(), idx);
+	if (!t) t = thd_alloc_in(cos_inv_token(), idx, &p, 0);
 	if (!t) return 0;
 
 	return t->tid;
@@ -236,6 +345,32 @@ done:
 	return ret;
 }
 
+/*
+ * Block until either the timeout, or an explicit wakeup. Unlike
+ * `thd_block_until`, this does not re-block if woken early, so that
+ * it can be used for timed waits on events (e.g. futexes).
+ */
+static int
+thd_block_timeout(cycles_t timeout)
+{
+	struct slm_thd *current = slm_thd_current();
+	int ret = 0;
+
+	if (!cycles_greater_than(timeout, slm_now())) return 0;
+
+	slm_cs_enter(current, SLM_CS_NONE);
+	if (slm_timer_add(current, timeout)) goto done;
+	if (slm_thd_block(current)) {
+		slm_timer_cancel(current);
+	}
+done:
+	ret = slm_cs_exit_reschedule(current, SLM_CS_NONE);
+	/* cleanup stale timeouts (e.g. if we were woken outside of the timer) */
+	slm_timer_cancel(current);
+
+	return ret;
+}
+
 cycles_t
 sched_thd_block_timeout(thdid_t dep_id, cycles_t abs_timeout)
 {
@@ -250,6 +385,24 @@ sched_thd_block_timeout(thdid_t dep_id, cycles_t abs_timeout)
 	return now;
 }
 
+/*
+ * Returns the current time if the timeout has passed, and `0` if we
+ * were woken up before it.
+ */
+cycles_t
+sched_thd_block_timeout_wakeup(thdid_t dep_id, cycles_t abs_timeout)
+{
+	cycles_t now;
+
+	if (dep_id) return 0;
+	if (thd_block_timeout(abs_timeout)) return 0;
+
+	now = slm_now();
+	if (!cycles_greater_than(now, abs_timeout)) return 0;
+
+	return now;
+}
+
 int
 thd_sleep(cycles_t c)
 {
@@ -288,22 +441,52 @@ sched_blkpt_block(sched_blkpt_id_t blkpt, sched_blkpt_epoch_t epoch, thdid_t dep
 	return slm_blkpt_block(blkpt, current, epoch, dependency);
 }
 
-struct ipc_retvals {
-	int ready;
-	word_t r0, r1;
+/***
+ * Synchronous, rendezvous IPC between threads (see `syncipc.h`).
+ *
+ * Endpoints are per-core: an endpoint id names a separate endpoint on
+ * each core, so clients rendezvous only with server threads on their
+ * own core, and communication never requires cross-core
+ * switches. Each endpoint tracks the server threads awaiting a call,
+ * and the clients awaiting a server, thus any number of clients and
+ * servers can share an endpoint. All endpoint and per-thread IPC
+ * state is only modified within the scheduler critical section, and
+ * we use direct thread switches, bypassing the scheduling policy,
+ * for the common case of the rendezvous.
+ */
+struct ipc_thd {
+	struct slm_thd *thd;
+	/* client: the server is awaiting our call; server: the client we're servicing */
+	struct ipc_thd *peer;
+	word_t          a0, a1;
+	word_t          r0, r1;
+	int             ready;
+	struct ps_list  list;
 };
 
 struct ipc_ep {
-	struct slm_thd     *client, *server;
-	word_t              a0, a1;
-	struct ipc_retvals *retvals;
+	struct ps_list_head servers; /* servers awaiting a call */
+	struct ps_list_head clients; /* clients awaiting a server */
+	int                 flags;   /* SYNCIPC_EP_* flags set by servers */
 };
 
-/* For now, mainly a testing feature, thus only one */
-#define IPC_EP_NUM 1 /* MAX_NUM_THREADS */
+/* Internal endpoint flag: has the endpoint been lazily initialized? */
+#define IPC_EP_INITIALIZED 1
 
-struct ipc_ep eps[IPC_EP_NUM];
+#ifndef IPC_EP_NUM
+#define IPC_EP_NUM 2048	/* per core */
+#endif
 
+struct ipc_thd ipc_thds[MAX_NUM_THREADS];
+struct ipc_ep   eps[NUM_CPU][IPC_EP_NUM];
+
+/*
+ * Set to 1 to gather per-stage latencies and path counts of the IPC
+ * fast-paths, and periodically print them.
+ */
+#define SYNCIPC_TRACE 0
+
+#if SYNCIPC_TRACE
 enum {
 	CNT_C_CALL,
 	CNT_C_LOOP,
@@ -314,35 +497,40 @@ enum {
 	CNT_S_RET,
 	CNT_MAX
 };
-unsigned long counts[CNT_MAX];
+
+#define TRACE_STAGES 4
+
+struct ipc_trace {
+	unsigned long counts[CNT_MAX];
+	cycles_t      readings[TRACE_STAGES];
+	struct total {
+		int      cnt;
+		int      prev_stage_cnt[TRACE_STAGES];
+		cycles_t tot;
+	} totals[TRACE_STAGES];
+} CACHE_ALIGNED;
+
+struct ipc_trace ipc_traces[NUM_CPU];
+
 static void
 count_inc(int type)
 {
-	counts[type]++;
+	ipc_traces[cos_cpuid()].counts[type]++;
 }
 
-cycles_t readings[4];
-struct total {
-	int cnt;
-	int prev_stage_cnt[4];
-	cycles_t tot;
-} totals[4];
-
 static void
 trace_add(int reading)
 {
-	struct total *t = &totals[reading];
+	struct ipc_trace *tr = &ipc_traces[cos_cpuid()];
+	struct total *t = &tr->totals[reading];
 	cycles_t prev_tsc;
 	cycles_t now = ps_tsc();
 	cycles_t max = 0;
-	int i, max_idx;
+	int i, max_idx = 0;
 
-	/* Avoid this overhead for now! */
-	return;
-
-	for (i = 0; i < 4; i++) {
-		if (readings[i] > max) {
-			max = readings[i];
+	for (i = 0; i < TRACE_STAGES; i++) {
+		if (tr->readings[i] > max) {
+			max = tr->readings[i];
 			max_idx = i;
 		}
 	}
@@ -353,91 +541,175 @@ trace_add(int reading)
 	t->tot += now - prev_tsc;
 
 	if (t->cnt % 128 == 128 - 1) {
-		int i;
-
-		for (i = 0; i < 4; i++)	{
-			int cnt = totals[i].cnt;
+		for (i = 0; i < TRACE_STAGES; i++) {
+			int cnt = tr->totals[i].cnt;
 			int j;
 
 			if (cnt == 0) cnt = 1;
-			printc("%d:%llu (", i, totals[i].tot / cnt);
-			for (j = 0; j < 4; j++) {
-				printc("%d:%d%s", j, totals[i].prev_stage_cnt[j], j == 3 ? "" :  ", ");
+			printc("%d:%llu (", i, tr->totals[i].tot / cnt);
+			for (j = 0; j < TRACE_STAGES; j++) {
+				printc("%d:%d%s", j, tr->totals[i].prev_stage_cnt[j], j == TRACE_STAGES - 1 ? "" :  ", ");
 			}
 			printc(")\n");
 		}
 		printc("Counts: ");
 		for (i = 0; i < CNT_MAX; i++) {
-			printc("%ld%s", counts[i], i == CNT_MAX - 1 ? "\n\n" : ", ");
+			printc("%ld%s", tr->counts[i], i == CNT_MAX - 1 ? "\n\n" : ", ");
 		}
 
-		readings[reading] = ps_tsc();
+		tr->readings[reading] = ps_tsc();
 	} else {
-		readings[reading] = now;
+		tr->readings[reading] = now;
 	}
 }
+#else
+#define count_inc(type)
+#define trace_add(reading)
+#endif
 
-int
-syncipc_call(int ipc_ep, word_t arg0, word_t arg1, word_t *ret0, word_t *ret1)
+static inline struct ipc_ep *
+ipc_ep_get(int ipc_ep)
 {
-	struct slm_thd *t = slm_thd_current(), *switchto, *client;
 	/* avoid the conditional for bounds checking, ala Nova */
-	struct ipc_ep *ep = &eps[ipc_ep % IPC_EP_NUM];
-	sched_tok_t   tok;
-	int           ret;
-	struct ipc_retvals retvals = { .ready = 0 };
+	return &eps[cos_cpuid()][(unsigned int)SYNCIPC_EP_ID(ipc_ep) % IPC_EP_NUM];
+}
 
-	count_inc(CNT_C_CALL);
-	/* No server thread yet? Nothing to do here. */
-	if (ep->server == NULL) return -EAGAIN;
-	while (1) {
-		tok      = cos_sched_sync();
-		switchto = ps_load(&ep->server);
+/* Must be called within the critical section */
+static inline void
+ipc_ep_init(struct ipc_ep *ep, int flags)
+{
+	if (likely(ep->flags & IPC_EP_INITIALIZED)) {
+		ep->flags |= flags;
+		return;
+	}
 
+	ps_list_head_init(&ep->servers);
+	ps_list_head_init(&ep->clients);
+	ep->flags = flags | IPC_EP_INITIALIZED;
+}
+
+static inline struct ipc_thd *
+ipc_thd_get(struct slm_thd *t)
+{
+	struct ipc_thd *it = &ipc_thds[t->tid];
+
+	if (unlikely(it->thd != t)) {
+		*it = (struct ipc_thd) { .thd = t };
+		ps_list_init_d(it);
+	}
 
-		/* Lets try and set ourself as the client communicating with the server! */
-		if (likely(ps_cas((unsigned long *)&ep->client, 0, (unsigned long)t))) {
-			/* We are the serviced client, pass arguments! */
-			ep->a0      = arg0;
-			ep->a1      = arg1;
-			ep->retvals = &retvals;
-			assert(ps_load(&ep->client) == t);
+	return it;
+}
+
+/*
+ * Queue a client awaiting a server. Priority-ordered endpoints keep
+ * the queue sorted by priority (lower values are higher priority),
+ * with FIFO order within a priority.
+ */
+static void
+ipc_client_enqueue(struct ipc_ep *ep, struct ipc_thd *c)
+{
+	struct ipc_thd *it;
+
+	if (!(ep->flags & SYNCIPC_EP_PRIO)) {
+		ps_list_head_append_d(&ep->clients, c);
+		return;
+	}
+
+	ps_list_foreach_d(&ep->clients, it) {
+		if (it->thd->priority > c->thd->priority) {
+			ps_list_add_d(ps_list_prev_d(it), c);
+			return;
 		}
-		/*
-		 * If another client is already communicating with the
-		 * server, and they haven't yet populated the
-		 * arguments and retvals, let them finish setting up
-		 * their communication.
-		 */
-		client = ps_load(&ep->client);
-		if (unlikely(ep->client != t && ep->retvals == NULL)) switchto = client;
-
-		/*
-		 * If we are the client, then we're activating the
-		 * server here. If another client exists, we're
-		 * generally just performing priority inheritance
-		 * here.
-		 */
-		trace_add(0);
-		ret = slm_switch_to(t, switchto, tok, 1);
-		trace_add(3);
+	}
+	ps_list_head_append_d(&ep->clients, c);
+}
+
+/*
+ * Block the current thread, and switch to `to`, or to the thread the
+ * scheduler chooses if we cannot. Must be called within the critical
+ * section, and releases it. `inherit` designates if `to` should
+ * execute with our priority.
+ */
+static int
+ipc_block_switch(struct slm_thd *curr, struct slm_thd *to, int inherit)
+{
+	sched_tok_t tok;
+	int ret;
+
+	if (slm_thd_block(curr)) {
+		/* a wakeup raced with us; don't block */
+		slm_cs_exit(NULL, SLM_CS_NONE);
+
+		return 0;
+	}
+	if (!to) return slm_cs_exit_reschedule(curr, SLM_CS_NONE);
+
+	tok = cos_sched_sync();
+	slm_cs_exit(NULL, SLM_CS_NONE);
+	ret = slm_switch_to(curr, to, tok, inherit);
+	if (likely(ret == 0)) return 0;
+
+	/* The switch failed (e.g. stale token), so let the scheduler decide */
+	slm_cs_enter(curr, SLM_CS_NONE);
+	if (ps_load(&curr->state) == SLM_THD_RUNNABLE) {
+		slm_cs_exit(NULL, SLM_CS_NONE);
+		return 0;
+	}
+
+	return slm_cs_exit_reschedule(curr, SLM_CS_NONE);
+}
+
+int
+syncipc_call(int ipc_ep, word_t arg0, word_t arg1, word_t *ret0, word_t *ret1)
+{
+	struct slm_thd *t      = slm_thd_current();
+	struct ipc_ep  *ep     = ipc_ep_get(ipc_ep);
+	struct ipc_thd *client = ipc_thd_get(t);
+	struct ipc_thd *server = NULL;
+	int ret;
+
+	count_inc(CNT_C_CALL);
+	client->a0    = arg0;
+	client->a1    = arg1;
+	client->ready = 0;
+
+	slm_cs_enter(t, SLM_CS_NONE);
+	ipc_ep_init(ep, 0);
+	if (likely(!ps_list_head_empty(&ep->servers))) {
+		/* Rendezvous with an awaiting server, and wake it */
+		server = ps_list_head_first_d(&ep->servers, struct ipc_thd);
+		ps_list_rem_d(server);
+		server->peer = client;
+		slm_thd_wakeup(server->thd, 0);
+	} else {
+		/* All servers are busy (or not yet present): wait in line */
+		ipc_client_enqueue(ep, client);
+	}
+
+	/*
+	 * Switch to the server, lending it our priority. Others'
+	 * wakeups and preemptions might return to us before the
+	 * reply, thus the loop.
+	 */
+	trace_add(0);
+	ret = ipc_block_switch(t, server ? server->thd : NULL, 1);
+	trace_add(3);
+	while (!ps_load(&client->ready)) {
 		count_inc(CNT_C_LOOP);
-		/*
-		 * Iterate while we are not the serviced client, we
-		 * have a stale scheduling token...
-		 */
-		if (unlikely(ret)) {
-			if (ret != -EAGAIN) return ret;
-			if (ret == EAGAIN) continue;
-		}
+		if (unlikely(ret && ret != -EAGAIN && ret != -EBUSY)) return ret;
 
-		/* ...or the server hasn't provided a response. */
-		if (likely(ps_load(&retvals.ready))) break;
+		slm_cs_enter(t, SLM_CS_NONE);
+		if (ps_load(&client->ready)) {
+			slm_cs_exit(NULL, SLM_CS_NONE);
+			break;
+		}
+		ret = ipc_block_switch(t, NULL, 0);
 	}
 
 	count_inc(CNT_C_RET);
-	*ret0 = ps_load(&retvals.r0);
-	*ret1 = ps_load(&retvals.r1);
+	*ret0 = client->r0;
+	*ret1 = client->r1;
 
 	return 0;
 }
@@ -445,85 +717,79 @@ syncipc_call(int ipc_ep, word_t arg0, word_t arg1, word_t *ret0, word_t *ret1)
 int
 syncipc_reply_wait(int ipc_ep, word_t arg0, word_t arg1, word_t *ret0, word_t *ret1)
 {
-	struct slm_thd *t = slm_thd_current(), *client;
-	/* avoid the conditional for bounds checking, ala Nova */
-	struct ipc_ep *ep = &eps[ipc_ep % IPC_EP_NUM];
-	sched_tok_t   tok;
-	int           ret;
+	struct slm_thd *t      = slm_thd_current();
+	struct ipc_ep  *ep     = ipc_ep_get(ipc_ep);
+	struct ipc_thd *server = ipc_thd_get(t);
+	struct ipc_thd *client, *next;
+	int ret;
+
+	slm_cs_enter(t, SLM_CS_NONE);
+	/* Servers determine the endpoint's policy */
+	ipc_ep_init(ep, SYNCIPC_EP_FLAGS(ipc_ep));
 
 	/*
-	 * Phase 1: An EP is associated with a specific server. This
-	 * conditional is formulated to move the cas and awaiting the
-	 * first client off the fast-path.
+	 * Phase 1: Reply to the client we are currently servicing, if
+	 * any. The reply is only visible to the client once it is
+	 * ready, and it is woken.
 	 */
-	if (unlikely(ep->server != t)) {
-		/* Another server claimed the endpoint */
-		if (ep->server != NULL)         return -1;
-		if (!ps_cas((unsigned long *)&ep->server, 0, (unsigned long)t)) return -1;
-		ret = slm_sched_thd_update(t, SCHEDP_INIT, 0);
-		assert(ret == 0);
-		assert(ep->server == t);
-
-		/* Now await the first client spinning at idle prio! */
-		while (ps_load(&ep->client) == NULL) ;
-		*ret0 = ep->a0;
-		*ret1 = ep->a1;
-
-		return 0;
+	client = server->peer;
+	if (likely(client)) {
+		count_inc(CNT_S_REPLY);
+		client->r0    = arg0;
+		client->r1    = arg1;
+		client->ready = 1;
+		server->peer  = NULL;
+		slm_thd_wakeup(client->thd, 0);
 	}
 
-	count_inc(CNT_S_REPLY);
-
 	/*
-	 * Phase 2: Reply to the client we are currently servicing!
+	 * Phase 2: If clients are queued, service the next
+	 * immediately, without blocking.
 	 */
-	client             = ps_load(&ep->client);
-	ep->retvals->r0    = arg0;
-	ep->retvals->r1    = arg1;
-	/* Make sure to set this *last*. */
-	ep->retvals->ready = 1;
+	if (!ps_list_head_empty(&ep->clients)) {
+		next = ps_list_head_first_d(&ep->clients, struct ipc_thd);
+		ps_list_rem_d(next);
+		server->peer = next;
+		if (client) {
+			/* Let the replied-to client run now if it has a higher priority */
+			ret = slm_cs_exit_reschedule(t, SLM_CS_NONE);
+			if (unlikely(ret && ret != -EAGAIN && ret != -EBUSY)) return ret;
+		} else {
+			slm_cs_exit(NULL, SLM_CS_NONE);
+		}
+
+		count_inc(CNT_S_RET);
+		*ret0 = next->a0;
+		*ret1 = next->a1;
+
+		return 0;
+	}
+
 	/*
-	 * Reset the endpoint, so that the next client can make a
-	 * request. As the client variable is the sync point, we have
-	 * to write it last.
+	 * Phase 3: Await the next call, switching back to the client
+	 * we just replied to. Servers are reused LIFO to keep the
+	 * most recently active (cache-warm) one busy.
 	 */
-	ep->retvals       = NULL;
-	ep->client        = NULL;
-
-	do {
-		/*
-		 * Switch back to the client!
-		 *
-		 * TODO: We should add a bit that designates if there
-		 * is *contention* on the server thread, and if it is
-		 * set, instead call `slm_exit_reschedule` here to
-		 * instead run the highest-priority client.
-		 */
-		trace_add(2);
-		ret = slm_switch_to(t, client, cos_sched_sync(), 1);
-		trace_add(1);
-		if (unlikely(ret) && ret != -EAGAIN) return ret;
+	count_inc(CNT_S_WAIT);
+	ps_list_head_add_d(&ep->servers, server);
+	trace_add(2);
+	ret = ipc_block_switch(t, client ? client->thd : NULL, 0);
+	trace_add(1);
+	while (!ps_load(&server->peer)) {
 		count_inc(CNT_S_LOOP);
-	} while (ret == -EAGAIN);
+		if (unlikely(ret && ret != -EAGAIN && ret != -EBUSY)) return ret;
 
-	count_inc(CNT_S_WAIT);
-	/*
-	 * Phase 3: Now await the next call! We spin as we're idle
-	 * priority.
-	 */
-	while (ps_load(&ep->client) == NULL) ;
-	/*
-	 * FIXME: If we are repriorized at higher than the client, we
-	 * might preempt it after it sets ->client, but before it sets
-	 * the arguments. The *correct* design is to create a PASSIVE
-	 * priority in which threads only execute using explicit
-	 * switches from other, properly prioritized threads. Such
-	 * threads could *not* reprioritize.
-	 */
-	*ret0 = ep->a0;
-	*ret1 = ep->a1;
+		slm_cs_enter(t, SLM_CS_NONE);
+		if (ps_load(&server->peer)) {
+			slm_cs_exit(NULL, SLM_CS_NONE);
+			break;
+		}
+		ret = ipc_block_switch(t, NULL, 0);
+	}
 
 	count_inc(CNT_S_RET);
+	*ret0 = server->peer->a0;
+	*ret1 = server->peer->a1;
 
 	return 0;
 }
@@ -1,5 +1,5 @@
 #include <slm.h>
-#include <slm_modules.h>
+#include "slm_modules.h"
 #include <capmgr.h>
 
 struct slm_thd_container *
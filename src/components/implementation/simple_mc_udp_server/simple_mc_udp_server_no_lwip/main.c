@@ -139,17 +139,13 @@ parallel_main(coreid_t cid)
 	if (cos_compid() == 21 && cid != 16) {
 		return 0;
 	}
-	int ret;
+	int ret, i, n;
 	u32_t ip;
 	compid_t compid;
 	u16_t port;
-	shm_bm_objid_t objid;
-	struct netshmem_pkt_buf *rx_obj;
-	struct netshmem_pkt_buf *tx_obj;
-	char *data;
-	u16_t data_offset, data_len;
-	u16_t remote_port;
-	u32_t remote_addr;
+	shm_bm_objid_t msgsid;
+	struct netshmem_pkt_buf *msgs_buf;
+	struct udp_stack_msg *msgs;
 
 	ret = 0;
 	ip = inet_addr("10.10.1.2");
@@ -162,23 +158,22 @@ parallel_main(coreid_t cid)
 	printc("tenant id:%d\n", port);
 	ret = udp_stack_udp_bind(ip, port);
 	assert(ret == 0);
-	objid = 0;
-	remote_addr = inet_addr("10.10.1.1");
-	remote_port = 6;
-	cycles_t    before, after;
-	
+	/* the datagrams are read and written in batches, described in this shmem object */
+	msgs_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &msgsid);
+	assert(msgs_buf);
+	msgs = (struct udp_stack_msg *)msgs_buf->data;
+
 	while (1)
 	{
-		objid  = udp_stack_shmem_read(&data_offset, &data_len, &remote_addr, &remote_port);
+		/* invalid packets are dropped by the udp stack */
+		n = udp_stack_shmem_read_batch(msgsid, UDP_STACK_BATCH_MAX);
 
-		/* application would like to own the shmem because it does not want ohters to free it. */
-		rx_obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
-		if (unlikely(data_len == 0)) {
-			//invalid packet, drop it
-			shm_bm_free_net_pkt_buf(rx_obj);
-			continue;
+		for (i = 0; i < n; i++) {
+			/* the reply is written in place of the command */
+			msgs[i].data_len    = mc_process_command(fd, msgs[i].objid, msgs[i].data_offset, msgs[i].data_len);
+			msgs[i].data_offset = netshmem_get_data_offset();
 		}
-		data_len = mc_process_command(fd, objid, data_offset, data_len);
-		udp_stack_shmem_write(objid, netshmem_get_data_offset(), data_len, remote_addr, remote_port);
+		/* the nicmgr frees the objects once the replies are sent */
+		udp_stack_shmem_write_batch(msgsid, n);
 	}
 }
@@ -28,17 +28,14 @@ cos_init(void)
 int
 parallel_main(coreid_t cid)
 {
-	int ret;
+	int ret, conn, i, n;
 	u32_t ip;
 	compid_t compid;
 	u16_t port;
-	shm_bm_objid_t objid;
+	shm_bm_objid_t msgsid;
 	struct netshmem_pkt_buf *rx_obj;
-	struct netshmem_pkt_buf *tx_obj;
-	char *data;
-	u16_t data_offset, data_len;
-	u16_t remote_port;
-	u32_t remote_addr;
+	struct netshmem_pkt_buf *msgs_buf;
+	struct netmgr_udp_msg *msgs;
 
 	ret = 0;
 	ip = inet_addr("10.10.1.2");
@@ -50,19 +47,30 @@ parallel_main(coreid_t cid)
 
 	printc("tenant id:%d\n", port);
 
-	ret = netmgr_udp_bind(ip, port);
-	assert(ret == NETMGR_OK);
+	conn = netmgr_udp_bind(ip, port);
+	assert(conn > 0);
+
+	/* the datagrams are read and written in batches, described in this shmem object */
+	msgs_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &msgsid);
+	assert(msgs_buf);
+	msgs = (struct netmgr_udp_msg *)msgs_buf->data;
 
 	while (1)
 	{
-		objid  = netmgr_udp_shmem_read(&data_offset, &data_len, &remote_addr, &remote_port);
-
-		/* application would like to own the shmem because it does not want ohters to free it. */
-		rx_obj = shm_bm_transfer_net_pkt_buf(netshmem_get_shm(), objid);
+		n = netmgr_udp_shmem_read_batch(conn, msgsid, NETMGR_UDP_BATCH_MAX);
+		assert(n > 0);
 
-		data_len = mc_process_command(fd, objid, data_offset, data_len);
-		netmgr_udp_shmem_write(objid, netshmem_get_data_offset(), data_len, remote_addr, remote_port);
+		for (i = 0; i < n; i++) {
+			/* the reply is written in place of the command */
+			msgs[i].data_len    = mc_process_command(fd, msgs[i].objid, msgs[i].data_offset, msgs[i].data_len);
+			msgs[i].data_offset = netshmem_get_data_offset();
+		}
+		netmgr_udp_shmem_write_batch(conn, msgsid, n);
 
-		shm_bm_free_net_pkt_buf(rx_obj);
+		for (i = 0; i < n; i++) {
+			/* application would like to own the shmem because it does not want ohters to free it. */
+			rx_obj = shm_bm_transfer_net_pkt_buf(netshmem_get_shm(), msgs[i].objid);
+			shm_bm_free_net_pkt_buf(rx_obj);
+		}
 	}
 }
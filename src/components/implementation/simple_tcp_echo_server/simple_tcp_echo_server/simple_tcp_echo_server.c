@@ -4,57 +4,73 @@
 #include <netmgr.h>
 #include <netshmem.h>
 
-void
-cos_init(void)
+/* Echo the data of connection `conn`, returns !0 once it is closed */
+static int
+echo(int conn)
 {
-	shm_bm_objid_t objid;
-	struct netshmem_pkt_buf *obj;
+	shm_bm_objid_t           objid;
+	struct netshmem_pkt_buf *rx_obj;
+	struct netshmem_pkt_buf *tx_obj;
+	char *data;
+	u16_t data_offset, data_len;
 
-	/* create current component's shmem */
-	netshmem_create();
+	objid = netmgr_tcp_shmem_read(conn, &data_offset, &data_len);
+	if (data_len == 0) return 1;
 
-	netmgr_shmem_map(netshmem_get_shm_id());
+	/* the data read is the application's */
+	rx_obj = shm_bm_transfer_net_pkt_buf(netshmem_get_shm(), objid);
+	data   = rx_obj->data + data_offset;
+
+	tx_obj = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &objid);
+	assert(tx_obj);
+	memcpy(netshmem_get_data_buf(tx_obj), data, data_len);
+
+	/* application free unused rx buf */
+	shm_bm_free_net_pkt_buf(rx_obj);
 
-	printc("app init shm done\n");
+	netmgr_tcp_shmem_write(conn, objid, netshmem_get_data_offset(), data_len);
+	shm_bm_free_net_pkt_buf(tx_obj);
+
+	return 0;
 }
 
+/*
+ * The server runs on the core of its netmgr, if that is one of per-core
+ * netmgrs: each of their servers then accepts the connections RSS
+ * spreads to its core.
+ */
 int
-main(void)
+parallel_main(coreid_t cid)
 {
-	int ret		= 0;
 	u32_t ip	= inet_addr("10.10.1.2");
 	u16_t port	= 80;
 	struct conn_addr client_addr;
-	shm_bm_objid_t           objid;
-	struct netshmem_pkt_buf *rx_obj;
-	struct netshmem_pkt_buf *tx_obj;
-	char *data;
-	u16_t data_offset, data_len;
+	int listen_conn, conn, ret;
 
-	ret = netmgr_tcp_bind(ip, port);
-	assert(ret == NETMGR_OK);
+	if (cid != (NETMGR_CORE < 0 ? 0 : NETMGR_CORE)) return 0;
 
-	ret = netmgr_tcp_listen(16);
-	assert(ret == NETMGR_OK);
+	/* create this thread's shmem */
+	netshmem_create();
+	netmgr_shmem_map(netshmem_get_shm_id());
+
+	listen_conn = netmgr_tcp_bind(ip, port);
+	assert(listen_conn > 0);
 
-	printc("App begin to accept connection\n");
-	ret = netmgr_tcp_accept(&client_addr);
+	ret = netmgr_tcp_listen(listen_conn, 128);
 	assert(ret == NETMGR_OK);
 
+	printc("App begin to accept connections on core %d\n", cid);
+
+	/* Serve all of the clients from this thread, as their connections get ready */
 	while (1)
 	{
-		objid  = netmgr_tcp_shmem_read(&data_offset, &data_len);
-		rx_obj = shm_bm_take_net_pkt_buf(netshmem_get_shm(), objid);
-		
-		data = rx_obj->data + data_offset;
-
-		tx_obj = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &objid);
-		memcpy(netshmem_get_data_buf(tx_obj), data, data_len);
-
-		/* application free unused rx buf */
-		shm_bm_free_net_pkt_buf(rx_obj);
+		conn = netmgr_conn_wait();
 
-		netmgr_tcp_shmem_write(objid, netshmem_get_data_offset(), data_len);
-		shm_bm_free_net_pkt_buf(tx_obj);
+		if (conn == listen_conn) {
+			conn = netmgr_tcp_accept(listen_conn, &client_addr);
+			assert(conn > 0);
+			continue;
+		}
+		if (echo(conn)) netmgr_tcp_close(conn);
 	}
 }
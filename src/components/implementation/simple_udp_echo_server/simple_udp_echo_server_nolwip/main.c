@@ -4,6 +4,11 @@
 #include <netshmem.h>
 #include <simple_udp_stack.h>
 
+/* The most datagrams read and echoed at once: 1 to measure the server without batching */
+#ifndef UDP_ECHO_BATCH
+#define UDP_ECHO_BATCH UDP_STACK_BATCH_MAX
+#endif
+
 struct conn_addr {
 	u32_t ip;
 	u16_t port;
@@ -24,45 +29,37 @@ cos_init(void)
 int
 parallel_main(coreid_t cid)
 {
-	int ret;
+	int ret, n;
 	u32_t ip;
 	compid_t compid;
 	u16_t port;
-	shm_bm_objid_t objid;
-	struct netshmem_pkt_buf *rx_obj;
-	struct netshmem_pkt_buf *tx_obj;
-	char *data;
-	u16_t data_offset, data_len;
-	u16_t remote_port;
-	u32_t remote_addr;
+	shm_bm_objid_t msgsid;
+	struct netshmem_pkt_buf *msgs_buf;
 
 	ret = 0;
 	ip = inet_addr("10.10.1.2");
 	compid = cos_compid();
 
-	/* we use comp id as UDP port, representing tenant id */
+	/* we use comp id as UDP port, representing tenant id, unless a benchmark sets it */
 	assert(compid < (1 << 16));
 	port	= (u16_t)compid;
+#ifdef UDP_ECHO_PORT
+	port	= UDP_ECHO_PORT;
+#endif
 
 	printc("tenant id:%d\n", port);
 	ret = udp_stack_udp_bind(ip, port);
 	assert(ret == 0);
 
+	/* the datagrams are read and written in batches, described in this shmem object */
+	msgs_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &msgsid);
+	assert(msgs_buf);
+
 	while (1)
 	{
-		objid  = udp_stack_shmem_read(&data_offset, &data_len, &remote_addr, &remote_port);
-		/* application would like to own the shmem because it does not want ohters to free it. */
-		rx_obj = shm_bm_transfer_net_pkt_buf(netshmem_get_shm(), objid);
-		data = rx_obj->data + data_offset;
-
-		tx_obj = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &objid);
-		assert(tx_obj);
-		memcpy(netshmem_get_data_buf(tx_obj), data, data_len);
-
-		/* application free unused rx buf */
-		shm_bm_free_net_pkt_buf(rx_obj);
+		n = udp_stack_shmem_read_batch(msgsid, UDP_ECHO_BATCH);
 
-		udp_stack_shmem_write(objid, netshmem_get_data_offset(), data_len, remote_addr, remote_port);
-		shm_bm_free_net_pkt_buf(tx_obj);
+		/* the datagrams are sent back in place, and the nicmgr frees them once they are sent */
+		udp_stack_shmem_echo_batch(msgsid, n);
 	}
 }
@@ -21,17 +21,16 @@ cos_init(void)
 int
 parallel_main(coreid_t cid)
 {
-	int ret;
+	int ret, conn, i, n;
 	u32_t ip;
 	compid_t compid;
 	u16_t port;
-	shm_bm_objid_t objid;
+	shm_bm_objid_t objid, msgsid;
 	struct netshmem_pkt_buf *rx_obj;
 	struct netshmem_pkt_buf *tx_obj;
+	struct netshmem_pkt_buf *msgs_buf;
+	struct netmgr_udp_msg *msgs;
 	char *data;
-	u16_t data_offset, data_len;
-	u16_t remote_port;
-	u32_t remote_addr;
 
 	ret = 0;
 	ip = inet_addr("10.10.1.2");
@@ -42,24 +41,39 @@ parallel_main(coreid_t cid)
 	port	= (u16_t)compid;
 
 	printc("tenant id:%d\n", port);
-	ret = netmgr_udp_bind(ip, port);
-	assert(ret == NETMGR_OK);
+	conn = netmgr_udp_bind(ip, port);
+	assert(conn > 0);
+
+	/* the datagrams are read and written in batches, described in this shmem object */
+	msgs_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &msgsid);
+	assert(msgs_buf);
+	msgs = (struct netmgr_udp_msg *)msgs_buf->data;
 
 	while (1)
 	{
-		objid  = netmgr_udp_shmem_read(&data_offset, &data_len, &remote_addr, &remote_port);
-		/* application would like to own the shmem because it does not want ohters to free it. */
-		rx_obj = shm_bm_transfer_net_pkt_buf(netshmem_get_shm(), objid);
-		data = rx_obj->data + data_offset;
+		n = netmgr_udp_shmem_read_batch(conn, msgsid, NETMGR_UDP_BATCH_MAX);
+		assert(n > 0);
+
+		for (i = 0; i < n; i++) {
+			/* application would like to own the shmem because it does not want ohters to free it. */
+			rx_obj = shm_bm_transfer_net_pkt_buf(netshmem_get_shm(), msgs[i].objid);
+			data = rx_obj->data + msgs[i].data_offset;
+
+			tx_obj = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &objid);
+			assert(tx_obj);
+			memcpy(netshmem_get_data_buf(tx_obj), data, msgs[i].data_len);
 
-		tx_obj = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &objid);
-		assert(tx_obj);
-		memcpy(netshmem_get_data_buf(tx_obj), data, data_len);
+			/* application free unused rx buf */
+			shm_bm_free_net_pkt_buf(rx_obj);
 
-		/* application free unused rx buf */
-		shm_bm_free_net_pkt_buf(rx_obj);
+			/* the reply goes back to the datagram's source */
+			msgs[i].objid       = objid;
+			msgs[i].data_offset = netshmem_get_data_offset();
+		}
 
-		netmgr_udp_shmem_write(objid, netshmem_get_data_offset(), data_len, remote_addr, remote_port);
-		shm_bm_free_net_pkt_buf(tx_obj);
+		netmgr_udp_shmem_write_batch(conn, msgsid, n);
+		for (i = 0; i < n; i++) {
+			shm_bm_free_net_pkt_buf(shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), msgs[i].objid));
+		}
 	}
 }
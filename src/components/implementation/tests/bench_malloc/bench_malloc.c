@@ -0,0 +1,123 @@
+#include <cos_component.h>
+#include <llprint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cos_time.h>
+#include <perfdata.h>
+#include <barrier.h>
+#include <init.h>
+#include <sched.h>
+
+/*
+ * Each core measures the latency of malloc/free pairs of a range of
+ * sizes, of bursts of allocations followed by their frees (that
+ * exercise the refill and flush of the thread's cache), and of frees
+ * of objects allocated on another core (that go through the remote
+ * free queues).
+ */
+#define ITERATION 1024
+#define BURST     256
+
+static size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384 };
+#define NSIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+struct bench_core {
+	struct perfdata perf;
+	cycles_t        results[ITERATION];
+	void           *objs[BURST];
+} CACHE_ALIGNED;
+
+static struct bench_core cores[NUM_CPU];
+static struct simple_barrier barrier;
+static int nparallel;
+
+static void
+bench_report(struct bench_core *c, const char *nm, size_t sz, int n)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "Core %ld: %s (%lu bytes)", cos_cpuid(), nm, (unsigned long)sz);
+	perfdata_init(&c->perf, name, c->results, n);
+	perfdata_calc(&c->perf);
+	perfdata_print(&c->perf);
+}
+
+static void
+bench_pairs(struct bench_core *c, size_t sz)
+{
+	cycles_t start, end;
+	void *p;
+	int i;
+
+	for (i = 0; i < ITERATION; i++) {
+		start = time_now();
+		p     = malloc(sz);
+		free(p);
+		end   = time_now();
+		assert(p);
+		c->results[i] = end - start;
+	}
+	bench_report(c, "malloc/free pair", sz, ITERATION);
+}
+
+static void
+bench_bursts(struct bench_core *c, size_t sz)
+{
+	cycles_t start, end;
+	int i, j;
+
+	for (i = 0; i < ITERATION / BURST; i++) {
+		start = time_now();
+		for (j = 0; j < BURST; j++) c->objs[j] = malloc(sz);
+		end   = time_now();
+		c->results[i * 2] = (end - start) / BURST;
+
+		start = time_now();
+		for (j = 0; j < BURST; j++) free(c->objs[j]);
+		end   = time_now();
+		c->results[i * 2 + 1] = (end - start) / BURST;
+	}
+	bench_report(c, "burst malloc and free", sz, ITERATION / BURST * 2);
+}
+
+static void
+bench_remote(struct bench_core *c, size_t sz)
+{
+	struct bench_core *from = &cores[(cos_cpuid() + 1) % nparallel];
+	cycles_t start, end;
+	int i;
+
+	for (i = 0; i < BURST; i++) c->objs[i] = malloc(sz);
+	simple_barrier(&barrier);
+
+	for (i = 0; i < BURST; i++) {
+		start = time_now();
+		free(from->objs[i]);
+		end   = time_now();
+		c->results[i] = end - start;
+	}
+	bench_report(c, "free of another core's objects", sz, BURST);
+}
+
+void
+cos_init(void)
+{
+	nparallel = init_parallelism();
+	simple_barrier_init(&barrier, nparallel);
+}
+
+void
+parallel_main(coreid_t cid, int init_core, int ncores)
+{
+	struct bench_core *c = &cores[cid];
+	int i;
+
+	for (i = 0; i < NSIZES; i++) bench_pairs(c, sizes[i]);
+	for (i = 0; i < NSIZES; i++) bench_bursts(c, sizes[i]);
+	/* All cores take part, once */
+	bench_remote(c, 64);
+
+	printc("SUCCESS: malloc benchmark on core %ld\n", cos_cpuid());
+	sched_thd_block(0);
+}
@@ -0,0 +1,290 @@
+#include <cos_types.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <llprint.h>
+#include <sched.h>
+#include <netshmem.h>
+#include <nic.h>
+#include <net_stack_types.h>
+#include <simple_udp_stack.h>
+#include <perfdata.h>
+#include <cos_time.h>
+
+/*
+ * An in-system traffic generator for the nicmgr. The sender thread
+ * injects TRAFGEN_NFLOWS flows of UDP or TCP packets at
+ * TRAFGEN_RATE_PPS, or as fast as the nicmgr queues them (0). The
+ * flows differ by their source address. The packets carry the time
+ * they are sent, and the receiver thread measures their round-trip
+ * latency once they come back: through the nicmgr's loopback virtual
+ * NIC, or from a reflector on the wire that swaps their addresses.
+ */
+#define TRAFGEN_PROTO        UDP_PROTO
+#define TRAFGEN_NFLOWS       16
+#define TRAFGEN_PKT_LEN      128 /* the frame, without its FCS */
+#define TRAFGEN_RATE_PPS     0
+#define TRAFGEN_BURST        32
+#define TRAFGEN_BACKOFF_USEC 10
+/* The latency and throughput are reported every TRAFGEN_SAMPLES packets */
+#define TRAFGEN_SAMPLES      PERF_VAL_MAX_SZ
+
+#define TRAFGEN_IP           "10.10.1.2" /* flow i is from TRAFGEN_IP + i */
+#define TRAFGEN_PORT         7000 /* the receiver's: the packets are from it, and come back to it */
+#define TRAFGEN_TX_PORT      7001 /* the sender's session */
+/* The packets are sent to an echo server's port to measure it, and come back to the receiver */
+#ifndef TRAFGEN_DST_PORT
+#define TRAFGEN_DST_PORT     TRAFGEN_PORT
+#endif
+/*
+ * The destination address, a string (e.g. value = '"10.10.1.3"' in the
+ * composition script): by default the receiver's, as the loopback NIC
+ * doesn't swap the addresses of the packets it returns.
+ */
+#ifndef TRAFGEN_DST_IP
+#define TRAFGEN_DST_IP       TRAFGEN_IP
+#endif
+/* The destination MAC address, as a 48-bit integer (e.g. 0x101010101011) */
+#ifndef TRAFGEN_DST_MAC
+#define TRAFGEN_DST_MAC      0x101010101011ULL
+#endif
+
+struct trafgen_payload {
+	cycles_t tsc;
+	u32_t    seq;
+	u32_t    flow;
+} __attribute__((packed));
+
+#define TRAFGEN_L4_LEN   (TRAFGEN_PROTO == TCP_PROTO ? TCP_STD_LEN : UDP_STD_LEN)
+#define TRAFGEN_HDRS_LEN (ETH_STD_LEN + IP_STD_LEN + TRAFGEN_L4_LEN)
+
+static struct ether_addr src_mac;
+static struct ether_addr dst_mac;
+
+static volatile unsigned long tx_sent, tx_dropped;
+
+static struct perfdata perf;
+static cycles_t        rtts[TRAFGEN_SAMPLES];
+
+static u16_t
+trafgen_pkt_build(struct netshmem_pkt_buf *obj, u32_t flow, u32_t seq)
+{
+	struct eth_hdr         *eth     = (struct eth_hdr *)obj->data;
+	struct ip_hdr          *ip      = (struct ip_hdr *)((char *)eth + ETH_STD_LEN);
+	char                   *l4      = (char *)ip + IP_STD_LEN;
+	struct trafgen_payload *payload = (struct trafgen_payload *)(l4 + TRAFGEN_L4_LEN);
+	u16_t                   l3_len  = TRAFGEN_PKT_LEN - ETH_STD_LEN;
+
+	eth->src_addr   = src_mac;
+	eth->dst_addr   = dst_mac;
+	eth->ether_type = htons(0x0800);
+
+	ip->ihl       = IP_STD_LEN / 4;
+	ip->version   = IPv4;
+	ip->tos       = 0;
+	ip->total_len = htons(l3_len);
+	ip->id        = htons((u16_t)seq);
+	ip->frag_off  = htons(0x4000); /* don't fragment */
+	ip->ttl       = 64;
+	ip->proto     = TRAFGEN_PROTO;
+	ip->checksum  = 0;
+	ip->src_addr  = htonl(ntohl(inet_addr(TRAFGEN_IP)) + flow);
+	ip->dst_addr  = inet_addr(TRAFGEN_DST_IP);
+
+	if (TRAFGEN_PROTO == TCP_PROTO) {
+		struct tcp_hdr *tcp = (struct tcp_hdr *)l4;
+
+		memset(tcp, 0, TCP_STD_LEN);
+		tcp->port.src_port = htons(TRAFGEN_PORT);
+		tcp->port.dst_port = htons(TRAFGEN_DST_PORT);
+		tcp->seq           = htonl(seq);
+		tcp->doff          = TCP_STD_LEN / 4;
+		tcp->flags         = TCP_FLAG_PSH | TCP_FLAG_ACK;
+		tcp->window        = htons(0xffff);
+	} else {
+		struct udp_hdr *udp = (struct udp_hdr *)l4;
+
+		udp->port.src_port = htons(TRAFGEN_PORT);
+		udp->port.dst_port = htons(TRAFGEN_DST_PORT);
+		udp->len           = htons(l3_len - IP_STD_LEN);
+		udp->checksum      = 0;
+	}
+
+	payload->seq  = seq;
+	payload->flow = flow;
+	payload->tsc  = time_now();
+
+	/* The checksums are set, so that the nicmgr doesn't offload them as UDP's */
+	ip->checksum = udp_stack_ip_csum_calculate(ip);
+	if (TRAFGEN_PROTO == TCP_PROTO) ((struct tcp_hdr *)l4)->checksum = udp_stack_udp_cksum(ip, l4);
+	else                            ((struct udp_hdr *)l4)->checksum = udp_stack_udp_cksum(ip, l4);
+
+	return TRAFGEN_PKT_LEN;
+}
+
+/* The payload of a received packet, NULL if it isn't one of ours */
+static struct trafgen_payload *
+trafgen_pkt_payload(char *pkt, u16_t pkt_len)
+{
+	struct eth_hdr *eth = (struct eth_hdr *)pkt;
+	struct ip_hdr  *ip  = (struct ip_hdr *)(pkt + ETH_STD_LEN);
+	u16_t           off;
+
+	if (pkt_len < TRAFGEN_HDRS_LEN + sizeof(struct trafgen_payload)) return NULL;
+	if (eth->ether_type != htons(0x0800) || ip->proto != TRAFGEN_PROTO) return NULL;
+
+	off = ETH_STD_LEN + ip->ihl * 4;
+	if (TRAFGEN_PROTO == TCP_PROTO) off += ((struct tcp_hdr *)(pkt + off))->doff * 4;
+	else                            off += UDP_STD_LEN;
+	if (off + sizeof(struct trafgen_payload) > pkt_len) return NULL;
+
+	return (struct trafgen_payload *)(pkt + off);
+}
+
+/* Each thread has its own shmem and nicmgr session */
+static void
+trafgen_session_init(u16_t port)
+{
+	netshmem_create();
+	nic_shmem_map(netshmem_get_shm_id());
+	nic_bind_port(inet_addr(TRAFGEN_IP), htons(port));
+}
+
+static void
+trafgen_send(void *d)
+{
+	struct netshmem_pkt_buf *objs[TRAFGEN_BURST], *desc_buf;
+	shm_bm_objid_t           objids[TRAFGEN_BURST], descid;
+	struct nic_pkt_desc     *descs;
+	cycles_t                 period, next, now;
+	u32_t                    seq = 0;
+	int                      i, n, sent;
+
+	trafgen_session_init(TRAFGEN_TX_PORT);
+	desc_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &descid);
+	assert(desc_buf);
+	descs = (struct nic_pkt_desc *)desc_buf->data;
+
+	period = TRAFGEN_RATE_PPS ? time_usec2cyc(1000000) / TRAFGEN_RATE_PPS : 0;
+	next   = time_now();
+
+	while (1) {
+		n = shm_bm_alloc_n_net_pkt_buf(netshmem_get_shm(), (void **)objs, objids, TRAFGEN_BURST);
+		if (n == 0) {
+			/* All of the objects are queued, the nicmgr frees them once they are sent */
+			sched_thd_block_timeout(0, time_now() + time_usec2cyc(TRAFGEN_BACKOFF_USEC));
+			continue;
+		}
+
+		for (i = 0; i < n; i++, seq++) {
+			descs[i].objid      = objids[i];
+			descs[i].pkt_offset = 0;
+			descs[i].pkt_len    = trafgen_pkt_build(objs[i], seq % TRAFGEN_NFLOWS, seq);
+		}
+		/* The packets that are not queued are dropped (and freed) by the nicmgr */
+		sent        = nic_send_packets(descid, n);
+		tx_sent    += sent;
+		tx_dropped += n - sent;
+
+		if (!period) continue;
+		/* Don't catch up on the time spent preempted with a larger burst */
+		now = time_now();
+		if (next < now) next = now;
+		next += n * period;
+		while (time_now() < next) ;
+	}
+}
+
+static void
+trafgen_report(cycles_t elapsed, unsigned long npkts, unsigned long long bytes)
+{
+	microsec_t usecs = time_cyc2usec(elapsed);
+
+	if (usecs == 0) usecs = 1;
+	printc("trafgen: received %lu packets in %llu usec: %llu pps, %llu Mbps (sent %lu, dropped %lu)\n",
+	       npkts, (unsigned long long)usecs, (unsigned long long)npkts * 1000000 / usecs, bytes * 8 / usecs,
+	       tx_sent, tx_dropped);
+	perfdata_calc(&perf);
+	perfdata_print(&perf);
+}
+
+static void
+trafgen_recv(void *d)
+{
+	struct netshmem_pkt_buf *objs[NIC_PKT_BURST_MAX], *desc_buf;
+	struct trafgen_payload  *payload;
+	struct nic_pkt_desc     *descs;
+	shm_bm_objid_t           descid;
+	cycles_t                 start, now;
+	unsigned long            npkts = 0;
+	unsigned long long       bytes = 0;
+	int                      i, n;
+
+	trafgen_session_init(TRAFGEN_PORT);
+	desc_buf = shm_bm_alloc_net_pkt_buf(netshmem_get_shm(), &descid);
+	assert(desc_buf);
+	descs = (struct nic_pkt_desc *)desc_buf->data;
+
+	perfdata_init(&perf, "trafgen: round-trip latency (cycles)", rtts, TRAFGEN_SAMPLES);
+	start = time_now();
+
+	while (1) {
+		n   = nic_get_packets(descid, NIC_PKT_BURST_MAX);
+		now = time_now();
+
+		for (i = 0; i < n; i++) {
+			objs[i] = shm_bm_transfer_net_pkt_buf(netshmem_get_shm(), descs[i].objid);
+			assert(objs[i]);
+
+			payload = trafgen_pkt_payload(objs[i]->data + descs[i].pkt_offset, descs[i].pkt_len);
+			if (payload) perfdata_add(&perf, now - payload->tsc);
+			bytes += descs[i].pkt_len;
+		}
+		shm_bm_free_n_net_pkt_buf((void **)objs, n);
+		npkts += n;
+
+		if (perfdata_sz(&perf) < TRAFGEN_SAMPLES) continue;
+		trafgen_report(now - start, npkts, bytes);
+		perfdata_init(&perf, "trafgen: round-trip latency (cycles)", rtts, TRAFGEN_SAMPLES);
+		npkts = 0;
+		bytes = 0;
+		start = time_now();
+	}
+}
+
+void
+cos_init(void)
+{
+	u64_t mac = nic_get_port_mac_address(0);
+	char *mac_addr = (char *)&mac;
+	int   i;
+
+	/* The nicmgr returns the address in the reverse order */
+	for (i = 0; i < 6; i++) src_mac.addr_bytes[i] = mac_addr[5 - i];
+	for (i = 0; i < 6; i++) dst_mac.addr_bytes[i] = (u8_t)((u64_t)TRAFGEN_DST_MAC >> (8 * (5 - i)));
+
+	printc("NIC traffic generator: %d %s flows of %d byte packets, at %s\n", TRAFGEN_NFLOWS,
+	       TRAFGEN_PROTO == TCP_PROTO ? "TCP" : "UDP", TRAFGEN_PKT_LEN, TRAFGEN_RATE_PPS ? "a fixed rate" : "line rate");
+}
+
+int
+main(void)
+{
+	sched_param_t rx_prio = SCHED_PARAM_CONS(SCHEDP_PRIO, 4);
+	sched_param_t tx_prio = SCHED_PARAM_CONS(SCHEDP_PRIO, 6);
+	thdid_t       rx, tx;
+
+	/* The receiver has the higher priority, so that it binds first and is not starved by the sender */
+	rx = sched_thd_create(trafgen_recv, NULL);
+	assert(rx);
+	sched_thd_param_set(rx, rx_prio);
+
+	tx = sched_thd_create(trafgen_send, NULL);
+	assert(tx);
+	sched_thd_param_set(tx, tx_prio);
+
+	printc("Running the traffic generator, exiting main thread...\n");
+	sched_thd_block(0);
+	BUG();
+
+	return 0;
+}
@@ -5,42 +5,76 @@
 #include <perfdata.h>
 #include <syncipc.h>
 
+/*
+ * Each core runs NCLIENTS clients that call NSERVERS servers across
+ * NEPS (per-core) endpoints. Set all of them to 1 for the minimal
+ * round-trip latency between a single pair of threads.
+ */
+#define NCLIENTS  8
+#define NSERVERS  2
+#define NEPS      2
 #define ITERATION 256
-struct perfdata perf;
-cycles_t results[ITERATION] = {0, };
+
+struct bench_core {
+	struct perfdata perf;
+	cycles_t        results[NCLIENTS * ITERATION];
+	cycles_t        client_results[NCLIENTS][ITERATION];
+	unsigned long   nclients_done;
+	cycles_t        start, end;
+} CACHE_ALIGNED;
+
+struct bench_core cores[NUM_CPU];
+
+static void
+bench_report(struct bench_core *c)
+{
+	cycles_t elapsed = c->end - c->start;
+	int i, j;
+
+	perfdata_init(&c->perf, "Synchronous IPC round trip latency", c->results, NCLIENTS * ITERATION);
+	for (i = 0; i < NCLIENTS; i++) {
+		for (j = 0; j < ITERATION; j++) perfdata_add(&c->perf, c->client_results[i][j]);
+	}
+	perfdata_calc(&c->perf);
+	perfdata_print(&c->perf);
+
+	printc("Core %ld: %d clients, %d servers, %d endpoints: %llu cycles per call (throughput)\n",
+	       cos_cpuid(), NCLIENTS, NSERVERS, NEPS, elapsed / (NCLIENTS * ITERATION));
+}
 
 static void
 client(void *d)
 {
+	int idx = (int)(word_t)d;
+	struct bench_core *c = &cores[cos_cpuid()];
 	word_t arg0 = 0, arg1 = 1;
 	cycles_t start, end;
 	int i;
 
-	sched_thd_block_timeout(0, time_now() + (1 << 15));
+	if (c->start == 0) c->start = time_now();
 
 	for (i = 0; i < ITERATION; i++) {
 		word_t ret0 = 0, ret1 = 0;
 		int ret;
 
 		start = time_now();
-		ret   = syncipc_call(0, arg0, arg1, &ret0, &ret1);
+		/* Clients block on the endpoint until a server awaits calls on it */
+		ret   = syncipc_call(idx % NEPS, arg0, arg1, &ret0, &ret1);
 		end   = time_now();
-		/*
-		 * This assertion might mean that the client executed
-		 * *before* the server (ret == -EAGAIN), which means
-		 * that the delay above is not sufficient.
-		 */
 		assert(ret == 0);
+		assert(ret0 == arg0 && ret1 == arg1);
 
 		arg0++;
 		arg1++;
 
-		perfdata_add(&perf, end - start);
+		c->client_results[idx][i] = end - start;
 	}
-	perfdata_calc(&perf);
-	perfdata_print(&perf);
 
-	printc("SUCCESS: synchronous IPC between threads\n");
+	if (ps_faa(&c->nclients_done, 1) == NCLIENTS - 1) {
+		c->end = time_now();
+		bench_report(c);
+		printc("SUCCESS: synchronous IPC between threads\n");
+	}
 
 	sched_thd_block(0);
 }
@@ -48,37 +82,42 @@ client(void *d)
 static void
 server(void *d)
 {
+	int ep = (int)(word_t)d;
 	word_t ret0 = 0, ret1 = 0;
 
 	while (1) {
 		int ret;
 		word_t arg0 = ret0, arg1 = ret1;
 
-		ret = syncipc_reply_wait(0, arg0, arg1, &ret0, &ret1);
+		/* Echo the arguments back to the client */
+		ret = syncipc_reply_wait(ep, arg0, arg1, &ret0, &ret1);
 		if (ret != 0) {
 			printc("syncipc benchmark: server reply_wait returned %d\n", ret);
 		}
 	}
 }
 
-int
-main(void)
+void
+parallel_main(coreid_t cid, int init_core, int ncores)
 {
 	thdid_t tid;
 	sched_param_t sps[] = {
 		SCHED_PARAM_CONS(SCHEDP_PRIO, 4),
 		SCHED_PARAM_CONS(SCHEDP_PRIO, 6),
 	};
+	int i;
 
-	perfdata_init(&perf, "Synchronous IPC round trip latency", results, ITERATION);
-
-	tid = sched_thd_create(client, NULL);
-	assert(tid > 0);
-	sched_thd_param_set(tid, sps[0]);
+	for (i = 0; i < NSERVERS; i++) {
+		tid = sched_thd_create(server, (void *)(word_t)(i % NEPS));
+		assert(tid > 0);
+		sched_thd_param_set(tid, sps[1]);
+	}
 
-	tid = sched_thd_create(server, NULL);
-	assert(tid > 0);
-	sched_thd_param_set(tid, sps[1]);
+	for (i = 0; i < NCLIENTS; i++) {
+		tid = sched_thd_create(client, (void *)(word_t)i);
+		assert(tid > 0);
+		sched_thd_param_set(tid, sps[0]);
+	}
 
 	sched_thd_block(0);
 }
@@ -13,6 +13,8 @@ static compid_t test_compid = 2;
 static compid_t chkpt_compid = 3;
 
 static u32_t test_var = 2;
+/* Pages of the bss that the component created from the checkpoint dirties */
+static char test_buf[4 * PAGE_SIZE];
 
 void
 cos_init(void)
@@ -37,4 +39,8 @@ parallel_main(coreid_t cid)
 	assert(test_var == 5);
 
 	printc("Success: Checkpoint created and executed\n");
+
+	/* Dirty the data and bss, that the booter restores once we return */
+	test_var = 7;
+	memset(test_buf, 1, sizeof(test_buf));
 }
@@ -43,10 +43,29 @@ test_aligned_allocation_continuity()
 
 }
 
+static void
+test_multichunk_reuse()
+{
+	/* Runs of several heap chunks, many more times than there are chunks */
+	unsigned long n = 2000;
+	int           i;
+	char         *ptr;
+
+	for (i = 0; i < 200; i++) {
+		ptr = (char *)memmgr_heap_page_allocn(n);
+		if (!ptr) break;
+		ptr[0] = ptr[n * 4096 - 1] = '\1';
+		memmgr_heap_page_freen((vaddr_t)ptr, n);
+	}
+
+	printc("%s: Freed multi-page runs are reused\n", (i < 200) ? "FAILURE" : "SUCCESS");
+}
+
 int
 main(void)
 {
 	test_alignment();
 	test_aligned_allocation_continuity();
+	test_multichunk_reuse();
 	return 0;
 }
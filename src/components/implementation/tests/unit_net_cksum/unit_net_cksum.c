@@ -0,0 +1,133 @@
+#include <llprint.h>
+#include <net_cksum.h>
+
+/***
+ * Compare the vectorized checksum, and its incremental updates,
+ * against a byte-wise reference. Lengths cover the odd ones, and
+ * those around the vector loop's bound (2 * NET_CKSUM_VEC_SZ), at
+ * every offset from an aligned address.
+ */
+
+#define MAX_OFF  8
+/* past twice the vector loop bound, for the largest (AVX2) vectors */
+#define MAX_LEN  (4 * 32 + 8)
+#define PKT_LEN  1514
+#define HDR_LEN  40
+#define ITERATION 4096
+
+static u8_t buf[MAX_OFF + PKT_LEN];
+
+static u32_t rand_state = 0x2545f491;
+
+static u32_t
+test_rand(void)
+{
+	/* xorshift32: deterministic, thus failures are reproducible */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+/* RFC 1071 a byte at a time: pairs of bytes, in memory order, make a 16-bit word */
+static u16_t
+ref_cksum(const u8_t *p, size_t len, u64_t sum)
+{
+	size_t i;
+	u16_t w;
+
+	for (i = 0; i < len; i += 2) {
+		w = 0;
+		((u8_t *)&w)[0] = p[i];
+		if (i + 1 < len) ((u8_t *)&w)[1] = p[i + 1];
+		sum += w;
+	}
+	while (sum >> 16) sum = (sum >> 16) + (sum & 0xffff);
+
+	return (u16_t)sum;
+}
+
+static void
+fill(u8_t *p, size_t len, int ones)
+{
+	size_t i;
+
+	/* all ones maximizes the carries to fold back in */
+	for (i = 0; i < len; i++) p[i] = ones ? 0xff : (u8_t)test_rand();
+}
+
+static int
+test_raw(void)
+{
+	size_t off, len;
+	int ones;
+
+	for (ones = 0; ones < 2; ones++) {
+		fill(buf, sizeof(buf), ones);
+		for (off = 0; off < MAX_OFF; off++) {
+			for (len = 0; len <= MAX_LEN; len++) {
+				u64_t init = len % 3 ? test_rand() : 0;
+
+				if (net_cksum_fold(net_cksum_raw(buf + off, len, init)) != ref_cksum(buf + off, len, init)) {
+					printc("FAIL: net_cksum_raw, offset %lu, length %lu, ones %d\n", off, len, ones);
+					return -1;
+				}
+			}
+			len = PKT_LEN - off;
+			if (net_cksum_fold(net_cksum_raw(buf + off, len, 0)) != ref_cksum(buf + off, len, 0)) {
+				printc("FAIL: net_cksum_raw, offset %lu, length %lu, ones %d\n", off, len, ones);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int
+test_adjust(void)
+{
+	u8_t *hdr = buf + 2;
+	u16_t cksum, from16, to16;
+	u32_t from32, to32;
+	size_t off;
+	int i;
+
+	for (i = 0; i < ITERATION; i++) {
+		fill(hdr, HDR_LEN, 0);
+		cksum = ~ref_cksum(hdr, HDR_LEN, 0);
+
+		/* the extremes of a field's value, as well as random ones */
+		off  = (test_rand() % (HDR_LEN / 2)) * 2;
+		to16 = i % 4 == 0 ? 0 : (i % 4 == 1 ? 0xffff : (u16_t)test_rand());
+		memcpy(&from16, hdr + off, sizeof(from16));
+		memcpy(hdr + off, &to16, sizeof(to16));
+		if (net_cksum_adjust16(cksum, from16, to16) != (u16_t)~ref_cksum(hdr, HDR_LEN, 0)) {
+			printc("FAIL: net_cksum_adjust16, %x -> %x at offset %lu\n", from16, to16, off);
+			return -1;
+		}
+
+		cksum = ~ref_cksum(hdr, HDR_LEN, 0);
+		off   = (test_rand() % (HDR_LEN / 2 - 1)) * 2;
+		to32  = i % 4 == 0 ? 0 : (i % 4 == 1 ? 0xffffffff : test_rand());
+		memcpy(&from32, hdr + off, sizeof(from32));
+		memcpy(hdr + off, &to32, sizeof(to32));
+		if (net_cksum_adjust32(cksum, from32, to32) != (u16_t)~ref_cksum(hdr, HDR_LEN, 0)) {
+			printc("FAIL: net_cksum_adjust32, %x -> %x at offset %lu\n", from32, to32, off);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+main(void)
+{
+	printc("Unit-test of the network checksum (vector size %d)\n", NET_CKSUM_VEC_SZ);
+	if (test_raw() || test_adjust()) return 0;
+	printc("SUCCESS: net_cksum_raw, net_cksum_adjust16 and net_cksum_adjust32 match the byte-wise checksum\n");
+
+	return 0;
+}
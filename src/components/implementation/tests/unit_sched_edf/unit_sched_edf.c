@@ -0,0 +1,61 @@
+#include <llprint.h>
+#include <sched.h>
+
+/***
+ * Test of the earliest deadline first scheduler
+ * (`sched.edf_quantum_static`): threads released together execute in
+ * the order of their deadlines, not of their creation.
+ */
+
+#define NTHDS 3
+
+/* Relative deadlines, in microseconds, in creation order */
+static unsigned int deadlines[NTHDS] = { 30000, 10000, 20000 };
+static int order[NTHDS];
+static volatile int nexecuted;
+
+static void
+edf_thd(void *d)
+{
+	int id = (int)(word_t)d;
+	int i;
+
+	order[nexecuted++] = id;
+	if (nexecuted == NTHDS) {
+		for (i = 1; i < NTHDS; i++) {
+			if (deadlines[order[i - 1]] > deadlines[order[i]]) {
+				printc("FAILURE: thread with deadline %uus executed before the one with %uus\n",
+				       deadlines[order[i - 1]], deadlines[order[i]]);
+				break;
+			}
+		}
+		if (i == NTHDS) printc("SUCCESS: threads executed in deadline order\n");
+	}
+
+	while (1) sched_thd_block(0);
+}
+
+void
+cos_init(void)
+{
+	printc("Unit test for EDF scheduling.\n");
+}
+
+int
+main(void)
+{
+	thdid_t tid;
+	int i;
+
+	/* The earliest deadline, so that none of the threads preempts us while we create them */
+	sched_thd_param_set(cos_thdid(), SCHED_PARAM_CONS(SCHEDP_DEADLINE, 1));
+	for (i = 0; i < NTHDS; i++) {
+		tid = sched_thd_create(edf_thd, (void *)(word_t)i);
+		assert(tid);
+		sched_thd_param_set(tid, SCHED_PARAM_CONS(SCHEDP_DEADLINE, deadlines[i]));
+	}
+
+	while (1) sched_thd_block(0);
+
+	return 0;
+}
@@ -0,0 +1,281 @@
+#include <cos_types.h>
+#include <llprint.h>
+#include <memmgr.h>
+#include <shm_bm.h>
+
+/***
+ * Tests of the per-core magazines of shm_bm: their refill from, and
+ * flush to, the bitmap; batched allocations and frees; objects freed
+ * on another core than the one that allocated them; and the
+ * exhaustion of the region, including the objects cached by other
+ * cores, and its recovery once they are freed. Run with NUM_CPU > 1
+ * for the cross-core test.
+ */
+
+#define NOBJ (4 * SHM_BM_BITMAP_BLOCK)
+
+struct obj_test {
+	word_t data[8];
+};
+
+SHM_BM_INTERFACE_CREATE(testobj, sizeof(struct obj_test), NOBJ);
+
+static shm_bm_t       shm;
+static void          *objs[NOBJ + 1];
+static void          *perm[NOBJ];
+static shm_bm_objid_t ids[NOBJ + 1];
+
+/* Cross-core test state, core 0 drives it through the steps */
+static int            step;
+static void          *remote_obj;
+static shm_bm_objid_t remote_objid;
+static int            remote_failure;
+
+#define CHECK(cond, msg)                                 \
+	do {                                             \
+		if (!(cond)) {                           \
+			printc("FAILURE: %s\n", msg);    \
+			return -1;                       \
+		}                                        \
+	} while (0)
+
+/* The fences order the accesses to the region with the steps */
+static void
+step_await(int s)
+{
+	while (ps_load(&step) != s) ;
+	ps_mem_fence();
+}
+
+static void
+step_set(int s)
+{
+	ps_mem_fence();
+	ps_store(&step, s);
+}
+
+static int
+mag_nfree(coreid_t c)
+{
+	return __builtin_popcountl(SHM_BM_CORE(shm)[c].mag & SHM_BM_MAG_MASK);
+}
+
+/* The half-word of the bitmap the magazine of core `c` caches */
+static unsigned int
+mag_half(coreid_t c)
+{
+	return (SHM_BM_CORE(shm)[c].mag >> SHM_BM_MAG_BITS) - 1;
+}
+
+static int
+bm_nfree(void)
+{
+	unsigned int i;
+	int n = 0;
+
+	for (i = 0; i < SHM_BM_BITS_TO_WORDS(NOBJ); i++) n += __builtin_popcountl(SHM_BM_BM(shm)[i]);
+
+	return n;
+}
+
+static int
+bm_isfree(shm_bm_objid_t id)
+{
+	return (SHM_BM_BM(shm)[id / SHM_BM_BITMAP_BLOCK] >> (SHM_BM_BITMAP_BLOCK - 1 - id % SHM_BM_BITMAP_BLOCK)) & 1;
+}
+
+static int
+test_mag_refill_flush(void)
+{
+	coreid_t       c = cos_cpuid();
+	unsigned int   half;
+	int            i;
+
+	shm_bm_init_testobj(shm);
+	CHECK(SHM_BM_CORE(shm)[c].mag == 0 && bm_nfree() == NOBJ, "magazine is empty after init");
+
+	objs[0] = shm_bm_alloc_testobj(shm, &ids[0]);
+	half    = ids[0] / SHM_BM_MAG_BITS;
+	CHECK(objs[0] != NULL, "allocation from an empty magazine");
+	CHECK(mag_half(c) == half && mag_nfree(c) == SHM_BM_MAG_BITS - 1 && bm_nfree() == NOBJ - SHM_BM_MAG_BITS,
+	      "first allocation refills the magazine with a half-word of the bitmap");
+
+	for (i = 1; i < SHM_BM_MAG_BITS; i++) {
+		objs[i] = shm_bm_alloc_testobj(shm, &ids[i]);
+		CHECK(objs[i] != NULL && ids[i] / SHM_BM_MAG_BITS == half, "allocations are from the magazine");
+	}
+	CHECK(mag_nfree(c) == 0 && bm_nfree() == NOBJ - SHM_BM_MAG_BITS, "magazine is emptied without using the bitmap");
+
+	objs[i] = shm_bm_alloc_testobj(shm, &ids[i]);
+	CHECK(objs[i] != NULL && ids[i] / SHM_BM_MAG_BITS != half && mag_half(c) == ids[i] / SHM_BM_MAG_BITS,
+	      "empty magazine is refilled with another half-word");
+	CHECK(mag_nfree(c) == SHM_BM_MAG_BITS - 1 && bm_nfree() == NOBJ - 2 * SHM_BM_MAG_BITS,
+	      "refill takes the whole half-word");
+
+	/* Objects of the half-word in the magazine are freed to it, the others flushed to the bitmap */
+	shm_bm_free_testobj(objs[SHM_BM_MAG_BITS]);
+	CHECK(mag_nfree(c) == SHM_BM_MAG_BITS && bm_nfree() == NOBJ - 2 * SHM_BM_MAG_BITS, "free into the magazine");
+	for (i = 0; i < SHM_BM_MAG_BITS; i++) {
+		shm_bm_free_testobj(objs[i]);
+		CHECK(bm_isfree(ids[i]), "free of an object not in the magazine is flushed to the bitmap");
+	}
+	CHECK(mag_nfree(c) == SHM_BM_MAG_BITS && bm_nfree() == NOBJ - SHM_BM_MAG_BITS, "magazine is unchanged by the flushes");
+
+	printc("SUCCESS: magazines are refilled from, and flushed to the bitmap\n");
+
+	return 0;
+}
+
+/* Are the `n` objects in `objs` distinct, and identified by `ids`? */
+static int
+objs_valid(int n)
+{
+	static unsigned char seen[NOBJ];
+	int i;
+
+	memset(seen, 0, sizeof(seen));
+	for (i = 0; i < n; i++) {
+		if (ids[i] >= NOBJ || seen[ids[i]] || shm_bm_borrow_testobj(shm, ids[i]) != objs[i]) return 0;
+		seen[ids[i]] = 1;
+	}
+
+	return 1;
+}
+
+static int
+test_batch(void)
+{
+	shm_bm_objid_t id;
+	coreid_t       c = cos_cpuid();
+	int            n, got, i;
+
+	shm_bm_init_testobj(shm);
+
+	/* A whole half-word, then half of the next one */
+	n = SHM_BM_MAG_BITS + SHM_BM_MAG_BITS / 2;
+	got = shm_bm_alloc_n_testobj(shm, objs, ids, n);
+	CHECK(got == n && objs_valid(got), "batch spanning a magazine refill is fully allocated");
+	CHECK(mag_nfree(c) == SHM_BM_MAG_BITS / 2 && bm_nfree() == NOBJ - 2 * SHM_BM_MAG_BITS,
+	      "batch spanning a magazine refill takes two half-words");
+
+	/* Ask for one more object than are free */
+	got = shm_bm_alloc_n_testobj(shm, objs + n, ids + n, NOBJ - n + 1);
+	CHECK(got == NOBJ - n, "partial batch gets all of the free objects");
+	n += got;
+	CHECK(objs_valid(n), "batches allocate distinct objects");
+	CHECK(shm_bm_alloc_n_testobj(shm, &objs[n], &id, 1) == 0, "batch from an exhausted region is empty");
+
+	/* An object with another reference is only freed with its last one */
+	CHECK(shm_bm_take_testobj(shm, ids[0]) == objs[0], "take of an allocated object");
+	shm_bm_free_n_testobj(objs, n);
+	CHECK(!bm_isfree(ids[0]) && bm_nfree() + mag_nfree(c) == NOBJ - 1, "batch free drops a reference of each object");
+	shm_bm_free_testobj(objs[0]);
+	CHECK(bm_nfree() + mag_nfree(c) == NOBJ, "last reference frees the object");
+
+	/* Objects of different half-words interleaved in a batch free */
+	got = shm_bm_alloc_n_testobj(shm, objs, ids, NOBJ);
+	CHECK(got == NOBJ && objs_valid(got), "batch of the whole region");
+	for (i = 0; i < NOBJ; i++) perm[i] = objs[(i * 7) % NOBJ];
+	shm_bm_free_n_testobj(perm, NOBJ);
+	CHECK(bm_nfree() + mag_nfree(c) == NOBJ, "batch free of interleaved half-words frees all objects");
+
+	printc("SUCCESS: objects are allocated and freed in batches\n");
+
+	return 0;
+}
+
+/* Core 1's half of the cross-core test: allocate an object for core 0 to free */
+static void
+test_xcore_remote(void)
+{
+	step_await(1);
+	remote_obj = shm_bm_alloc_testobj(shm, &remote_objid);
+	step_set(2);
+
+	step_await(3);
+	/* The free on core 0 must not have put the object in this core's magazine */
+	remote_failure = mag_nfree(1) != SHM_BM_MAG_BITS - 1 || mag_half(1) != remote_objid / SHM_BM_MAG_BITS;
+	step_set(4);
+}
+
+static int
+test_xcore(void)
+{
+	int nfree;
+
+	shm_bm_init_testobj(shm);
+	step_set(1);
+	step_await(2);
+	CHECK(remote_obj != NULL, "allocation on core 1");
+	nfree = bm_nfree();
+
+	/* Core 0's magazine is empty, thus doesn't cache the object's half-word either */
+	shm_bm_free_testobj(remote_obj);
+	CHECK(bm_isfree(remote_objid) && bm_nfree() == nfree + 1 && SHM_BM_CORE(shm)[0].mag == 0,
+	      "free on another core than the allocation's returns the object to the bitmap");
+	step_set(3);
+	step_await(4);
+	CHECK(!remote_failure, "free on another core leaves the allocating core's magazine unchanged");
+
+	printc("SUCCESS: objects are freed on another core than the one that allocated them\n");
+
+	return 0;
+}
+
+/*
+ * Allocate all objects, including those cached by other cores (e.g.
+ * core 1's, after the cross-core test), free them, and do it again.
+ */
+static int
+test_exhaust(void)
+{
+	shm_bm_objid_t id;
+	int            n, round, i;
+
+	for (round = 0; round < 2; round++) {
+		for (n = 0; n <= NOBJ; n++) {
+			objs[n] = shm_bm_alloc_testobj(shm, &id);
+			if (objs[n] == NULL) break;
+		}
+		CHECK(n == NOBJ, "all objects, including other cores' cached ones, are allocated before exhaustion");
+		CHECK(bm_nfree() == 0 && mag_nfree(cos_cpuid()) == 0, "exhausted region has no free objects");
+		CHECK(shm_bm_alloc_testobj(shm, &id) == NULL, "allocation from an exhausted region fails");
+
+		for (i = 0; i < n; i++) shm_bm_free_testobj(objs[i]);
+		CHECK(bm_nfree() + mag_nfree(cos_cpuid()) == NOBJ, "all objects are free again");
+	}
+
+	printc("SUCCESS: region recovers from exhaustion\n");
+
+	return 0;
+}
+
+void
+cos_init(void)
+{
+	void        *mem;
+	unsigned long npages = round_up_to_page(shm_bm_size_testobj()) / PAGE_SIZE;
+
+	mem = (void *)memmgr_heap_page_allocn_aligned(npages, SHM_BM_ALIGN);
+	assert(mem);
+	shm = shm_bm_create_testobj(mem, npages * PAGE_SIZE);
+	assert(shm);
+}
+
+void
+parallel_main(coreid_t cid, int init_core, int ncores)
+{
+	if (cid == 1) {
+		test_xcore_remote();
+		return;
+	}
+	if (cid != 0) return;
+
+	if (test_mag_refill_flush() || test_batch()) return;
+	if (ncores > 1) {
+		if (test_xcore()) return;
+	} else {
+		printc("Cross-core test skipped, with a single core\n");
+	}
+	test_exhaust();
+}
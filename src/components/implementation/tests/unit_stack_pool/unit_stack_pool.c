@@ -0,0 +1,134 @@
+#include <cos_component.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sched.h>
+#include <cos_time.h>
+#include <pong.h>
+
+/***
+ * Tests of the per-core stack pools, through invocations of
+ * pong.stack_pool (with POOL_NSTACKS stacks per core) from threads of
+ * this component: invocations run on pooled stacks, that stay bound
+ * to their threads unless they are released on return; return values
+ * are intact after releases; and once the pool is empty, invocations
+ * run on the static stacks.
+ */
+
+#define POOL_NSTACKS 4
+#define THD_PRIORITY 20
+
+#define CHECK(cond, msg)                                 \
+	do {                                             \
+		if (!(cond)) {                           \
+			printc("FAILURE: %s\n", msg);    \
+			return -1;                       \
+		}                                        \
+	} while (0)
+
+static volatile int thd_done;
+static int          thd_ret;
+
+static void
+thd_run(cos_thd_fn_t fn)
+{
+	thdid_t tid;
+
+	thd_done = 0;
+	tid = sched_thd_create(fn, NULL);
+	sched_thd_param_set(tid, sched_param_pack(SCHEDP_PRIO, THD_PRIORITY));
+	while (!thd_done) sched_thd_block_timeout(0, time_now() + time_usec2cyc(1000));
+}
+
+static void
+thd_ret_fn(void *d)
+{
+	thd_ret  = pong_ret();
+	thd_done = 1;
+	sched_thd_exit();
+}
+
+static void
+thd_call_fn(void *d)
+{
+	pong_call();
+	thd_done = 1;
+	sched_thd_exit();
+}
+
+static void
+thd_subset_fn(void *d)
+{
+	unsigned long top;
+
+	thd_ret  = pong_subset(0, 0, &top);
+	thd_done = 1;
+	sched_thd_exit();
+}
+
+static int
+test_bound(void)
+{
+	unsigned long top, top2;
+	compid_t      us, them;
+
+	CHECK(pong_subset(0, 0, &top) == 1, "invocation runs on a pooled stack");
+	CHECK(pong_ret() == POOL_NSTACKS - 1, "invocation takes a stack from the pool");
+	CHECK(pong_subset(0, 0, &top2) == 1 && top2 == top, "stack stays bound to its thread without releases");
+	CHECK(pong_ids(&us, &them) == cos_thdid() && us == cos_compid() && them != us,
+	      "thread id and invocation token are saved on pooled stacks");
+
+	printc("SUCCESS: invocations run on pooled stacks, bound to their threads\n");
+
+	return 0;
+}
+
+static int
+test_release(void)
+{
+	long long a = 1, b = 2;
+	word_t    r0, r1;
+
+	CHECK(pong_arg(1) == 1, "return value of the first release");
+	CHECK(pong_ret() == POOL_NSTACKS - 1, "released stack is back in the pool");
+	thd_run(thd_ret_fn);
+	CHECK(thd_ret == POOL_NSTACKS - 1, "stacks of other threads are released as well");
+
+	/* The return values are in registers, through the releases */
+	CHECK(pong_args(1, 2, 3, 4) == 10, "single return value with releases");
+	CHECK(pong_argsrets(4, 3, 2, 1, &r0, &r1) == 3 && r0 == 4 && r1 == 3, "three return values with releases");
+	CHECK(pong_widerets(a, b) == a + b, "wide return value with releases");
+
+	printc("SUCCESS: stacks are released on return, with intact return values\n");
+
+	return 0;
+}
+
+static int
+test_fallback(void)
+{
+	word_t r0, r1;
+	int    i;
+
+	/* This thread, and the others keep their stacks */
+	CHECK(pong_arg(0) == 0, "return value without releases");
+	for (i = 1; i < POOL_NSTACKS; i++) thd_run(thd_call_fn);
+	CHECK(pong_ret() == 0, "all pooled stacks are bound");
+
+	thd_run(thd_subset_fn);
+	CHECK(thd_ret == 0, "with an empty pool, invocations run on static stacks");
+	CHECK(pong_argsrets(4, 3, 2, 1, &r0, &r1) == 3 && r0 == 4 && r1 == 3, "return values on a bound stack");
+
+	printc("SUCCESS: invocations run on static stacks once the pool is empty\n");
+
+	return 0;
+}
+
+int
+main(void)
+{
+	printc("Unit-test of the stack pools\n");
+	if (test_bound() || test_release()) return 0;
+	test_fallback();
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include <llprint.h>
+#include <sched.h>
+
+/***
+ * Recycle a thread many times: each worker exits with
+ * `sched_thd_exit_recycle`, so that the next creation reuses its
+ * thread. Each reuse must run on the same frame at the top of the
+ * thread's stack, not deeper in the one of the previous exit.
+ */
+
+#define ITERATION 10000
+
+static thdid_t driver;
+static volatile thdid_t worker_tid;
+static volatile unsigned long worker_sp;
+
+static void
+worker_fn(void *d)
+{
+	int local;
+
+	worker_tid = cos_thdid();
+	worker_sp  = (unsigned long)&local;
+	sched_thd_wakeup(driver);
+
+	sched_thd_exit_recycle();
+}
+
+static void
+driver_fn(void *d)
+{
+	thdid_t tid = 0;
+	unsigned long sp = 0;
+	int i;
+
+	for (i = 0; i < ITERATION; i++) {
+		thdid_t t = sched_thd_create(worker_fn, NULL);
+
+		assert(t);
+		/* Higher priority than the driver: the worker exits before the next creation */
+		sched_thd_param_set(t, SCHED_PARAM_CONS(SCHEDP_PRIO, 5));
+		sched_thd_block(0);
+		assert(worker_tid == t);
+
+		/* The first worker creates the thread, the following ones reuse it */
+		if (i == 1) {
+			tid = t;
+			sp  = worker_sp;
+		} else if (i > 1) {
+			assert(t == tid);
+			assert(worker_sp == sp);
+		}
+	}
+	printc("SUCCESS: thread %lu recycled %d times, on the same stack frame\n", (unsigned long)tid, ITERATION - 1);
+
+	while (1) sched_thd_block(0);
+}
+
+void
+cos_init(void)
+{
+	printc("Unit test for thread recycling.\n");
+}
+
+int
+main(void)
+{
+	driver = sched_thd_create(driver_fn, NULL);
+	sched_thd_param_set(driver, SCHED_PARAM_CONS(SCHEDP_PRIO, 6));
+
+	return 0;
+}
@@ -2,7 +2,8 @@
  * This API is really meant to only be used by capmgrs. It allows the
  * capmgr to get key addresses within another component they
  * oversee. For the time being, this is limited to the heap pointer
- * and capability frontier.
+ * and capability frontier, and the address of the boot timeline
+ * (see crt_timeline.h) in the capmgr itself.
  */
 
 #ifndef ADDR_H
@@ -11,6 +12,7 @@
 typedef enum {
 	ADDR_HEAP_FRONTIER,
 	ADDR_CAPTBL_FRONTIER,
+	ADDR_BOOT_TIMELINE,
 } addr_t;
 
 unsigned long addr_get(compid_t id, addr_t type);
@@ -13,5 +13,7 @@
 #include <cos_stubs.h>
 
 vaddr_t contigmem_alloc(unsigned long npages);
+/* Unmap `npages` pages at `addr`, returning them to the contiguous pool */
+int contigmem_free(vaddr_t addr, unsigned long npages);
 cbuf_t contigmem_shared_alloc_aligned(unsigned long npages, unsigned long align, vaddr_t *pgaddr);
 #endif /* MEMMGR_H */
@@ -12,3 +12,23 @@ memmgr_shared_page_alloc(vaddr_t *pgaddr)
 {
 	return memmgr_shared_page_allocn(1, pgaddr);
 }
+
+int
+memmgr_stack_pool_grow(coreid_t core, unsigned long nstacks)
+{
+	vaddr_t guard;
+	unsigned long i;
+
+	for (i = 0; i < nstacks; i++) {
+		/* The stack is the upper half, and the unmapped lower half its guard */
+		guard = memmgr_heap_page_allocn_aligned(2 * COS_STACK_SZ / PAGE_SIZE, COS_STACK_SZ);
+		if (!guard) break;
+		if (memmgr_heap_page_freen(guard, COS_STACK_SZ / PAGE_SIZE)) BUG();
+		if (cos_stack_pool_add(core, guard + COS_STACK_SZ)) {
+			memmgr_heap_page_freen(guard + COS_STACK_SZ, COS_STACK_SZ / PAGE_SIZE);
+			break;
+		}
+	}
+
+	return i;
+}
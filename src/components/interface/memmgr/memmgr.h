@@ -22,6 +22,19 @@ vaddr_t       COS_STUB_DECL(memmgr_heap_page_allocn)(unsigned long num_pages);
 vaddr_t       memmgr_heap_page_allocn_aligned(unsigned long num_pages, unsigned long align);
 vaddr_t       COS_STUB_DECL(memmgr_heap_page_allocn_aligned)(unsigned long num_pages, unsigned long align);
 
+/*
+ * Unmap the `num_pages` pages at `addr` from this component. The
+ * pages are reused once they are mapped nowhere, and the unmapping is
+ * quiescent. Returns `0`, or `-EINVAL` if a page isn't mapped here.
+ */
+int           memmgr_heap_page_freen(vaddr_t addr, unsigned long num_pages);
+/*
+ * Map `nstacks` stacks into `core`'s stack pool (cos_stack_pool_add),
+ * each with an unmapped guard region below it. Components call this
+ * at initialization, and whenever cos_stack_pool_nfree runs low.
+ * Returns the number of stacks added. (lib.c)
+ */
+int           memmgr_stack_pool_grow(coreid_t core, unsigned long nstacks);
 cbuf_t        memmgr_shared_page_alloc(vaddr_t *pgaddr);
 
 cbuf_t        memmgr_shared_page_allocn(unsigned long num_pages, vaddr_t *pgaddr);
@@ -5,9 +5,30 @@
 #include <cos_component.h>
 #include <cos_stubs.h>
 #include <shm_bm.h>
+#include <netshmem.h>
 
 #define NETMGR_OK (0)
 
+/*
+ * Connections (TCP, listening TCP, or UDP) are named by descriptors,
+ * that are > 0. A connection is used by the thread that bound or
+ * accepted it: its packets are received by that thread's nicmgr
+ * session. The calls return a descriptor or NETMGR_OK on success, and
+ * a negative errno on error.
+ */
+
+/*
+ * lwip keeps its stack (pcbs, timers, ARP cache) in globals, thus
+ * there is a stack per netmgr. A system runs a netmgr per core by
+ * setting NETMGR_CORE (a component constant) to the core it serves, in
+ * it and in its client. The nicmgr gives each core the flows RSS
+ * spreads to it, so that all of a connection's packets are processed
+ * by its core's stack. -1 is for a netmgr that serves any core.
+ */
+#ifndef NETMGR_CORE
+#define NETMGR_CORE (-1)
+#endif
+
 struct conn_addr {
 	u32_t ip;
 	u16_t port;
@@ -17,15 +38,47 @@ void netmgr_shmem_map(cbuf_t shm_id);
 
 int netmgr_tcp_bind(u32_t ip_addr, u16_t port);
 
-int netmgr_tcp_listen(u8_t backlog);
-int netmgr_tcp_accept(struct conn_addr *client_addr);
+int netmgr_tcp_listen(int fd, u8_t backlog);
+int netmgr_tcp_accept(int fd, struct conn_addr *client_addr);
 
-shm_bm_objid_t netmgr_tcp_shmem_read(u16_t *data_offset, u16_t *data_len);
-int netmgr_tcp_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len);
+/* The data read is the caller's to free. Once the connection is closed, data_len is 0 and the objid not valid */
+shm_bm_objid_t netmgr_tcp_shmem_read(int fd, u16_t *data_offset, u16_t *data_len);
+int netmgr_tcp_shmem_write(int fd, shm_bm_objid_t objid, u16_t data_offset, u16_t data_len);
+int netmgr_tcp_close(int fd);
 
 int netmgr_udp_bind(u32_t ip_addr, u16_t port);
 
-shm_bm_objid_t netmgr_udp_shmem_read(u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port);
-int netmgr_udp_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port);
+shm_bm_objid_t netmgr_udp_shmem_read(int fd, u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port);
+int netmgr_udp_shmem_write(int fd, shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port);
+
+/* A datagram of a batch: its shmem object, its data's offset and length in obj->data, and its peer */
+struct netmgr_udp_msg {
+	shm_bm_objid_t objid;
+	u16_t          data_offset;
+	u16_t          data_len;
+	u32_t          remote_addr;
+	u16_t          remote_port;
+};
+
+/* The most datagrams a shmem object of struct netmgr_udp_msg describes */
+#define NETMGR_UDP_BATCH_MAX (PKT_BUF_SIZE / sizeof(struct netmgr_udp_msg))
+
+/*
+ * Batch versions of netmgr_udp_shmem_read/write. The caller passes a
+ * shmem object (msgsid), that stays its own, used as an array of
+ * struct netmgr_udp_msg. A read blocks until there is a datagram, and
+ * fills the array with up to max of them; their objects are the
+ * caller's to free. A write sends the n datagrams of the array, and
+ * frees none of their objects. Both return the number of datagrams, or
+ * a negative errno.
+ */
+int netmgr_udp_shmem_read_batch(int fd, shm_bm_objid_t msgsid, u16_t max);
+int netmgr_udp_shmem_write_batch(int fd, shm_bm_objid_t msgsid, u16_t n);
+
+/*
+ * Block until one of this thread's connections has data, or accepted
+ * connections, to read, or is closed. Returns its descriptor.
+ */
+int netmgr_conn_wait(void);
 
 #endif /* NETMGR_H */
@@ -1,9 +1,30 @@
 #include <cos_stubs.h>
 #include <netmgr.h>
 
+COS_SERVER_3RET_STUB(int, netmgr_tcp_accept)
+{
+	struct conn_addr client_addr;
+	int fd;
+
+	fd = netmgr_tcp_accept(p0, &client_addr);
+
+	*r1 = client_addr.ip;
+	*r2 = client_addr.port;
+
+	return fd;
+}
+
 COS_SERVER_3RET_STUB(shm_bm_objid_t, netmgr_tcp_shmem_read)
 {
-	return netmgr_tcp_shmem_read((u16_t *)r1, (u16_t *)r2);
+	u16_t data_offset, data_len;
+	shm_bm_objid_t objid;
+
+	objid = netmgr_tcp_shmem_read(p0, &data_offset, &data_len);
+
+	*r1 = data_offset;
+	*r2 = data_len;
+
+	return objid;
 }
 
 COS_SERVER_3RET_STUB(shm_bm_objid_t, netmgr_udp_shmem_read)
@@ -12,7 +33,7 @@ COS_SERVER_3RET_STUB(shm_bm_objid_t, netmgr_udp_shmem_read)
 	u32_t remote_addr;
 	shm_bm_objid_t objid;
 
-	objid = netmgr_udp_shmem_read(&data_offset, &data_len, &remote_addr, &remote_port);
+	objid = netmgr_udp_shmem_read(p0, &data_offset, &data_len, &remote_addr, &remote_port);
 
 	*r1 = (word_t)(data_offset) << 32 | data_len;
 	*r2 = (word_t)(remote_addr) << 32 | remote_port;
@@ -20,7 +41,7 @@ COS_SERVER_3RET_STUB(shm_bm_objid_t, netmgr_udp_shmem_read)
 	return objid;
 }
 
-COS_SERVER_3RET_STUB(shm_bm_objid_t, netmgr_udp_shmem_write)
+COS_SERVER_3RET_STUB(int, netmgr_udp_shmem_write)
 {
-	return netmgr_udp_shmem_write(p0, p1, p2, (p3 >> 32), p3);
+	return netmgr_udp_shmem_write(p0, p1, (u16_t)(p2 >> 16), (u16_t)p2, (p3 >> 32), p3);
 }
@@ -5,6 +5,7 @@
 #include <cos_component.h>
 #include <cos_stubs.h>
 #include <shm_bm.h>
+#include <netshmem.h>
 
 void nic_shmem_map(cbuf_t shm_id);
 
@@ -12,10 +13,53 @@ int nic_send_packet(shm_bm_objid_t pktid, u16_t pkt_offset, u16_t pkt_len);
 int nic_bind_port(u32_t ip_addr, u16_t port);
 u64_t nic_get_port_mac_address(u16_t port);
 
+/*
+ * Steer the packets of a flow to this thread's session, which is bound
+ * with nic_bind_port to the flow's local address: those from
+ * remote_ip:remote_port (network byte order) over proto (UDP_PROTO or
+ * TCP_PROTO), e.g. of a TCP connection. They take precedence over the
+ * port a session is bound to. Returns 0 on success, or -ENOSPC if the
+ * nicmgr has too many flows.
+ */
+int nic_bind_flow(u32_t remote_ip, u16_t remote_port, u16_t proto);
+/* Undo nic_bind_flow. Returns 0 on success, or -ENOENT for an unknown flow */
+int nic_unbind_flow(u32_t remote_ip, u16_t remote_port, u16_t proto);
+
 /*
  * caller will be suspended until there is a packet for this thread,
  * dpdk will then copy the packet to this shmem region specified by the shmid
  * and return its shmem objectid.
  */
 shm_bm_objid_t nic_get_a_packet(u16_t *pkt_len);
+
+/* A received packet: its shmem object, and its offset and length in obj->data */
+struct nic_pkt_desc {
+	shm_bm_objid_t objid;
+	u16_t          pkt_offset;
+	u16_t          pkt_len;
+};
+
+/* The descriptors that fit in a shmem packet buffer */
+#define NIC_PKT_BURST_MAX (PKT_BUF_SIZE / sizeof(struct nic_pkt_desc))
+
+/*
+ * Burst version of nic_get_a_packet: the caller passes a shmem object
+ * (descid) used as an array of struct nic_pkt_desc, which is filled
+ * with up to max packets. The caller is suspended only if there are
+ * no packets for this thread. Returns the number of packets received.
+ */
+int nic_get_packets(shm_bm_objid_t descid, u16_t max);
+/*
+ * nic_get_packets that stops waiting at abs_timeout (in cycles), e.g.
+ * to run the timers of a protocol stack, and then returns 0.
+ */
+int nic_get_packets_timeout(shm_bm_objid_t descid, u16_t max, cycles_t abs_timeout);
+
+/*
+ * Burst version of nic_send_packet: send the n packets described by
+ * the struct nic_pkt_desc array in the shmem object descid (which
+ * stays the caller's). The packets are queued, and transmitted in
+ * bursts by the nicmgr. Returns the number of packets queued.
+ */
+int nic_send_packets(shm_bm_objid_t descid, u16_t n);
 #endif /* NIC_H */
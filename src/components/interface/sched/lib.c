@@ -11,6 +11,36 @@ sched_thd_create(cos_thd_fn_t fn, void *data)
 	return sched_thd_create_closure(idx);
 }
 
+/* Run the closures of the threads that reuse this one, until it exits */
+static void
+sched_thd_recycle_loop(word_t idx)
+{
+	do {
+		cos_thd_init_exec((thdclosure_index_t)idx);
+	} while ((idx = sched_thd_recycle()) > 0);
+
+	sched_thd_exit();
+	BUG();
+}
+
+void
+sched_thd_exit_recycle(void)
+{
+	thdclosure_index_t idx = sched_thd_recycle();
+
+	if (idx > 0) {
+		/*
+		 * The closure is run on a fresh frame at the top of the
+		 * stack, not in the frames of the function that exited,
+		 * so that a thread reused many times does not overflow.
+		 */
+		cos_stack_restart(sched_thd_recycle_loop, (word_t)idx);
+	}
+
+	sched_thd_exit();
+	BUG();
+}
+
 thdid_t
 sched_aep_create(struct cos_aep_info *aep, cos_aepthd_fn_t fn, void *data, int owntc, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax)
 {
@@ -33,6 +33,9 @@ int      sched_thd_block(thdid_t dep_id);
 int      COS_STUB_DECL(sched_thd_block)(thdid_t dep_id);
 cycles_t sched_thd_block_timeout(thdid_t dep_id, cycles_t abs_timeout);
 cycles_t COS_STUB_DECL(sched_thd_block_timeout)(thdid_t dep_id, cycles_t abs_timeout);
+/* As sched_thd_block_timeout, but returns `0` if woken before the timeout */
+cycles_t sched_thd_block_timeout_wakeup(thdid_t dep_id, cycles_t abs_timeout);
+cycles_t COS_STUB_DECL(sched_thd_block_timeout_wakeup)(thdid_t dep_id, cycles_t abs_timeout);
 
 void     sched_set_tls(void* tls_addr);
 unsigned long sched_get_cpu_freq(void);
@@ -59,6 +62,17 @@ int COS_STUB_DECL(sched_thd_delete)(thdid_t tid);
 int sched_thd_exit(void);
 int COS_STUB_DECL(sched_thd_exit)(void);
 
+/*
+ * Park the current thread in the scheduler's per-core cache of exited
+ * threads for this component, so that a later thread creation can
+ * reuse its kernel thread, id, and scheduler memory. Returns the
+ * closure of the thread that reuses it, or 0 if it can't be cached.
+ */
+thdclosure_index_t sched_thd_recycle(void);
+thdclosure_index_t COS_STUB_DECL(sched_thd_recycle)(void);
+/* Exit, making the thread available for reuse; does not return. */
+void sched_thd_exit_recycle(void); /* lib.c */
+
 /* TODO: lock i/f */
 
 #endif /* SCHED_H */
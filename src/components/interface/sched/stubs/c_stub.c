@@ -23,6 +23,18 @@ COS_CLIENT_STUB(cycles_t, sched_thd_block_timeout, thdid_t dep_id, cycles_t abs_
 	return elapsed_cycles;
 }
 
+COS_CLIENT_STUB(cycles_t, sched_thd_block_timeout_wakeup, thdid_t dep_id, cycles_t abs_timeout)
+{
+	COS_CLIENT_INVCAP;
+	word_t elapsed_hi = 0, elapsed_lo = 0;
+	word_t abs_hi, abs_lo;
+
+	COS_ARG_DWORD_TO_WORD(abs_timeout, abs_hi, abs_lo);
+	cos_sinv_2rets(uc, dep_id, abs_hi, abs_lo, 0, &elapsed_hi, &elapsed_lo);
+
+	return ((cycles_t)elapsed_hi << 32) | (cycles_t)elapsed_lo;
+}
+
 COS_CLIENT_STUB(thdid_t, sched_aep_create_closure, thdclosure_index_t id, int owntc, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax, arcvcap_t *rcv)
 {
 	COS_CLIENT_INVCAP;
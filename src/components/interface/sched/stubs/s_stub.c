@@ -14,6 +14,18 @@ COS_SERVER_3RET_STUB(int, sched_thd_block_timeout)
 	return 0;
 }
 
+COS_SERVER_3RET_STUB(int, sched_thd_block_timeout_wakeup)
+{
+	cycles_t elapsed = 0, abs_timeout;
+
+	COS_ARG_WORDS_TO_DWORD(p1, p2, abs_timeout);
+	elapsed = sched_thd_block_timeout_wakeup((thdid_t)p0, abs_timeout);
+	*r1 = (elapsed >> 32);
+	*r2 = (elapsed << 32) >> 32;
+
+	return 0;
+}
+
 COS_SERVER_3RET_STUB(thdid_t, sched_aep_create_closure)
 {
 	struct cos_defcompinfo *dci;
@@ -7,13 +7,30 @@
  * A simple API to mimic the L4-based synchronous rendezvous between
  * threads. Use `call` and `reply_wait` to minimize "system calls" (in
  * our case, thread migration-based invocations).
+ *
+ * Endpoints are per-core: the same endpoint id names a distinct
+ * endpoint on each core, and clients only rendezvous with servers on
+ * their own core. Any number of clients and server threads can use
+ * an endpoint; clients that find no awaiting server block in the
+ * endpoint's queue until a server is available.
  */
 
+/*
+ * Endpoint flags that servers pass in the upper bits of the endpoint
+ * id to `syncipc_reply_wait` to specify the endpoint's policy.
+ * Clients can pass either the plain id, or the id with flags.
+ */
+#define SYNCIPC_EP_PRIO       (1 << 30) /* queue clients by priority, not FIFO */
+#define SYNCIPC_EP_FLAGS_MASK (SYNCIPC_EP_PRIO)
+#define SYNCIPC_EP_ID(ep)     ((ep) & ~SYNCIPC_EP_FLAGS_MASK)
+#define SYNCIPC_EP_FLAGS(ep)  ((ep) & SYNCIPC_EP_FLAGS_MASK)
+
 /**
  * `syncipc_call` invokes the IPC endpoint (`ipc_ep`), which is an
  * opaque identifier for an endpoint, passing two arguments, and
  * awaits two reply arguments. Another thread, rendezvousing on the
- * endpoint, is the communicating pair.
+ * endpoint, is the communicating pair. The server executes the call
+ * with the client's priority until it replies.
  */
 int syncipc_call(int ipc_ep, word_t arg0, word_t arg1, word_t *ret0, word_t *ret1);
 
@@ -21,7 +38,8 @@ int syncipc_call(int ipc_ep, word_t arg0, word_t arg1, word_t *ret0, word_t *ret
  * `syncipc_reply_wait` replies to the most recent `call` on an ipc
  * endpoint with two arguments, and returns the arguments from the
  * next. If there was no previous `call` for which to return, the
- * arguments are ignored. Either way, the current thread blocks
+ * arguments are ignored. If clients are queued on the endpoint, the
+ * next is serviced immediately, otherwise the current thread blocks
  * awaiting a `call`.
  */
 int syncipc_reply_wait(int ipc_ep, word_t arg0, word_t arg1, word_t *ret0, word_t *ret1);
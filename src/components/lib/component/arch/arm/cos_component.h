@@ -194,6 +194,27 @@ get_stk_data(int offset)
 	return *(long *)((curr_stk_pointer & ~(COS_STACK_SZ - 1)) + COS_STACK_SZ - offset * sizeof(u32_t));
 }
 
+/*
+ * Discard the current thread's stack frames, and call fn(arg) on a
+ * fresh frame at the top of its stack, past the cpuid, thread id and
+ * invocation token saved there (see get_stk_data). fn must not return.
+ */
+static inline void __attribute__((noreturn))
+cos_stack_restart(void (*fn)(word_t), word_t arg)
+{
+	unsigned long sp = (unsigned long)&sp;
+
+	sp = (sp & ~(COS_STACK_SZ - 1)) + COS_STACK_SZ - 4 * sizeof(u32_t);
+	__asm__ __volatile__("mov sp, %0\n\t"
+	                     "mov r0, %2\n\t"
+	                     "blx %1\n\t"
+	                     "udf\n\t"
+	                     :
+	                     : "r"(sp), "r"(fn), "r"(arg)
+	                     : "r0", "lr", "memory");
+	__builtin_unreachable();
+}
+
 static inline void
 set_stk_data(int offset, long value)
 {
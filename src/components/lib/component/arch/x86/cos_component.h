@@ -180,6 +180,28 @@ get_stk_data(int offset)
 	return *(long *)((curr_stk_pointer & ~(COS_STACK_SZ - 1)) + COS_STACK_SZ - offset * sizeof(u32_t));
 }
 
+/*
+ * Discard the current thread's stack frames, and call fn(arg) on a
+ * fresh frame at the top of its stack, past the cpuid, thread id and
+ * invocation token saved there (see get_stk_data). fn must not return.
+ */
+static inline void __attribute__((noreturn))
+cos_stack_restart(void (*fn)(word_t), word_t arg)
+{
+	unsigned long sp = (unsigned long)&sp;
+
+	sp = (sp & ~(COS_STACK_SZ - 1)) + COS_STACK_SZ - 4 * sizeof(u32_t);
+	__asm__ __volatile__("movl %0, %%esp\n\t"
+	                     "xorl %%ebp, %%ebp\n\t"
+	                     "pushl %2\n\t"
+	                     "call *%1\n\t"
+	                     "ud2\n\t"
+	                     :
+	                     : "r"(sp), "r"(fn), "r"(arg)
+	                     : "memory");
+	__builtin_unreachable();
+}
+
 #define GET_CURR_CPU cos_cpuid()
 
 static inline u32_t
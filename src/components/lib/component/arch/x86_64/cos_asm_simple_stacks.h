@@ -21,7 +21,33 @@
 	COS_ASM_GET_STACK_BASIC    \
 	push %rbp;
 
-#define COS_ASM_RET_STACK
+/*
+ * If the component asked for it (cos_stack_release_set), return the
+ * thread's pooled stack to its pool, and unbind it. Only ax and dx
+ * are clobbered, as the return values are in the other registers,
+ * and ax is set to RET_CAP. Once its bit is set, the stack can be
+ * taken by a preempting thread, thus it isn't accessed anymore.
+ */
+#define COS_ASM_RET_STACK					\
+	movabs $cos_stack_release, %rdx;			\
+	cmpq $0, (%rdx);					\
+	je 2f;							\
+	/* rdx = the tid, 16 bytes below the top */		\
+	movq %rsp, %rdx;					\
+	orq $(COS_STACK_SZ - 1), %rdx;				\
+	movq -15(%rdx), %rdx;					\
+	movabs $cos_thd_stacks, %rax;				\
+	lea (%rax, %rdx, 8), %rdx;				\
+	movq (%rdx), %rax;					\
+	/* a static stack? */					\
+	test %rax, %rax;					\
+	jz 2f;							\
+	movq $0, (%rdx);					\
+	sub $1, %rax;						\
+	movabs $cos_stack_pool_free, %rdx;			\
+	lock bts %rax, (%rdx);					\
+2:								\
+	movq $RET_CAP, %rax;
 
 #define COS_ASM_REQUEST_STACK
 
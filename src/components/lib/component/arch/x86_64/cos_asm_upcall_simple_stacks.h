@@ -39,7 +39,7 @@ __cosrt_upcall_entry:			\
 	/* ABI mandate a 16-byte alignment stack pointer*/ \
 	and $~0xf, %rsp;		\
 	call cos_upcall_fn;		\
-	addl $24, %esp;			\
+	add $24, %rsp;			\
 	pop %rsi;			\
 	pop %rdi;			\
 	movl %eax, %ecx;		\
@@ -64,6 +64,15 @@ __cosrt_upcall_entry:			\
 
 /* This is a very critical path used by both the upcall and synchronous IPC, thus make sure you fully understand it and change it */
 /* Be very very careful of the registers used here, you only would want to use ax and dx and don't change other registers as they could possibly be used by upcall and IPC */
+/*
+ * Once the component has added stacks to its pools (see
+ * cos_stack_pool_add), a thread runs on the pooled stack bound to it,
+ * or otherwise takes one from its core's pool and binds it. A stack
+ * is taken by clearing its bit in the pool's bitmap with a lock btr,
+ * thus two threads can't take the same stack. If the pool is empty,
+ * the thread runs on its static stack. Until the new stack's ids are
+ * saved by COS_ASM_GET_STACK_BASIC, its top words are scratch space.
+ */
 #define COS_DEFAULT_STACK_ACQUIRE						\
 .text;										\
 .align 16;									\
@@ -73,6 +82,13 @@ custom_acquire_stack:								\
 	/* ax holds cpuid and thread id*/					\
 	/* rax[0:15]=tid, rax[16:31]=cpuid */					\
 	movq %rax, %rdx;							\
+	movabs $cos_stack_pooled, %rsp;						\
+	cmpq $0, (%rsp);							\
+	jne 2f;									\
+1:										\
+	/* threads above the static stacks can only run on pooled stacks */	\
+	cmpw $COS_STATIC_STACK_THDS, %ax;					\
+	jae 6f;									\
 	movabs $cos_static_stack, %rsp;						\
 	/*rax hols coreid and thread id, do not use other registers! */		\
 	/* get the tid by masking rax[0:15] */					\
@@ -86,4 +102,62 @@ custom_acquire_stack:								\
 	/* get the cpuid by right shifting the lower 16 bits*/			\
 	shr $16, %rdx;								\
 	/* on the return, rax is thread id, rdx is core id */ 			\
-	jmpq %rcx;
+	jmpq *%rcx;								\
+2:										\
+	/* rax = the thread's binding: its pooled stack's index + 1, or 0 */	\
+	movzwl %ax, %eax;							\
+	movabs $cos_thd_stacks, %rsp;						\
+	movq (%rsp, %rax, 8), %rax;						\
+	test %rax, %rax;							\
+	jnz 5f;									\
+	/* rsp = the first word of this core's bitmap of free stacks */	\
+	movq %rdx, %rax;							\
+	shr $16, %rax;								\
+	imul $(COS_STACK_POOL_SZ / 8), %rax, %rax;				\
+	movabs $cos_stack_pool_free, %rsp;					\
+	add %rax, %rsp;								\
+3:										\
+	movq (%rsp), %rax;							\
+	bsf %rax, %rax;								\
+	jnz 4f;									\
+	/* the word is empty: next one, unless it's the next core's */	\
+	add $8, %rsp;								\
+	test $(COS_STACK_POOL_SZ / 8 - 1), %rsp;				\
+	jnz 3b;									\
+	/* the pool is empty, thus use the static stack */			\
+	movq %rdx, %rax;							\
+	jmp 1b;									\
+4:										\
+	/* take the stack, unless a preempting thread took it first */	\
+	lock btr %rax, (%rsp);							\
+	jnc 3b;									\
+	/* rax = the stack's index, as the bitmap is page-aligned */		\
+	and $(PAGE_SIZE - 1), %rsp;						\
+	shl $3, %rsp;								\
+	add %rsp, %rax;								\
+	movabs $cos_stack_pool_tops, %rsp;					\
+	movq (%rsp, %rax, 8), %rsp;						\
+	/* bind it to the thread, with the ids stashed on the new stack */	\
+	add $1, %rax;								\
+	movq %rdx, -8(%rsp);							\
+	movq %rax, -16(%rsp);							\
+	movzwl %dx, %edx;							\
+	movabs $cos_thd_stacks, %rax;						\
+	lea (%rax, %rdx, 8), %rax;						\
+	movq -16(%rsp), %rdx;							\
+	movq %rdx, (%rax);							\
+	movq -8(%rsp), %rdx;							\
+	jmp 7f;									\
+5:										\
+	/* the thread's bound stack */						\
+	movabs $(cos_stack_pool_tops - 8), %rsp;				\
+	movq (%rsp, %rax, 8), %rsp;						\
+7:										\
+	movq %rdx, %rax;							\
+	andq $0xffff, %rax;							\
+	shr $16, %rdx;								\
+	/* on the return, rax is thread id, rdx is core id */ 			\
+	jmpq *%rcx;								\
+6:										\
+	/* no static stack, and no stack in the pool */			\
+	ud2;
@@ -252,6 +252,27 @@ get_stk_data(int offset)
 	return *(long *)((curr_stk_pointer & ~(COS_STACK_SZ - 1)) + COS_STACK_SZ - offset * sizeof(unsigned long));
 }
 
+/*
+ * Discard the current thread's stack frames, and call fn(arg) on a
+ * fresh frame at the top of its stack, past the cpuid, thread id and
+ * invocation token saved there (see get_stk_data). fn must not return.
+ */
+static inline void __attribute__((noreturn))
+cos_stack_restart(void (*fn)(word_t), word_t arg)
+{
+	unsigned long sp = (unsigned long)&sp;
+
+	sp = (sp & ~(COS_STACK_SZ - 1)) + COS_STACK_SZ - 4 * sizeof(unsigned long);
+	__asm__ __volatile__("mov %0, %%rsp\n\t"
+	                     "xor %%rbp, %%rbp\n\t"
+	                     "call *%1\n\t"
+	                     "ud2\n\t"
+	                     :
+	                     : "r"(sp), "r"(fn), "D"(arg)
+	                     : "memory");
+	__builtin_unreachable();
+}
+
 #define GET_CURR_CPU cos_cpuid()
 
 static inline u64_t
@@ -442,6 +463,23 @@ cos_get_prealloc_page(void)
 extern void *cos_get_vas_page(void);
 extern void  cos_release_vas_page(void *p);
 
+/*
+ * Per-core pools of stacks for the threads entering this component,
+ * used once the first stack is added (see custom_acquire_stack).
+ * Threads with ids from COS_STATIC_STACK_THDS require them. Add the
+ * COS_STACK_SZ-aligned `stack` to `core`'s pool: `0`, or `-ENOSPC`
+ * if the pool holds COS_STACK_POOL_SZ stacks already.
+ */
+int           cos_stack_pool_add(coreid_t core, vaddr_t stack);
+/* The number of stacks free in `core`'s pool */
+unsigned long cos_stack_pool_nfree(coreid_t core);
+/*
+ * Return a thread's pooled stack to its pool when it returns from an
+ * invocation of this component? Otherwise, it stays bound to the
+ * thread.
+ */
+void          cos_stack_release_set(int release);
+
 /* only if the heap pointer is pre_addr, set it to post_addr */
 static inline void
 cos_set_heap_ptr_conditional(void *pre_addr, void *post_addr)
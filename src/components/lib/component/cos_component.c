@@ -5,6 +5,7 @@
  * Public License v2.
  */
 #include <stdio.h>
+#include <errno.h>
 
 #include <sys/auxv.h>
 
@@ -229,6 +230,21 @@ cos_thd_entry_exec(u32_t idx)
 	(fn)(data);
 }
 
+void
+cos_thd_init_exec(thdclosure_index_t i)
+{
+	word_t idx = (word_t)i - 1;
+
+	assert(i > 0);
+	if (idx >= COS_THD_INIT_REGION_SIZE) {
+		/* This means static defined entry */
+		cos_thd_entry_static(idx - COS_THD_INIT_REGION_SIZE);
+	} else {
+		/* Execute dynamic allocated entry. */
+		cos_thd_entry_exec(idx);
+	}
+}
+
 static void
 start_execution(coreid_t cid, int init_core, int ncores)
 {
@@ -360,14 +376,7 @@ cos_upcall_fn(upcall_type_t t, void *arg1, void *arg2, void *arg3)
 			/* FIXME: assume that core 0 is the initial core for now */
 			start_execution(cos_coreid(), ps_cas(&first_core, 1, 0), init_parallelism());
 		} else {
-			word_t idx = (word_t)arg1 - 1;
-			if (idx >= COS_THD_INIT_REGION_SIZE) {
-				/* This means static defined entry */
-				cos_thd_entry_static(idx - COS_THD_INIT_REGION_SIZE);
-			} else {
-				/* Execute dynamic allocated entry. */
-				cos_thd_entry_exec(idx);
-			}
+			cos_thd_init_exec((thdclosure_index_t)(word_t)arg1);
 		}
 		break;
 	}
@@ -398,6 +407,68 @@ cos_release_vas_page(void *p)
 	cos_set_heap_ptr_conditional(p + PAGE_SIZE, p);
 }
 
+#if NUM_CPU * COS_STACK_POOL_SZ > PAGE_SIZE * 8
+#error "The bitmap of the stack pools must fit in a page: reduce COS_STACK_POOL_SZ"
+#endif
+
+/*
+ * The per-core stack pools (see custom_acquire_stack). Core c's pool
+ * holds the stacks with indices in [c * COS_STACK_POOL_SZ, (c + 1) *
+ * COS_STACK_POOL_SZ). Stack i's top is cos_stack_pool_tops[i], and it
+ * is free if bit i of the bitmap is set. The assembly derives the
+ * index of a stack from the offset of its word in the bitmap's page.
+ */
+unsigned long        cos_stack_pool_free[NUM_CPU * COS_STACK_POOL_SZ / 64] __attribute__((aligned(PAGE_SIZE)));
+vaddr_t              cos_stack_pool_tops[NUM_CPU * COS_STACK_POOL_SZ];
+static unsigned long cos_stack_pool_nstacks[NUM_CPU];
+/* The pooled stack bound to each thread: its index + 1, or 0 */
+unsigned long        cos_thd_stacks[MAX_NUM_THREADS + 1];
+/* Read on each entry into the component, and return from it */
+unsigned long        cos_stack_pooled  = 0;
+unsigned long        cos_stack_release = 0;
+
+int
+cos_stack_pool_add(coreid_t core, vaddr_t stack)
+{
+	unsigned long i, *w, old;
+
+	assert(core < NUM_CPU && stack % COS_STACK_SZ == 0);
+	do {
+		i = ps_load(&cos_stack_pool_nstacks[core]);
+		if (i == COS_STACK_POOL_SZ) return -ENOSPC;
+	} while (!ps_cas(&cos_stack_pool_nstacks[core], i, i + 1));
+	i += core * COS_STACK_POOL_SZ;
+	cos_stack_pool_tops[i] = stack + COS_STACK_SZ;
+
+	/* The cas orders the stack's top before its bit */
+	w = &cos_stack_pool_free[i / 64];
+	do {
+		old = ps_load(w);
+	} while (!ps_cas(w, old, old | (1UL << (i % 64))));
+	cos_stack_pooled = 1;
+
+	return 0;
+}
+
+unsigned long
+cos_stack_pool_nfree(coreid_t core)
+{
+	unsigned long i, n = 0;
+
+	assert(core < NUM_CPU);
+	for (i = 0; i < COS_STACK_POOL_SZ / 64; i++) {
+		n += __builtin_popcountl(ps_load(&cos_stack_pool_free[core * COS_STACK_POOL_SZ / 64 + i]));
+	}
+
+	return n;
+}
+
+void
+cos_stack_release_set(int release)
+{
+	cos_stack_release = release;
+}
+
 extern const vaddr_t cos_atomic_cmpxchg, cos_atomic_cmpxchg_end, cos_atomic_user1, cos_atomic_user1_end,
   cos_atomic_user2, cos_atomic_user2_end, cos_atomic_user3, cos_atomic_user3_end, cos_atomic_user4,
   cos_atomic_user4_end;
@@ -70,4 +70,12 @@ cos_thd_init_free(thdclosure_index_t idx)
 	return;
 }
 
+/*
+ * Execute, in the current thread, the closure `idx` of a thread
+ * created in this component: one allocated with `cos_thd_init_alloc`
+ * (its entry is released), or a static one (`cos_thd_entry_static`).
+ * Used to run a new thread's function in a recycled thread.
+ */
+void cos_thd_init_exec(thdclosure_index_t idx);
+
 #endif /* COS_THD_INIT_H */
@@ -54,12 +54,59 @@
 #include <protdom.h>
 
 #include <crt.h>
+#include <crt_timeline.h>
 
 #define CRT_REFCNT_INITVAL 1
 
 static unsigned long nchkpt = 0;
 static unsigned long ncomp = 1;
 
+/*
+ * The read-only images of the components created from elf objects.
+ * Components created from identical objects (at the same addresses)
+ * share one read-only copy of their image, and only have their own
+ * writable image.
+ */
+struct crt_ro_image {
+	vaddr_t addr;
+	size_t  sz;
+	char   *src;	/* in the elf object */
+	char   *mem;
+};
+static struct crt_ro_image ro_images[MAX_NUM_COMPS];
+static unsigned long       n_ro_images = 0;
+static struct ps_lock      ro_images_lock;
+
+/* Find the read-only image identical to `src`, or NULL if there is none */
+static char *
+crt_ro_image_find(vaddr_t addr, size_t sz, char *src)
+{
+	struct crt_ro_image *img;
+	unsigned long i;
+
+	for (i = 0; i < n_ro_images; i++) {
+		img = &ro_images[i];
+		if (img->addr != addr || img->sz != sz) continue;
+		if (img->src == src || !memcmp(img->src, src, sz)) return img->mem;
+	}
+
+	return NULL;
+}
+
+static int __crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vaddr_t info, prot_domain_t protdom, int share_ro);
+
+static void
+crt_ro_image_add(vaddr_t addr, size_t sz, char *src, char *mem)
+{
+	if (n_ro_images == MAX_NUM_COMPS) return;
+	ro_images[n_ro_images++] = (struct crt_ro_image) {
+		.addr = addr,
+		.sz   = sz,
+		.src  = src,
+		.mem  = mem,
+	};
+}
+
 unsigned long
 crt_ncomp()
 {
@@ -87,15 +134,21 @@ crt_chkpt_create(struct crt_chkpt *chkpt, struct crt_comp *c)
 	chkpt->c = c;
 	ps_faa(&nchkpt, 1);
 
-	/* allocate space for saving the component's memory */
+	/*
+	 * The read-only image is never modified after the component
+	 * is loaded, so it is shared rather than copied. Only the
+	 * writable image is saved.
+	 */
+	chkpt->ro_mem     = c->mem;
+	chkpt->rw_sz      = c->tot_sz_mem - round_up_to_page(c->ro_sz);
+	chkpt->tot_sz_mem = c->tot_sz_mem;
+
 	root_ci = cos_compinfo_get(cos_defcompinfo_curr_get());
-	mem = cos_page_bump_allocn(root_ci, c->tot_sz_mem);
+	mem = cos_page_bump_allocn(root_ci, chkpt->rw_sz);
 	if (!mem) return -ENOMEM;
-
 	chkpt->mem = mem;
-	chkpt->tot_sz_mem = c->tot_sz_mem;
 
-	memcpy(mem, c->mem, c->tot_sz_mem);
+	memcpy(mem, c->rw_mem, chkpt->rw_sz);
 	/*
 	 * TODO: capabilities aren't copied, so components that could modify their capabilities
 	 * while running (schedulers/cap mgrs) shouldn't be checkpointed
@@ -105,12 +158,65 @@ crt_chkpt_create(struct crt_chkpt *chkpt, struct crt_comp *c)
 	return 0;
 }
 
+/*
+ * Make the current resources of `c`, a component created from a
+ * checkpoint, those that `crt_chkpt_restore` resets it to: typically
+ * once its initial thread and synchronous invocations are created.
+ */
+void
+crt_chkpt_restore_point(struct crt_comp *c)
+{
+	struct cos_compinfo *ci = cos_compinfo_get(c->comp_res);
+
+	assert(c->chkpt);
+	c->chkpt_refcnt       = c->refcnt;
+	c->chkpt_cap_frontier = ci->cap_frontier;
+	c->chkpt_vas_frontier = ci->vas_frontier;
+}
+
+/*
+ * Reset `c`, a component created from `chkpt`, to its restore point
+ * (see `crt_chkpt_restore_point`), by resetting its writable image to
+ * the checkpoint's. None of its threads can be executing in it, as
+ * their stacks are reset as well.
+ *
+ * The threads, capabilities (e.g. synchronous invocations from or to
+ * it), and memory created through `c` since its restore point aren't
+ * part of the checkpoint, and can't be reclaimed, thus the restore is
+ * rejected (`-EBUSY`) if there are any.
+ *
+ * The kernel maps the pages with their dirty bit set, and doesn't
+ * allow us to clear it, so the pages the component modified aren't
+ * tracked: each page of the writable image (data, bss, and the static
+ * stacks) is compared to the checkpoint's, and only those that differ
+ * are written. A restore thus reads twice the whole writable image,
+ * whatever the number of pages modified.
+ *
+ * Returns the number of pages reset, or a negative error.
+ */
 int
 crt_chkpt_restore(struct crt_chkpt *chkpt, struct crt_comp *c)
 {
-	/* turning c, a terminated component, back into a chkpt */
-	/* TODO: return memory to a previous saved state */
-	return 0;
+	struct cos_component_information *comp_info;
+	struct cos_compinfo *ci = cos_compinfo_get(c->comp_res);
+	size_t off;
+	int    n = 0;
+
+	if (c->chkpt != chkpt || c->mem != chkpt->ro_mem || c->tot_sz_mem != chkpt->tot_sz_mem) return -EINVAL;
+	/* No restore point? */
+	if (!c->chkpt_cap_frontier) return -EINVAL;
+	if (c->refcnt != c->chkpt_refcnt || ci->cap_frontier != c->chkpt_cap_frontier || ci->vas_frontier != c->chkpt_vas_frontier) return -EBUSY;
+
+	for (off = 0; off < chkpt->rw_sz; off += PAGE_SIZE) {
+		if (!memcmp(c->rw_mem + off, chkpt->mem + off, PAGE_SIZE)) continue;
+		memcpy(c->rw_mem + off, chkpt->mem + off, PAGE_SIZE);
+		n++;
+	}
+	/* The checkpoint has the id of the checkpointed component */
+	comp_info = (struct cos_component_information *)(c->rw_mem + (c->info - c->rw_addr));
+	comp_info->cos_this_spd_id = c->id;
+
+	return n;
 }
 
 int
@@ -153,7 +259,11 @@ crt_comp_create_in_vas(struct crt_comp *c, char *name, compid_t id, void *elf_hd
 
 	protdom = protdom_ns_vas_alloc(vas, (elf_hdr ? elf_entry_addr(elf_hdr) : 0));
 
-	crt_comp_create(c, name, id, elf_hdr, info, protdom);
+	/*
+	 * The callgates in the text of components sharing a VAS are
+	 * generated for their servers, so their text isn't shared.
+	 */
+	__crt_comp_create(c, name, id, elf_hdr, info, protdom, 0);
 
 	protdom_ns_vas_set_comp(vas, elf_entry_addr(elf_hdr), c->comp_res);
 	top_lvl_ptc = protdom_ns_vas_pgtbl(vas);
@@ -339,22 +449,23 @@ crt_comp_create_from(struct crt_comp *c, char *name, compid_t id, struct crt_chk
 	ret = cos_compinfo_alloc(ci, c->ro_addr, BOOT_CAPTBL_FREE, c->entry_addr, root_ci, 0);
 	assert(!ret);
 
-	mem = cos_page_bump_allocn(root_ci, chkpt->tot_sz_mem);
+	/* Only the writable image is copied, the read-only one is shared */
+	mem = cos_page_bump_allocn(root_ci, chkpt->rw_sz);
 	if (!mem) return -ENOMEM;
-	c->mem = mem;
+	c->chkpt      = chkpt;
+	c->mem        = chkpt->ro_mem;
+	c->rw_mem     = mem;
 	c->tot_sz_mem = chkpt->tot_sz_mem;
-	c->ro_sz = chkpt->c->ro_sz;
+	c->ro_sz      = chkpt->c->ro_sz;
 
-	memcpy(mem, chkpt->mem, round_up_to_page(chkpt->tot_sz_mem));
+	memcpy(mem, chkpt->mem, chkpt->rw_sz);
 
 	info_offset = info - c->rw_addr;
-	comp_info   = (struct cos_component_information *)(mem + round_up_to_page(c->ro_sz) + info_offset);
-	comp_info->cos_this_spd_id = 0;
-	assert(comp_info->cos_this_spd_id == 0);
+	comp_info   = (struct cos_component_information *)(mem + info_offset);
 	comp_info->cos_this_spd_id = id;
 
-	if (c->ro_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)mem, round_up_to_page(c->ro_sz), COS_PAGE_READABLE)) return -ENOMEM;
-	if (c->rw_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)mem + round_up_to_page(c->ro_sz), c->tot_sz_mem - round_to_page(c->ro_sz), COS_PAGE_READABLE | COS_PAGE_WRITABLE)) return -ENOMEM;
+	if (c->ro_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)chkpt->ro_mem, round_up_to_page(c->ro_sz), COS_PAGE_READABLE)) return -ENOMEM;
+	if (c->rw_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)mem, chkpt->rw_sz, COS_PAGE_READABLE | COS_PAGE_WRITABLE)) return -ENOMEM;
 
 	/* FIXME: cos_time.h assumes we have access to this... */
 	ret = cos_cap_cpy_at(ci, BOOT_CAPTBL_SELF_INITHW_BASE, root_ci, BOOT_CAPTBL_SELF_INITHW_BASE);
@@ -369,6 +480,9 @@ crt_comp_create_from(struct crt_comp *c, char *name, compid_t id, struct crt_chk
  *
  * Notes:
  * - The capability tables in the generated component are empty.
+ * - Components created from identical objects share a single copy
+ *   of their read-only image, and only their writable image is
+ *   copied.
  * - `name` is *not* copied, so it is borrowed from within
  *   `c`. Allocate/copy it manually if you can't guarantee it will
  *   stay alive.
@@ -382,14 +496,14 @@ crt_comp_create_from(struct crt_comp *c, char *name, compid_t id, struct crt_chk
  *
  * @return: 0 on success, != 0 on error.
  */
-int
-crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vaddr_t info, prot_domain_t protdom)
+static int
+__crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vaddr_t info, prot_domain_t protdom, int share_ro)
 {
 	struct cos_compinfo *ci, *root_ci;
 	struct cos_component_information *comp_info;
 	unsigned long info_offset;
 	size_t  ro_sz,   rw_sz, data_sz, bss_sz, tot_sz;
-	char   *ro_src, *data_src, *mem;
+	char   *ro_src, *data_src, *mem, *ro_mem = NULL;
 	int     ret;
 
 	assert(c && name);
@@ -408,27 +522,53 @@ crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vadd
 	assert(!ret);
 
 	tot_sz = round_up_to_page(round_up_to_page(ro_sz) + data_sz + bss_sz);
-	mem    = cos_page_bump_allocn(root_ci, tot_sz);
-	if (!mem) return -ENOMEM;
-	c->mem = mem;
+	rw_sz  = tot_sz - round_up_to_page(ro_sz);
+	if (share_ro) {
+		ps_lock_take(&ro_images_lock);
+		ro_mem = crt_ro_image_find(c->ro_addr, ro_sz, ro_src);
+		ps_lock_release(&ro_images_lock);
+	}
+	if (ro_mem) {
+		/* An identical object was already loaded: only allocate the writable image */
+		mem = cos_page_bump_allocn(root_ci, rw_sz);
+		if (!mem) return -ENOMEM;
+		c->mem    = ro_mem;
+		c->rw_mem = mem;
+	} else {
+		mem = cos_page_bump_allocn(root_ci, tot_sz);
+		if (!mem) return -ENOMEM;
+		/*
+		 * Components can be created in parallel, so the copy is
+		 * made outside of the lock. Concurrent loads of the same
+		 * object can thus each make their own copy, which is
+		 * only a loss of sharing.
+		 */
+		memcpy(mem, ro_src, ro_sz);
+		c->mem    = mem;
+		c->rw_mem = mem + round_up_to_page(ro_sz);
+		if (share_ro) {
+			ps_lock_take(&ro_images_lock);
+			if (!crt_ro_image_find(c->ro_addr, ro_sz, ro_src)) crt_ro_image_add(c->ro_addr, ro_sz, ro_src, mem);
+			ps_lock_release(&ro_images_lock);
+		}
+	}
 	c->tot_sz_mem = tot_sz;
 	c->ro_sz = ro_sz;
 
-	memcpy(mem, ro_src, ro_sz);
-	memcpy(mem + round_up_to_page(ro_sz), data_src, data_sz);
-	memset(mem + round_up_to_page(ro_sz) + data_sz, 0, bss_sz);
+	memcpy(c->rw_mem, data_src, data_sz);
+	memset(c->rw_mem + data_sz, 0, bss_sz);
 
 	assert(info >= c->rw_addr && info < c->rw_addr + data_sz);
 	info_offset = info - c->rw_addr;
-	comp_info   = (struct cos_component_information *)(mem + round_up_to_page(ro_sz) + info_offset);
+	comp_info   = (struct cos_component_information *)(c->rw_mem + info_offset);
 	assert(comp_info->cos_this_spd_id == 0);
 	comp_info->cos_this_spd_id = id;
 
 	c->n_sinvs = 0;
 	memset(c->sinvs, 0, sizeof(c->sinvs));
 
-	if (c->ro_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)mem, round_up_to_page(ro_sz), protdom_pgtbl_flags_readable(protdom))) return -ENOMEM;
-	if (c->rw_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)mem + round_up_to_page(ro_sz), round_up_to_page(data_sz + bss_sz), protdom_pgtbl_flags_writable(protdom))) return -ENOMEM;
+	if (c->ro_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)c->mem, round_up_to_page(ro_sz), protdom_pgtbl_flags_readable(protdom))) return -ENOMEM;
+	if (c->rw_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)c->rw_mem, rw_sz, protdom_pgtbl_flags_writable(protdom))) return -ENOMEM;
 
 	/* FIXME: cos_time.h assumes we have access to this... */
 	ret = cos_cap_cpy_at(ci, BOOT_CAPTBL_SELF_INITHW_BASE, root_ci, BOOT_CAPTBL_SELF_INITHW_BASE);
@@ -437,6 +577,12 @@ crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vadd
 	return 0;
 }
 
+int
+crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vaddr_t info, prot_domain_t protdom)
+{
+	return __crt_comp_create(c, name, id, elf_hdr, info, protdom, 1);
+}
+
 int
 crt_vm_comp_init(struct crt_comp *c, char *name, compid_t id, vaddr_t info)
 {
@@ -734,8 +880,10 @@ crt_sinv_create(struct crt_sinv *sinv, char *name, struct crt_comp *server, stru
 
 	/* poor-mans virtual address translation from client VAS -> our ptrs */
 	assert(sinv->c_ucap_addr - sinv->client->ro_addr > 0);
-	ucap_off = sinv->c_ucap_addr - sinv->client->ro_addr;
-	ucap = (struct usr_inv_cap *)(sinv->client->mem + ucap_off);
+	/* The ucaps are in the writable image, that might not follow the read-only one */
+	assert(sinv->c_ucap_addr >= sinv->client->rw_addr);
+	ucap_off = sinv->c_ucap_addr - sinv->client->rw_addr;
+	ucap = (struct usr_inv_cap *)(sinv->client->rw_mem + ucap_off);
 	*ucap = (struct usr_inv_cap) {
 		.invocation_fn = sinv->c_fn_addr,
 		.cap_no        = sinv->sinv_cap,
@@ -1398,6 +1546,8 @@ crt_compinit_execute(comp_get_fn_t comp_get)
 	struct initargs_iter i;
 	int cont;
 	int ret;
+	int self_initcore = comp_get(cos_compid())->init_core == cos_cpuid();
+	cycles_t init_start = ps_tsc();
 
 	/*
 	 * Initialize components (cos_init, then cos_parallel_init) in
@@ -1412,6 +1562,7 @@ crt_compinit_execute(comp_get_fn_t comp_get)
 		char    *exec_type = args_value(&curr);
 		int      initcore, ret;
 		thdcap_t thdcap;
+		cycles_t start = ps_tsc();
 
 		comp     = comp_get(id);
 		assert(comp);
@@ -1439,6 +1590,11 @@ crt_compinit_execute(comp_get_fn_t comp_get)
 			}
 		}
 		assert(comp->init_state > CRT_COMP_INIT_PAR_INIT);
+		if (initcore) crt_timeline_mark(start, "init %s", comp->name);
+	}
+	if (self_initcore) {
+		crt_timeline_mark(init_start, "components initialized");
+		crt_timeline_done();
 	}
 
 	/*
@@ -73,6 +73,7 @@ struct crt_comp {
 	vaddr_t entry_addr, ro_addr, rw_addr, info;
 
 	char *mem;		/* image memory */
+	char *rw_mem;		/* its writable part (after the read-only part, unless from a checkpoint) */
 	pgtblcap_t capmgr_untyped_mem;
 	struct elf_hdr *elf_hdr;
 	struct cos_defcompinfo *comp_res;
@@ -99,6 +100,16 @@ struct crt_comp {
 	struct protdom_ns_vas *ns_vas;
 
 	struct crt_vm_comp_info vm_comp_info;
+
+	/*
+	 * For a component created from a checkpoint: the checkpoint, and
+	 * the resources it had at its restore point (see
+	 * `crt_chkpt_restore`).
+	 */
+	struct crt_chkpt *chkpt;
+	crt_refcnt_t      chkpt_refcnt;
+	capid_t           chkpt_cap_frontier;
+	vaddr_t           chkpt_vas_frontier;
 };
 
 struct crt_comp_resources {
@@ -110,9 +121,16 @@ struct crt_comp_resources {
 	vaddr_t     info;
 };
 
+/*
+ * A checkpoint shares the read-only image of the component with it
+ * (and all components created from it), and only saves its writable
+ * image.
+ */
 struct crt_chkpt {
 	struct crt_comp *c;
-	char            *mem;
+	char            *ro_mem;	/* the component's read-only image */
+	char            *mem;		/* the saved writable image */
+	size_t           rw_sz;
 	size_t           tot_sz_mem;
 };
 
@@ -236,6 +254,7 @@ void crt_compinit_done(struct crt_comp *c, int parallel_init, init_main_t main_t
 void crt_compinit_exit(struct crt_comp *c, int retval);
 
 int crt_chkpt_create(struct crt_chkpt *chkpt, struct crt_comp *c);
+void crt_chkpt_restore_point(struct crt_comp *c);
 int crt_chkpt_restore(struct crt_chkpt *chkpt, struct crt_comp *c);
 
 int crt_ulk_init(void);
@@ -0,0 +1,188 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2020, The George Washington University
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cos_component.h>
+#include <cos_kernel_api.h>
+#include <llprint.h>
+#include <ps.h>
+#include <crt.h>
+#include <crt_timeline.h>
+
+static struct crt_timeline *timeline = NULL;
+
+static const char *kern_phase_names[KERN_BOOT_NPHASES] = {
+	[KERN_BOOT_START]       = "kernel: entry",
+	[KERN_BOOT_CPU]         = "kernel: cpu init",
+	[KERN_BOOT_MEM_MAP]     = "kernel: memory map",
+	[KERN_BOOT_RETYPE_TBL]  = "kernel: cap/retype tables",
+	[KERN_BOOT_DATA_STRUCT] = "kernel: data-structures",
+	[KERN_BOOT_UT_MEM]      = "kernel: untyped memory setup",
+	[KERN_BOOT_KMEM]        = "kernel: acpi/lapic/timer",
+	[KERN_BOOT_COMP_IMG]    = "kernel: booter image",
+	[KERN_BOOT_UT_MAP]      = "kernel: untyped memory mapping",
+	[KERN_BOOT_COMP]        = "kernel: booter threads",
+	[KERN_BOOT_SMP]         = "kernel: smp boot",
+};
+
+static struct crt_timeline_mark *
+crt_timeline_mark_alloc(void)
+{
+	unsigned long idx = ps_faa(&timeline->nmarks, 1);
+
+	if (idx >= CRT_TIMELINE_MAX_MARKS) return NULL;
+
+	return &timeline->marks[idx];
+}
+
+/* Add the phases the kernel timestamped; platforms can omit some */
+static void
+crt_timeline_kernel(void)
+{
+	struct crt_timeline_mark *m;
+	u64_t prev, tsc;
+	int i;
+
+	if (cos_hw_boot_tsc(BOOT_CAPTBL_SELF_INITHW_BASE, KERN_BOOT_START, &prev) || prev == 0) return;
+	for (i = KERN_BOOT_START + 1 ; i < KERN_BOOT_NPHASES ; i++) {
+		if (cos_hw_boot_tsc(BOOT_CAPTBL_SELF_INITHW_BASE, i, &tsc) || tsc == 0) continue;
+
+		m = crt_timeline_mark_alloc();
+		if (!m) return;
+		*m = (struct crt_timeline_mark) {
+			.start = prev,
+			.end   = tsc,
+			.comp  = 0,
+			.core  = 0,
+		};
+		strncpy(m->name, kern_phase_names[i], CRT_TIMELINE_NAMESZ - 1);
+		prev = tsc;
+	}
+}
+
+/**
+ * Create the boot timeline in the booter `self`, and record the
+ * kernel's boot phases in it.
+ *
+ * @return: 0 on success, -ENOMEM if the timeline cannot be allocated.
+ */
+int
+crt_timeline_create(struct crt_comp *self)
+{
+	struct crt_timeline *tl;
+
+	tl = crt_page_allocn(self, CRT_TIMELINE_PAGES);
+	if (!tl) return -ENOMEM;
+	memset(tl, 0, CRT_TIMELINE_PAGES * PAGE_SIZE);
+
+	tl->nusers        = 1;
+	tl->cycs_per_usec = cos_hw_cycles_per_usec(BOOT_CAPTBL_SELF_INITHW_BASE);
+	timeline          = tl;
+	crt_timeline_kernel();
+
+	return 0;
+}
+
+/**
+ * Alias the timeline into component `c`. This must be done before
+ * `c` executes: its heap starts after the timeline (`@addr`, in `c`).
+ *
+ * @return: 0 on success, != 0 on error.
+ */
+int
+crt_timeline_alias_in(struct crt_comp *self, struct crt_comp *c, vaddr_t *addr)
+{
+	struct cos_component_information *comp_info;
+
+	if (!timeline) return -EINVAL;
+	if (crt_page_aliasn_in(timeline, CRT_TIMELINE_PAGES, self, c, addr)) return -ENOMEM;
+
+	assert(c->info >= c->rw_addr);
+	comp_info = (struct cos_component_information *)(c->rw_mem + (c->info - c->rw_addr));
+	comp_info->cos_heap_ptr = cos_compinfo_get(c->comp_res)->vas_frontier;
+	ps_faa(&timeline->nusers, 1);
+
+	return 0;
+}
+
+/* Use the timeline the booter aliased at `addr` */
+void
+crt_timeline_set(vaddr_t addr)
+{
+	timeline = (struct crt_timeline *)addr;
+}
+
+/*
+ * Record the phase named by `fmt` (formatted as printf), executed on
+ * this core since `start`, until now.
+ */
+void
+crt_timeline_mark(cycles_t start, const char *fmt, ...)
+{
+	struct crt_timeline_mark *m;
+	va_list args;
+
+	if (!timeline) return;
+	m = crt_timeline_mark_alloc();
+	if (!m) return;
+
+	*m = (struct crt_timeline_mark) {
+		.start = start,
+		.end   = ps_tsc(),
+		.comp  = cos_compid(),
+		.core  = cos_cpuid(),
+	};
+	va_start(args, fmt);
+	vsnprintf(m->name, CRT_TIMELINE_NAMESZ, fmt, args);
+	va_end(args);
+}
+
+static void
+crt_timeline_print(void)
+{
+	struct crt_timeline_mark *marks = timeline->marks, tmp;
+	unsigned long n = timeline->nmarks, i, j;
+	cycles_t base;
+	int cycs = timeline->cycs_per_usec > 0 ? timeline->cycs_per_usec : 1;
+
+	if (n > CRT_TIMELINE_MAX_MARKS) {
+		printc("Boot timeline: %lu phases not recorded (timeline full).\n", n - CRT_TIMELINE_MAX_MARKS);
+		n = CRT_TIMELINE_MAX_MARKS;
+	}
+	if (n == 0) return;
+
+	/* Insertion sort by start time: there are only a few hundred phases */
+	for (i = 1 ; i < n ; i++) {
+		tmp = marks[i];
+		for (j = i ; j > 0 && marks[j - 1].start > tmp.start ; j--) marks[j] = marks[j - 1];
+		marks[j] = tmp;
+	}
+
+	base = marks[0].start;
+	printc("Boot timeline (usec from %s):\n", marks[0].comp == 0 ? "kernel entry" : "the first phase");
+	printc("\t   start  duration  comp core  phase\n");
+	for (i = 0 ; i < n ; i++) {
+		printc("\t%8llu  %8llu  %4lu %4u  %s\n",
+		       (unsigned long long)((marks[i].start - base) / cycs),
+		       (unsigned long long)((marks[i].end - marks[i].start) / cycs),
+		       marks[i].comp, (unsigned int)marks[i].core, marks[i].name);
+	}
+	printc("\ttotal: %llu usec\n", (unsigned long long)((ps_tsc() - base) / cycs));
+}
+
+/*
+ * This component has initialized all of its components. The last
+ * component sharing the timeline to do so prints it.
+ */
+void
+crt_timeline_done(void)
+{
+	if (!timeline) return;
+	if (ps_faa(&timeline->nusers, -1) == 1) crt_timeline_print();
+}
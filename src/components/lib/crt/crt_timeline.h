@@ -0,0 +1,47 @@
+#ifndef CRT_TIMELINE_H
+#define CRT_TIMELINE_H
+
+/***
+ * The boot timeline: TSC-stamped phases of the boot of the kernel,
+ * the booter, and the capability managers, collected into pages
+ * shared between them. Once the last of them completes the
+ * initialization of its components, the timeline is printed, sorted
+ * by time, with the duration of each phase.
+ *
+ * The booter creates the timeline (which records the kernel's
+ * phases), and aliases it into the capability managers. They find it
+ * with `addr_get(cos_compid(), ADDR_BOOT_TIMELINE)`. All of the
+ * functions are no-ops in components without a timeline.
+ */
+
+#include <cos_types.h>
+
+#define CRT_TIMELINE_PAGES  4
+#define CRT_TIMELINE_NAMESZ 40
+
+struct crt_timeline_mark {
+	cycles_t start, end;
+	compid_t comp;		/* 0 for the kernel */
+	coreid_t core;
+	char     name[CRT_TIMELINE_NAMESZ];
+};
+
+struct crt_timeline {
+	unsigned long            nmarks;
+	unsigned long            nusers; /* components yet to complete their initialization */
+	int                      cycs_per_usec;
+	struct crt_timeline_mark marks[0];
+};
+
+#define CRT_TIMELINE_MAX_MARKS \
+	((CRT_TIMELINE_PAGES * PAGE_SIZE - sizeof(struct crt_timeline)) / sizeof(struct crt_timeline_mark))
+
+struct crt_comp;
+
+int  crt_timeline_create(struct crt_comp *self);
+int  crt_timeline_alias_in(struct crt_comp *self, struct crt_comp *c, vaddr_t *addr);
+void crt_timeline_set(vaddr_t addr);
+void crt_timeline_mark(cycles_t start, const char *fmt, ...);
+void crt_timeline_done(void);
+
+#endif /* CRT_TIMELINE_H */
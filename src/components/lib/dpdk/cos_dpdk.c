@@ -9,6 +9,10 @@
 #include <rte_log.h>
 #include <rte_config.h>
 #include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_malloc.h>
+#include <rte_flow.h>
+#include <rte_eth_ring.h>
 
 #include <arpa/inet.h>
 #include <net_stack_types.h>
@@ -103,6 +107,7 @@ cos_eth_ports_init(void)
 	uint16_t i;
 
 	memset(ports_ids, 0, sizeof(ports_ids));
+	nb_ports = 0;
 
 	RTE_ETH_FOREACH_DEV(port_id) {
 		ports_ids[nb_ports] = port_id;
@@ -122,6 +127,58 @@ cos_eth_ports_init(void)
 	return nb_ports;
 }
 
+/* The most queues of a virtual NIC, and the packets each can hold */
+#define COS_VNIC_MAX_QUEUES 32
+#define COS_VNIC_RING_SZ    1024
+
+/*
+ * cos_eth_vnic_loopback_create: create a software Ether port (net_ring)
+ * that loops its tx queues back to its rx queues: packets sent on tx
+ * queue i are received on rx queue i % nb_rx_q
+ *
+ * @name: port name, also used to name its rings
+ * @nb_rx_q: number of rx queues
+ * @nb_tx_q: number of tx queues
+ *
+ * @return: 0 on success, < 0 on failure
+ *
+ * note: this is for systems without a NIC the drivers support, to run
+ *       the network stack and its benchmarks in-system. The port is
+ *       found by the following cos_eth_ports_init as any other port.
+ */
+int
+cos_eth_vnic_loopback_create(const char *name, uint16_t nb_rx_q, uint16_t nb_tx_q)
+{
+	struct rte_ring *rx_rings[COS_VNIC_MAX_QUEUES], *tx_rings[COS_VNIC_MAX_QUEUES];
+	char ring_name[RTE_RING_NAMESIZE];
+	uint16_t i, j;
+	int port_id;
+
+	if (nb_rx_q == 0 || nb_tx_q == 0 || nb_rx_q > COS_VNIC_MAX_QUEUES || nb_tx_q > COS_VNIC_MAX_QUEUES) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nb_rx_q; i++) {
+		snprintf(ring_name, sizeof(ring_name), "%s_%u", name, i);
+		/* the tx queues of several cores can loop back to the same rx queue */
+		rx_rings[i] = rte_ring_create(ring_name, COS_VNIC_RING_SZ, rte_socket_id(), RING_F_SC_DEQ);
+		if (!rx_rings[i]) goto err;
+	}
+	for (j = 0; j < nb_tx_q; j++) tx_rings[j] = rx_rings[j % nb_rx_q];
+
+	port_id = rte_eth_from_rings(name, rx_rings, nb_rx_q, tx_rings, nb_tx_q, rte_socket_id());
+	if (port_id < 0) goto err;
+
+	COS_DPDK_APP_LOG(NOTICE, "cos_eth_vnic_loopback_create success, port %d: %s\n", port_id, name);
+
+	return 0;
+err:
+	COS_DPDK_APP_LOG(ERR, "cos_eth_vnic_loopback_create failed: %s\n", name);
+	while (i-- > 0) rte_ring_free(rx_rings[i]);
+
+	return -1;
+}
+
 static struct rte_mempool * cos_dpdk_pktmbuf_pool = NULL;
 static struct rte_eth_conf default_port_conf = {
 	.rxmode = {
@@ -181,13 +238,24 @@ cos_free_packet(char* packet)
  * 
  * return: 0 on success, others will cause panic
  * 
- * note: this function gives users ability to config a port's rx/tx queues
+ * note: this function gives users ability to config a port's rx/tx queues,
+ *       with more than one rx queue, packets are spread by RSS over them
  */
 int
 cos_config_dev_port_queue(cos_portid_t port_id, uint16_t nb_rx_q, uint16_t nb_tx_q)
 {
 	int ret;
 	struct rte_eth_conf local_port_conf = default_port_conf;
+	struct rte_eth_dev_info dev_info;
+
+	/* Spread the packets over the rx queues by their flows */
+	if (nb_rx_q > 1 && rte_eth_dev_info_get(ports_ids[port_id], &dev_info) == 0) {
+		local_port_conf.rxmode.mq_mode               = RTE_ETH_MQ_RX_RSS;
+		local_port_conf.rx_adv_conf.rss_conf.rss_key = NULL;
+		local_port_conf.rx_adv_conf.rss_conf.rss_hf  =
+			(RTE_ETH_RSS_IP | RTE_ETH_RSS_UDP | RTE_ETH_RSS_TCP) & dev_info.flow_type_rss_offloads;
+		if (local_port_conf.rx_adv_conf.rss_conf.rss_hf == 0) local_port_conf.rxmode.mq_mode = RTE_ETH_MQ_RX_NONE;
+	}
 
 	ret = rte_eth_dev_configure(ports_ids[port_id], nb_rx_q, nb_tx_q, &local_port_conf);
 	if (ret < 0) {
@@ -196,7 +264,7 @@ cos_config_dev_port_queue(cos_portid_t port_id, uint16_t nb_rx_q, uint16_t nb_tx
 	}
 	
 	COS_DPDK_APP_LOG(NOTICE, "cos_config_dev_port_queue success, with "
-			"%d rx_queue, %d tx_queues\n", nb_tx_q, nb_tx_q);
+			"%d rx_queue, %d tx_queues\n", nb_rx_q, nb_tx_q);
 
 	return ret;
 }
@@ -232,6 +300,60 @@ cos_dev_port_adjust_rx_tx_desc(cos_portid_t port_id, uint16_t *nb_rx_desc, uint1
 	return ret;
 }
 
+/*
+ * cos_dev_port_max_rx_queues: the maximum number of rx queues of a port
+ *
+ * @port_id: eth port id, from user's perspective, the maximum id is get
+ *           from cos_eth_ports_init
+ *
+ * @return: the number of rx queues the port supports
+ */
+uint16_t
+cos_dev_port_max_rx_queues(cos_portid_t port_id)
+{
+	struct rte_eth_dev_info dev_info;
+
+	if (rte_eth_dev_info_get(ports_ids[port_id], &dev_info) < 0) return 1;
+
+	return dev_info.max_rx_queues;
+}
+
+/*
+ * cos_dev_port_rss_queues: spread the packets with RSS only over the first rx queues
+ *
+ * @port_id: eth port id, from user's perspective, the maximum id is get
+ *           from cos_eth_ports_init
+ * @nb_rss_q: the number of rx queues, from queue 0, that RSS spreads packets to
+ *
+ * @return: 0 on success, -1 if the port's RSS redirection table cannot be set
+ *
+ * note: the other queues only receive the packets steered to them, see
+ *       cos_dev_port_flow_udp_to_queue. The port has to be started.
+ */
+int
+cos_dev_port_rss_queues(cos_portid_t port_id, uint16_t nb_rss_q)
+{
+	struct rte_eth_rss_reta_entry64 reta_conf[RTE_ETH_RSS_RETA_SIZE_512 / RTE_ETH_RETA_GROUP_SIZE];
+	struct rte_eth_dev_info dev_info;
+	cos_portid_t real_port_id = ports_ids[port_id];
+	uint16_t i;
+
+	if (nb_rss_q == 0 || rte_eth_dev_info_get(real_port_id, &dev_info) < 0) return -1;
+	if (dev_info.reta_size == 0 || dev_info.reta_size > RTE_ETH_RSS_RETA_SIZE_512) return -1;
+
+	memset(reta_conf, 0, sizeof(reta_conf));
+	for (i = 0; i < dev_info.reta_size; i++) {
+		reta_conf[i / RTE_ETH_RETA_GROUP_SIZE].mask |= 1ULL << (i % RTE_ETH_RETA_GROUP_SIZE);
+		reta_conf[i / RTE_ETH_RETA_GROUP_SIZE].reta[i % RTE_ETH_RETA_GROUP_SIZE] = i % nb_rss_q;
+	}
+	if (rte_eth_dev_rss_reta_update(real_port_id, reta_conf, dev_info.reta_size)) return -1;
+
+	COS_DPDK_APP_LOG(NOTICE, "cos_dev_port_rss_queues success, rss over "
+			"%d rx_queues\n", nb_rss_q);
+
+	return 0;
+}
+
 /*
  * cos_dev_port_rx_queue_setup: wrapper function for rte_eth_rx_queue_setup
  *
@@ -708,6 +830,155 @@ cos_create_pkt_mbuf_pool_by_ops(const char *name, size_t nb_mbufs, char* ops_nam
 		COS_MBUF_DEFAULT_BUF_SIZE, rte_socket_id(), ops_name);
 }
 
+/*
+ * The cos_extbuf mempool ops: a ring of mbufs, as the ring ops, that
+ * attaches the pool's user's external buffers to mbufs as they are
+ * allocated (e.g. when a rx queue refills its descriptors). Without a
+ * user, the mbufs use their own buffers.
+ */
+struct cos_extbuf_pool {
+	struct rte_ring       *ring;
+	cos_extbuf_attach_fn_t attach_fn;
+	void                  *opaque;
+};
+
+static int
+cos_extbuf_pool_alloc(struct rte_mempool *mp)
+{
+	char rg_name[RTE_RING_NAMESIZE];
+	struct cos_extbuf_pool *p;
+
+	p = rte_zmalloc_socket("cos_extbuf_pool", sizeof(*p), RTE_CACHE_LINE_SIZE, mp->socket_id);
+	if (!p) return -ENOMEM;
+
+	snprintf(rg_name, sizeof(rg_name), "CX_%s", mp->name);
+	p->ring = rte_ring_create(rg_name, rte_align32pow2(mp->size + 1), mp->socket_id, 0);
+	if (!p->ring) {
+		rte_free(p);
+		return -rte_errno;
+	}
+	mp->pool_data = p;
+
+	return 0;
+}
+
+static void
+cos_extbuf_pool_free(struct rte_mempool *mp)
+{
+	struct cos_extbuf_pool *p = mp->pool_data;
+
+	rte_ring_free(p->ring);
+	rte_free(p);
+}
+
+static int
+cos_extbuf_pool_enqueue(struct rte_mempool *mp, void * const *obj_table, unsigned int n)
+{
+	struct cos_extbuf_pool *p = mp->pool_data;
+
+	return rte_ring_mp_enqueue_bulk(p->ring, obj_table, n, NULL) == 0 ? -ENOBUFS : 0;
+}
+
+/* Point the mbuf back to its own buffer, as rte_pktmbuf_detach does */
+static inline void
+cos_mbuf_reset_buf(struct rte_mbuf *m)
+{
+	uint32_t mbuf_size = sizeof(struct rte_mbuf) + rte_pktmbuf_priv_size(m->pool);
+
+	m->buf_addr = (char *)m + mbuf_size;
+	m->buf_iova = rte_mempool_virt2iova(m) + mbuf_size;
+	m->buf_len  = (uint16_t)rte_pktmbuf_data_room_size(m->pool);
+	m->data_off = RTE_MIN(RTE_PKTMBUF_HEADROOM, (uint16_t)m->buf_len);
+	m->ol_flags = 0;
+	m->shinfo   = NULL;
+}
+
+static int
+cos_extbuf_pool_dequeue(struct rte_mempool *mp, void **obj_table, unsigned int n)
+{
+	struct cos_extbuf_pool *p = mp->pool_data;
+	unsigned int i;
+
+	if (rte_ring_mc_dequeue_bulk(p->ring, obj_table, n, NULL) == 0) return -ENOBUFS;
+
+	/*
+	 * The drivers can overwrite the ol_flags of received mbufs,
+	 * so mbufs can come back still pointing to external buffers.
+	 */
+	if (!p->opaque) {
+		for (i = 0; i < n; i++) cos_mbuf_reset_buf(obj_table[i]);
+		return 0;
+	}
+	if (p->attach_fn(p->opaque, (char **)obj_table, n)) {
+		rte_ring_mp_enqueue_bulk(p->ring, obj_table, n, NULL);
+		return -ENOBUFS;
+	}
+
+	return 0;
+}
+
+static unsigned int
+cos_extbuf_pool_get_count(const struct rte_mempool *mp)
+{
+	struct cos_extbuf_pool *p = mp->pool_data;
+
+	return rte_ring_count(p->ring);
+}
+
+static const struct rte_mempool_ops cos_extbuf_pool_ops = {
+	.name      = COS_MEMPOOL_EXTBUF_OPS,
+	.alloc     = cos_extbuf_pool_alloc,
+	.free      = cos_extbuf_pool_free,
+	.enqueue   = cos_extbuf_pool_enqueue,
+	.dequeue   = cos_extbuf_pool_dequeue,
+	.get_count = cos_extbuf_pool_get_count,
+};
+
+MEMPOOL_REGISTER_OPS(cos_extbuf_pool_ops);
+
+/*
+ * cos_create_pkt_mbuf_pool_extbuf: create a mbuf pool with the cos_extbuf ops
+ *
+ * @name: pkt pool name
+ * @nb_mbufs: number of mbufs within this pool
+ * @attach_fn: attaches the external buffers of the pool's user to mbufs
+ *
+ * @return: NULL on allocate failure, others on success
+ *
+ * note: the pool has no user when created, see cos_mbuf_pool_extbuf_user.
+ *       The mbufs are not cached per core, so that they are attached
+ *       to the current user's buffers.
+ */
+char*
+cos_create_pkt_mbuf_pool_extbuf(const char *name, size_t nb_mbufs, cos_extbuf_attach_fn_t attach_fn)
+{
+	struct rte_mempool *mp;
+	struct cos_extbuf_pool *p;
+
+	mp = rte_pktmbuf_pool_create_by_ops(name, nb_mbufs, 0, 0,
+		COS_MBUF_DEFAULT_BUF_SIZE, rte_socket_id(), COS_MEMPOOL_EXTBUF_OPS);
+	if (!mp) return NULL;
+
+	p = mp->pool_data;
+	p->attach_fn = attach_fn;
+
+	return (char *)mp;
+}
+
+/*
+ * cos_mbuf_pool_extbuf_user: set the user of a cos_extbuf pool
+ *
+ * @mp: the pool, created by cos_create_pkt_mbuf_pool_extbuf
+ * @opaque: passed to the pool's attach_fn, NULL for no user
+ */
+void
+cos_mbuf_pool_extbuf_user(char *mp, void *opaque)
+{
+	struct cos_extbuf_pool *p = ((struct rte_mempool *)mp)->pool_data;
+
+	__atomic_store_n(&p->opaque, opaque, __ATOMIC_RELEASE);
+}
+
 uint64_t
 cos_get_port_mac_address(uint16_t port_id)
 {
@@ -772,3 +1043,104 @@ void cos_rte_flow(void)
 	// return flow;
 
 }
+
+/* The rules cos_dev_port_flow_udp_to_queue created, to destroy them */
+#define COS_MAX_UDP_FLOWS 64
+
+struct cos_udp_flow {
+	cos_portid_t     port_id;
+	uint16_t         udp_port;
+	struct rte_flow *flow;
+};
+
+static struct cos_udp_flow udp_flows[COS_MAX_UDP_FLOWS];
+static int nb_udp_flows;
+
+/*
+ * cos_dev_port_flow_udp_to_queue: steer udp packets to a rx queue
+ *
+ * @port_id: eth port id, from user's perspective, the maximum id is get
+ *           from cos_eth_ports_init
+ * @udp_dst_port: the destination port of the packets, in network order
+ * @queue_id: the rx queue that receives them
+ *
+ * @return: 0 on success, -1 if the port cannot steer the packets
+ */
+int
+cos_dev_port_flow_udp_to_queue(cos_portid_t port_id, uint16_t udp_dst_port, uint16_t queue_id)
+{
+	struct rte_flow_attr         attr;
+	struct rte_flow_item         pattern[4];
+	struct rte_flow_action       action[2];
+	struct rte_flow_action_queue queue = { .index = queue_id };
+	struct rte_flow_item_udp     udp_spec, udp_mask;
+	struct rte_flow_error        error;
+	struct rte_flow             *flow;
+	cos_portid_t real_port_id = ports_ids[port_id];
+
+	memset(&attr, 0, sizeof(attr));
+	memset(pattern, 0, sizeof(pattern));
+	memset(action, 0, sizeof(action));
+	memset(&udp_spec, 0, sizeof(udp_spec));
+	memset(&udp_mask, 0, sizeof(udp_mask));
+
+	attr.ingress = 1;
+
+	udp_spec.hdr.dst_port = udp_dst_port;
+	udp_mask.hdr.dst_port = 0xFFFF;
+
+	pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+	pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
+	pattern[2].type = RTE_FLOW_ITEM_TYPE_UDP;
+	pattern[2].spec = &udp_spec;
+	pattern[2].mask = &udp_mask;
+	pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
+
+	action[0].type = RTE_FLOW_ACTION_TYPE_QUEUE;
+	action[0].conf = &queue;
+	action[1].type = RTE_FLOW_ACTION_TYPE_END;
+
+	if (nb_udp_flows >= COS_MAX_UDP_FLOWS) return -1;
+	if (rte_flow_validate(real_port_id, &attr, pattern, action, &error)) return -1;
+	flow = rte_flow_create(real_port_id, &attr, pattern, action, &error);
+	if (!flow) return -1;
+
+	udp_flows[nb_udp_flows++] = (struct cos_udp_flow) {
+		.port_id  = port_id,
+		.udp_port = udp_dst_port,
+		.flow     = flow,
+	};
+
+	COS_DPDK_APP_LOG(NOTICE, "cos_dev_port_flow_udp_to_queue success, udp port "
+			"%u to rx_queue_%d\n", ntohs(udp_dst_port), queue_id);
+
+	return 0;
+}
+
+/*
+ * cos_dev_port_flow_udp_unsteer: let RSS spread the udp packets that
+ * cos_dev_port_flow_udp_to_queue steered to a rx queue
+ *
+ * @port_id: eth port id, from user's perspective, the maximum id is get
+ *           from cos_eth_ports_init
+ * @udp_dst_port: the destination port of the packets, in network order
+ *
+ * @return: 0 on success, -1 if they are not steered, or the rule cannot be destroyed
+ */
+int
+cos_dev_port_flow_udp_unsteer(cos_portid_t port_id, uint16_t udp_dst_port)
+{
+	struct rte_flow_error error;
+	int i;
+
+	for (i = 0; i < nb_udp_flows; i++) {
+		if (udp_flows[i].port_id != port_id || udp_flows[i].udp_port != udp_dst_port) continue;
+
+		if (rte_flow_destroy(ports_ids[port_id], udp_flows[i].flow, &error)) return -1;
+		udp_flows[i] = udp_flows[--nb_udp_flows];
+
+		return 0;
+	}
+
+	return -1;
+}
@@ -73,15 +73,36 @@ enum cos_dpdk_switch_t {
 #define COS_MEMPOOL_MT_RTS_OPS "ring_mt_rts"
 #define COS_MEMPOOL_MT_HTS_OPS "ring_mt_hts"
 
+/*
+ * Mbuf pools whose mbufs are attached to external buffers when they
+ * are allocated, so that a rx queue using the pool receives directly
+ * into them (see cos_create_pkt_mbuf_pool_extbuf).
+ */
+#define COS_MEMPOOL_EXTBUF_OPS "cos_extbuf"
+
+/*
+ * Attach an external buffer (with cos_attach_external_mbuf) to each of
+ * the `n` mbufs. Returns 0 on success, or !0 if there are not enough
+ * buffers, in which case no buffer must be attached.
+ */
+typedef int (*cos_extbuf_attach_fn_t)(void *opaque, char **mbufs, unsigned int n);
+
 int cos_dpdk_init(int argc, char **argv);
 uint16_t cos_eth_ports_init(void);
+int cos_eth_vnic_loopback_create(const char *name, uint16_t nb_rx_q, uint16_t nb_tx_q);
 
 char* cos_create_pkt_mbuf_pool(const char *name, size_t nb_mbufs);
 char* cos_create_pkt_mbuf_pool_by_ops(const char *name, size_t nb_mbufs, char* ops_name);
+char* cos_create_pkt_mbuf_pool_extbuf(const char *name, size_t nb_mbufs, cos_extbuf_attach_fn_t attach_fn);
+void cos_mbuf_pool_extbuf_user(char *mp, void *opaque);
 int cos_free_packet(char* packet);
 
 int cos_config_dev_port_queue(cos_portid_t port_id, uint16_t nb_rx_q, uint16_t nb_tx_q);
 int cos_dev_port_adjust_rx_tx_desc(cos_portid_t port_id, uint16_t *nb_rx_desc, uint16_t *nb_tx_desc);
+uint16_t cos_dev_port_max_rx_queues(cos_portid_t port_id);
+int cos_dev_port_rss_queues(cos_portid_t port_id, uint16_t nb_rss_q);
+int cos_dev_port_flow_udp_to_queue(cos_portid_t port_id, uint16_t udp_dst_port, uint16_t queue_id);
+int cos_dev_port_flow_udp_unsteer(cos_portid_t port_id, uint16_t udp_dst_port);
 
 int cos_dev_port_rx_queue_setup(cos_portid_t port_id, uint16_t rx_queue_id, 
 			uint16_t nb_rx_desc, char* mp);
@@ -118,7 +139,10 @@ uint64_t cos_get_port_mac_address(uint16_t port_id);
 void cos_test_send(int queue, char *mp);
 
 #define E810_NIC 0
-#define NIC_RX_QUEUE_NUM 1
+/* The maximum number of rx queues shared by the sessions, spread with RSS */
+#ifndef NIC_RX_QUEUE_NUM
+#define NIC_RX_QUEUE_NUM NUM_CPU
+#endif
 
 #if E810_NIC
 #define NIC_TX_QUEUE_NUM (NUM_CPU - 1)
@@ -1593,11 +1593,16 @@ cos_mem_alias_atn(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *
 	return 0;
 }
 
+/*
+ * Unmap the page at `addr`. The unmapping isn't tracked by a
+ * dedicated liveness id, thus the caller must ensure the quiescence
+ * of the page's TLB entries (see cos_hw_tlb_quiescent) before it
+ * reuses the page.
+ */
 int
 cos_mem_remove(pgtblcap_t pt, vaddr_t addr)
 {
-	assert(0);
-	return 0;
+	return call_cap_op(pt, CAPTBL_OP_MEMDEACTIVATE, addr, 0, 0, 0);
 }
 
 vaddr_t
@@ -1744,6 +1749,26 @@ cos_hw_cycles_thresh(hwcap_t hwc)
 	return call_cap_op(hwc, CAPTBL_OP_HW_CYC_THRESH, 0, 0, 0, 0);
 }
 
+/* The TSC at the end of one of the kernel's boot phases */
+int
+cos_hw_boot_tsc(hwcap_t hwc, kern_boot_phase_t phase, u64_t *tsc)
+{
+	word_t lo, hi, unused;
+	int    ret;
+
+	ret = call_cap_retvals_asm(hwc, CAPTBL_OP_HW_BOOT_TSC, phase, 0, 0, 0, &lo, &hi, &unused);
+	if (ret) return ret;
+	*tsc = ((u64_t)(u32_t)hi << 32) | (u32_t)lo;
+
+	return 0;
+}
+
+int
+cos_hw_tlb_quiescent(hwcap_t hwc, u64_t unmap_tsc)
+{
+	return call_cap_op(hwc, CAPTBL_OP_HW_TLB_QUIESCENT, (u32_t)unmap_tsc, (u32_t)(unmap_tsc >> 32), 0, 0);
+}
+
 void
 cos_hw_shutdown(hwcap_t hwc)
 {
@@ -235,6 +235,13 @@ int     cos_hw_detach(hwcap_t hwc, hwid_t hwid);
 void   *cos_hw_map(struct cos_compinfo *ci, hwcap_t hwc, paddr_t pa, unsigned int len);
 int     cos_hw_cycles_per_usec(hwcap_t hwc);
 int     cos_hw_cycles_thresh(hwcap_t hwc);
+int     cos_hw_boot_tsc(hwcap_t hwc, kern_boot_phase_t phase, u64_t *tsc);
+/*
+ * Have the TLBs of all cores been flushed since the memory unmapped at
+ * `unmap_tsc` was? Returns 1 if so, else 0, and has the cores flush
+ * theirs soon, so that a later call succeeds.
+ */
+int     cos_hw_tlb_quiescent(hwcap_t hwc, u64_t unmap_tsc);
 int     cos_hw_tlb_lockdown(hwcap_t hwc, unsigned long entryid, unsigned long vaddr, unsigned long paddr);
 int     cos_hw_l1flush(hwcap_t hwc);
 int     cos_hw_tlbflush(hwcap_t hwc);
@@ -31,4 +31,8 @@ typedef unsigned long int mem_ptr_t;
 #include <llprint.h>
 #define LWIP_PLATFORM_DIAG(x) do { printc x; } while (0);
 #define LWIP_PLATFORM_ASSERT(x) do { printc(x); } while (0);
+
+/* The checksums of the packets lwip sends and receives are summed with vectors */
+#include <net_cksum.h>
+#define LWIP_CHKSUM(dataptr, len) net_cksum_fold(net_cksum_raw((dataptr), (size_t)(len), 0))
 #endif /* __ARCH_CC_H__ */
@@ -6,7 +6,7 @@
 
 #define NO_SYS 1
 #define MEM_ALIGNMENT 8
-#define MEM_SIZE  (12 * 1024)//64000
+#define MEM_SIZE  (256 * 1024) /* the headers of the segments not yet acknowledged, of all connections */
 // #define MEMP_OVERFLOW_CHECK 1
 // #define MEMP_SANITY_CHECK 1
 #define MEMP_NUM_PBUF (4096*4)
@@ -18,11 +18,14 @@
 
 #define MEMP_NUM_UDP_PCB 512
 
-#define MEMP_NUM_TCP_PCB 512 	/* need a fair amount of these due to timed wait on close  */
+#define MEMP_NUM_TCP_PCB 4096 	/* need a fair amount of these due to timed wait on close, and for many clients */
 #define MEMP_NUM_TCP_PCB_LISTEN 128
 #define IP_REASSEMBLY 0
 #define IP_FRAG 0
 
+/* The netmgr receives packets in place, in pbufs that free their shmem objects */
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
 #define SYS_LIGHTWEIGHT_PROT           0
 //#define LWIP_WND_SCALE                  1
 
@@ -40,6 +43,9 @@
 
 #define MEMP_NUM_TCP_SEG 2*4096 //(TCP_SND_QUEUELEN*16)
 
+/* TCP sender buffer space (bytes): a write is up to a shmem object's data */
+#define TCP_SND_BUF             (4 * TCP_MSS)
+
 /* TCP receive window. */
 #define TCP_WND                 4096
 
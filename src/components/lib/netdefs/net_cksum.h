@@ -0,0 +1,108 @@
+#ifndef NET_CKSUM_H
+#define NET_CKSUM_H
+
+#include <cos_types.h>
+
+/***
+ * The Internet checksum (RFC 1071): the ones' complement sum of the
+ * 16-bit words of the data. It depends neither on the byte order, nor
+ * on the width of the words summed, as long as their carries are
+ * folded back in: the bulk of the data is summed as 32-bit words, in
+ * the 64-bit lanes of vectors. These are AVX2 vectors in components
+ * compiled for it (-mavx2, with a kernel that saves the AVX state),
+ * SSE2 ones otherwise on x86_64, and scalars on the other platforms.
+ * They are GCC's generic vectors, as the intrinsics headers are not in
+ * the components' include path.
+ *
+ * A header rewritten a field at a time has its checksum updated
+ * (RFC 1624), rather than computed again.
+ */
+
+#if defined(__AVX2__)
+#define NET_CKSUM_VEC_SZ 32
+#elif defined(__SSE2__)
+#define NET_CKSUM_VEC_SZ 16
+#else
+#define NET_CKSUM_VEC_SZ 0
+#endif
+
+#if NET_CKSUM_VEC_SZ
+typedef u64_t net_cksum_vec_t __attribute__((vector_size(NET_CKSUM_VEC_SZ), aligned(1), __may_alias__));
+#endif
+
+/* Fold the carries of `sum` back in, down to 16 bits */
+static inline u16_t
+net_cksum_fold(u64_t sum)
+{
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+
+	return (u16_t)sum;
+}
+
+/*
+ * Add the 16-bit words of the `len` bytes at `buf` to `sum`, without
+ * folding the carries in. An odd last byte is summed as if followed by
+ * a 0.
+ */
+static inline u64_t
+net_cksum_raw(const void *buf, size_t len, u64_t sum)
+{
+	/* extend strict-aliasing rules */
+	typedef u16_t __attribute__((__may_alias__)) u16_p;
+	const char  *p = buf;
+	const u16_p *u16_buf, *end;
+
+#if NET_CKSUM_VEC_SZ
+	if (len >= 2 * NET_CKSUM_VEC_SZ) {
+		/* Two accumulators, so that an addition does not wait for the previous one */
+		net_cksum_vec_t acc0 = { 0 }, acc1 = { 0 }, v;
+		size_t i;
+
+		for (; len >= 2 * NET_CKSUM_VEC_SZ; len -= 2 * NET_CKSUM_VEC_SZ, p += 2 * NET_CKSUM_VEC_SZ) {
+			v     = *(const net_cksum_vec_t *)p;
+			acc0 += (v & 0xffffffff) + (v >> 32);
+			v     = *(const net_cksum_vec_t *)(p + NET_CKSUM_VEC_SZ);
+			acc1 += (v & 0xffffffff) + (v >> 32);
+		}
+		acc0 += acc1;
+		for (i = 0; i < NET_CKSUM_VEC_SZ / sizeof(u64_t); i++) sum += acc0[i];
+	}
+#endif
+
+	u16_buf = (const u16_p *)p;
+	end     = u16_buf + len / sizeof(*u16_buf);
+	for (; u16_buf != end; ++u16_buf) sum += *u16_buf;
+
+	/* if length is odd, keeping it byte order independent */
+	if (len % 2) {
+		u16_t left = 0;
+		*(unsigned char *)&left = *(const unsigned char *)end;
+		sum += left;
+	}
+
+	return sum;
+}
+
+/* The checksum `cksum`, once a 16-bit word of the data is changed `from` one value `to` another: RFC 1624, eqn. 3 */
+static inline u16_t
+net_cksum_adjust16(u16_t cksum, u16_t from, u16_t to)
+{
+	return (u16_t)~net_cksum_fold((u64_t)(u16_t)~cksum + (u16_t)~from + to);
+}
+
+/* The same, for a 32-bit field (e.g. an IPv4 address) */
+static inline u16_t
+net_cksum_adjust32(u16_t cksum, u32_t from, u32_t to)
+{
+	u64_t sum = (u16_t)~cksum;
+
+	sum += (u16_t)~(from >> 16) + (u16_t)~(from & 0xffff);
+	sum += (to >> 16) + (to & 0xffff);
+
+	return (u16_t)~net_cksum_fold(sum);
+}
+
+#endif /* NET_CKSUM_H */
@@ -72,6 +72,24 @@ struct udp_hdr
 	u16_t checksum;
 } __attribute__((packed));
 
+struct tcp_hdr
+{
+	struct tcp_udp_port port;
+	u32_t seq;
+	u32_t ack;
+	u8_t  rsvd:4;
+	u8_t  doff:4;
+	u8_t  flags;
+	u16_t window;
+	u16_t checksum;
+	u16_t urg_ptr;
+} __attribute__((packed));
+
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_PSH 0x08
+#define TCP_FLAG_ACK 0x10
+
 #define ICMP_PROTO 1
 #define UDP_PROTO 17
 #define TCP_PROTO 6
@@ -79,6 +97,7 @@ struct udp_hdr
 #define ETH_STD_LEN sizeof(struct eth_hdr)
 #define IP_STD_LEN sizeof(struct ip_hdr)
 #define UDP_STD_LEN sizeof(struct udp_hdr)
+#define TCP_STD_LEN sizeof(struct tcp_hdr)
 
 #define IPv4 4
 
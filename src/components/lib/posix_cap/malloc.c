@@ -0,0 +1,471 @@
+/*
+ * The malloc of components linked with posix_cap, replacing musl's
+ * (which has a single global lock, and grows its heap through mmap).
+ * Defining the whole malloc family here keeps musl's from being
+ * linked at all.
+ *
+ * Small allocations are from slab spans of objects of a size class.
+ * Spans are `MALLOC_SPAN_SZ` aligned, so the span of an object is
+ * found by masking its address. Each span is owned by the core that
+ * allocated it, and its free objects are only manipulated by that
+ * core, under the core's lock. Above that, each thread caches free
+ * objects of each class, so most allocations and frees don't
+ * synchronize at all. Threads refill their caches, and flush them, a
+ * batch at a time: objects of spans of this core are returned to the
+ * spans, and those of other cores are pushed on their (lock-free)
+ * remote free queue, which those cores' threads take objects from
+ * before allocating from spans.
+ *
+ * Large allocations are a span of their own, directly from the
+ * memmgr, that is returned to it when freed.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <cos_component.h>
+#include <ps.h>
+#include <memmgr.h>
+
+#define MALLOC_ALIGN       16
+#define MALLOC_SPAN_ORDER  16
+#define MALLOC_SPAN_SZ     (1UL << MALLOC_SPAN_ORDER)
+#define MALLOC_SPAN_PAGES  (MALLOC_SPAN_SZ / PAGE_SIZE)
+#define MALLOC_HDR_SZ      round_up_to_pow2(sizeof(struct malloc_span), CACHE_LINE)
+/*
+ * Size classes: multiples of 16 up to 128, then four classes per
+ * power of two, up to `MALLOC_SMALL_MAX`.
+ */
+#define MALLOC_SMALL_MAX   4096
+#define MALLOC_NCLASSES    28
+/* Bytes of objects moved between a thread's cache and the spans at once */
+#define MALLOC_BATCH_SZ    8192
+#define MALLOC_BATCH_MAX   32
+
+#define MALLOC_SPAN(p)     ((struct malloc_span *)((word_t)(p) & ~(MALLOC_SPAN_SZ - 1)))
+#define MALLOC_NEXT(o)     (*(void **)(o))
+
+struct malloc_span {
+	struct malloc_span *next, *prev; /* in the core's list of spans with free objects */
+	void               *free;        /* freed objects */
+	char               *bump;        /* the objects that were never allocated start here */
+	unsigned long       npages;      /* of a large allocation, 0 for slab spans */
+	unsigned int        cls, nobj, nfree;
+	coreid_t            core;
+};
+
+struct malloc_core {
+	struct ps_lock      lock;
+	struct malloc_span *partial[MALLOC_NCLASSES];
+	/* Objects of this core's spans freed on other cores */
+	void               *remote[MALLOC_NCLASSES];
+} CACHE_ALIGNED;
+
+struct malloc_tcache {
+	void         *free[MALLOC_NCLASSES];
+	unsigned int  nfree[MALLOC_NCLASSES];
+};
+
+static struct malloc_core   malloc_cores[NUM_CPU];
+static struct malloc_tcache malloc_tcaches[MAX_NUM_THREADS];
+
+static inline unsigned int
+malloc_class(size_t sz)
+{
+	unsigned int o;
+
+	if (sz <= 128) return sz == 0 ? 0 : (sz - 1) / 16;
+	o = (sizeof(long) * 8 - 1) - __builtin_clzl(sz - 1);
+
+	return 8 + (o - 7) * 4 + ((sz - 1) >> (o - 2)) - 4;
+}
+
+static inline size_t
+malloc_class_sz(unsigned int cls)
+{
+	if (cls < 8) return (cls + 1) * 16;
+
+	return (size_t)(5 + (cls - 8) % 4) << (5 + (cls - 8) / 4);
+}
+
+static inline unsigned int
+malloc_batch(unsigned int cls)
+{
+	unsigned int n = MALLOC_BATCH_SZ / malloc_class_sz(cls);
+
+	return n > MALLOC_BATCH_MAX ? MALLOC_BATCH_MAX : n;
+}
+
+/* The thread's cache, or NULL if its id is out of the range of the caches */
+static inline struct malloc_tcache *
+malloc_tcache(void)
+{
+	thdid_t t = cos_thdid();
+
+	if (unlikely(t >= MAX_NUM_THREADS)) return NULL;
+
+	return &malloc_tcaches[t];
+}
+
+static void
+malloc_partial_add(struct malloc_core *c, struct malloc_span *s)
+{
+	s->prev = NULL;
+	s->next = c->partial[s->cls];
+	if (s->next) s->next->prev = s;
+	c->partial[s->cls] = s;
+}
+
+static void
+malloc_partial_rem(struct malloc_core *c, struct malloc_span *s)
+{
+	if (s->prev) s->prev->next = s->next;
+	else         c->partial[s->cls] = s->next;
+	if (s->next) s->next->prev = s->prev;
+	s->next = s->prev = NULL;
+}
+
+static struct malloc_span *
+malloc_span_alloc(unsigned int cls)
+{
+	struct malloc_span *s;
+
+	s = (struct malloc_span *)memmgr_heap_page_allocn_aligned(MALLOC_SPAN_PAGES, MALLOC_SPAN_SZ);
+	if (!s) return NULL;
+
+	*s = (struct malloc_span) {
+		.bump  = (char *)s + MALLOC_HDR_SZ,
+		.cls   = cls,
+		.nobj  = (MALLOC_SPAN_SZ - MALLOC_HDR_SZ) / malloc_class_sz(cls),
+		.core  = cos_cpuid(),
+	};
+	s->nfree = s->nobj;
+
+	return s;
+}
+
+/*
+ * Take up to `n` objects from the core's spans, chained from
+ * `*chain`, allocating a span if none have free objects. Returns the
+ * number of objects taken.
+ */
+static unsigned int
+malloc_spans_get(struct malloc_core *c, unsigned int cls, void **chain, unsigned int n)
+{
+	struct malloc_span *s;
+	unsigned int got = 0;
+	void *o;
+
+	ps_lock_take(&c->lock);
+	while (got < n) {
+		s = c->partial[cls];
+		if (!s) {
+			/* Don't hold the lock across the invocation */
+			ps_lock_release(&c->lock);
+			s = malloc_span_alloc(cls);
+			ps_lock_take(&c->lock);
+			if (!s) break;
+			malloc_partial_add(c, s);
+		}
+		while (got < n && s->nfree > 0) {
+			if (s->free) {
+				o       = s->free;
+				s->free = MALLOC_NEXT(o);
+			} else {
+				o        = s->bump;
+				s->bump += malloc_class_sz(cls);
+			}
+			s->nfree--;
+			MALLOC_NEXT(o) = *chain;
+			*chain         = o;
+			got++;
+		}
+		if (s->nfree == 0) malloc_partial_rem(c, s);
+	}
+	ps_lock_release(&c->lock);
+
+	return got;
+}
+
+/*
+ * Return the `chain` of objects, all of the core's spans, to them.
+ * Spans whose objects are all free are returned to the memmgr, unless
+ * they are the only ones of their class with free objects.
+ */
+static void
+malloc_spans_put(struct malloc_core *c, unsigned int cls, void *chain)
+{
+	struct malloc_span *s, *empty = NULL;
+	void *o;
+
+	ps_lock_take(&c->lock);
+	while (chain) {
+		o     = chain;
+		chain = MALLOC_NEXT(o);
+		s     = MALLOC_SPAN(o);
+
+		MALLOC_NEXT(o) = s->free;
+		s->free        = o;
+		if (s->nfree++ == 0) malloc_partial_add(c, s);
+		if (s->nfree == s->nobj && (s->next || s->prev)) {
+			malloc_partial_rem(c, s);
+			s->next = empty;
+			empty   = s;
+		}
+	}
+	ps_lock_release(&c->lock);
+
+	while (empty) {
+		s     = empty;
+		empty = s->next;
+		memmgr_heap_page_freen((vaddr_t)s, MALLOC_SPAN_PAGES);
+	}
+}
+
+/* Push the chain of objects from `head` to `tail` on core `core`'s remote free queue */
+static void
+malloc_remote_push(coreid_t core, unsigned int cls, void *head, void *tail)
+{
+	void **q = &malloc_cores[core].remote[cls];
+	void  *h;
+
+	do {
+		h = *q;
+		MALLOC_NEXT(tail) = h;
+	} while (!ps_cas((unsigned long *)q, (unsigned long)h, (unsigned long)head));
+}
+
+/* Take all of the objects on this core's remote free queue */
+static void *
+malloc_remote_take(struct malloc_core *c, unsigned int cls)
+{
+	void *h;
+
+	do {
+		h = c->remote[cls];
+	} while (h && !ps_cas((unsigned long *)&c->remote[cls], (unsigned long)h, 0));
+
+	return h;
+}
+
+/* Return the `chain` of objects to their spans, or their cores */
+static void
+malloc_release(unsigned int cls, void *chain)
+{
+	coreid_t core = cos_cpuid();
+	void    *local = NULL, *o;
+	void    *head[NUM_CPU] = { NULL }, *tail[NUM_CPU];
+	int      i;
+
+	while (chain) {
+		o     = chain;
+		chain = MALLOC_NEXT(o);
+		i     = MALLOC_SPAN(o)->core;
+		if (i == core) {
+			MALLOC_NEXT(o) = local;
+			local          = o;
+			continue;
+		}
+		if (!head[i]) tail[i] = o;
+		MALLOC_NEXT(o) = head[i];
+		head[i]        = o;
+	}
+	if (local) malloc_spans_put(&malloc_cores[core], cls, local);
+	for (i = 0; i < NUM_CPU; i++) {
+		if (head[i]) malloc_remote_push(i, cls, head[i], tail[i]);
+	}
+}
+
+/* Refill the thread's cache for `cls`, returns the number of objects added */
+static unsigned int
+malloc_refill(struct malloc_tcache *t, unsigned int cls)
+{
+	struct malloc_core *c = &malloc_cores[cos_cpuid()];
+	unsigned int n = 0;
+	void *o;
+
+	/* Objects freed on other cores first, they are already free of any span */
+	t->free[cls] = malloc_remote_take(c, cls);
+	for (o = t->free[cls]; o; o = MALLOC_NEXT(o)) n++;
+	if (n == 0) n = malloc_spans_get(c, cls, &t->free[cls], malloc_batch(cls));
+	t->nfree[cls] = n;
+
+	return n;
+}
+
+/* Flush a batch of the thread's cache for `cls` */
+static void
+malloc_flush(struct malloc_tcache *t, unsigned int cls)
+{
+	unsigned int i, n = malloc_batch(cls);
+	void *chain = t->free[cls], *o = chain;
+
+	for (i = 1; i < n; i++) o = MALLOC_NEXT(o);
+	t->free[cls]   = MALLOC_NEXT(o);
+	t->nfree[cls] -= n;
+	MALLOC_NEXT(o) = NULL;
+
+	malloc_release(cls, chain);
+}
+
+/*
+ * A large allocation of `sz` bytes aligned on `align`: the pages are
+ * directly from the memmgr, with the span header at their start.
+ */
+static void *
+malloc_large(size_t sz, size_t align)
+{
+	struct malloc_span *s;
+	size_t off = round_up_to_pow2(MALLOC_HDR_SZ, align);
+	unsigned long npages;
+
+	if (unlikely(sz > (~0UL >> 1) - off)) goto enomem;
+	npages = round_up_to_page(off + sz) / PAGE_SIZE;
+	s = (struct malloc_span *)memmgr_heap_page_allocn_aligned(npages, MALLOC_SPAN_SZ);
+	if (!s) goto enomem;
+	s->npages = npages;
+
+	return (char *)s + off;
+enomem:
+	errno = ENOMEM;
+	return NULL;
+}
+
+void *
+malloc(size_t sz)
+{
+	struct malloc_tcache *t;
+	unsigned int cls;
+	void *o = NULL;
+
+	if (sz > MALLOC_SMALL_MAX) return malloc_large(sz, MALLOC_ALIGN);
+
+	cls = malloc_class(sz);
+	t   = malloc_tcache();
+	if (unlikely(!t)) {
+		if (!malloc_spans_get(&malloc_cores[cos_cpuid()], cls, &o, 1)) goto enomem;
+		return o;
+	}
+	if (unlikely(t->nfree[cls] == 0) && !malloc_refill(t, cls)) goto enomem;
+
+	o            = t->free[cls];
+	t->free[cls] = MALLOC_NEXT(o);
+	t->nfree[cls]--;
+
+	return o;
+enomem:
+	errno = ENOMEM;
+	return NULL;
+}
+
+void
+free(void *p)
+{
+	struct malloc_span   *s;
+	struct malloc_tcache *t;
+	unsigned int cls;
+
+	if (!p) return;
+
+	s = MALLOC_SPAN(p);
+	if (s->npages) {
+		memmgr_heap_page_freen((vaddr_t)s, s->npages);
+		return;
+	}
+
+	cls = s->cls;
+	t   = malloc_tcache();
+	if (unlikely(!t)) {
+		MALLOC_NEXT(p) = NULL;
+		malloc_release(cls, p);
+		return;
+	}
+	MALLOC_NEXT(p) = t->free[cls];
+	t->free[cls]   = p;
+	if (++t->nfree[cls] > 2 * malloc_batch(cls)) malloc_flush(t, cls);
+}
+
+size_t
+malloc_usable_size(void *p)
+{
+	struct malloc_span *s;
+
+	if (!p) return 0;
+	s = MALLOC_SPAN(p);
+	if (s->npages) return (char *)s + s->npages * PAGE_SIZE - (char *)p;
+
+	return malloc_class_sz(s->cls);
+}
+
+void *
+calloc(size_t m, size_t n)
+{
+	void *p;
+
+	if (n && m > (size_t)-1 / n) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	n *= m;
+	p = malloc(n);
+	/* Large allocations are fresh pages from the memmgr, that zeroes them */
+	if (p && n <= MALLOC_SMALL_MAX) memset(p, 0, n);
+
+	return p;
+}
+
+void *
+realloc(void *p, size_t sz)
+{
+	size_t usable;
+	void  *n;
+
+	if (!p) return malloc(sz);
+
+	usable = malloc_usable_size(p);
+	if (sz <= usable) return p;
+	n = malloc(sz);
+	if (!n) return NULL;
+	memcpy(n, p, usable);
+	free(p);
+
+	return n;
+}
+
+void *
+memalign(size_t align, size_t sz)
+{
+	if (align & (align - 1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (align <= MALLOC_ALIGN) return malloc(sz);
+	/* The object must be in the first span-size of its pages to find their header */
+	if (align > MALLOC_SPAN_SZ / 2) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return malloc_large(sz, align);
+}
+
+void *
+aligned_alloc(size_t align, size_t sz)
+{
+	return memalign(align, sz);
+}
+
+int
+posix_memalign(void **res, size_t align, size_t sz)
+{
+	void *p;
+
+	if (align < sizeof(void *)) return EINVAL;
+	p = memalign(align, sz);
+	if (!p) return errno;
+	*res = p;
+
+	return 0;
+}
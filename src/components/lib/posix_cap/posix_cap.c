@@ -1,7 +1,10 @@
+/* For the mremap flags */
+#define _GNU_SOURCE
 #include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syscall.h>
 #include <time.h>
 
@@ -98,7 +101,7 @@ cos_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 		return MAP_FAILED;
 	}
 
-	addr = (void *)contigmem_alloc((length / PAGE_SIZE));
+	addr = (void *)contigmem_alloc(round_up_to_page(length) / PAGE_SIZE);
 	if (!addr){
 		ret = (void *) -1;
 	} else {
@@ -116,9 +119,14 @@ cos_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 int
 cos_munmap(void *start, size_t length)
 {
-	printc("munmap not implemented\n");
-	errno = ENOSYS;
-	return -1;
+	if ((vaddr_t)start % PAGE_SIZE || length == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* Unmapping pages that aren't mapped isn't an error */
+	contigmem_free((vaddr_t)start, round_up_to_page(length) / PAGE_SIZE);
+
+	return 0;
 }
 
 int
@@ -131,9 +139,37 @@ cos_madvise(void *start, size_t length, int advice)
 void *
 cos_mremap(void *old_address, size_t old_size, size_t new_size, int flags)
 {
-	printc("mremap not implemented\n");
-	errno = ENOSYS;
-	return (void*) -1;
+	unsigned long old_pages = round_up_to_page(old_size) / PAGE_SIZE;
+	unsigned long new_pages = round_up_to_page(new_size) / PAGE_SIZE;
+	void *new_address;
+
+	if ((vaddr_t)old_address % PAGE_SIZE || new_pages == 0 || (flags & MREMAP_FIXED)) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+	/* Shrink in place */
+	if (new_pages <= old_pages) {
+		if (new_pages < old_pages) {
+			contigmem_free((vaddr_t)old_address + new_pages * PAGE_SIZE, old_pages - new_pages);
+		}
+
+		return old_address;
+	}
+
+	/* The pages following the mapping might be in use, so only grow by moving */
+	if (!(flags & MREMAP_MAYMOVE)) {
+		errno = ENOMEM;
+		return MAP_FAILED;
+	}
+	new_address = (void *)contigmem_alloc(new_pages);
+	if (!new_address) {
+		errno = ENOMEM;
+		return MAP_FAILED;
+	}
+	memcpy(new_address, old_address, old_pages * PAGE_SIZE);
+	contigmem_free((vaddr_t)old_address, old_pages);
+
+	return new_address;
 }
 
 int
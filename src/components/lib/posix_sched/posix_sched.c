@@ -15,6 +15,7 @@
 #include <posix.h>
 #include <ps_list.h>
 #include <sched.h>
+#include <cos_time.h>
 
 static volatile int* null_ptr = NULL;
 #define ABORT() do {int i = *null_ptr;} while(0)
@@ -148,73 +149,354 @@ cos_clone(int (*func)(void *), void *stack, int flags, void *arg, pid_t *ptid, v
 #define FUTEX_UNLOCK_PI		7
 #define FUTEX_TRYLOCK_PI	8
 #define FUTEX_WAIT_BITSET	9
+#define FUTEX_WAKE_BITSET	10
 
 #define FUTEX_PRIVATE 128
 
 #define FUTEX_CLOCK_REALTIME 256
 
-struct futex_data
-{
-	int *uaddr;
-	struct ps_list_head waiters;
-};
+int cos_clock_gettime(clockid_t clock_id, struct timespec *ts);
 
-struct futex_waiter
-{
+#define FUTEX_CMD_MASK (~(FUTEX_PRIVATE | FUTEX_CLOCK_REALTIME))
+
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+/*
+ * Futex waiters are kept in a hashed table of wait-queues keyed by
+ * the futex address. Each waiter lives on the stack of the blocked
+ * thread, so no allocation is needed to wait, and empty queues cost
+ * nothing. A bucket's lock protects the queue, and the `woken` state
+ * of each waiter in it; blocking and waking is done through the
+ * scheduler *outside* of the lock, which relies on the scheduler
+ * tolerating wakeups that race ahead of the corresponding block.
+ */
+struct futex_waiter {
+	int *uaddr;
+	u32_t bitset;
 	thdid_t thdid;
+	int woken;
 	struct ps_list list;
 };
 
-#define FUTEX_COUNT 20
-struct futex_data futexes[FUTEX_COUNT];
+/*
+ * Values of `woken`. A waker moves the waiters it dequeues onto a
+ * private list, and marks them as WAKING while it holds the lock;
+ * they then wait for it to mark them as WOKEN, and to wake them,
+ * after it releases the lock. Until then, the waiter's memory is
+ * still on the waker's list, so it can't return or time out.
+ */
+enum {
+	FUTEX_WAITING = 0,
+	FUTEX_WAKING,
+	FUTEX_WOKEN
+};
+
+struct futex_bucket {
+	struct ps_lock lock;
+	struct ps_list_head waiters;
+} CACHE_ALIGNED;
 
-struct futex_data *
-lookup_futex(int *uaddr)
+#define FUTEX_BUCKETS_ORDER 8
+#define FUTEX_BUCKETS       (1 << FUTEX_BUCKETS_ORDER)
+/* Threads woken per lock acquisition when waking many waiters */
+#define FUTEX_WAKE_BATCH    16
+
+static struct futex_bucket futex_buckets[FUTEX_BUCKETS];
+
+static inline struct futex_bucket *
+futex_bucket_lookup(int *uaddr)
 {
-	int last_free = -1;
-	int i;
+	/* futex words are 4-byte aligned, so ignore the low bits; then fold with a multiplicative hash */
+	u32_t h = (u32_t)(((word_t)uaddr >> 2) * 2654435761u);
+
+	return &futex_buckets[h >> (32 - FUTEX_BUCKETS_ORDER)];
+}
+
+/*
+ * Lock the bucket the waiter is currently queued on. A requeue can
+ * move the waiter to a different bucket up until we hold the lock,
+ * thus the retry.
+ */
+static struct futex_bucket *
+futex_waiter_lock(struct futex_waiter *w)
+{
+	struct futex_bucket *b;
+
+	while (1) {
+		b = futex_bucket_lookup(ps_load(&w->uaddr));
+		ps_lock_take(&b->lock);
+		if (futex_bucket_lookup(w->uaddr) == b) return b;
+		ps_lock_release(&b->lock);
+	}
+}
+
+/* Take two bucket locks in a globally consistent order to avoid deadlock */
+static void
+futex_bucket_lock2(struct futex_bucket *b1, struct futex_bucket *b2)
+{
+	if (b1 == b2) {
+		ps_lock_take(&b1->lock);
+	} else if (b1 < b2) {
+		ps_lock_take(&b1->lock);
+		ps_lock_take(&b2->lock);
+	} else {
+		ps_lock_take(&b2->lock);
+		ps_lock_take(&b1->lock);
+	}
+}
+
+static void
+futex_bucket_unlock2(struct futex_bucket *b1, struct futex_bucket *b2)
+{
+	ps_lock_release(&b1->lock);
+	if (b1 != b2) ps_lock_release(&b2->lock);
+}
+
+/*
+ * Convert a futex timeout into an absolute timeout in cycles. Plain
+ * FUTEX_WAIT uses relative timeouts, while FUTEX_WAIT_BITSET uses
+ * absolute timeouts against either the monotonic or realtime clock.
+ *
+ * Returns 0 if the timeout has already passed.
+ */
+static cycles_t
+futex_timeout_cycles(const struct timespec *timeout, int cmd, int clock_rt)
+{
+	microsec_t us = time_to_microsec(timeout);
+
+	if (cmd == FUTEX_WAIT_BITSET) {
+		struct timespec now;
+		microsec_t now_us;
 
-	for (i = 0; i < FUTEX_COUNT; i++) {
-		if (futexes[i].uaddr == uaddr) {
-			return &futexes[i];
-		} else if (futexes[i].uaddr == 0) {
-			last_free = i;
+		cos_clock_gettime(clock_rt ? CLOCK_REALTIME : CLOCK_MONOTONIC, &now);
+		now_us = time_to_microsec(&now);
+		if (us <= now_us) return 0;
+		us -= now_us;
+	}
+
+	return time_now() + time_usec2cyc(us);
+}
+
+static int
+futex_wait(int *uaddr, int val, const struct timespec *timeout, u32_t bitset, int cmd, int clock_rt)
+{
+	struct futex_bucket *b = futex_bucket_lookup(uaddr);
+	struct futex_waiter w;
+	cycles_t abs_timeout = 0;
+
+	if (bitset == 0) return -EINVAL;
+	if (timeout) {
+		if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 || timeout->tv_nsec >= 1000000000) return -EINVAL;
+		abs_timeout = futex_timeout_cycles(timeout, cmd, clock_rt);
+		if (abs_timeout == 0) return -ETIMEDOUT;
+	}
+
+	w = (struct futex_waiter) {
+		.uaddr  = uaddr,
+		.bitset = bitset,
+		.thdid  = cos_thdid(),
+		.woken  = FUTEX_WAITING
+	};
+	ps_list_init_d(&w);
+
+	ps_lock_take(&b->lock);
+	/* The value check must happen under the lock to serialize with wakers */
+	if (ps_load(uaddr) != val) {
+		ps_lock_release(&b->lock);
+		return -EAGAIN;
+	}
+	ps_list_head_append_d(&b->waiters, &w);
+	ps_lock_release(&b->lock);
+
+	while (1) {
+		if (timeout) sched_thd_block_timeout_wakeup(0, abs_timeout);
+		else         sched_thd_block(0);
+
+		b = futex_waiter_lock(&w);
+		if (ps_load(&w.woken) == FUTEX_WOKEN) {
+			ps_lock_release(&b->lock);
+			return 0;
+		}
+		/*
+		 * Spurious wakeup before the timeout, or a waker has
+		 * yet to wake us? Go back to sleep.
+		 */
+		if (!timeout || ps_load(&w.woken) == FUTEX_WAKING || cycles_greater_than(abs_timeout, time_now())) {
+			ps_lock_release(&b->lock);
+			continue;
 		}
+		ps_list_rem_d(&w);
+		ps_lock_release(&b->lock);
+
+		return -ETIMEDOUT;
 	}
-	if (last_free >= 0) {
-		futexes[last_free] = (struct futex_data) {
-			.uaddr = uaddr
-		};
-		ps_list_head_init(&futexes[last_free].waiters);
-		return &futexes[last_free];
+}
+
+/*
+ * Dequeue up to `nwake` waiters on `uaddr` that match `bitset` from
+ * the (locked) bucket onto the `woken` list. Returns the number of
+ * waiters dequeued.
+ */
+static int
+futex_dequeue(struct futex_bucket *b, int *uaddr, u32_t bitset, int nwake, struct ps_list_head *woken)
+{
+	struct futex_waiter *w, *tmp;
+	int n = 0;
+
+	ps_list_foreach_del_d(&b->waiters, w, tmp) {
+		if (n == nwake) break;
+		if (w->uaddr != uaddr || !(w->bitset & bitset)) continue;
+
+		ps_list_rem_d(w);
+		ps_store(&w->woken, FUTEX_WAKING);
+		ps_list_head_append_d(woken, w);
+		n++;
 	}
-	printc("Out of futex ids!");
-	assert(0);
+
+	return n;
 }
 
-/* TODO: Cleanup empty futexes */
-static struct ps_lock futex_lock;
+/* Wake the waiters futex_dequeue moved onto `woken`; called without the bucket locks */
+static void
+futex_wakeup_all(struct ps_list_head *woken)
+{
+	struct futex_waiter *w, *tmp;
+	thdid_t thdid;
+
+	ps_list_foreach_del_d(woken, w, tmp) {
+		thdid = w->thdid;
+		ps_list_rem_d(w);
+		/* once marked as woken, the waiter can return, and its memory is gone */
+		ps_store(&w->woken, FUTEX_WOKEN);
+		sched_thd_wakeup(thdid);
+	}
+}
+
+static int
+futex_wake(int *uaddr, int nwake, u32_t bitset)
+{
+	struct futex_bucket *b = futex_bucket_lookup(uaddr);
+	struct ps_list_head woken;
+	int nwoken = 0;
+
+	if (bitset == 0) return -EINVAL;
+
+	ps_list_head_init(&woken);
+	while (nwoken < nwake) {
+		int n, batch = nwake - nwoken;
+
+		if (batch > FUTEX_WAKE_BATCH) batch = FUTEX_WAKE_BATCH;
+
+		ps_lock_take(&b->lock);
+		n = futex_dequeue(b, uaddr, bitset, batch, &woken);
+		ps_lock_release(&b->lock);
+
+		futex_wakeup_all(&woken);
+		nwoken += n;
+		if (n < batch) break;
+	}
+
+	return nwoken;
+}
+
+/*
+ * Wake `nwake` waiters, and move `nrequeue` more to `uaddr2`, all
+ * under both bucket locks, so that FUTEX_CMP_REQUEUE's value check
+ * holds for the whole operation, however many waiters it wakes.
+ */
+static int
+futex_requeue(int *uaddr, int nwake, int nrequeue, int *uaddr2, int cmp, int val3)
+{
+	struct futex_bucket *b1 = futex_bucket_lookup(uaddr);
+	struct futex_bucket *b2 = futex_bucket_lookup(uaddr2);
+	struct futex_waiter *w, *tmp;
+	struct ps_list_head woken;
+	int nwoken, requeued = 0;
+
+	if (nwake < 0 || nrequeue < 0) return -EINVAL;
+
+	ps_list_head_init(&woken);
+	futex_bucket_lock2(b1, b2);
+	if (cmp && ps_load(uaddr) != val3) {
+		futex_bucket_unlock2(b1, b2);
+		return -EAGAIN;
+	}
+	nwoken = futex_dequeue(b1, uaddr, FUTEX_BITSET_MATCH_ANY, nwake, &woken);
+	ps_list_foreach_del_d(&b1->waiters, w, tmp) {
+		if (requeued == nrequeue) break;
+		if (w->uaddr != uaddr) continue;
+
+		ps_list_rem_d(w);
+		ps_store(&w->uaddr, uaddr2);
+		ps_list_head_append_d(&b2->waiters, w);
+		requeued++;
+	}
+	futex_bucket_unlock2(b1, b2);
+	futex_wakeup_all(&woken);
+
+	return nwoken + requeued;
+}
 
 int
 cos_futex(int *uaddr, int op, int val,
           const struct timespec *timeout, /* or: uint32_t val2 */
 		  int *uaddr2, int val3)
 {
-	printc("futex not implemented\n");
-	errno = ENOSYS;
-	return -1;
+	int cmd      = op & FUTEX_CMD_MASK;
+	int clock_rt = op & FUTEX_CLOCK_REALTIME;
+	/* requeue operations pass the requeue count in place of the timeout */
+	int val2     = (int)(word_t)timeout;
+	int ret;
+
+	switch (cmd) {
+	case FUTEX_WAIT:
+		ret = futex_wait(uaddr, val, timeout, FUTEX_BITSET_MATCH_ANY, cmd, clock_rt);
+		break;
+	case FUTEX_WAIT_BITSET:
+		ret = futex_wait(uaddr, val, timeout, (u32_t)val3, cmd, clock_rt);
+		break;
+	case FUTEX_WAKE:
+		ret = futex_wake(uaddr, val, FUTEX_BITSET_MATCH_ANY);
+		break;
+	case FUTEX_WAKE_BITSET:
+		ret = futex_wake(uaddr, val, (u32_t)val3);
+		break;
+	case FUTEX_REQUEUE:
+		ret = futex_requeue(uaddr, val, val2, uaddr2, 0, 0);
+		break;
+	case FUTEX_CMP_REQUEUE:
+		ret = futex_requeue(uaddr, val, val2, uaddr2, 1, val3);
+		break;
+	default:
+		printc("futex op %d not implemented\n", cmd);
+		ret = -ENOSYS;
+		break;
+	}
+
+	/*
+	 * musl issues futex calls with the raw syscall convention, and
+	 * looks for -ETIMEDOUT/-EAGAIN in the return value, not errno.
+	 */
+	return ret;
 }
 
+/* one hour after 1970-01-01, just a hack. */
+#define REALTIME_BASE_SEC 3600
+
 int
 cos_clock_gettime(clockid_t clock_id, struct timespec *ts)
 {
+	microsec_t now = time_now_usec();
+
+	ts->tv_sec  = now / 1000000;
+	ts->tv_nsec = (now % 1000000) * 1000;
+
 	switch (clock_id)
 	{
 	case CLOCK_REALTIME:
-		/* code */
-		ts->tv_sec = 3600; //one hour after 1970-01-01, just a hack.
+		ts->tv_sec += REALTIME_BASE_SEC;
 		break;
-	
+	case CLOCK_MONOTONIC:
 	default:
 		break;
 	}
@@ -239,7 +521,12 @@ libc_tls_init(unsigned int cpuid)
 void
 libc_posixsched_initialization_handler()
 {
-	ps_lock_init(&futex_lock);
+	int i;
+
+	for (i = 0; i < FUTEX_BUCKETS; i++) {
+		ps_lock_init(&futex_buckets[i].lock);
+		ps_list_head_init(&futex_buckets[i].waiters);
+	}
 	libc_syscall_override((cos_syscall_t)(void*)cos_nanosleep, __NR_nanosleep);
 	libc_syscall_override((cos_syscall_t)(void*)cos_rt_sigprocmask, __NR_rt_sigprocmask);
 	libc_syscall_override((cos_syscall_t)(void*)cos_gettid, __NR_gettid);
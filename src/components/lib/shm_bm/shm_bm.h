@@ -27,7 +27,28 @@
 typedef void *        shm_bm_t;
 typedef unsigned int  shm_bm_objid_t;
 
-#define SHM_BM_REFC(shm, nobj) ((unsigned char *)((unsigned char *)shm + SHM_BM_BITS_TO_WORDS(nobj) * sizeof (word_t)))
+/*
+ * Each core caches free objects in a magazine, that it takes from the
+ * bitmap a half-word at a time: the low half of the magazine holds
+ * the free objects (in bitmap order), and the high half the index of
+ * the half-word of the bitmap they are from, plus one (so that 0 is an
+ * empty magazine). The `hint` is the bitmap word at which the core
+ * resumes searching for free objects. The per-core state is at the
+ * head of the shared memory, as all of the components that share it
+ * allocate from it, and has a cache-line per core.
+ */
+struct shm_bm_core {
+	word_t        mag;
+	unsigned long hint;
+} CACHE_ALIGNED;
+
+#define SHM_BM_MAG_BITS (SHM_BM_BITMAP_BLOCK / 2)
+#define SHM_BM_MAG_MASK ((1ul << SHM_BM_MAG_BITS) - 1)
+#define SHM_BM_HDR_SZ   (sizeof (struct shm_bm_core) * NUM_CPU)
+
+#define SHM_BM_CORE(shm)       ((struct shm_bm_core *)(shm))
+#define SHM_BM_BM(shm)         ((word_t *)((unsigned char *)shm + SHM_BM_HDR_SZ))
+#define SHM_BM_REFC(shm, nobj) ((unsigned char *)((unsigned char *)SHM_BM_BM(shm) + SHM_BM_BITS_TO_WORDS(nobj) * sizeof (word_t)))
 #define SHM_BM_DATA(shm, nobj) ((unsigned char *)(SHM_BM_REFC(shm, nobj) + (unsigned int)nobj))
 
 static inline void
@@ -41,25 +62,81 @@ __shm_bm_set_contig(word_t *bm, int offset)
 	for (i = 0; i < ind; i++) {
 		bm[i] = ~0x0ul;
 	}
+	/* bm[ind] is past the end of the bitmap if it is full */
+	if (offset == 0) return;
 
 	n = SHM_BM_BITMAP_BLOCK - offset;
 	bm[ind] = ~((1ul << n) - 1); // set most sig n bits of bm[ind]
 }
 
-/* Find the first nonzero word in the inputted bitmap */
-static inline int
-__shm_bm_next_free_word(word_t *bm, unsigned long nwords)
+/* Atomically set the bits of `mask` in the bitmap word `w` */
+static inline void
+__shm_bm_word_set(word_t *w, word_t mask)
 {
-	/* the index of the word in the bitmap where the first set bit is found */
-	int idx;
+	word_t word;
+
+	do {
+		word = *w;
+	} while (!cos_cas(w, word, word | mask));
+}
 
-	for (idx = 0; idx < (int) nwords; idx++) {
-		if (*bm != 0) return idx;
-		bm++;
+/*
+ * Take the free objects of a half-word of the bitmap, searching from
+ * the word at `*hint`, which is updated to the word they are from.
+ * Returns the magazine of those objects, or 0 if none are free.
+ */
+static inline word_t
+__shm_bm_mag_fill(word_t *bm, unsigned long *hint, unsigned long nwords)
+{
+	unsigned long i, idx;
+	word_t        word, half;
+	int           lower;
+
+	for (i = 0; i < nwords; i++) {
+		idx = (*hint + i) % nwords;
+		do {
+			word = bm[idx];
+			if (word == 0) break;
+			/* Take the first half-word with free objects */
+			lower = (word >> SHM_BM_MAG_BITS) == 0;
+			half  = lower ? word & SHM_BM_MAG_MASK : word >> SHM_BM_MAG_BITS;
+		} while (!cos_cas(bm + idx, word, lower ? 0 : word & SHM_BM_MAG_MASK));
+		if (word == 0) continue;
+
+		*hint = idx;
+		return ((word_t)(idx * 2 + lower + 1) << SHM_BM_MAG_BITS) | half;
 	}
 
-	/* all bits set to zero */
-	return -1;
+	return 0;
+}
+
+/* Return the free objects of magazine `mag` to the bitmap */
+static inline void
+__shm_bm_mag_release(word_t *bm, word_t mag)
+{
+	word_t        bits = mag & SHM_BM_MAG_MASK;
+	unsigned long half;
+
+	if (bits == 0) return;
+	half = (mag >> SHM_BM_MAG_BITS) - 1;
+	__shm_bm_word_set(bm + half / 2, half % 2 ? bits : bits << SHM_BM_MAG_BITS);
+}
+
+/* Return the objects cached by all of the cores to the bitmap */
+static inline void
+__shm_bm_mags_drain(shm_bm_t shm)
+{
+	struct shm_bm_core *core;
+	word_t mag;
+	int    i;
+
+	for (i = 0; i < NUM_CPU; i++) {
+		core = SHM_BM_CORE(shm) + i;
+		do {
+			mag = core->mag;
+		} while (mag != 0 && !cos_cas(&core->mag, mag, 0));
+		__shm_bm_mag_release(SHM_BM_BM(shm), mag);
+	}
 }
 
 static inline size_t
@@ -71,7 +148,7 @@ __shm_bm_size(size_t objsz, unsigned int nobj)
 	refcnt_sz = nobj;
 	data_sz   = nobj * objsz;
 
-	return bitmap_sz + refcnt_sz + data_sz;
+	return SHM_BM_HDR_SZ + bitmap_sz + refcnt_sz + data_sz;
 }
 
 static inline shm_bm_t 
@@ -85,39 +162,85 @@ __shm_bm_create(void *mem, size_t memsz, size_t objsz, unsigned int nobj)
 static inline void
 __shm_bm_init(shm_bm_t shm, size_t objsz, unsigned int nobj)
 {
+	int i;
+
 	memset(shm, 0, __shm_bm_size(objsz, nobj));
 	/* set nobj bits to free in the bitmap */
-	__shm_bm_set_contig((word_t *)shm, nobj);
+	__shm_bm_set_contig(SHM_BM_BM(shm), nobj);
+	/* spread the cores' searches across the bitmap */
+	for (i = 0; i < NUM_CPU; i++) {
+		SHM_BM_CORE(shm)[i].hint = i * SHM_BM_BITS_TO_WORDS(nobj) / NUM_CPU;
+	}
+}
+
+/* The bit of object `idx` in the magazine format */
+#define SHM_BM_MAG_BIT(idx) (1ul << (SHM_BM_MAG_BITS - (idx) % SHM_BM_MAG_BITS - 1))
+
+/*
+ * Allocate up to `n` objects, returned in `ptrs` and `objids`. The
+ * objects are taken from this core's magazine; could be preempted by
+ * other threads on this core, thus the cas. If the magazine is empty,
+ * refill it from the bitmap, and only if the bitmap has no free
+ * objects, get back those cached by the other cores. Returns the
+ * number of objects allocated.
+ */
+static inline int
+__shm_bm_alloc_n(shm_bm_t shm, void **ptrs, shm_bm_objid_t *objids, int n, size_t objsz, unsigned int nobj)
+{
+	struct shm_bm_core *core = SHM_BM_CORE(shm) + cos_cpuid();
+	int     got = 0, i, bit, drained = 0;
+	word_t  mag, bits, take, fill;
+	unsigned int freebit, base;
+
+	while (got < n) {
+		mag  = core->mag;
+		bits = mag & SHM_BM_MAG_MASK;
+		if (likely(bits != 0)) {
+			/* Take the first n - got objects of the magazine at once */
+			for (take = 0, i = got; i < n && bits != 0; i++) {
+				word_t b = 1ul << (SHM_BM_BITMAP_BLOCK - __builtin_clzl(bits) - 1);
+
+				take |= b;
+				bits &= ~b;
+			}
+			if (!cos_cas(&core->mag, mag, mag & ~take)) continue;
+
+			base = ((mag >> SHM_BM_MAG_BITS) - 1) * SHM_BM_MAG_BITS;
+			while (take != 0) {
+				bit      = __builtin_clzl(take) - SHM_BM_MAG_BITS;
+				take    &= ~SHM_BM_MAG_BIT(bit);
+				freebit  = base + bit;
+
+				cos_faab(SHM_BM_REFC(shm, nobj) + freebit, 1);
+				objids[got] = (shm_bm_objid_t)freebit;
+				ptrs[got]   = SHM_BM_DATA(shm, nobj) + (freebit * objsz);
+				got++;
+			}
+			continue;
+		}
+
+		fill = __shm_bm_mag_fill(SHM_BM_BM(shm), &core->hint, SHM_BM_BITS_TO_WORDS(nobj));
+		if (unlikely(fill == 0)) {
+			if (drained) break;
+			__shm_bm_mags_drain(shm);
+			drained = 1;
+			continue;
+		}
+		/* Another thread on this core refilled the magazine first */
+		if (!cos_cas(&core->mag, mag, fill)) __shm_bm_mag_release(SHM_BM_BM(shm), fill);
+	}
+
+	return got;
 }
 
 static inline void * 
 __shm_bm_alloc(shm_bm_t shm, shm_bm_objid_t *objid, size_t objsz, unsigned int nobj)
 {
-	int     freebit, idx , offset, lz;
-	word_t  word; 
-	word_t *bm;
-
-	/* 
-	 * Find a free space; could be preempted. Find the next word in
-	 * the bitmap with a free bit and get its index in the bitmap, and 
-	 * the offset of the free bit in that word. Then try to atomically 
-	 * xchg the bitmap with the freebit set to 0
-	 */
-	bm = (word_t *)shm;
-	do {
-		idx = __shm_bm_next_free_word(bm, SHM_BM_BITS_TO_WORDS(nobj));
-		if (unlikely(idx == -1)) return NULL;
-		word   = bm[idx];
-		lz     = __builtin_clzl(word); 
-		offset = SHM_BM_BITMAP_BLOCK - lz - 1;
-	} while (!cos_cas(bm + idx, word, word & ~(1ul << offset)));
+	void *ptr;
 
-	freebit = lz + (idx * SHM_BM_BITMAP_BLOCK);
+	if (unlikely(__shm_bm_alloc_n(shm, &ptr, objid, 1, objsz, nobj) == 0)) return NULL;
 
-	cos_faab(SHM_BM_REFC(shm, nobj) + freebit, 1);
-
-	*objid = (shm_bm_objid_t)freebit;
-	return SHM_BM_DATA(shm, nobj) + (freebit * objsz);
+	return ptr;
 }
 
 static inline void *   
@@ -144,34 +267,92 @@ __shm_bm_take_norefcnt(shm_bm_t shm, shm_bm_objid_t objid, size_t objsz, unsigne
 	return SHM_BM_DATA(shm, nobj) + (objid * objsz);
 }
 
+/*
+ * Set the objects `bits` (in the magazine format) of the half-word
+ * `half` of the bitmap to free: in this core's magazine if it caches
+ * that half-word, otherwise in the bitmap.
+ */
+static inline void
+__shm_bm_bits_free(shm_bm_t shm, unsigned int half, word_t bits)
+{
+	struct shm_bm_core *core = SHM_BM_CORE(shm) + cos_cpuid();
+	word_t mag;
+
+	do {
+		mag = core->mag;
+		if ((mag >> SHM_BM_MAG_BITS) != half + 1) {
+			__shm_bm_mag_release(SHM_BM_BM(shm), ((word_t)(half + 1) << SHM_BM_MAG_BITS) | bits);
+
+			return;
+		}
+	} while (!cos_cas(&core->mag, mag, mag | bits));
+}
+
+/* Drop a reference to object `obj_idx`, returning `1` if it was the last */
+static inline int
+__shm_bm_obj_put(shm_bm_t shm, unsigned int obj_idx, unsigned int nobj)
+{
+	return cos_faab(SHM_BM_REFC(shm, nobj) + obj_idx, -1) <= 1;
+}
+
+static inline void
+__shm_bm_obj_free(shm_bm_t shm, unsigned int obj_idx, unsigned int nobj)
+{
+	if (!__shm_bm_obj_put(shm, obj_idx, nobj)) return;
+	/* droping the last reference, must set obj to free */
+	__shm_bm_bits_free(shm, obj_idx / SHM_BM_MAG_BITS, SHM_BM_MAG_BIT(obj_idx));
+}
+
 static void
 __shm_bm_ptr_free(void *ptr, size_t objsz, unsigned int nobj)
 {
 	void        *shm;
-	unsigned int obj_idx, bm_idx, bm_offset;
-	word_t      *bm;
+	unsigned int obj_idx;
 
 	/* Mask out bits less significant than the alignment to get pointer to head of shm */
 	shm = (void *)((word_t)ptr & ~(SHM_BM_ALIGN - 1));
 	obj_idx = ((unsigned char *)ptr - SHM_BM_DATA(shm, nobj)) / objsz;
 	if (obj_idx >= nobj) return;
-	
-	if (cos_faab(SHM_BM_REFC(shm, nobj) + obj_idx, -1) > 1) { 
-		return;
+
+	__shm_bm_obj_free(shm, obj_idx, nobj);
+}
+
+/*
+ * Free `n` objects. The objects whose last reference is dropped are
+ * set free together with those in the same half-word of the bitmap
+ * that precede them in `ptrs`, thus bursts of objects allocated
+ * together are freed with few atomic operations.
+ */
+static void
+__shm_bm_ptr_free_n(void **ptrs, int n, size_t objsz, unsigned int nobj)
+{
+	void        *shm, *prev_shm = NULL;
+	unsigned int obj_idx, half, prev_half = 0;
+	word_t       bits = 0;
+	int          i;
+
+	for (i = 0; i < n; i++) {
+		shm     = (void *)((word_t)ptrs[i] & ~(SHM_BM_ALIGN - 1));
+		obj_idx = ((unsigned char *)ptrs[i] - SHM_BM_DATA(shm, nobj)) / objsz;
+		if (obj_idx >= nobj || !__shm_bm_obj_put(shm, obj_idx, nobj)) continue;
+
+		half = obj_idx / SHM_BM_MAG_BITS;
+		if (bits != 0 && (shm != prev_shm || half != prev_half)) {
+			__shm_bm_bits_free(prev_shm, prev_half, bits);
+			bits = 0;
+		}
+		bits     |= SHM_BM_MAG_BIT(obj_idx);
+		prev_shm  = shm;
+		prev_half = half;
 	}
-	/* droping the last reference, must set obj to free in bitmap */
-	bm         = (word_t *)shm;
-	bm_idx     = obj_idx / SHM_BM_BITMAP_BLOCK;
-	bm_offset  = SHM_BM_BITMAP_BLOCK - obj_idx % SHM_BM_BITMAP_BLOCK - 1;
-	bm[bm_idx] = bm[bm_idx] | (1ul << bm_offset);
+	if (bits != 0) __shm_bm_bits_free(prev_shm, prev_half, bits);
 }
 
 static shm_bm_objid_t
 __shm_bm_get_objid(void *ptr, size_t objsz, unsigned int nobj)
 {
 	void        *shm;
-	unsigned int obj_idx, bm_idx, bm_offset;
-	word_t      *bm;
+	unsigned int obj_idx;
 
 	/* Mask out bits less significant than the alignment to get pointer to head of shm */
 	shm = (void *)((word_t)ptr & ~(SHM_BM_ALIGN - 1));
@@ -187,10 +368,12 @@ __shm_bm_get_objid(void *ptr, size_t objsz, unsigned int nobj)
     static inline shm_bm_t shm_bm_create_##name(void *mem, size_t memsz);                   \
     static inline void     shm_bm_init_##name(shm_bm_t shm);                                \
     static inline void *   shm_bm_alloc_##name(shm_bm_t shm, shm_bm_objid_t *objid);        \
+    static inline int      shm_bm_alloc_n_##name(shm_bm_t shm, void **ptrs, shm_bm_objid_t *objids, int n); \
     static inline void *   shm_bm_take_##name(shm_bm_t shm, shm_bm_objid_t objid);          \
     static inline void *   shm_bm_borrow_##name(shm_bm_t shm, shm_bm_objid_t objid);        \
     static inline void *   shm_bm_transfer_##name(shm_bm_t shm, shm_bm_objid_t objid);      \
-    static inline void     shm_bm_free_##name(void *ptr);                                                                                         
+    static inline void     shm_bm_free_##name(void *ptr);                                   \
+    static inline void     shm_bm_free_n_##name(void **ptrs, int n);
 
 #define __SHM_BM_CREATE_FCNS(name, objsz, nobjs)                                            \
     static inline size_t                                                                    \
@@ -213,6 +396,11 @@ __shm_bm_get_objid(void *ptr, size_t objsz, unsigned int nobj)
     {                                                                                       \
         return __shm_bm_alloc(shm, objid, objsz, nobjs);                                    \
     }                                                                                       \
+    static inline int                                                                       \
+    shm_bm_alloc_n_##name(shm_bm_t shm, void **ptrs, shm_bm_objid_t *objids, int n)         \
+    {                                                                                       \
+        return __shm_bm_alloc_n(shm, ptrs, objids, n, objsz, nobjs);                        \
+    }                                                                                       \
     static inline void *                                                                    \
     shm_bm_take_##name(shm_bm_t shm, shm_bm_objid_t objid)                                  \
     {                                                                                       \
@@ -233,14 +421,19 @@ __shm_bm_get_objid(void *ptr, size_t objsz, unsigned int nobj)
     {                                                                                       \
         __shm_bm_ptr_free(ptr, objsz, nobjs);                                               \
     }                                                                                       \
+    static inline void                                                                      \
+    shm_bm_free_n_##name(void **ptrs, int n)                                                \
+    {                                                                                       \
+        __shm_bm_ptr_free_n(ptrs, n, objsz, nobjs);                                         \
+    }                                                                                       \
     static inline shm_bm_objid_t                                                            \
     shm_bm_get_objid_##name(void *ptr)                                                      \
     {                                                                                       \
-        return __shm_bm_get_objid(ptr, objsz, nobjs);                                              \
+        return __shm_bm_get_objid(ptr, objsz, nobjs);                                       \
     }
 
 #define SHM_BM_INTERFACE_CREATE(name, objsz, nobjs)                                         \
     __SHM_BM_DEFINE_FCNS(name)                                                              \
     __SHM_BM_CREATE_FCNS(name, objsz, nobjs) 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,348 @@
+#include <slm.h>
+#include <edf.h>
+#include <slm_api.h>
+#include <cos_types.h>
+#include <cos_component.h>
+#include <heap.h>
+
+/***
+ * Earliest deadline first scheduling, with optional sporadic server
+ * budget enforcement.
+ *
+ * Threads given a deadline (`SCHEDP_DEADLINE`) or a period
+ * (`SCHEDP_WINDOW`, with an implicit deadline equal to the period)
+ * are scheduled by EDF within a single fixed-priority band,
+ * `SLM_EDF_PRIO`. All other threads (including the system threads)
+ * are scheduled with fixed priorities, round-robin, as in `fprr`, thus
+ * threads with priorities numerically lower than `SLM_EDF_PRIO`
+ * preempt all deadline threads.
+ *
+ * Each wakeup of a deadline thread after its previous deadline starts
+ * a new job with the deadline `now + relative deadline`, and a thread
+ * that is still executing at its deadline has it postponed by a
+ * period.
+ *
+ * A deadline thread given a budget (`SCHEDP_BUDGET`) and a period is
+ * a sporadic server: its execution is charged against the budget, and
+ * once it is exhausted, the thread is throttled until its budget is
+ * replenished, a period after the budget started being consumed. slm
+ * executes all threads on the scheduler's single tcap, thus the
+ * budget is enforced here at scheduling decisions: execution is
+ * charged to a thread from its dispatch to the next decision, and
+ * the enforcement granularity is the timer's quantum.
+ */
+
+#define SLM_EDF_NPRIOS         32
+#define SLM_EDF_PRIO_HIGHEST   TCAP_PRIO_MAX
+#define SLM_EDF_PRIO_LOWEST    (SLM_EDF_NPRIOS - 1)
+
+/* The fixed-priority band within which deadline threads execute */
+#ifndef SLM_EDF_PRIO
+#define SLM_EDF_PRIO           1
+#endif
+
+static int
+__slm_deadline_compare_min(void *a, void *b)
+{
+	return slm_thd_sched_policy((struct slm_thd *)a)->deadline <= slm_thd_sched_policy((struct slm_thd *)b)->deadline;
+}
+
+static void
+__slm_deadline_update_idx(void *e, int pos)
+{ slm_thd_sched_policy((struct slm_thd *)e)->heap_idx = pos; }
+
+DECLARE_HEAP(deadline, __slm_deadline_compare_min, __slm_deadline_update_idx);
+
+struct runqueue {
+	struct heap          deadlines;
+	void                *data[MAX_NUM_THREADS + 1];
+	struct ps_list_head  prio[SLM_EDF_NPRIOS];
+	struct ps_list_head  throttled;
+	/* The last thread selected, and when, to charge its execution */
+	struct slm_thd      *curr;
+	cycles_t             dispatched;
+} CACHE_ALIGNED;
+static struct runqueue threads[NUM_CPU];
+
+static inline int
+edf_thd(struct slm_sched_thd *p)
+{
+	return p->rel_deadline != 0;
+}
+
+static inline int
+edf_sporadic(struct slm_sched_thd *p)
+{
+	return edf_thd(p) && p->budget != 0 && p->period != 0;
+}
+
+static void
+edf_enqueue(struct slm_thd *t)
+{
+	struct slm_sched_thd *p  = slm_thd_sched_policy(t);
+	struct runqueue      *rq = &threads[cos_cpuid()];
+
+	if (!p->runnable || p->throttled) return;
+
+	if (edf_thd(p)) {
+		assert(p->heap_idx == -1);
+		deadline_heap_add(&rq->deadlines, t);
+	} else {
+		assert(ps_list_singleton_d(p));
+		ps_list_head_append_d(&rq->prio[t->priority], p);
+	}
+}
+
+/* Remove the thread from the runqueue, if it is on it */
+static void
+edf_dequeue(struct slm_thd *t)
+{
+	struct slm_sched_thd *p  = slm_thd_sched_policy(t);
+	struct runqueue      *rq = &threads[cos_cpuid()];
+
+	if (p->throttled) return;
+
+	if (p->heap_idx > 0) {
+		deadline_heap_remove(&rq->deadlines, p->heap_idx);
+		p->heap_idx = -1;
+	}
+	ps_list_rem_d(p);
+}
+
+static void
+edf_job_release(struct slm_sched_thd *p, cycles_t now)
+{
+	if (cycles_greater_than(p->deadline, now)) return;
+	p->deadline = now + p->rel_deadline;
+}
+
+/*
+ * Charge the execution since the last scheduling decision to the
+ * thread selected by it, throttle it if it exhausted its budget, and
+ * postpone its deadline if it executed past it.
+ */
+static void
+edf_charge(struct runqueue *rq, cycles_t now)
+{
+	struct slm_thd       *t = rq->curr;
+	struct slm_sched_thd *p;
+	cycles_t              used;
+
+	if (!t) return;
+	p = slm_thd_sched_policy(t);
+	if (!edf_thd(p) || p->throttled) return;
+
+	if (edf_sporadic(p)) {
+		used = now - rq->dispatched;
+		/* Started consuming a full budget: the replenishment is a period later */
+		if (p->budget_left == p->budget) p->replenish = rq->dispatched + p->period;
+		if (used >= p->budget_left) {
+			edf_dequeue(t);
+			p->budget_left = 0;
+			p->throttled   = 1;
+			ps_list_head_append_d(&rq->throttled, p);
+
+			return;
+		}
+		p->budget_left -= used;
+	}
+
+	if (p->heap_idx > 0 && !cycles_greater_than(p->deadline, now)) {
+		p->deadline += p->period ? p->period : p->rel_deadline;
+		edf_job_release(p, now);
+		deadline_heap_adjust(&rq->deadlines, p->heap_idx);
+	}
+}
+
+static void
+edf_replenish_expired(struct runqueue *rq, cycles_t now)
+{
+	struct slm_sched_thd *p, *pn;
+
+	ps_list_foreach_del_d(&rq->throttled, p, pn) {
+		if (cycles_greater_than(p->replenish, now)) continue;
+
+		ps_list_rem_d(p);
+		p->throttled   = 0;
+		p->budget_left = p->budget;
+		edf_job_release(p, now);
+		edf_enqueue(slm_thd_from_sched(p));
+	}
+}
+
+/* Execution is charged at scheduling decisions, see `edf_charge` */
+void
+slm_sched_edf_execution(struct slm_thd *t, cycles_t cycles)
+{ return; }
+
+struct slm_thd *
+slm_sched_edf_schedule(void)
+{
+	struct runqueue      *rq    = &threads[cos_cpuid()];
+	struct ps_list_head  *prios = rq->prio;
+	struct slm_thd       *ret   = NULL;
+	struct slm_sched_thd *t;
+	cycles_t              now   = slm_now();
+	int i;
+
+	edf_charge(rq, now);
+	edf_replenish_expired(rq, now);
+
+	for (i = 0 ; i < SLM_EDF_NPRIOS ; i++) {
+		if (i == SLM_EDF_PRIO && !heap_empty(&rq->deadlines)) {
+			ret = heap_peek(&rq->deadlines);
+			break;
+		}
+		if (ps_list_head_empty(&prios[i])) continue;
+		t = ps_list_head_first_d(&prios[i], struct slm_sched_thd);
+
+		/* Round robin within each fixed priority */
+		ps_list_rem_d(t);
+		ps_list_head_append_d(&prios[i], t);
+
+		ret = slm_thd_from_sched(t);
+		break;
+	}
+	rq->curr       = ret;
+	rq->dispatched = now;
+
+	return ret;
+}
+
+int
+slm_sched_edf_block(struct slm_thd *t)
+{
+	struct slm_sched_thd *p = slm_thd_sched_policy(t);
+
+	edf_dequeue(t);
+	p->runnable = 0;
+
+	return 0;
+}
+
+int
+slm_sched_edf_wakeup(struct slm_thd *t)
+{
+	struct slm_sched_thd *p = slm_thd_sched_policy(t);
+
+	p->runnable = 1;
+	if (edf_thd(p)) edf_job_release(p, slm_now());
+	edf_enqueue(t);
+
+	return 0;
+}
+
+void
+slm_sched_edf_yield(struct slm_thd *t, struct slm_thd *yield_to)
+{
+	struct slm_sched_thd *p = slm_thd_sched_policy(t);
+
+	/* Deadline threads keep their place, the deadline orders them */
+	if (edf_thd(p) || p->throttled) return;
+
+	ps_list_rem_d(p);
+	ps_list_head_append_d(&threads[cos_cpuid()].prio[t->priority], p);
+}
+
+int
+slm_sched_edf_thd_init(struct slm_thd *t)
+{
+	struct slm_sched_thd *p = slm_thd_sched_policy(t);
+
+	t->priority = SLM_EDF_PRIO_LOWEST;
+	*p = (struct slm_sched_thd) {
+		.heap_idx = -1,
+		.runnable = 1,
+	};
+	ps_list_init_d(p);
+
+	return 0;
+}
+
+void
+slm_sched_edf_thd_deinit(struct slm_thd *t)
+{
+	struct slm_sched_thd *p  = slm_thd_sched_policy(t);
+	struct runqueue      *rq = &threads[cos_cpuid()];
+
+	edf_dequeue(t);
+	ps_list_rem_d(p);
+	p->throttled = 0;
+	if (rq->curr == t) rq->curr = NULL;
+}
+
+int
+slm_sched_edf_thd_update(struct slm_thd *t, sched_param_type_t type, unsigned int v)
+{
+	struct slm_sched_thd *p = slm_thd_sched_policy(t);
+	int ret = 0;
+
+	/* if we're already on a runqueue, and we're updating parameters */
+	edf_dequeue(t);
+
+	switch (type) {
+	case SCHEDP_INIT_PROTO:
+	{
+		t->priority     = 0;
+		p->rel_deadline = 0;
+		break;
+	}
+	case SCHEDP_INIT:
+	{
+		t->priority     = SLM_EDF_PRIO_LOWEST;
+		p->rel_deadline = 0;
+		break;
+	}
+	case SCHEDP_PRIO:
+	{
+		assert(v >= SLM_EDF_PRIO_HIGHEST && v <= SLM_EDF_PRIO_LOWEST);
+		t->priority     = v;
+		p->rel_deadline = 0;
+		break;
+	}
+	case SCHEDP_DEADLINE:	/* microseconds */
+	case SCHEDP_WINDOW:
+	{
+		cycles_t c = slm_usec2cyc(v);
+
+		if (v == 0) {
+			ret = -1;
+			break;
+		}
+		if (type == SCHEDP_WINDOW) {
+			p->period = c;
+			/* Implicit deadline, unless one is set */
+			if (p->rel_deadline) break;
+		}
+		t->priority     = SLM_EDF_PRIO;
+		p->rel_deadline = c;
+		p->deadline     = slm_now() + c;
+		break;
+	}
+	case SCHEDP_BUDGET:
+	{
+		p->budget      = slm_usec2cyc(v);
+		p->budget_left = p->budget;
+		break;
+	}
+	default:
+		ret = -1;
+	}
+	edf_enqueue(t);
+
+	return ret;
+}
+
+void
+slm_sched_edf_init(void)
+{
+	struct runqueue *rq = &threads[cos_cpuid()];
+	int i;
+
+	heap_init(&rq->deadlines, MAX_NUM_THREADS);
+	for (i = 0 ; i < SLM_EDF_NPRIOS ; i++) {
+		ps_list_head_init(&rq->prio[i]);
+	}
+	ps_list_head_init(&rq->throttled);
+	rq->curr = NULL;
+}
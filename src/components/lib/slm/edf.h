@@ -0,0 +1,26 @@
+#ifndef EDF_H
+#define EDF_H
+
+#include <ps_list.h>
+#include <cos_types.h>
+
+struct slm_sched_thd {
+	struct ps_list list;	  /* fixed-priority runqueue, or the throttled list */
+	int            heap_idx;  /* where are we in the deadline heap? -1 if not present */
+	int            runnable;
+	int            throttled; /* budget exhausted, awaiting replenishment */
+	cycles_t       deadline;  /* absolute deadline of the current job */
+	/* Parameters: a thread with a relative deadline is scheduled by EDF */
+	cycles_t       rel_deadline;
+	cycles_t       period;
+	cycles_t       budget;	  /* 0 = no budget enforcement */
+	/* Sporadic server accounting */
+	cycles_t       budget_left;
+	cycles_t       replenish; /* absolute time of the next replenishment */
+};
+
+#include <slm.h>
+
+SLM_MODULES_POLICY_PROTOTYPES(edf)
+
+#endif	/* EDF_H */
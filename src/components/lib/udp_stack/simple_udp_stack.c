@@ -11,6 +11,7 @@
 
 static u32_t host_ip;
 static u16_t host_port;
+static u16_t ip_id;
 
 static struct ether_addr nic_mac;
 #if 1
@@ -75,7 +76,6 @@ udp_stack_eth_hdr_set(struct eth_hdr *eth_hdr, struct ether_addr* src_mac, struc
 static inline void
 udp_stack_ip_hdr_set(struct ip_hdr *ip_hdr, u16_t data_len, u32_t src_host, u32_t dst_host)
 {
-	static u16_t ip_id = 0;
 	/* We don't support complex IP options */
 	ip_hdr->ihl = IP_STD_LEN / 4;
 	ip_hdr->version = IPv4;
@@ -162,54 +162,42 @@ udp_stack_udp_bind(u32_t ip_addr, u16_t port)
 	return 0;
 }
 
-shm_bm_objid_t
-udp_stack_shmem_read(u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port)
+/*
+ * Find the data and source of the datagram received in `obj` at
+ * `pkt_offset`. Returns 0 on success, !0 if it is not a valid one.
+ */
+static inline int
+udp_stack_pkt_parse(struct netshmem_pkt_buf *obj, u16_t pkt_offset, u16_t pkt_len, u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port)
 {
-	shm_bm_objid_t           objid;
-	struct netshmem_pkt_buf *obj;
 	struct ip_hdr *ip_hdr;
 	struct udp_hdr *udp_hdr;
-	u16_t pkt_len;
 	u16_t ip_len;
 
-	objid = nic_get_a_packet(&pkt_len);
-	obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
-	assert(obj);
-
-	ip_hdr = (struct ip_hdr *)(obj->data + ETH_STD_LEN);
+	ip_hdr = (struct ip_hdr *)(obj->data + pkt_offset + ETH_STD_LEN);
 
 	/* try to pass the validation */
-	if (unlikely(udp_stack_packet_validate(ip_hdr, pkt_len, host_ip, host_port))) {
-		data_len = 0;
-		return objid;
-	}
+	if (unlikely(udp_stack_packet_validate(ip_hdr, pkt_len, host_ip, host_port))) return 1;
 
 	ip_len = ip_hdr->ihl * 4;
 	udp_hdr = (struct udp_hdr *)((char *)ip_hdr + ip_len);
 
-	*data_offset = ETH_STD_LEN + ip_len + UDP_STD_LEN;
+	*data_offset = pkt_offset + ETH_STD_LEN + ip_len + UDP_STD_LEN;
 
 	*data_len    = ntohs(udp_hdr->len) - UDP_STD_LEN;
 	*remote_addr = ip_hdr->src_addr;
 	*remote_port = udp_hdr->port.src_port;
 
-	return objid;
+	return 0;
 }
 
-int
-udp_stack_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port)
+/* Build the headers of the datagram of `data_len` bytes at `data_offset` in `obj`, and return its packet's length */
+static inline u16_t
+udp_stack_pkt_build(struct netshmem_pkt_buf *obj, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port)
 {
-	struct netshmem_pkt_buf *obj;
-	u16_t pkt_offset, pkt_len;
 	struct ip_hdr *ip_hdr;
 	struct udp_hdr *udp_hdr;
-
-	char *mac_addr_arr = (char *)&nic_mac;
-
-	thdid_t thd = cos_thdid();
 	char *data;
 
-	obj  = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
 	data = obj->data + data_offset;
 
 	/* data now points to Eth hdr */
@@ -224,10 +212,172 @@ udp_stack_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u
 	udp_stack_udp_csum_set(ip_hdr);
 	udp_stack_eth_hdr_set((struct eth_hdr *)data, &nic_mac, &gw_mac);
 
-	pkt_len = ntohs(ip_hdr->total_len) + ETH_STD_LEN;
-	pkt_offset = netshmem_get_data_offset() - udp_stack_hdr_room();
+	return ntohs(ip_hdr->total_len) + ETH_STD_LEN;
+}
+
+/*
+ * Turn the datagram received in `obj`, whose data is at `data_offset`,
+ * into its echo to its source, and return its packet's length. The
+ * ones' complement sums do not depend on the order of the words: the
+ * addresses and ports are swapped without changing the checksums, and
+ * the IP checksum is updated with the fields that change.
+ */
+static inline u16_t
+udp_stack_pkt_echo(struct netshmem_pkt_buf *obj, u16_t data_offset)
+{
+	struct eth_hdr *eth_hdr;
+	struct ip_hdr  *ip_hdr;
+	struct udp_hdr *udp_hdr;
+	u16_t *ttl_proto, old, port;
+	u32_t addr;
+
+	eth_hdr = (struct eth_hdr *)(obj->data + data_offset - udp_stack_hdr_room());
+	ip_hdr  = udp_stack_ip_hdr_pos(eth_hdr);
+	udp_hdr = udp_stack_udp_hdr_pos(ip_hdr);
+
+	udp_stack_eth_hdr_set(eth_hdr, &nic_mac, &gw_mac);
+
+	addr             = ip_hdr->src_addr;
+	ip_hdr->src_addr = ip_hdr->dst_addr;
+	ip_hdr->dst_addr = addr;
+
+	port                   = udp_hdr->port.src_port;
+	udp_hdr->port.src_port = udp_hdr->port.dst_port;
+	udp_hdr->port.dst_port = port;
+
+	/* The TTL shares a word with the protocol */
+	ttl_proto   = (u16_t *)&ip_hdr->ttl;
+	old         = *ttl_proto;
+	ip_hdr->ttl = 64;
+	if (unlikely(!ENABLE_OFFLOAD)) ip_hdr->checksum = net_cksum_adjust16(ip_hdr->checksum, old, *ttl_proto);
 
-	nic_send_packet(objid, pkt_offset, pkt_len);
+	old        = ip_hdr->id;
+	ip_hdr->id = ++ip_id;
+	if (unlikely(!ENABLE_OFFLOAD)) ip_hdr->checksum = net_cksum_adjust16(ip_hdr->checksum, old, ip_hdr->id);
+
+	return ntohs(ip_hdr->total_len) + ETH_STD_LEN;
+}
+
+shm_bm_objid_t
+udp_stack_shmem_read(u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port)
+{
+	shm_bm_objid_t           objid;
+	struct netshmem_pkt_buf *obj;
+	u16_t pkt_len;
+
+	objid = nic_get_a_packet(&pkt_len);
+	obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
+	assert(obj);
+
+	if (unlikely(udp_stack_pkt_parse(obj, 0, pkt_len, data_offset, data_len, remote_addr, remote_port))) {
+		*data_len = 0;
+	}
+
+	return objid;
+}
+
+int
+udp_stack_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port)
+{
+	struct netshmem_pkt_buf *obj;
+	u16_t pkt_len;
+
+	obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), objid);
+	pkt_len = udp_stack_pkt_build(obj, data_offset, data_len, remote_ip, remote_port);
+
+	nic_send_packet(objid, data_offset - udp_stack_hdr_room(), pkt_len);
 
 	return 0;
 }
+
+int
+udp_stack_shmem_read_batch(shm_bm_objid_t msgsid, u16_t max)
+{
+	struct netshmem_pkt_buf *msgs_buf, *obj;
+	struct udp_stack_msg    *msgs;
+	struct nic_pkt_desc     *descs, d;
+	int i, n, valid;
+
+	msgs_buf = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), msgsid);
+	assert(msgs_buf);
+	msgs  = (struct udp_stack_msg *)msgs_buf->data;
+	descs = (struct nic_pkt_desc *)msgs_buf->data;
+	if (max > UDP_STACK_BATCH_MAX) max = UDP_STACK_BATCH_MAX;
+
+	/* Packets can be dropped when out of shmem objects */
+	do {
+		n = nic_get_packets(msgsid, max);
+	} while (n == 0);
+	assert(n > 0);
+
+	/*
+	 * The descriptors are smaller than the messages: from the last one,
+	 * a message is written over descriptors already parsed.
+	 */
+	for (i = n - 1; i >= 0; i--) {
+		d   = descs[i];
+		obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), d.objid);
+		assert(obj);
+
+		msgs[i].objid = d.objid;
+		if (unlikely(udp_stack_pkt_parse(obj, d.pkt_offset, d.pkt_len, &msgs[i].data_offset, &msgs[i].data_len, &msgs[i].remote_addr, &msgs[i].remote_port))) {
+			/* The data of a valid one is past its headers */
+			msgs[i].data_offset = 0;
+		}
+	}
+
+	/* Drop the invalid packets */
+	for (i = 0, valid = 0; i < n; i++) {
+		if (unlikely(msgs[i].data_offset == 0)) {
+			shm_bm_free_net_pkt_buf(shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), msgs[i].objid));
+			continue;
+		}
+		msgs[valid++] = msgs[i];
+	}
+
+	return valid;
+}
+
+/* Send the n datagrams of the array msgsid, as echoes of the datagrams read if `echo` */
+static int
+udp_stack_shmem_send_batch(shm_bm_objid_t msgsid, u16_t n, int echo)
+{
+	struct netshmem_pkt_buf *msgs_buf, *obj;
+	struct udp_stack_msg    *msgs, m;
+	struct nic_pkt_desc     *descs;
+	int i;
+
+	msgs_buf = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), msgsid);
+	assert(msgs_buf);
+	msgs  = (struct udp_stack_msg *)msgs_buf->data;
+	descs = (struct nic_pkt_desc *)msgs_buf->data;
+	if (n > UDP_STACK_BATCH_MAX) n = UDP_STACK_BATCH_MAX;
+	if (n == 0) return 0;
+
+	/* From the first message, a descriptor is written over messages already built */
+	for (i = 0; i < n; i++) {
+		m   = msgs[i];
+		obj = shm_bm_borrow_net_pkt_buf(netshmem_get_shm(), m.objid);
+		assert(obj);
+
+		descs[i].objid      = m.objid;
+		if (echo) descs[i].pkt_len = udp_stack_pkt_echo(obj, m.data_offset);
+		else      descs[i].pkt_len = udp_stack_pkt_build(obj, m.data_offset, m.data_len, m.remote_addr, m.remote_port);
+		descs[i].pkt_offset = m.data_offset - udp_stack_hdr_room();
+	}
+
+	/* A single invocation of the nicmgr, that frees the objects once they are sent */
+	return nic_send_packets(msgsid, n);
+}
+
+int
+udp_stack_shmem_write_batch(shm_bm_objid_t msgsid, u16_t n)
+{
+	return udp_stack_shmem_send_batch(msgsid, n, 0);
+}
+
+int
+udp_stack_shmem_echo_batch(shm_bm_objid_t msgsid, u16_t n)
+{
+	return udp_stack_shmem_send_batch(msgsid, n, 1);
+}
@@ -4,27 +4,14 @@
 #include <cos_types.h>
 #include <shm_bm.h>
 #include <net_stack_types.h>
+#include <net_cksum.h>
+#include <netshmem.h>
 
-/* checksum functions directly picked from DPDK */
+/* checksum functions directly picked from DPDK, the raw sum is vectorized (see net_cksum.h) */
 static inline u32_t
 __udp_stack_raw_cksum(const void *buf, size_t len, u32_t sum)
 {
-	/* extend strict-aliasing rules */
-	typedef u16_t __attribute__((__may_alias__)) u16_p;
-	const u16_p *u16_buf = (const u16_p *)buf;
-	const u16_p *end = u16_buf + len / sizeof(*u16_buf);
-
-	for (; u16_buf != end; ++u16_buf)
-		sum += *u16_buf;
-
-	/* if length is odd, keeping it byte order independent */
-	if (unlikely(len % 2)) {
-		u16_t left = 0;
-		*(unsigned char *)&left = *(const unsigned char *)end;
-		sum += left;
-	}
-
-	return sum;
+	return net_cksum_fold(net_cksum_raw(buf, len, sum));
 }
 
 static inline u16_t
@@ -132,9 +119,41 @@ udp_stack_udp_csum_calculate(struct ip_hdr *ip_hdr)
 	return udp_stack_udp_cksum(ip_hdr, (char *)ip_hdr + ip_hdr->ihl * 4);
 }
 
+/* A datagram of a batch: its shmem object, its data's offset and length in obj->data, and its peer */
+struct udp_stack_msg {
+	shm_bm_objid_t objid;
+	u16_t          data_offset;
+	u16_t          data_len;
+	u32_t          remote_addr;
+	u16_t          remote_port;
+};
+
+/* The most datagrams a shmem object of struct udp_stack_msg describes */
+#define UDP_STACK_BATCH_MAX (PKT_BUF_SIZE / sizeof(struct udp_stack_msg))
+
 void udp_stack_shmem_map(cbuf_t shm_id);
 int udp_stack_udp_bind(u32_t ip_addr, u16_t port);
 shm_bm_objid_t udp_stack_shmem_read(u16_t *data_offset, u16_t *data_len, u32_t *remote_addr, u16_t *remote_port);
 int udp_stack_shmem_write(shm_bm_objid_t objid, u16_t data_offset, u16_t data_len, u32_t remote_ip, u16_t remote_port);
 
+/*
+ * Batch versions of udp_stack_shmem_read/write, on a shmem object
+ * (msgsid) used as an array of struct udp_stack_msg, which the nicmgr
+ * is passed in place of its descriptors. A read blocks until there is
+ * a datagram, and fills the array with up to max of them, that are the
+ * caller's. A write sends the n datagrams of the array, whose objects
+ * the nicmgr frees once they are sent, and does not keep its content.
+ * Both return the number of datagrams.
+ */
+int udp_stack_shmem_read_batch(shm_bm_objid_t msgsid, u16_t max);
+int udp_stack_shmem_write_batch(shm_bm_objid_t msgsid, u16_t n);
+
+/*
+ * Send each of the n datagrams of an array udp_stack_shmem_read_batch
+ * filled back to its source, with the data it was received with, in
+ * place: its headers are rewritten, and their checksums updated rather
+ * than computed again. The nicmgr frees the objects once they are sent.
+ */
+int udp_stack_shmem_echo_batch(shm_bm_objid_t msgsid, u16_t n);
+
 #endif /* SIMPLE_UDP_STACK_H */
\ No newline at end of file
@@ -184,6 +184,76 @@ ss_state_refcnt_add(ss_state_t *state, long amnt)
 	return prev;
 }
 
+/***
+ * The index of free objects: a bitmap with a bit per object, set if
+ * the object is (or is being) allocated, and a hint of the bitmap
+ * word at which to start searching. The objects' states remain the
+ * authority on their allocation, and the bitmap only avoids scanning
+ * them: a bit is set before trying to allocate the object, and only
+ * cleared after it is freed, so an object with a clear bit is almost
+ * always free. If the allocation of an object with a clear bit still
+ * fails (it was concurrently allocated by id), the search continues,
+ * and its bit stays set until it is freed.
+ */
+#define SS_BITMAP_BITS         (sizeof(word_t) * 8)
+#define SS_BITMAP_WORDS(nbits) (((nbits) + SS_BITMAP_BITS - 1) / SS_BITMAP_BITS)
+
+static inline void
+ss_bitmap_set(word_t *bm, unsigned int idx)
+{
+	word_t *w = &bm[idx / SS_BITMAP_BITS], v;
+	word_t  b = 1UL << (idx % SS_BITMAP_BITS);
+
+	do {
+		v = ps_load(w);
+		if (v & b) return;
+	} while (!ps_cas(w, v, v | b));
+}
+
+static inline void
+ss_bitmap_clear(word_t *bm, unsigned int idx)
+{
+	word_t *w = &bm[idx / SS_BITMAP_BITS], v;
+	word_t  b = 1UL << (idx % SS_BITMAP_BITS);
+
+	do {
+		v = ps_load(w);
+		if (!(v & b)) return;
+	} while (!ps_cas(w, v, v & ~b));
+}
+
+/**
+ * Find an object with a clear bit, and set it, searching from the
+ * word `hint`.
+ *
+ * - @bm       - the bitmap
+ * - @nbits    - the number of objects
+ * - @hint     - the word at which to start searching
+ * - @searched - the number of words searched so far (`0` initially);
+ *               the search fails once all have been
+ * - @return   - the index of the object, or `nbits` if none are free
+ */
+static inline unsigned int
+ss_bitmap_take(word_t *bm, unsigned int nbits, unsigned long hint, unsigned int *searched)
+{
+	unsigned int nwords = SS_BITMAP_WORDS(nbits), i, idx;
+	word_t v;
+
+	for (; *searched < nwords; (*searched)++) {
+		i = (hint + *searched) % nwords;
+		while (1) {
+			v = ps_load(&bm[i]);
+			if (v == ~0UL) break;
+			idx = i * SS_BITMAP_BITS + __builtin_ctzl(~v);
+			/* The bits past the last object are never set */
+			if (idx >= nbits) break;
+			if (ps_cas(&bm[i], v, v | (1UL << (idx % SS_BITMAP_BITS)))) return idx;
+		}
+	}
+
+	return nbits;
+}
+
 /***
  * A memory allocator for statically-allocated collections of
  * objects. Similar to an API, and a baby version of parsec
@@ -207,7 +277,9 @@ ss_state_refcnt_add(ss_state_t *state, long amnt)
  *   memory for the objects to be able to allocate `max_num_objects`
  *   number of objects, and the following functions.
  * - `type *ss_name_alloc()` - Allocate a new object of the
- *   specified type. This is not fast. It is linear in max_num_objects.
+ *   specified type. A bitmap of the allocated objects, searched from
+ *   where the last allocation or free was, makes this (usually)
+ *   constant-time rather than linear in max_num_objects.
  * - `void ss_name_free(type *obj)` - Free an allocated object,
  *   `obj`.
  * - `type *ss_name_alloc_at_index(unsigned int idx)` -
@@ -283,6 +355,7 @@ ss_state_refcnt_add(ss_state_t *state, long amnt)
  * - All allocation is through the static array. No dynamic allocation.
  * - Constant-time (array indexed) `get`.
  * - Constant-time `alloc_at_index`.
+ * - `alloc` searches a bitmap a word at a time, from a hint.
  * - Objects are laid out contiguously. Alignment constraints should
  *   be embedded into your object/struct type, and they are honored.
  * - Statically allocated memory is BSS-allocated.
@@ -309,14 +382,17 @@ ss_state_refcnt_add(ss_state_t *state, long amnt)
  */
 #define SS_STATIC_SLAB_FNS(name, obj_type, max_num, id_offset)		\
 	struct ss_##name##_heap {					\
-		ss_state_t states[max_num];				\
-		obj_type   objs[max_num];				\
+		ss_state_t    states[max_num];				\
+		word_t        bitmap[SS_BITMAP_WORDS(max_num)];		\
+		unsigned long hint;					\
+		obj_type      objs[max_num];				\
 	};								\
 	static obj_type *	/* Not part of the public API */	\
 	__ss_##name##_alloc_at_index(struct ss_##name##_heap *heap, unsigned int idx) \
 	{								\
 		if (idx >= max_num) return NULL;			\
 		if (ss_state_alloc(&heap->states[idx])) return NULL;	\
+		ss_bitmap_set(heap->bitmap, idx);			\
 		memset(&heap->objs[idx], 0, sizeof(obj_type));		\
 									\
 		return &heap->objs[idx];				\
@@ -331,15 +407,19 @@ ss_state_refcnt_add(ss_state_t *state, long amnt)
 	static obj_type *						\
 	ss_##name##_alloc(struct ss_##name##_heap *heap)		\
 	{								\
-		unsigned int i;						\
-		obj_type *c = NULL;					\
+		unsigned long hint = heap->hint;			\
+		unsigned int idx, searched = 0;				\
 									\
-		for (i = 0; i < max_num; i++) {				\
-			c = __ss_##name##_alloc_at_index(heap, i);	\
-			if (c) return c;				\
-		}							\
+		while (1) {						\
+			idx = ss_bitmap_take(heap->bitmap, max_num, hint, &searched); \
+			if (idx == max_num) return NULL;		\
+			/* Lost a race with an allocation by id */	\
+			if (ss_state_alloc(&heap->states[idx])) continue; \
+			heap->hint = idx / SS_BITMAP_BITS;		\
+			memset(&heap->objs[idx], 0, sizeof(obj_type));	\
 									\
-		return NULL;						\
+			return &heap->objs[idx];			\
+		}							\
 	}								\
 	static unsigned int /* not part of the public API */		\
 	__ss_##name##_index(struct ss_##name##_heap *heap, obj_type *o)	\
@@ -366,6 +446,8 @@ ss_state_refcnt_add(ss_state_t *state, long amnt)
 		unsigned int idx = __ss_##name##_index(heap, o);	\
 									\
 		ss_state_free(&heap->states[idx]);			\
+		ss_bitmap_clear(heap->bitmap, idx);			\
+		heap->hint = idx / SS_BITMAP_BITS;			\
 	}								\
 	static obj_type *						\
 	ss_##name##_get(struct ss_##name##_heap *heap, unsigned int id)	\
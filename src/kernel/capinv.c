@@ -1846,6 +1846,24 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 			ret = chal_tlbstall_recount(0);
 			break;
 		}
+		case CAPTBL_OP_HW_BOOT_TSC: {
+			unsigned long phase = __userregs_get1(regs);
+			u64_t         tsc;
+
+			if (phase >= KERN_BOOT_NPHASES) cos_throw(err, -EINVAL);
+			tsc = kern_boot_tsc[phase];
+			/* split, so that it fits into the registers of 32 bit platforms */
+			__userregs_setretvals(regs, 0, (u32_t)tsc, (u32_t)(tsc >> 32), 0);
+			ret = 0;
+			break;
+		}
+		case CAPTBL_OP_HW_TLB_QUIESCENT: {
+			/* the unmap time, split as for CAPTBL_OP_HW_BOOT_TSC */
+			u64_t ts = ((u64_t)(u32_t)__userregs_get2(regs) << 32) | (u32_t)__userregs_get1(regs);
+
+			ret = chal_tlb_quiescent(ts);
+			break;
+		}
 		default:
 			goto err;
 		}
@@ -18,6 +18,8 @@
 #define HW_IRQ_EXTERNAL_MAX 63
 
 extern struct cap_asnd hw_asnd_caps[HW_IRQ_TOTAL];
+/* TSC at the end of each of the kernel's boot phases */
+extern u64_t kern_boot_tsc[KERN_BOOT_NPHASES];
 
 struct cap_hw {
 	struct cap_header h;
@@ -42,14 +42,29 @@
 /* Stack size in words */
 #define MAX_STACK_SZ (COS_STACK_SZ / 4)
 
-#define ALL_STACK_SZ ((MAX_NUM_THREADS + 1) * MAX_STACK_SZ)
+/*
+ * Threads with ids below this have a static stack in each component,
+ * as part of its image. The others only run on stacks from the
+ * component's per-core stack pools, which are mapped on demand (see
+ * cos_stack_pool_add), thus this can be lowered below
+ * MAX_NUM_THREADS to shrink every component image.
+ */
+#define COS_STATIC_STACK_THDS MAX_NUM_THREADS
+/*
+ * The maximum number of stacks in each core's stack pool: a power of
+ * two, and a multiple of 64, as the free stacks are a bitmap, with a
+ * word per 64 stacks, and all cores' bitmaps in a single page.
+ */
+#define COS_STACK_POOL_SZ 512
+
+#define ALL_STACK_SZ ((COS_STATIC_STACK_THDS + 1) * MAX_STACK_SZ)
 /* 
  * 4096B / 4 * (64+1) : to flatten the math because of the below error
  * cos_asm_upcall_simple_stacks.S:28: Error: bad or irreducible absolute expression
  * All stack size = per_stack_size * number_of_threads, here we set it as COS_STACK_SZ * 8
  * by default
  */
-#define ALL_STACK_SZ_FLAT (COS_STACK_SZ * MAX_NUM_THREADS)
+#define ALL_STACK_SZ_FLAT (COS_STACK_SZ * COS_STATIC_STACK_THDS)
 #define MAX_SPD_VAS_LOCATIONS 8
 
 /* a kludge:  should not use a tmp stack on a stack miss */
@@ -171,11 +171,33 @@ typedef enum {
 	CAPTBL_OP_HW_TLBFLUSH,
 	CAPTBL_OP_HW_TLBSTALL,
 	CAPTBL_OP_HW_TLBSTALL_RECOUNT,
+	CAPTBL_OP_HW_BOOT_TSC,
+	CAPTBL_OP_HW_TLB_QUIESCENT,
 
 	CAPTBL_OP_ULK_MEMACTIVATE,
 
 } syscall_op_t;
 
+/*
+ * The phases of the kernel's boot. The kernel records the TSC at the
+ * end of each (KERN_BOOT_START at its entry), which user-level can
+ * retrieve with CAPTBL_OP_HW_BOOT_TSC.
+ */
+typedef enum {
+	KERN_BOOT_START,
+	KERN_BOOT_CPU,        /* tss, gdt, idt, serial */
+	KERN_BOOT_MEM_MAP,    /* kernel paging, physical memory layout */
+	KERN_BOOT_RETYPE_TBL, /* capability, liveness, and retype tables */
+	KERN_BOOT_DATA_STRUCT,
+	KERN_BOOT_UT_MEM,     /* untyped memory virtual addresses */
+	KERN_BOOT_KMEM,       /* acpi, lapic, timer */
+	KERN_BOOT_COMP_IMG,   /* booter's resource tables and image */
+	KERN_BOOT_UT_MAP,     /* untyped memory mapped into the booter */
+	KERN_BOOT_COMP,       /* booter's initial threads */
+	KERN_BOOT_SMP,        /* other cores booted */
+	KERN_BOOT_NPHASES
+} kern_boot_phase_t;
+
 typedef enum {
 	CAP_FREE = 0,
 	CAP_SINV,       /* synchronous communication -- invoke */
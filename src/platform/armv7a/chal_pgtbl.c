@@ -268,6 +268,18 @@ chal_tlb_quiescence_check(u64_t timestamp)
 	return quiescent;
 }
 
+/* TODO: the shootdown of the x86 chal_tlb_quiescent. Until then, unmapped memory is never quiescent */
+int
+chal_tlb_quiescent(u64_t timestamp)
+{
+	return 0;
+}
+
+void
+chal_tlb_flush_pending(void)
+{
+}
+
 int
 chal_cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr,
                      vaddr_t order)
@@ -18,6 +18,7 @@
 
 struct mem_layout glb_memlayout;
 volatile int      cores_ready[NUM_CPU];
+u64_t             kern_boot_tsc[KERN_BOOT_NPHASES];
 
 static int
 xdtoi(char c)
@@ -53,6 +54,7 @@ kern_memory_setup(struct multiboot *mb, u32_t mboot_magic)
 void
 kmain(struct multiboot *mboot, u32_t mboot_magic, u32_t esp)
 {
+	kern_boot_tsc[KERN_BOOT_START] = tsc();
 	serial_init();
 
 	printk("serial initialization complete\r\n");
@@ -63,8 +65,10 @@ kmain(struct multiboot *mboot, u32_t mboot_magic, u32_t esp)
 	cap_init();
 	ltbl_init();
 	retype_tbl_init();
+	kern_boot_tsc[KERN_BOOT_RETYPE_TBL] = tsc();
 	comp_init();
 	thd_init();
+	kern_boot_tsc[KERN_BOOT_DATA_STRUCT] = tsc();
 
 	/* We know the memory layout and will initialize it here - kernel : 256MB */
 	glb_memlayout.kern_end = &end_all;
@@ -84,8 +88,10 @@ kmain(struct multiboot *mboot, u32_t mboot_magic, u32_t esp)
 	chal_kernel_mem_pa = chal_va2pa(mem_kmem_start());
 
 	paging_init();
+	kern_boot_tsc[KERN_BOOT_UT_MEM] = tsc();
 
 	kern_boot_comp(INIT_CORE);
+	kern_boot_tsc[KERN_BOOT_COMP] = tsc();
 	kern_boot_upcall();
 
 	/* should not get here... */
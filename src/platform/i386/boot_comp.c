@@ -304,6 +304,7 @@ kern_boot_comp(const cpuid_t cpu_id)
 	ret = boot_elf_process(glb_boot_ct, BOOT_CAPTBL_SELF_PT, BOOT_CAPTBL_BOOTVM_PTE, "booter VM",
 			       mem_bootc_start(), mem_bootc_end() - mem_bootc_start());
 	assert(ret == 0);
+	kern_boot_tsc[KERN_BOOT_COMP_IMG] = tsc();
 
 	/*
 	 * Map in the untyped memory.  This is more complicated as we
@@ -328,6 +329,7 @@ kern_boot_comp(const cpuid_t cpu_id)
                                       mem_utmem_end() - mem_utmem_start(), 0);
 
 	assert(ret == 0);
+	kern_boot_tsc[KERN_BOOT_UT_MAP] = tsc();
 
 	printk("\tCapability table and page-table created.\n");
 
@@ -37,6 +37,51 @@ cos_cas(unsigned long *target, unsigned long old, unsigned long updated)
 	return (int)z;
 }
 
+/*
+ * 64-bit compare-and-swap, also on 32-bit x86 (cmpxchg8b). Return
+ * values as for cos_cas.
+ */
+static inline int
+cos_cas_64(u64_t *target, u64_t old, u64_t updated)
+{
+	char z;
+	#if defined(__x86_64__)
+	__asm__ __volatile__("lock cmpxchgq %2, %0; setz %1"
+	                     : "+m"(*target), "=a"(z)
+	                     : "q"(updated), "a"(old)
+	                     : "memory", "cc");
+	#elif defined(__i386__)
+	__asm__ __volatile__("lock cmpxchg8b %0; setz %1"
+	                     : "+m"(*target), "=a"(z)
+	                     : "d"((u32_t)(old >> 32)), "a"((u32_t)old), "c"((u32_t)(updated >> 32)), "b"((u32_t)updated)
+	                     : "memory", "cc");
+	#endif
+
+	return (int)z;
+}
+
+/*
+ * Atomic 64-bit load. Aligned 64-bit loads are atomic on x86_64; on
+ * 32-bit x86, a value is only known to be untorn once a cmpxchg8b
+ * of it to itself succeeds.
+ */
+static inline u64_t
+cos_load_64(u64_t *target)
+{
+	u64_t v;
+
+	#if defined(__x86_64__)
+	v = *(volatile u64_t *)target;
+	__asm__ __volatile__("" ::: "memory");
+	#elif defined(__i386__)
+	do {
+		v = *(volatile u64_t *)target;
+	} while (!cos_cas_64(target, v, v));
+	#endif
+
+	return v;
+}
+
 /* Fetch-and-add implementation on x86. It returns the original value
  * before xaddl. */
 static inline int
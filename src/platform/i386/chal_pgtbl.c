@@ -182,6 +182,76 @@ chal_tlb_quiescence_check(u64_t timestamp)
 	return quiescent;
 }
 
+/* The latest unmap time that a TLB flush was requested for, see chal_tlb_quiescent */
+static u64_t tlb_flush_requested;
+
+/*
+ * Flush all of this core's TLB entries: those of all PCIDs, that
+ * switching page-tables with CR3_NO_FLUSH keeps, and the global
+ * ones. Toggling CR4.PGE invalidates them all. The time is taken
+ * before the flush (mov to cr4 is serializing), thus anything
+ * unmapped before it is gone from the TLB.
+ */
+static void
+chal_tlb_flush_all(void)
+{
+	unsigned long cr4;
+	u64_t t;
+
+	asm volatile("mov %%cr4, %0" : "=r"(cr4));
+	rdtscll(t);
+	asm volatile("mov %0, %%cr4" : : "r"(cr4 & ~(1UL << 7) /* CR4.PGE */) : "memory");
+	asm volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+	tlb_quiescence[get_cpuid()].last_mandatory_flush = t;
+}
+
+/*
+ * Called on the interrupts (timer, IPI) of each core: flush its TLB
+ * if a flush was requested since its last one.
+ */
+void
+chal_tlb_flush_pending(void)
+{
+	if (unlikely(cos_load_64(&tlb_flush_requested) >= tlb_quiescence[get_cpuid()].last_mandatory_flush)) {
+		chal_tlb_flush_all();
+	}
+}
+
+/*
+ * Has every core flushed its TLB since `timestamp`, the time memory
+ * was unmapped at? If not, this core flushes its own, and the others
+ * are sent an IPI to flush theirs (see chal_tlb_flush_pending), so
+ * that a later check succeeds. Unlike `chal_tlb_quiescence_check`,
+ * this neither relies on periodic flushes, nor prints.
+ */
+int
+chal_tlb_quiescent(u64_t timestamp)
+{
+	int   i, quiescent = 1;
+	u64_t requested;
+
+	if (tlb_quiescence[get_cpuid()].last_mandatory_flush <= timestamp) chal_tlb_flush_all();
+	for (i = 0; i < NUM_CPU; i++) {
+		if (tlb_quiescence[i].last_mandatory_flush <= timestamp) quiescent = 0;
+	}
+	if (quiescent) return 1;
+
+	/*
+	 * Only the first check of a timestamp sends the IPIs: raise
+	 * tlb_flush_requested to it, unless another core already has
+	 * (to it, or to a later one that covers it).
+	 */
+	do {
+		requested = cos_load_64(&tlb_flush_requested);
+		if (requested >= timestamp) return 0;
+	} while (!cos_cas_64(&tlb_flush_requested, requested, timestamp));
+	for (i = 0; i < NUM_CPU; i++) {
+		if (i != get_cpuid() && tlb_quiescence[i].last_mandatory_flush <= timestamp) chal_send_ipi(i);
+	}
+
+	return 0;
+}
+
 int
 chal_cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr, vaddr_t order)
 {
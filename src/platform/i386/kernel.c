@@ -16,6 +16,7 @@
 #define ADDR_STR_LEN 8
 
 boot_state_t initialization_state = INIT_BOOTED;
+u64_t        kern_boot_tsc[KERN_BOOT_NPHASES];
 
 void
 boot_state_transition(boot_state_t from, boot_state_t to)
@@ -145,6 +146,7 @@ kmain(unsigned long mboot_addr, unsigned long mboot_magic)
 #define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
 	unsigned long max;
 
+	kern_boot_tsc[KERN_BOOT_START] = tsc();
 	tss_init(INIT_CORE);
 	gdt_init(INIT_CORE);
 	idt_init(INIT_CORE);
@@ -153,34 +155,42 @@ kmain(unsigned long mboot_addr, unsigned long mboot_magic)
 	serial_init();
 #endif
 	boot_state_transition(INIT_BOOTED, INIT_CPU);
+	kern_boot_tsc[KERN_BOOT_CPU] = tsc();
 
 	max = MAX((unsigned long)chal_va2pa((void*)mboot_addr), (unsigned long)(chal_va2pa(&end)));
 
 	kern_paging_map_init((void *)(max));
 	kern_memory_setup(mboot_addr, mboot_magic);
 	boot_state_transition(INIT_CPU, INIT_MEM_MAP);
+	kern_boot_tsc[KERN_BOOT_MEM_MAP] = tsc();
 
 	chal_init();
 	cap_init();
 	ltbl_init();
 	retype_tbl_init();
+	kern_boot_tsc[KERN_BOOT_RETYPE_TBL] = tsc();
 	comp_init();
 	vm_cap_init();
 	thd_init();
 	boot_state_transition(INIT_MEM_MAP, INIT_DATA_STRUCT);
+	kern_boot_tsc[KERN_BOOT_DATA_STRUCT] = tsc();
 
 	paging_init();
 	boot_state_transition(INIT_DATA_STRUCT, INIT_UT_MEM);
+	kern_boot_tsc[KERN_BOOT_UT_MEM] = tsc();
 
 	acpi_init();
 	lapic_init();
 	timer_init();
 	boot_state_transition(INIT_UT_MEM, INIT_KMEM);
+	kern_boot_tsc[KERN_BOOT_KMEM] = tsc();
 
 	kern_boot_comp(INIT_CORE);
+	kern_boot_tsc[KERN_BOOT_COMP] = tsc();
 
 	smp_init(cores_ready);
 	cores_ready[INIT_CORE] = 1;
+	kern_boot_tsc[KERN_BOOT_SMP] = tsc();
 
 	kern_boot_upcall();
 
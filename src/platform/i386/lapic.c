@@ -88,6 +88,7 @@ volatile int apicids[NUM_CPU];
 #define LAPIC_TSCDEADLINE_THRESH 0
 
 extern int timer_process(struct pt_regs *regs);
+extern void chal_tlb_flush_pending(void);
 
 enum lapic_timer_type
 {
@@ -454,6 +455,7 @@ lapic_ipi_asnd_handler(struct pt_regs *regs)
 {
 	int preempt = 1;
 
+	chal_tlb_flush_pending();
 	preempt = cap_ipi_process(regs);
 
 	lapic_ack();
@@ -468,6 +470,7 @@ lapic_timer_handler(struct pt_regs *regs)
 
 	lapic_ack();
 
+	chal_tlb_flush_pending();
 	preempt = timer_process(regs);
 
 	return preempt;